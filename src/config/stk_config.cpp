@@ -213,6 +213,7 @@ void STKConfig::init_defaults()
     m_solver_iterations          = -100;
     m_solver_set_flags           = 0;
     m_solver_reset_flags         = 0;
+    m_broadphase                 = "";
     m_network_steering_reduction = -100;
     m_title_music                = NULL;
     m_default_music              = NULL;
@@ -357,6 +358,12 @@ void STKConfig::getAllData(const XMLNode * root)
             }
         }   // for mode in solver_modes
 
+        physics_node->get("broadphase",             &m_broadphase            );
+        if (m_broadphase != "axis-sweep" && m_broadphase != "dbvt")
+        {
+            Log::fatal("STK-Config", "Unknown broadphase '%s'.",
+                       m_broadphase.c_str());
+        }
     }
 
     if (const XMLNode *startup_node= root->getNode("startup"))
@@ -122,6 +122,9 @@ public:
      *  added to the solver mode, bits set in reset_flags are removed. */
     int m_solver_set_flags, m_solver_reset_flags;
 
+    /** The broadphase of the physics: "axis-sweep" or "dbvt". */
+    std::string m_broadphase;
+
     int   m_max_skidmarks;           /**<Maximum number of skid marks/kart.  */
     float m_skid_fadeout_time;       /**<Time till skidmarks fade away.      */
     float m_near_ground;             /**<Determines when a kart is not near
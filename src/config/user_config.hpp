@@ -843,6 +843,11 @@ namespace UserConfigParams
      PARAM_PREFIX IntUserConfigParam m_timer_sync_difference_tolerance
         PARAM_DEFAULT(IntUserConfigParam(5, "timer-sync-difference-tolerance",
         &m_network_group, "Max time difference tolerance (in ms) to synchronize timer with server."));
+    PARAM_PREFIX IntUserConfigParam m_max_rewind_ticks_per_frame
+        PARAM_DEFAULT(IntUserConfigParam(60, "max-rewind-ticks-per-frame",
+        &m_network_group, "Maximum number of ticks re-simulated in a frame "
+        "after a rewind on a client, the remaining ticks are re-simulated in "
+        "the next frames (0 for no limit)."));
     PARAM_PREFIX IntUserConfigParam m_default_ip_type
         PARAM_DEFAULT(IntUserConfigParam(0, "default-ip-type",
         &m_network_group, "Default IP type of this machine, "
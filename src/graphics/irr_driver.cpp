@@ -71,6 +71,7 @@
 #include "main_loop.hpp"
 #include "modes/world.hpp"
 #include "network/network_config.hpp"
+#include "network/rewind_manager.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "physics/physics.hpp"
@@ -1771,11 +1772,20 @@ void IrrDriver::displayFPS()
     gui::IGUIFont* font = GUIEngine::getSmallFont();
     core::rect<s32> position;
 
+    // Rewinds make the game stutter on clients with a high ping, so they are
+    // shown next to the ping
+    RewindManager* rm = NULL;
+    if (World::getWorld() && RewindManager::isEnabled() &&
+        NetworkConfig::get()->isNetworking() &&
+        NetworkConfig::get()->isClient())
+        rm = RewindManager::get();
+
     const int fheight = font->getHeightPerLine();
+    const int width = rm ? 12 * fheight : 0;
     if (UserConfigParams::m_artist_debug_mode)
         position = core::rect<s32>(51, 0, 30*fheight+51, 2*fheight + fheight / 3);
     else
-        position = core::rect<s32>(75, 0, 18*fheight+75 , fheight + fheight / 5);
+        position = core::rect<s32>(75, 0, 18*fheight+width+75 , fheight + fheight / 5);
     GL32_draw2DRectangle(video::SColor(150, 96, 74, 196), position, NULL);
     // We will let pass some time to let things settle before trusting FPS counter
     // even if we also ignore fps = 1, which tends to happen in first checks
@@ -1852,6 +1862,12 @@ void IrrDriver::displayFPS()
         }
     }
 
+    if (rm)
+    {
+        fps_string += StringUtils::insertValues(L", Rewinds: %d/s (%d ticks)",
+            rm->getRewindsPerSecond(), rm->getResimulatedTicksPerSecond());
+    }
+
     static video::SColor fpsColor = video::SColor(255, 0, 0, 0);
 
     font->drawQuick( fps_string.c_str(), position, fpsColor, false );
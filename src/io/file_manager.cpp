@@ -254,6 +254,8 @@ FileManager::FileManager()
     checkAndCreateScreenshotDir();
     checkAndCreateReplayDir();
     checkAndCreateCachedTexturesDir();
+    checkAndCreateCachedBvhDir();
+    checkAndCreateCachedNavmeshDir();
     checkAndCreateGPDir();
 
     redirectOutput();
@@ -1181,6 +1183,59 @@ void FileManager::checkAndCreateCachedTexturesDir()
 
 }   // checkAndCreateCachedTexturesDir
 
+// ----------------------------------------------------------------------------
+/** Creates the directory for cached collision BVHs (see TriangleMesh). This
+ *  will set m_cached_bvh_dir with the appropriate path, or leave it empty if
+ *  the directory can't be created.
+ */
+void FileManager::checkAndCreateCachedBvhDir()
+{
+#if defined(WIN32)
+    m_cached_bvh_dir = m_user_config_dir + "cached-bvh/";
+#elif defined(__APPLE__)
+    m_cached_bvh_dir = getenv("HOME");
+    m_cached_bvh_dir += "/Library/Application Support/SuperTuxKart/CachedBvh/";
+#else
+    m_cached_bvh_dir = checkAndCreateLinuxDir("XDG_CACHE_HOME", "supertuxkart", ".cache/", ".");
+    m_cached_bvh_dir += "cached-bvh/";
+#endif
+
+    if (!checkAndCreateDirectory(m_cached_bvh_dir))
+    {
+        Log::error("FileManager", "Can not create cached BVH directory '%s', "
+            "collision BVHs will not be cached.", m_cached_bvh_dir.c_str());
+        m_cached_bvh_dir = "";
+    }
+
+}   // checkAndCreateCachedBvhDir
+
+// ----------------------------------------------------------------------------
+/** Creates the directory for the cached shortest paths of arena navmeshes
+ *  (see ArenaGraph). This will set m_cached_navmesh_dir with the appropriate
+ *  path, or leave it empty if the directory can't be created.
+ */
+void FileManager::checkAndCreateCachedNavmeshDir()
+{
+#if defined(WIN32)
+    m_cached_navmesh_dir = m_user_config_dir + "cached-navmesh/";
+#elif defined(__APPLE__)
+    m_cached_navmesh_dir = getenv("HOME");
+    m_cached_navmesh_dir += "/Library/Application Support/SuperTuxKart/CachedNavmesh/";
+#else
+    m_cached_navmesh_dir = checkAndCreateLinuxDir("XDG_CACHE_HOME", "supertuxkart", ".cache/", ".");
+    m_cached_navmesh_dir += "cached-navmesh/";
+#endif
+
+    if (!checkAndCreateDirectory(m_cached_navmesh_dir))
+    {
+        Log::error("FileManager", "Can not create cached navmesh directory "
+            "'%s', arena paths will not be cached.",
+            m_cached_navmesh_dir.c_str());
+        m_cached_navmesh_dir = "";
+    }
+
+}   // checkAndCreateCachedNavmeshDir
+
 // ----------------------------------------------------------------------------
 /** Creates the directories for user-defined grand prix. This will set m_gp_dir
  *  with the appropriate path.
@@ -98,6 +98,14 @@ private:
     /** Directory where resized textures are cached. */
     std::string       m_cached_textures_dir;
 
+    /** Directory where collision BVHs of tracks are cached, or empty if
+     *  they are not cached. */
+    std::string       m_cached_bvh_dir;
+
+    /** Directory where the shortest paths of arena navmeshes are cached, or
+     *  empty if they are not cached. */
+    std::string       m_cached_navmesh_dir;
+
     /** Directory where user-defined grand prix are stored. */
     std::string       m_gp_dir;
 
@@ -128,6 +136,8 @@ private:
     void              checkAndCreateScreenshotDir();
     void              checkAndCreateReplayDir();
     void              checkAndCreateCachedTexturesDir();
+    void              checkAndCreateCachedBvhDir();
+    void              checkAndCreateCachedNavmeshDir();
     void              checkAndCreateGPDir();
     void              discoverPaths();
     void              addAssetsSearchPath();
@@ -154,6 +164,9 @@ public:
     std::string       getScreenshotDir() const;
     std::string       getReplayDir() const;
     std::string       getCachedTexturesDir() const;
+    const std::string& getCachedBvhDir() const    { return m_cached_bvh_dir; }
+    const std::string& getCachedNavmeshDir() const
+                                              { return m_cached_navmesh_dir; }
     std::string       getGPDir() const;
     bool              checkAndCreateDirectory(const std::string &path);
     bool              checkAndCreateDirectoryP(const std::string &path);
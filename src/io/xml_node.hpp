@@ -72,6 +72,9 @@ public:
     const void         getNodes(const std::string &s, std::vector<XMLNode*>& out) const;
     const XMLNode     *getNode(unsigned int i) const;
     unsigned int       getNumNodes() const {return (unsigned int) m_nodes.size(); }
+    /** Returns all attributes of this element. */
+    const std::map<std::string, core::stringw>& getAttributes() const
+                                                      { return m_attributes; }
     int get(const std::string &attribute, std::string *value) const;
     int get(const std::string &attribute, core::stringw *value) const;
     int getAndDecode(const std::string &attribute, core::stringw *value) const;
@@ -424,6 +424,10 @@ public:
         return m_avoidance_points[1];
     }   // getAvoidancePoint
     // ------------------------------------------------------------------------
+    /** Returns a distance from the item at which hitKart is always false
+     *  (hitKart halves the height, so it can be twice the hit distance). */
+    float getMaxHitDistance() const { return 2.0f * sqrtf(m_distance_2); }
+    // ------------------------------------------------------------------------
     scene::ISceneNode *getSceneNode()
     {
         return (scene::ISceneNode *) m_node;
@@ -143,11 +143,17 @@ void ItemManager::removeTextures()
 
 
 // ============================================================================
+/** Size of the cells of the spatial hash of items, it's larger than twice
+ *  the hit distance so a kart is tested against at most 8 cells. */
+static const float ITEM_HASH_CELL_SIZE = 5.0f;
+
+// ----------------------------------------------------------------------------
 /** Creates a new instance of the item manager. This is done at startup
  *  of each race. */
-ItemManager::ItemManager()
+ItemManager::ItemManager() : m_items_hash(ITEM_HASH_CELL_SIZE)
 {
     m_switch_ticks = -1;
+    m_max_hit_distance = 0.0f;
     // The actual loading is done in loadDefaultItems
 
     // Prepare the switch to array, which stores which item should be
@@ -223,6 +229,7 @@ unsigned int ItemManager::insertItem(Item *item)
     }
     item->setItemId(index);
     insertItemInQuad(item);
+    insertItemInHash(item);
     // Now insert into the appropriate quad list, if there is a quad list
     // (i.e. race mode has a quad graph).
     return index;
@@ -247,6 +254,32 @@ void ItemManager::insertItemInQuad(Item *item)
     }   // if m_items_in_quads
 }   // insertItemInQuad
 
+//-----------------------------------------------------------------------------
+/** Adds an item (already in m_all_items) to the spatial hash of items.
+ */
+void ItemManager::insertItemInHash(ItemState *item)
+{
+    m_items_hash.insert(item->getItemId(), item->getXYZ());
+    // All items in m_all_items are Items, see getItem()
+    Item *i = dynamic_cast<Item*>(item);
+    if (i && i->getMaxHitDistance() > m_max_hit_distance)
+        m_max_hit_distance = i->getMaxHitDistance();
+}   // insertItemInHash
+
+//-----------------------------------------------------------------------------
+/** Adds all items to the spatial hash again, after items were changed
+ *  without insertItem and deleteItem (e.g. when rewinding).
+ */
+void ItemManager::rebuildItemHash()
+{
+    m_items_hash.clear();
+    for (ItemState *item : m_all_items)
+    {
+        if (item)
+            insertItemInHash(item);
+    }
+}   // rebuildItemHash
+
 //-----------------------------------------------------------------------------
 /** Creates a new item at the location of the kart (e.g. kart drops a
  *  bubblegum).
@@ -363,14 +396,11 @@ void ItemManager::collectedItem(ItemState *item, AbstractKart *kart)
  */
 void  ItemManager::checkItemHit(AbstractKart* kart)
 {
-    // We could use m_items_in_quads to to check for item hits: take the quad
-    // of the graph node of the kart, and only check items in that quad. But
-    // then we also need to check for any adjacent quads (since an item just
-    // on the order of one quad might get hit from an adjacent quad). Then
-    // it is possible that a quad is that short that we need to test adjacent
-    // of adjacent quads. And check for items outside of the track.
-    // Since at this stace item detection is by far not a bottle neck,
-    // the original, simple and stable algorithm is left in place.
+    // Only the items near the kart are tested, using a spatial hash instead
+    // of m_items_in_quads (which would need to check the adjacent quads,
+    // sometimes their adjacent quads, and items outside of the track). The
+    // items are tested in the order of m_all_items, like when testing all
+    // of them, so the items collected do not change.
 
     /** Disable item collection detection for debug purposes. */
     if(m_disable_item_collection) return;
@@ -378,16 +408,17 @@ void  ItemManager::checkItemHit(AbstractKart* kart)
     // Spare tire karts don't collect items
     if ( dynamic_cast<SpareTireAI*>(kart->getController()) ) return;
 
-    for(AllItemTypes::iterator i =m_all_items.begin();
-                               i!=m_all_items.end();  i++)
+    m_items_hash.findNear(kart->getXYZ(), m_max_hit_distance, &m_items_near);
+    for (unsigned index : m_items_near)
     {
+        ItemState *item = m_all_items[index];
         // Ignore items that have been collected or are not available atm
-        if ((!*i) || !(*i)->isAvailable() || (*i)->isUsedUp()) continue;
+        if (!item || !item->isAvailable() || item->isUsedUp()) continue;
 
         // Shielded karts can simply drive over bubble gums without any effect
         if ( kart->isShielded() &&
-             ( (*i)->getType() == ItemState::ITEM_BUBBLEGUM      ||
-               (*i)->getType() == ItemState::ITEM_BUBBLEGUM_NOLOK  ) )
+             ( item->getType() == ItemState::ITEM_BUBBLEGUM      ||
+               item->getType() == ItemState::ITEM_BUBBLEGUM_NOLOK  ) )
         {
             continue;
         }
@@ -395,11 +426,11 @@ void  ItemManager::checkItemHit(AbstractKart* kart)
 
         // To allow inlining and avoid including kart.hpp in item.hpp,
         // we pass the kart and the position separately.
-        if((*i)->hitKart(kart->getXYZ(), kart))
+        if(item->hitKart(kart->getXYZ(), kart))
         {
-            collectedItem(*i, kart);
+            collectedItem(item, kart);
         }   // if hit
-    }   // for m_all_items
+    }   // for m_items_near
 }   // checkItemHit
 
 //-----------------------------------------------------------------------------
@@ -505,6 +536,7 @@ void ItemManager::deleteItem(ItemState *item)
     // First check if the item needs to be removed from the items-in-quad list
     deleteItemInQuad(item);
     int index = item->getItemId();
+    m_items_hash.remove(index);
     m_all_items[index] = NULL;
     delete item;
 }   // delete item
@@ -24,6 +24,7 @@
 #include "items/item.hpp"
 #include "utils/aligned_array.hpp"
 #include "utils/no_copy.hpp"
+#include "utils/spatial_hash.hpp"
 #include "utils/vec3.hpp"
 
 #include <SColor.h>
@@ -107,6 +108,16 @@ private:
      *  field is undefined if no Graph exist, e.g. arena without navmesh. */
     std::vector< AllItemTypes > *m_items_in_quads;
 
+    /** The ids of all items by their position, so checkItemHit only needs
+     *  to test the items near a kart. */
+    SpatialHash m_items_hash;
+
+    /** The largest getMaxHitDistance() of all items added. */
+    float m_max_hit_distance;
+
+    /** Ids of the items near a kart, reused by checkItemHit. */
+    std::vector<unsigned> m_items_near;
+
     /** Stores all item models. */
     static std::vector<scene::IMesh *> m_item_mesh;
 
@@ -123,6 +134,8 @@ protected:
     void setSwitchItems(const std::vector<int> &switch_items);
     void insertItemInQuad(Item *item);
     void deleteItemInQuad(ItemState *item);
+    void insertItemInHash(ItemState *item);
+    void rebuildItemHash();
 public:
              ItemManager();
     virtual ~ItemManager();
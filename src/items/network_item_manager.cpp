@@ -219,9 +219,9 @@ void NetworkItemManager::setItemConfirmationTime(std::weak_ptr<STKPeer> peer,
  *  to save the initial state, which is the first confirmed state by all
  *  clients.
  */
-BareNetworkString* NetworkItemManager::saveState(std::vector<std::string>* ru)
+BareNetworkString* NetworkItemManager::saveState(std::vector<uint16_t>* ru)
 {
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderID());
     // On the server:
     // ==============
     m_item_events.lock();
@@ -507,6 +507,8 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
     }   // for i < max_index
     // Clean up the rest
     m_all_items.resize(m_confirmed_state.size());
+    // Items can have been replaced by others at the same index
+    rebuildItemHash();
 
     // Now set the clock back to the 'rewindto' time:
     world->setTicksForRewind(rewind_to_time);
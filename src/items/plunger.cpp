@@ -252,7 +252,7 @@ void Plunger::hitTrack()
 }   // hitTrack
 
 // ----------------------------------------------------------------------------
-BareNetworkString* Plunger::saveState(std::vector<std::string>* ru)
+BareNetworkString* Plunger::saveState(std::vector<uint16_t>* ru)
 {
     BareNetworkString* buffer = Flyable::saveState(ru);
     if (!buffer)
@@ -26,6 +26,7 @@
 #include "modes/easter_egg_hunt.hpp"
 #include "modes/linear_world.hpp"
 #include "modes/world.hpp"
+#include "replay/binary_replay.hpp"
 #include "replay/replay_recorder.hpp"
 #include "tracks/track.hpp"
 
@@ -38,6 +39,8 @@ GhostKart::GhostKart(const std::string& ident, unsigned int world_kart_id,
                  HANDICAP_NONE,
                  std::make_shared<RenderInfo>(color_hue, true/*transparent*/))
 {
+    m_replay_stream_kart = 0;
+    m_last_replay_time   = 0.0f;
 }   // GhostKart
 
 // ----------------------------------------------------------------------------
@@ -60,6 +63,7 @@ void GhostKart::addReplayEvent(float time,
 {
     GhostController* gc = dynamic_cast<GhostController*>(getController());
     gc->addReplayTime(time);
+    m_last_replay_time = time;
 
     m_all_transform.push_back(trans);
     m_all_physic_info.push_back(pi);
@@ -78,6 +82,42 @@ void GhostKart::addReplayEvent(float time,
 
 }   // addReplayEvent
 
+// ----------------------------------------------------------------------------
+/** Sets the binary replay from which the frames of this kart are read while
+ *  playing, and reads the first ones.
+ *  \param kart The index of this kart in the replay.
+ */
+void GhostKart::setReplayStream(std::shared_ptr<BinaryReplay> stream,
+                                unsigned int kart)
+{
+    m_replay_stream      = stream;
+    m_replay_stream_kart = kart;
+    readReplayChunk();
+}   // setReplayStream
+
+// ----------------------------------------------------------------------------
+/** Adds the next chunk of frames from the replay stream.
+ *  \return False if all frames were read (or the replay is invalid).
+ */
+bool GhostKart::readReplayChunk()
+{
+    if (!m_replay_stream)
+        return false;
+    std::vector<ReplayBase::ReplayFrame> frames;
+    bool read = m_replay_stream->readNextChunk(m_replay_stream_kart, &frames);
+    for (const ReplayBase::ReplayFrame& frame : frames)
+    {
+        addReplayEvent(frame.m_transform_event.m_time,
+                       frame.m_transform_event.m_transform,
+                       frame.m_physic_info, frame.m_bonus_info,
+                       frame.m_kart_replay_event);
+    }
+    // The file is closed once all ghosts have read their frames
+    if (!read || m_replay_stream->isEnd(m_replay_stream_kart))
+        m_replay_stream.reset();
+    return read;
+}   // readReplayChunk
+
 // ----------------------------------------------------------------------------
 /** Called once per rendered frame. It is used to only update any graphical
  *  effects.
@@ -105,6 +145,11 @@ void GhostKart::update(int ticks)
     GhostController* gc = dynamic_cast<GhostController*>(getController());
     if (gc == NULL) return;
 
+    // Read the frames until one after the current time
+    while (m_replay_stream &&
+           m_last_replay_time <= World::getWorld()->getTime())
+        readReplayChunk();
+
     gc->update(ticks);
     if (gc->isReplayEnd())
     {
@@ -295,6 +340,8 @@ float GhostKart::getTimeForDistance(float distance)
     {
         // If we have reached the end of the replay file without finding the
         // searched distance, break
+        if (upper_frame_index >= m_all_replay_events.size())
+            readReplayChunk();
         if (upper_frame_index >= m_all_replay_events.size() ||
             lower_frame_index < 0 )
             break;
@@ -366,6 +413,8 @@ float GhostKart::getTimeForEggs(int egg_number)
     {
         // If we have reached the end of the replay file without finding the
         // searched distance, break
+        if (upper_frame_index >= m_all_bonus_info.size())
+            readReplayChunk();
         if (upper_frame_index >= m_all_bonus_info.size() ||
             lower_frame_index < 0 )
             break;
@@ -25,8 +25,11 @@
 
 #include "LinearMath/btTransform.h"
 
+#include <memory>
 #include <vector>
 
+class BinaryReplay;
+
 /** \defgroup karts */
 
 /** A ghost kart. It does not have a phsyics representation. It gets two
@@ -48,6 +51,19 @@ private:
 
     unsigned int                             m_last_egg_idx = 0;
 
+    /** The binary replay file from which more frames are read while
+     *  playing, NULL if all frames were added. */
+    std::shared_ptr<BinaryReplay>            m_replay_stream;
+
+    /** The index of this kart in m_replay_stream. */
+    unsigned int                             m_replay_stream_kart;
+
+    /** The time of the last frame added. */
+    float                                    m_last_replay_time;
+
+    // ----------------------------------------------------------------------------
+    bool          readReplayChunk();
+
     // ----------------------------------------------------------------------------
     /** Compute the time at which the ghost finished the race */
     void          computeFinishTime();
@@ -74,6 +90,9 @@ public:
                                  const ReplayBase::BonusInfo &bi,
                                  const ReplayBase::KartReplayEvent &kre);
     // ------------------------------------------------------------------------
+    void          setReplayStream(std::shared_ptr<BinaryReplay> stream,
+                                  unsigned int kart);
+    // ------------------------------------------------------------------------
     /** Returns whether this kart is a ghost (replay) kart. */
     virtual bool  isGhostKart() const OVERRIDE { return true; }
     // ------------------------------------------------------------------------
@@ -159,15 +159,15 @@ void KartRewinder::computeError()
 /** Saves all state information for a kart in a memory buffer. The memory
  *  is allocated here and the address returned. It will then be managed
  *  by the RewindManager.
- *  \param[out] ru The unique identity of rewinder writing to.
+ *  \param[out] ru The rewinder id of rewinder writing to.
  *  \return The address of the memory buffer with the state.
  */
-BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
+BareNetworkString* KartRewinder::saveState(std::vector<uint16_t>* ru)
 {
     if (m_eliminated)
         return nullptr;
 
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderID());
     const int MEMSIZE = 17*sizeof(float) + 9+3;
 
     BareNetworkString *buffer = new BareNetworkString(MEMSIZE);
@@ -450,51 +450,57 @@ void KartRewinder::update(int ticks)
 }   // update
 
 // ----------------------------------------------------------------------------
-std::function<void()> KartRewinder::getLocalStateRestoreFunction()
+/** Writes the local state of the kart into a snapshot slot of the rewind
+ *  window, nothing is restored for an eliminated kart.
+ */
+bool KartRewinder::writeLocalState(uint8_t* snapshot) const
 {
     if (m_eliminated)
-        return nullptr;
+        return false;
 
-    // Variable can be saved locally if its adjustment only depends on the kart
-    // itself
-    int brake_ticks = m_brake_ticks;
-    int8_t min_nitro_ticks = m_min_nitro_ticks;
+    LocalState ls;
+    ls.m_brake_ticks = m_brake_ticks;
+    ls.m_min_nitro_ticks = m_min_nitro_ticks;
 
     // Controller local state
-    int steer_val_l = 0;
-    int steer_val_r = 0;
+    ls.m_steer_val_l = 0;
+    ls.m_steer_val_r = 0;
     PlayerController* pc = dynamic_cast<PlayerController*>(m_controller);
     if (pc)
     {
-        steer_val_l = pc->m_steer_val_l;
-        steer_val_r = pc->m_steer_val_r;
+        ls.m_steer_val_l = pc->m_steer_val_l;
+        ls.m_steer_val_r = pc->m_steer_val_r;
     }
 
     // Max speed local state (terrain)
-    float current_fraction = m_max_speed->m_speed_decrease
+    ls.m_current_fraction = m_max_speed->m_speed_decrease
         [MaxSpeed::MS_DECREASE_TERRAIN].m_current_fraction;
-    uint16_t max_speed_fraction = m_max_speed->m_speed_decrease
+    ls.m_max_speed_fraction = m_max_speed->m_speed_decrease
         [MaxSpeed::MS_DECREASE_TERRAIN].m_max_speed_fraction;
 
     // Skidding local state
-    float remaining_jump_time = m_skidding->m_remaining_jump_time;
+    ls.m_remaining_jump_time = m_skidding->m_remaining_jump_time;
+
+    memcpy(snapshot, &ls, sizeof(LocalState));
+    return true;
+}   // writeLocalState
 
-    return [brake_ticks, min_nitro_ticks,
-        steer_val_l, steer_val_r, current_fraction,
-        max_speed_fraction, remaining_jump_time, this]()
+// ----------------------------------------------------------------------------
+void KartRewinder::readLocalState(const uint8_t* snapshot)
+{
+    LocalState ls;
+    memcpy(&ls, snapshot, sizeof(LocalState));
+    m_brake_ticks = ls.m_brake_ticks;
+    m_min_nitro_ticks = ls.m_min_nitro_ticks;
+    PlayerController* pc = dynamic_cast<PlayerController*>(m_controller);
+    if (pc)
     {
-        m_brake_ticks = brake_ticks;
-        m_min_nitro_ticks = min_nitro_ticks;
-        PlayerController* pc = dynamic_cast<PlayerController*>(m_controller);
-        if (pc)
-        {
-            pc->m_steer_val_l = steer_val_l;
-            pc->m_steer_val_r = steer_val_r;
-        }
-        m_max_speed->m_speed_decrease[MaxSpeed::MS_DECREASE_TERRAIN]
-            .m_current_fraction = current_fraction;
-        m_max_speed->m_speed_decrease[MaxSpeed::MS_DECREASE_TERRAIN]
-            .m_max_speed_fraction = max_speed_fraction;
-        m_skidding->m_remaining_jump_time = remaining_jump_time;
-    };
-}   // getLocalStateRestoreFunction
+        pc->m_steer_val_l = ls.m_steer_val_l;
+        pc->m_steer_val_r = ls.m_steer_val_r;
+    }
+    m_max_speed->m_speed_decrease[MaxSpeed::MS_DECREASE_TERRAIN]
+        .m_current_fraction = ls.m_current_fraction;
+    m_max_speed->m_speed_decrease[MaxSpeed::MS_DECREASE_TERRAIN]
+        .m_max_speed_fraction = ls.m_max_speed_fraction;
+    m_skidding->m_remaining_jump_time = ls.m_remaining_jump_time;
+}   // readLocalState
@@ -32,6 +32,19 @@ private:
     float m_prev_steering, m_steering_smoothing_dt, m_steering_smoothing_time;
 
     bool m_has_server_state;
+
+    /** The values which can be saved locally, because their adjustment only
+     *  depends on the kart itself. */
+    struct LocalState
+    {
+        int      m_brake_ticks;
+        int      m_steer_val_l;
+        int      m_steer_val_r;
+        float    m_current_fraction;
+        float    m_remaining_jump_time;
+        uint16_t m_max_speed_fraction;
+        int8_t   m_min_nitro_ticks;
+    };   // LocalState
 public:
     KartRewinder(const std::string& ident, unsigned int world_kart_id,
                  int position, const btTransform& init_transform,
@@ -40,7 +53,7 @@ public:
     ~KartRewinder() {}
     virtual void saveTransform() OVERRIDE;
     virtual void computeError() OVERRIDE;
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru)
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru)
         OVERRIDE;
     void reset() OVERRIDE;
     virtual void restoreState(BareNetworkString *p, int count) OVERRIDE;
@@ -72,7 +85,12 @@ public:
     // -------------------------------------------------------------------------
     virtual void undoEvent(BareNetworkString *p) OVERRIDE {}
     // ------------------------------------------------------------------------
-    virtual std::function<void()> getLocalStateRestoreFunction() OVERRIDE;
+    virtual size_t getLocalStateSize() const OVERRIDE
+                                                { return sizeof(LocalState); }
+    // ------------------------------------------------------------------------
+    virtual bool writeLocalState(uint8_t* snapshot) const OVERRIDE;
+    // ------------------------------------------------------------------------
+    virtual void readLocalState(const uint8_t* snapshot) OVERRIDE;
 
 
 };   // Rewinder
@@ -221,10 +221,14 @@
 #include "karts/kart_properties_manager.hpp"
 #include "modes/cutscene_world.hpp"
 #include "modes/demo_world.hpp"
+#include "network/asset_ids.hpp"
+#include "network/database_index.hpp"
 #include "network/protocols/connect_to_server.hpp"
 #include "network/protocols/client_lobby.hpp"
 #include "network/protocols/server_lobby.hpp"
 #include "network/network.hpp"
+#include "network/load_generator.hpp"
+#include "network/match_log.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
 #include "network/protocols/connect_to_server.hpp"
@@ -237,6 +241,7 @@
 #include "network/server_config.hpp"
 #include "network/servers_manager.hpp"
 #include "network/socket_address.hpp"
+#include "network/state_delta.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "online/profile_manager.hpp"
@@ -245,6 +250,7 @@
 #include "race/highscore_manager.hpp"
 #include "race/history.hpp"
 #include "race/race_manager.hpp"
+#include "replay/binary_replay.hpp"
 #include "replay/replay_play.hpp"
 #include "replay/replay_recorder.hpp"
 #include "states_screens/main_menu_screen.hpp"
@@ -265,6 +271,7 @@
 #include "utils/log.hpp"
 #include "utils/mini_glm.hpp"
 #include "utils/profiler.hpp"
+#include "utils/spatial_hash.hpp"
 #include "utils/stk_process.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/translation.hpp"
@@ -272,6 +279,7 @@
 static void cleanSuperTuxKart();
 static void cleanUserConfig();
 void runUnitTests();
+void runMicroBenchmarks(const std::string& name);
 
 // ============================================================================
 //                        gamepad visualisation screen
@@ -574,6 +582,12 @@ void cmdLineHelp()
     "                          spaces are allowed in the track names.\n"
     "       --demo-laps=n      Number of laps to use in a demo.\n"
     "       --demo-karts=n     Number of karts to use in a demo.\n"
+    "       --convert-replays  Convert the text replays in the replay directory to\n"
+    "                          the binary format, keeping them as .replay.txt files.\n"
+    "       --replay-match=file Re-simulate a match log recorded by a server\n"
+    "                          (needs --no-graphics) and report any divergence.\n"
+    "       --physics-benchmark With --replay-match, re-simulate the match with\n"
+    "                          each physics broadphase and compare their time.\n"
     // "       --history          Replay history file 'history.dat'.\n"
     // "       --test-ai=n        Use the test-ai for every n-th AI kart.\n"
     // "                          (so n=1 means all Ais will be the test ai)\n"
@@ -584,9 +598,20 @@ void cmdLineHelp()
     "       --server-config=file Specify the server_config.xml for server hosting, it will create\n"
     "                            one if not found.\n"
     "       --network-console  Enable network console.\n"
+    "       --profiler-trace   Record profiler markers all the time, so the last ones\n"
+    "                          can be written with the profile console command.\n"
     "       --wan-server=name  Start a Wan server (not a playing client).\n"
     "       --public-server    Allow direct connection to the server (without stk server)\n"
     "       --lan-server=name  Start a LAN server (not a playing client).\n"
+    "       --load-test=n      Load test the LAN server with n simulated clients in\n"
+    "                          this process, then report the server tick duration,\n"
+    "                          state sizes, rewinds and bandwidth.\n"
+    "       --load-test-input=s Input of the simulated clients: idle, accelerate\n"
+    "                          (default), zigzag or random.\n"
+    "       --load-test-latency=n One-way latency of the simulated clients in ms,\n"
+    "                          or a range like 20-150 spread over the clients.\n"
+    "       --load-test-loss=n Percentage of packets lost by the simulated clients.\n"
+    "       --load-test-duration=n Duration of the load test in seconds (120).\n"
     "       --server-password= Sets a password for a server (both client and server).\n"
     "       --connect-now=ip   Connect to a server with IP or domain known now\n"
     "                          (in format x.x.x.x:xxx(optional port)), the port should be its\n"
@@ -1184,6 +1209,9 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         }
     }
 
+    if (CommandLine::has("--profiler-trace"))
+        profiler.setContinuousTrace(true);
+
     if (CommandLine::has("--network-console"))
     {
         ServerConfig::m_enable_console = true;
@@ -1387,6 +1415,36 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
             std::make_shared<ConnectToServer>(server)->requestStart();
     }
 
+    LoadGenerator::Settings load_test;
+    if (CommandLine::has("--load-test", &n))
+    {
+        if (!NetworkConfig::get()->isServer() || ServerConfig::m_wan_server ||
+            n <= 0)
+        {
+            Log::error("main", "--load-test=n needs --lan-server.");
+            cleanSuperTuxKart();
+            return false;
+        }
+        load_test.m_num_clients = n;
+        if (CommandLine::has("--load-test-input", &s) &&
+            !LoadGenerator::parseInputPattern(s, &load_test.m_input))
+        {
+            Log::warn("main", "Unknown load test input '%s'.", s.c_str());
+        }
+        if (CommandLine::has("--load-test-latency", &s) &&
+            !LoadGenerator::parseLatency(s, &load_test.m_min_latency,
+                                         &load_test.m_max_latency))
+        {
+            Log::warn("main", "Invalid load test latency '%s'.", s.c_str());
+        }
+        float f;
+        if (CommandLine::has("--load-test-loss", &f))
+            load_test.m_packet_loss = std::max(0.0f, std::min(f, 100.0f));
+        if (CommandLine::has("--load-test-duration", &f) && f > 0.0f)
+            load_test.m_duration = f;
+        LoadGenerator::configServer(load_test);
+    }
+
     if (NetworkConfig::get()->isServer())
     {
         const std::string& server_name = ServerConfig::m_server_name;
@@ -1416,6 +1474,11 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
                 server_name.c_str());
         }
     }
+    if (load_test.m_num_clients > 0 && STKHost::existHost())
+    {
+        LoadGenerator::create(load_test)
+            ->start(STKHost::get()->getPrivatePort());
+    }
 
     if (CommandLine::has("--auto-connect"))
     {
@@ -2156,6 +2219,19 @@ int main(int argc, char *argv[])
             exit(0);
         }
 
+        std::string benchmark;
+        if (CommandLine::has("--micro-benchmark", &benchmark))
+        {
+            runMicroBenchmarks(benchmark);
+            exit(0);
+        }
+
+        if (CommandLine::has("--convert-replays"))
+        {
+            ReplayPlay::get()->convertTextReplays();
+            exit(0);
+        }
+
 #ifndef SERVER_ONLY
         if (!GUIEngine::isNoGraphics())
         {
@@ -2308,6 +2384,30 @@ int main(int argc, char *argv[])
         // Now the story mode status and player manager is loaded
         story_mode_timer->reset();
 
+        // Re-simulate a match recorded by a server
+        // =========================================
+        std::string match_log;
+        if (CommandLine::has("--replay-match", &match_log))
+        {
+            if (!GUIEngine::isNoGraphics())
+            {
+                Log::error("main", "--replay-match needs --no-graphics.");
+                exit(1);
+            }
+            if (CommandLine::has("--physics-benchmark"))
+            {
+                bool loaded = MatchLog::benchmarkPhysics(match_log);
+                Log::flushBuffers();
+                exit(loaded ? 0 : 1);
+            }
+            if (!MatchLog::create()->load(match_log))
+                exit(1);
+            MatchLog::get()->startReplay();
+            main_loop->run();
+            Log::flushBuffers();
+            exit(MatchLog::get()->hasDiverged() ? 1 : 0);
+        }
+
         // Replay a race
         // =============
         if(history->replayHistory())
@@ -2427,6 +2527,7 @@ static void cleanSuperTuxKart()
 {
 
     delete main_loop;
+    LoadGenerator::destroy();
 
     if(Online::RequestManager::isRunning())
         Online::RequestManager::get()->stopNetworkThread();
@@ -2558,6 +2659,14 @@ void runUnitTests()
     NetworkString::unitTesting();
     Log::info("UnitTest", "SocketAddress");
     SocketAddress::unitTesting();
+    Log::info("UnitTest", "AssetIds");
+    AssetIds::unitTesting();
+#ifdef ENABLE_SQLITE3
+    Log::info("UnitTest", "DatabaseIndex");
+    DatabaseIndex::unitTesting();
+#endif
+    Log::info("UnitTest", "StateDelta");
+    StateDelta::unitTesting();
     Log::info("UnitTest", "StringUtils::versionToInt");
     StringUtils::unitTesting();
 
@@ -2601,6 +2710,24 @@ void runUnitTests()
     Log::info("UnitTest", "Arena Graph");
     ArenaGraph::unitTesting();
 
+    Log::info("UnitTest", "Graph sector lookups");
+    Graph::unitTesting();
+
+    Log::info("UnitTest", "SpatialHash");
+    SpatialHash::unitTesting();
+
+    Log::info("UnitTest", "Profiler trace");
+    Profiler::unitTesting();
+
+    Log::info("UnitTest", "BinaryReplay");
+    BinaryReplay::unitTesting();
+
+    Log::info("UnitTest", "MatchLog");
+    MatchLog::unitTesting();
+
+    Log::info("UnitTest", "LoadGenerator");
+    LoadGenerator::unitTesting();
+
     Log::info("UnitTest", "Fonts for translation");
     font_manager->unitTesting();
 
@@ -2611,3 +2738,31 @@ void runUnitTests()
     Log::info("UnitTest", "Testing successful   ");
     Log::info("UnitTest", "=====================");
 }   // runUnitTests
+
+//=============================================================================
+/** Runs the micro benchmark with the given name, or all of them for "all".
+ */
+void runMicroBenchmarks(const std::string& name)
+{
+    bool found = false;
+    if (name == "all" || name == "send-to-peers")
+    {
+        Log::info("Benchmark", "send-to-peers");
+        STKHost::benchmarkSendToPeers();
+        found = true;
+    }
+    if (name == "all" || name == "host-contention")
+    {
+        Log::info("Benchmark", "host-contention");
+        STKHost::benchmarkContention();
+        found = true;
+    }
+    if (name == "all" || name == "graph-sectors")
+    {
+        Log::info("Benchmark", "graph-sectors");
+        Graph::benchmarkSectorLookups();
+        found = true;
+    }
+    if (!found)
+        Log::error("Benchmark", "Unknown micro benchmark '%s'.", name.c_str());
+}   // runMicroBenchmarks
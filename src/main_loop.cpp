@@ -37,6 +37,8 @@
 #include "input/input_manager.hpp"
 #include "modes/world.hpp"
 #include "modes/profile_world.hpp"
+#include "network/load_generator.hpp"
+#include "network/match_log.hpp"
 #include "network/network_config.hpp"
 #include "network/network_timer_synchronizer.hpp"
 #include "network/protocols/client_lobby.hpp"
@@ -57,6 +59,8 @@
 #include "utils/time.hpp"
 #include "utils/translation.hpp"
 
+#include <chrono>
+
 #ifndef WIN32
 #include <unistd.h>
 #endif
@@ -184,9 +188,10 @@ float MainLoop::getLimitedDt()
 #endif
     float dt = 0;
 
-    // In profile mode without graphics, run with a fixed dt of 1/60
+    // In profile mode without graphics (or when re-simulating a match log),
+    // run with a fixed dt of 1/60
     if ((ProfileWorld::isProfileMode() && GUIEngine::isNoGraphics()) ||
-        UserConfigParams::m_arena_ai_stats)
+        UserConfigParams::m_arena_ai_stats || MatchLog::isReplaying())
     {
         return 1.0f/60.0f;
     }
@@ -450,6 +455,14 @@ void MainLoop::run()
         float dt = stk_config->ticks2Time(1);
         left_over_time -= num_steps * dt ;
 
+        if (LoadGenerator::get() && LoadGenerator::get()->isFinished())
+        {
+            LoadGenerator::get()->stop();
+            LoadGenerator::get()->report();
+            LoadGenerator::destroy();
+            m_request_abort = true;
+        }
+
         // Shutdown next frame if shutdown request is sent while loading the
         // world
         bool was_server = NetworkConfig::get()->isNetworking() &&
@@ -602,6 +615,8 @@ void MainLoop::run()
             bool fast_forward = NetworkConfig::get()->isNetworking() &&
                 NetworkConfig::get()->isClient() &&
                 num_steps > stk_config->time2Ticks(1.0f);
+            if (World::getWorld() && RewindManager::isEnabled())
+                RewindManager::get()->newFrame();
             for (int i = 0; i < num_steps; i++)
             {
                 if (World::getWorld() && history->replayHistory())
@@ -609,6 +624,19 @@ void MainLoop::run()
                     history->updateReplay(
                                        World::getWorld()->getTicksSinceStart());
                 }
+                if (World::getWorld() && MatchLog::isReplaying())
+                {
+                    MatchLog::get()->updateReplay(
+                                       World::getWorld()->getTicksSinceStart());
+                    if (m_abort)
+                        break;
+                }
+
+                // The duration of server ticks is measured in load tests
+                LoadGenerator* lg = LoadGenerator::get();
+                std::chrono::steady_clock::time_point tick_start;
+                if (lg)
+                    tick_start = std::chrono::steady_clock::now();
 
                 PROFILER_PUSH_CPU_MARKER("Protocol manager update",
                                          0x7F, 0x00, 0x7F);
@@ -624,6 +652,13 @@ void MainLoop::run()
                     updateRace(1, fast_forward);
                 }
                 PROFILER_POP_CPU_MARKER();
+                if (lg && World::getWorld())
+                {
+                    lg->addServerTick((uint32_t)
+                        std::chrono::duration_cast<std::chrono::microseconds>
+                        (std::chrono::steady_clock::now() - tick_start)
+                        .count());
+                }
 
                 // We need to check again because update_race may have requested
                 // the main loop to abort; and it's not a good idea to continue
@@ -60,6 +60,8 @@ public:
     /** Set the abort flag, causing the mainloop to be left. */
     void abort() { m_abort = true; }
     void requestAbort() { m_request_abort = true; }
+    /** Clears the abort flags, so that run can be called again. */
+    void resetAbort() { m_abort = false; m_request_abort = false; }
     void setThrottleFPS(bool throttle) { m_throttle_fps = throttle; }
     void setAllowLargeDt(bool enable) { m_allow_large_dt = enable; }
     void renderGUI(int phase, int loop_index=-1, int loop_size=-1);
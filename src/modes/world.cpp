@@ -53,6 +53,7 @@
 #include "main_loop.hpp"
 #include "modes/overworld.hpp"
 #include "network/child_loop.hpp"
+#include "network/match_log.hpp"
 #include "network/protocols/client_lobby.hpp"
 #include "network/network_config.hpp"
 #include "network/rewind_manager.hpp"
@@ -129,7 +130,8 @@ World::World() : WorldStatus()
 {
     if (m_process_type == PT_MAIN)
         GUIEngine::getDevice()->setResizable(true);
-    RewindManager::setEnable(NetworkConfig::get()->isNetworking());
+    RewindManager::setEnable(NetworkConfig::get()->isNetworking() ||
+                             MatchLog::isReplaying());
 #ifdef DEBUG
     m_magic_number = 0xB01D6543;
 #endif
@@ -222,7 +224,7 @@ void World::init()
     // Shuffles the start transforms with playing 3-strikes or free for all battles.
     if ((RaceManager::get()->getMinorMode() == RaceManager::MINOR_MODE_3_STRIKES ||
          RaceManager::get()->getMinorMode() == RaceManager::MINOR_MODE_FREE_FOR_ALL) &&
-         !NetworkConfig::get()->isNetworking())
+         !NetworkConfig::get()->isNetworking() && !MatchLog::isReplaying())
     {
         track->shuffleStartTransforms();
     }
@@ -700,7 +702,7 @@ void World::onGo()
     }
     // Reset track objects 1 more time to make sure all instances of moveable
     // fall at the same instant when race start in network
-    if (NetworkConfig::get()->isNetworking())
+    if (NetworkConfig::get()->isNetworking() || MatchLog::isReplaying())
     {
         PtrVector<TrackObject>& objs = Track::getCurrentTrack()
             ->getTrackObjectManager()->getObjects();
@@ -992,6 +994,9 @@ void World::updateWorld(int ticks)
         getPhase() == IN_GAME_MENU_PHASE))
         return;
 
+    if (MatchLog::get())
+        MatchLog::get()->update(getTicksSinceStart());
+
     try
     {
         update(ticks);
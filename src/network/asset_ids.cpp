@@ -0,0 +1,102 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/asset_ids.hpp"
+
+#include <cassert>
+
+// ----------------------------------------------------------------------------
+/** Adds all names, and returns the bitset of their ids. */
+DynamicBitset AssetIds::add(const std::set<std::string>& names)
+{
+    DynamicBitset bits;
+    for (const std::string& name : names)
+        bits.set(add(name));
+    return bits;
+}   // add
+
+// ----------------------------------------------------------------------------
+DynamicBitset AssetIds::add(const std::vector<std::string>& names)
+{
+    DynamicBitset bits;
+    for (const std::string& name : names)
+        bits.set(add(name));
+    return bits;
+}   // add
+
+// ----------------------------------------------------------------------------
+/** Returns the names of all ids set in bits. */
+std::set<std::string> AssetIds::getNames(const DynamicBitset& bits) const
+{
+    std::set<std::string> names;
+    bits.forEach([&names, this](unsigned id)
+        {
+            if (id < m_names.size())
+                names.insert(m_names[id]);
+        });
+    return names;
+}   // getNames
+
+// ----------------------------------------------------------------------------
+void AssetIds::unitTesting()
+{
+    DynamicBitset a;
+    assert(a.none() && a.count() == 0 && !a.test(1000));
+    a.set(3);
+    a.set(64);
+    a.set(200);
+    assert(a.test(3) && a.test(64) && a.test(200) && !a.test(4));
+    assert(a.count() == 3 && !a.none());
+    assert(a.findNth(0) == 3 && a.findNth(1) == 64 && a.findNth(2) == 200);
+    assert(a.findNth(3) == -1);
+
+    DynamicBitset b;
+    b.set(64);
+    b.set(5);
+    assert(a.countAnd(b) == 1 && b.countAnd(a) == 1);
+    assert(!a.containsAll(b) && !b.containsAll(a));
+    b.reset(5);
+    assert(a.containsAll(b) && !b.containsAll(a));
+    b.reset(1000);
+
+    DynamicBitset c = a;
+    c &= b;
+    assert(c.count() == 1 && c.test(64) && !c.test(200));
+    c |= a;
+    assert(c.count() == 3 && c.test(200));
+    std::vector<unsigned> bits;
+    c.forEach([&bits](unsigned i) { bits.push_back(i); });
+    assert(bits.size() == 3 && bits[0] == 3 && bits[1] == 64 &&
+        bits[2] == 200);
+    c.clear();
+    assert(c.none() && !c.test(3));
+
+    AssetIds ids;
+    assert(ids.add("abyss") == 0);
+    assert(ids.add("zengarden") == 1);
+    assert(ids.add("abyss") == 0);
+    assert(ids.find("zengarden") == 1 && ids.find("hacienda") == -1);
+    assert(ids.size() == 2 && ids.getName(1) == "zengarden");
+
+    std::set<std::string> names = { "hacienda", "zengarden" };
+    DynamicBitset server = ids.add(names);
+    assert(ids.size() == 3 && server.count() == 2);
+    assert(ids.test(server, "hacienda") && !ids.test(server, "abyss"));
+    assert(!ids.test(server, "unknown"));
+    assert(ids.getNames(server) == names);
+}   // unitTesting
@@ -0,0 +1,84 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_ASSET_IDS_HPP
+#define HEADER_ASSET_IDS_HPP
+
+#include "utils/dynamic_bitset.hpp"
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** Gives each kart or track name known by the server a dense integer id, so
+ *  sets of assets (of the server or of each client) can be stored as
+ *  DynamicBitset, and compared with a few bit operations. Ids are never
+ *  removed, so bitsets stay valid when more assets are added. Only names of
+ *  the server are added, names sent by clients are only looked up.
+ */
+class AssetIds
+{
+private:
+    std::unordered_map<std::string, unsigned> m_ids;
+
+    std::vector<std::string> m_names;
+
+public:
+    // ------------------------------------------------------------------------
+    /** Returns the id of name, adding it if needed. */
+    unsigned add(const std::string& name)
+    {
+        auto it = m_ids.find(name);
+        if (it != m_ids.end())
+            return it->second;
+        unsigned id = (unsigned)m_names.size();
+        m_ids[name] = id;
+        m_names.push_back(name);
+        return id;
+    }   // add
+    // ------------------------------------------------------------------------
+    /** Returns the id of name, or -1 if it's not added. */
+    int find(const std::string& name) const
+    {
+        auto it = m_ids.find(name);
+        return it == m_ids.end() ? -1 : (int)it->second;
+    }   // find
+    // ------------------------------------------------------------------------
+    /** True if name is added and its bit is set in bits. */
+    bool test(const DynamicBitset& bits, const std::string& name) const
+    {
+        int id = find(name);
+        return id != -1 && bits.test(id);
+    }   // test
+    // ------------------------------------------------------------------------
+    const std::string& getName(unsigned id) const       { return m_names[id]; }
+    // ------------------------------------------------------------------------
+    unsigned size() const                   { return (unsigned)m_names.size(); }
+    // ------------------------------------------------------------------------
+    DynamicBitset add(const std::set<std::string>& names);
+    // ------------------------------------------------------------------------
+    DynamicBitset add(const std::vector<std::string>& names);
+    // ------------------------------------------------------------------------
+    std::set<std::string> getNames(const DynamicBitset& bits) const;
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // AssetIds
+
+#endif
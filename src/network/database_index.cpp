@@ -0,0 +1,416 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifdef ENABLE_SQLITE3
+
+#include "network/database_index.hpp"
+
+#include "network/stk_ipv6.hpp"
+#include "utils/log.hpp"
+#include "utils/time.hpp"
+
+#include <cassert>
+#include <limits>
+
+/** Columns read for bans by readBan, and their checksum in the table. */
+static const char* BAN_COLUMNS =
+    "reason, description, CAST(strftime('%s', starting_time) AS INTEGER), "
+    "CAST(strftime('%s', starting_time, '+'||expired_days||' days') "
+    "AS INTEGER), CAST(expired_days * 86400 AS INTEGER)";
+static const char* BAN_CHECKSUM =
+    "ifnull(sum(CAST(strftime('%s', starting_time) AS INTEGER)), 0) + "
+    "ifnull(sum(CAST(expired_days * 86400 AS INTEGER)), 0)";
+
+// ----------------------------------------------------------------------------
+/** Creates the index, use refresh() to read the tables.
+ *  \param db The database, only used in the calling thread of refresh().
+ *  Table names are empty for tables which don't exist.
+ */
+DatabaseIndex::DatabaseIndex(sqlite3* db, const std::string& ip_ban_table,
+                             const std::string& ipv6_ban_table,
+                             const std::string& online_id_ban_table,
+                             const std::string& ip_geolocation_table,
+                             const std::string& ipv6_geolocation_table)
+{
+    m_db = db;
+    addTable(ip_ban_table, true, "ip_start, ip_end",
+        [this](sqlite3_stmt* stmt, Table& t)
+        {
+            int64_t checksum = 0;
+            BanInfo ban = readBan(t, stmt, 3, &checksum);
+            m_ip_bans.add((uint32_t)sqlite3_column_int64(stmt, 1),
+                (uint32_t)sqlite3_column_int64(stmt, 2), ban);
+            return checksum;
+        },
+        [this]() { m_ip_bans.clear(); }, [this]() { m_ip_bans.build(); });
+
+    addTable(ipv6_ban_table, true, "ipv6_cidr",
+        [this](sqlite3_stmt* stmt, Table& t)
+        {
+            int64_t checksum = 0;
+            BanInfo ban = readBan(t, stmt, 2, &checksum);
+            const char* cidr = (const char*)sqlite3_column_text(stmt, 1);
+            uint64_t first[2], last[2];
+            if (cidr && getIPv6CIDRRange(cidr, first, last))
+            {
+                m_ipv6_bans.add(std::make_pair(first[0], first[1]),
+                    std::make_pair(last[0], last[1]), ban);
+            }
+            return checksum;
+        },
+        [this]() { m_ipv6_bans.clear(); }, [this]() { m_ipv6_bans.build(); });
+
+    addTable(online_id_ban_table, true, "online_id",
+        [this](sqlite3_stmt* stmt, Table& t)
+        {
+            int64_t checksum = 0;
+            BanInfo ban = readBan(t, stmt, 2, &checksum);
+            uint32_t online_id = (uint32_t)sqlite3_column_int64(stmt, 1);
+            m_online_id_bans.add(online_id, online_id, ban);
+            return checksum;
+        },
+        [this]() { m_online_id_bans.clear(); },
+        [this]() { m_online_id_bans.build(); });
+
+    addTable(ip_geolocation_table, false, "ip_start, ip_end, country_code",
+        [this](sqlite3_stmt* stmt, Table& t)
+        {
+            const char* country_code =
+                (const char*)sqlite3_column_text(stmt, 3);
+            m_ip_geolocation.add((uint32_t)sqlite3_column_int64(stmt, 1),
+                (uint32_t)sqlite3_column_int64(stmt, 2),
+                country_code ? country_code : "");
+            return (int64_t)0;
+        },
+        [this]() { m_ip_geolocation.clear(); },
+        [this]() { m_ip_geolocation.build(); });
+
+    addTable(ipv6_geolocation_table, false, "ip_start, ip_end, country_code",
+        [this](sqlite3_stmt* stmt, Table& t)
+        {
+            const char* country_code =
+                (const char*)sqlite3_column_text(stmt, 3);
+            m_ipv6_geolocation.add(sqlite3_column_int64(stmt, 1),
+                sqlite3_column_int64(stmt, 2),
+                country_code ? country_code : "");
+            return (int64_t)0;
+        },
+        [this]() { m_ipv6_geolocation.clear(); },
+        [this]() { m_ipv6_geolocation.build(); });
+}   // DatabaseIndex
+
+// ----------------------------------------------------------------------------
+void DatabaseIndex::addTable(const std::string& name, bool ban,
+                             const std::string& columns,
+                         std::function<int64_t(sqlite3_stmt*, Table&)> read_row,
+                             std::function<void()> clear,
+                             std::function<void()> build)
+{
+    if (name.empty())
+        return;
+    Table t;
+    t.m_name = name;
+    t.m_ban = ban;
+    t.m_count = 0;
+    t.m_max_rowid = 0;
+    t.m_checksum = 0;
+    t.m_select = "SELECT rowid, " + columns;
+    if (ban)
+        t.m_select = t.m_select + ", " + BAN_COLUMNS;
+    t.m_select += " FROM " + name + " WHERE rowid > ?1;";
+    t.m_read_row = read_row;
+    t.m_clear = clear;
+    t.m_build = build;
+    m_tables.push_back(t);
+}   // addTable
+
+// ----------------------------------------------------------------------------
+/** Reads the columns of a ban starting from column (see BAN_COLUMNS).
+ *  \param checksum Set to the checksum of the ban times in this row.
+ */
+DatabaseIndex::BanInfo DatabaseIndex::readBan(Table& t, sqlite3_stmt* stmt,
+                                              int column, int64_t* checksum)
+{
+    BanInfo ban;
+    ban.m_row_id = sqlite3_column_int64(stmt, 0);
+    const char* reason = (const char*)sqlite3_column_text(stmt, column);
+    ban.m_reason = reason ? reason : "";
+    const char* desc = (const char*)sqlite3_column_text(stmt, column + 1);
+    ban.m_description = desc ? desc : "";
+    // A ban without starting time never starts, like in SQL
+    if (sqlite3_column_type(stmt, column + 2) == SQLITE_NULL)
+        ban.m_starting_time = std::numeric_limits<int64_t>::max();
+    else
+        ban.m_starting_time = sqlite3_column_int64(stmt, column + 2);
+    if (sqlite3_column_type(stmt, column + 3) == SQLITE_NULL)
+        ban.m_expired_time = -1;
+    else
+        ban.m_expired_time = sqlite3_column_int64(stmt, column + 3);
+    *checksum = sqlite3_column_int64(stmt, column + 2) +
+        sqlite3_column_int64(stmt, column + 4);
+    t.m_starting_times.push_back(ban.m_starting_time);
+    return ban;
+}   // readBan
+
+// ----------------------------------------------------------------------------
+/** Reads rows with rowid larger than after_rowid into the index of t.
+ *  \param count Increased by the number of rows read.
+ *  \param checksum Increased by the checksum of the rows read.
+ */
+bool DatabaseIndex::readRows(Table& t, int64_t after_rowid, int64_t* count,
+                             int64_t* checksum)
+{
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(m_db, t.m_select.c_str(), -1, &stmt, 0) !=
+        SQLITE_OK)
+    {
+        Log::error("DatabaseIndex", "Error preparing database for query "
+            "%s: %s", t.m_select.c_str(), sqlite3_errmsg(m_db));
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, after_rowid);
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        *checksum += t.m_read_row(stmt, t);
+        (*count)++;
+    }
+    sqlite3_finalize(stmt);
+    if (ret != SQLITE_DONE)
+    {
+        Log::error("DatabaseIndex", "Error reading %s: %s",
+            t.m_name.c_str(), sqlite3_errmsg(m_db));
+        return false;
+    }
+    return true;
+}   // readRows
+
+// ----------------------------------------------------------------------------
+/** Updates the index of t if the table changed.
+ *  \return True if it changed.
+ */
+bool DatabaseIndex::refreshTable(Table& t)
+{
+    std::string query = "SELECT count(*), ifnull(max(rowid), 0), ";
+    query += t.m_ban ? BAN_CHECKSUM : "0";
+    query += " FROM " + t.m_name + ";";
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0) != SQLITE_OK)
+    {
+        Log::error("DatabaseIndex", "Error preparing database for query "
+            "%s: %s", query.c_str(), sqlite3_errmsg(m_db));
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW)
+    {
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    int64_t count = sqlite3_column_int64(stmt, 0);
+    int64_t max_rowid = sqlite3_column_int64(stmt, 1);
+    int64_t checksum = sqlite3_column_int64(stmt, 2);
+    sqlite3_finalize(stmt);
+    if (count == t.m_count && max_rowid == t.m_max_rowid &&
+        checksum == t.m_checksum)
+        return false;
+
+    // Usually rows are only added, so read only them if nothing else changed
+    bool read_all = true;
+    if (count > t.m_count && max_rowid > t.m_max_rowid)
+    {
+        int64_t new_count = t.m_count;
+        int64_t new_checksum = t.m_checksum;
+        if (readRows(t, t.m_max_rowid, &new_count, &new_checksum) &&
+            new_count == count && new_checksum == checksum)
+            read_all = false;
+    }
+    if (read_all)
+    {
+        t.m_clear();
+        t.m_starting_times.clear();
+        int64_t new_count = 0;
+        int64_t new_checksum = 0;
+        readRows(t, 0, &new_count, &new_checksum);
+        Log::info("DatabaseIndex", "Read %d rows of %s.", (int)new_count,
+            t.m_name.c_str());
+    }
+    t.m_build();
+    std::sort(t.m_starting_times.begin(), t.m_starting_times.end());
+    t.m_count = count;
+    t.m_max_rowid = max_rowid;
+    t.m_checksum = checksum;
+    return true;
+}   // refreshTable
+
+// ----------------------------------------------------------------------------
+/** Reads changes of all tables since last call.
+ *  \return True if any ban table changed.
+ */
+bool DatabaseIndex::refresh()
+{
+    bool bans_changed = false;
+    for (Table& t : m_tables)
+    {
+        if (refreshTable(t) && t.m_ban)
+            bans_changed = true;
+    }
+    return bans_changed;
+}   // refresh
+
+// ----------------------------------------------------------------------------
+/** Returns true if any ban starts in [from, until) (in seconds since epoch),
+ *  i.e. it is active at until but was not at from, so connected peers need
+ *  to be tested again. */
+bool DatabaseIndex::hasBanStarted(int64_t from, int64_t until) const
+{
+    for (const Table& t : m_tables)
+    {
+        auto it = std::lower_bound(t.m_starting_times.begin(),
+            t.m_starting_times.end(), from);
+        if (it != t.m_starting_times.end() && *it < until)
+            return true;
+    }
+    return false;
+}   // hasBanStarted
+
+// ----------------------------------------------------------------------------
+const DatabaseIndex::BanInfo* DatabaseIndex::findIPBan(uint32_t ip,
+                                                       int64_t now) const
+{
+    return m_ip_bans.find(ip,
+        [now](const BanInfo& ban) { return ban.isActive(now); });
+}   // findIPBan
+
+// ----------------------------------------------------------------------------
+const DatabaseIndex::BanInfo*
+    DatabaseIndex::findIPv6Ban(const std::string& ipv6, int64_t now) const
+{
+    uint64_t value[2];
+    if (!getIPv6Value(ipv6.c_str(), value))
+        return NULL;
+    return m_ipv6_bans.find(std::make_pair(value[0], value[1]),
+        [now](const BanInfo& ban) { return ban.isActive(now); });
+}   // findIPv6Ban
+
+// ----------------------------------------------------------------------------
+const DatabaseIndex::BanInfo*
+    DatabaseIndex::findOnlineIdBan(uint32_t online_id, int64_t now) const
+{
+    return m_online_id_bans.find(online_id,
+        [now](const BanInfo& ban) { return ban.isActive(now); });
+}   // findOnlineIdBan
+
+// ----------------------------------------------------------------------------
+std::string DatabaseIndex::ip2Country(uint32_t ip) const
+{
+    const std::string* country_code = m_ip_geolocation.find(ip);
+    return country_code ? *country_code : "";
+}   // ip2Country
+
+// ----------------------------------------------------------------------------
+std::string DatabaseIndex::ipv62Country(const std::string& ipv6) const
+{
+    const std::string* country_code =
+        m_ipv6_geolocation.find(upperIPv6(ipv6.c_str()));
+    return country_code ? *country_code : "";
+}   // ipv62Country
+
+// ----------------------------------------------------------------------------
+void DatabaseIndex::unitTesting()
+{
+    sqlite3* db = NULL;
+    int ret = sqlite3_open(":memory:", &db);
+    assert(ret == SQLITE_OK);
+    (void)ret;
+    auto exec = [db](const char* query)
+        {
+            int ret = sqlite3_exec(db, query, NULL, NULL, NULL);
+            assert(ret == SQLITE_OK);
+            (void)ret;
+        };
+    exec("CREATE TABLE ip_ban (ip_start INTEGER, ip_end INTEGER, "
+        "starting_time TIMESTAMP DEFAULT CURRENT_TIMESTAMP, "
+        "expired_days REAL NULL DEFAULT NULL, reason TEXT, description TEXT);"
+        "CREATE TABLE ipv6_ban (ipv6_cidr TEXT, "
+        "starting_time TIMESTAMP DEFAULT CURRENT_TIMESTAMP, "
+        "expired_days REAL NULL DEFAULT NULL, reason TEXT, description TEXT);"
+        "CREATE TABLE ip_geo (ip_start INTEGER, ip_end INTEGER, "
+        "country_code TEXT);");
+    // Bans started 1 day ago, except a future one
+    exec("INSERT INTO ip_ban VALUES "
+        "(10, 20, datetime('now', '-1 days'), NULL, 'a', ''),"
+        "(15, 15, datetime('now', '+1 days'), NULL, 'b', ''),"
+        "(100, 200, datetime('now', '-1 days'), 0.5, 'c', '');"
+        "INSERT INTO ipv6_ban VALUES "
+        "('2001:db8::/32', datetime('now', '-1 days'), NULL, 'd', '');"
+        "INSERT INTO ip_geo VALUES (0, 100, 'AA'), (50, 60, 'BB'),"
+        "(4294967040, 4294967295, 'CC');");
+
+    DatabaseIndex index(db, "ip_ban", "ipv6_ban", "", "ip_geo", "");
+    // Only the first refresh reads the unchanged tables
+    bool changed = index.refresh();
+    assert(changed);
+    changed = index.refresh();
+    assert(!changed);
+    int64_t now = (int64_t)StkTime::getTimeSinceEpoch();
+
+    const BanInfo* ban = index.findIPBan(15, now);
+    assert(ban && ban->m_reason == "a");
+    (void)ban;
+    assert(!index.findIPBan(21, now));
+    // Expired after half a day
+    assert(!index.findIPBan(150, now));
+    assert(index.findIPBan(15, now + 2 * 86400)->m_reason == "b");
+    assert(index.hasBanStarted(now, now + 2 * 86400));
+    assert(!index.hasBanStarted(now + 2 * 86400, now + 3 * 86400));
+
+    assert(index.findIPv6Ban("2001:db8::1", now)->m_reason == "d");
+    assert(index.findIPv6Ban("2001:db8:ffff:ffff:ffff:ffff:ffff:ffff", now));
+    assert(!index.findIPv6Ban("2001:db9::1", now));
+
+    // The range with the largest start wins, like ORDER BY ip_start DESC
+    assert(index.ip2Country(40) == "AA");
+    assert(index.ip2Country(55) == "BB");
+    assert(index.ip2Country(61) == "AA");
+    assert(index.ip2Country(101) == "");
+    assert(index.ip2Country(4294967295u) == "CC");
+
+    // Added rows
+    exec("INSERT INTO ip_ban VALUES "
+        "(30, 40, datetime('now', '-1 days'), NULL, 'e', '');");
+    changed = index.refresh();
+    assert(changed);
+    assert(index.findIPBan(35, now)->m_reason == "e");
+    assert(index.findIPBan(15, now)->m_reason == "a");
+
+    // Removed and changed rows
+    exec("DELETE FROM ip_ban WHERE reason = 'a';");
+    changed = index.refresh();
+    assert(changed);
+    assert(!index.findIPBan(15, now));
+    exec("UPDATE ip_ban SET expired_days = NULL WHERE reason = 'c';");
+    changed = index.refresh();
+    assert(changed);
+    assert(index.findIPBan(150, now)->m_reason == "c");
+    (void)changed;
+    sqlite3_close(db);
+}   // unitTesting
+
+#endif // ENABLE_SQLITE3
@@ -0,0 +1,152 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_DATABASE_INDEX_HPP
+#define HEADER_DATABASE_INDEX_HPP
+
+#ifdef ENABLE_SQLITE3
+
+#include "utils/interval_index.hpp"
+#include "utils/no_copy.hpp"
+
+#include <sqlite3.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** Keeps the ban and IP geolocation tables of the server database in memory,
+ *  so testing a peer takes O(log n) without any query. The tables are read
+ *  at the first refresh(), later refreshes only read rows added since then
+ *  (using rowid), unless rows were removed or their ban time changed, which
+ *  reads the table again. Changing only the reason or description of a ban
+ *  is not noticed until then. All functions must be called from the thread
+ *  using the database (see DatabaseWorker).
+ */
+class DatabaseIndex : public NoCopy
+{
+public:
+    struct BanInfo
+    {
+        int64_t m_row_id;
+
+        /** Seconds since epoch when the ban starts, and when it expires (or
+         *  -1 if never). */
+        int64_t m_starting_time;
+
+        int64_t m_expired_time;
+
+        std::string m_reason;
+
+        std::string m_description;
+        // --------------------------------------------------------------------
+        bool isActive(int64_t now) const
+        {
+            return now > m_starting_time &&
+                (m_expired_time == -1 || m_expired_time > now);
+        }   // isActive
+    };   // BanInfo
+
+private:
+    /** A table mirrored in memory, with the row count, the largest rowid and
+     *  a checksum of the ban times when it was last read. */
+    struct Table
+    {
+        std::string m_name;
+
+        bool m_ban;
+
+        int64_t m_count;
+
+        int64_t m_max_rowid;
+
+        int64_t m_checksum;
+
+        /** Selects the rows with rowid larger than the bound value. */
+        std::string m_select;
+
+        /** Adds a row of m_select to the index, returns its checksum. */
+        std::function<int64_t(sqlite3_stmt*, Table&)> m_read_row;
+
+        std::function<void()> m_clear;
+
+        std::function<void()> m_build;
+
+        /** Sorted starting times of bans. */
+        std::vector<int64_t> m_starting_times;
+    };
+
+    sqlite3* m_db;
+
+    std::vector<Table> m_tables;
+
+    IntervalIndex<uint32_t, BanInfo> m_ip_bans;
+
+    IntervalIndex<std::pair<uint64_t, uint64_t>, BanInfo> m_ipv6_bans;
+
+    IntervalIndex<uint32_t, BanInfo> m_online_id_bans;
+
+    IntervalIndex<uint32_t, std::string> m_ip_geolocation;
+
+    /** Using the upper 64 bits of addresses (see upperIPv6). */
+    IntervalIndex<int64_t, std::string> m_ipv6_geolocation;
+
+    // ------------------------------------------------------------------------
+    void addTable(const std::string& name, bool ban,
+                  const std::string& columns,
+                  std::function<int64_t(sqlite3_stmt*, Table&)> read_row,
+                  std::function<void()> clear, std::function<void()> build);
+    // ------------------------------------------------------------------------
+    bool refreshTable(Table& t);
+    // ------------------------------------------------------------------------
+    bool readRows(Table& t, int64_t after_rowid, int64_t* count,
+                  int64_t* checksum);
+    // ------------------------------------------------------------------------
+    BanInfo readBan(Table& t, sqlite3_stmt* stmt, int column,
+                    int64_t* checksum);
+
+public:
+    DatabaseIndex(sqlite3* db, const std::string& ip_ban_table,
+                  const std::string& ipv6_ban_table,
+                  const std::string& online_id_ban_table,
+                  const std::string& ip_geolocation_table,
+                  const std::string& ipv6_geolocation_table);
+    // ------------------------------------------------------------------------
+    bool refresh();
+    // ------------------------------------------------------------------------
+    bool hasBanStarted(int64_t from, int64_t until) const;
+    // ------------------------------------------------------------------------
+    const BanInfo* findIPBan(uint32_t ip, int64_t now) const;
+    // ------------------------------------------------------------------------
+    const BanInfo* findIPv6Ban(const std::string& ipv6, int64_t now) const;
+    // ------------------------------------------------------------------------
+    const BanInfo* findOnlineIdBan(uint32_t online_id, int64_t now) const;
+    // ------------------------------------------------------------------------
+    std::string ip2Country(uint32_t ip) const;
+    // ------------------------------------------------------------------------
+    std::string ipv62Country(const std::string& ipv6) const;
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // DatabaseIndex
+
+#endif // ENABLE_SQLITE3
+
+#endif
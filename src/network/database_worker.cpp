@@ -0,0 +1,297 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifdef ENABLE_SQLITE3
+
+#include "network/database_worker.hpp"
+
+#include "utils/log.hpp"
+#include "utils/stk_process.hpp"
+#include "utils/vs.hpp"
+
+#include <stdexcept>
+
+/** Maximum number of prepared statements kept. */
+static const unsigned MAX_CACHED_STATEMENTS = 64;
+
+// ----------------------------------------------------------------------------
+/** Starts the database thread.
+ *  \param db The opened database, it's only used by this thread from now on
+ *         and must be closed after this object is deleted.
+ */
+DatabaseWorker::DatabaseWorker(sqlite3* db)
+{
+    m_db = db;
+    m_exit = false;
+    m_prepare_count = 0;
+    ProcessType pt = STKProcess::getType();
+    m_thread = std::thread([this, pt]()
+        {
+            VS::setThreadName("DatabaseWorker");
+            STKProcess::init(pt);
+            mainLoop();
+        });
+}   // DatabaseWorker
+
+// ----------------------------------------------------------------------------
+/** Runs all jobs left (without their callbacks) and stops the thread. */
+DatabaseWorker::~DatabaseWorker()
+{
+    std::unique_lock<std::mutex> ul(m_jobs_mutex);
+    m_exit = true;
+    ul.unlock();
+    m_jobs_cv.notify_one();
+    m_thread.join();
+    for (auto& s : m_statements)
+        sqlite3_finalize(s.second.first);
+}   // ~DatabaseWorker
+
+// ----------------------------------------------------------------------------
+void DatabaseWorker::mainLoop()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> ul(m_jobs_mutex);
+        m_jobs_cv.wait(ul, [this]() { return m_exit || !m_jobs.empty(); });
+        if (m_jobs.empty())
+            return;
+        std::deque<std::function<void()> > jobs;
+        std::swap(jobs, m_jobs);
+        ul.unlock();
+
+        // Writing in one transaction only syncs the database file once,
+        // the transaction is started by the first write (see prepare)
+        bool failed = false;
+        for (auto& job : jobs)
+        {
+            try
+            {
+                job();
+            }
+            catch (std::exception& e)
+            {
+                Log::error("DatabaseWorker", "Error in job: %s", e.what());
+                failed = true;
+            }
+        }
+        endTransaction(failed);
+    }
+}   // mainLoop
+
+// ----------------------------------------------------------------------------
+/** Starts a transaction if the statement writes and none is open yet. */
+void DatabaseWorker::beginTransactionFor(sqlite3_stmt* stmt)
+{
+    if (!sqlite3_stmt_readonly(stmt) && sqlite3_get_autocommit(m_db))
+        exec("BEGIN;");
+}   // beginTransactionFor
+
+// ----------------------------------------------------------------------------
+/** Commits the transaction of the jobs run, if any was started. It's rolled
+ *  back instead if a job failed or the commit fails (e.g. because the
+ *  database is locked by another process), so the next jobs never run in a
+ *  transaction left open.
+ *  \param failed True if a job failed.
+ */
+void DatabaseWorker::endTransaction(bool failed)
+{
+    // Some errors (like a full disk) roll back the transaction already
+    if (sqlite3_get_autocommit(m_db))
+        return;
+    if (!failed && exec("COMMIT;"))
+        return;
+    Log::warn("DatabaseWorker", "Rolling back the changes of the last jobs.");
+    exec("ROLLBACK;");
+}   // endTransaction
+
+// ----------------------------------------------------------------------------
+/** Runs a query without result.
+ *  \return True if no error occurs.
+ */
+bool DatabaseWorker::exec(const char* query)
+{
+    char* error = NULL;
+    bool ok = sqlite3_exec(m_db, query, NULL, NULL, &error) == SQLITE_OK;
+    if (!ok)
+    {
+        Log::error("DatabaseWorker", "Error running %s: %s", query,
+            error ? error : "");
+    }
+    sqlite3_free(error);
+    return ok;
+}   // exec
+
+// ----------------------------------------------------------------------------
+/** Adds a job to run in the database thread.
+ *  \param job The job, it must not use anything which can be changed in
+ *         other threads meanwhile (copy it into the job instead).
+ *  \param callback Optional function to run in the thread calling
+ *         handleCallbacks after the job is done, e.g. to use its result.
+ */
+void DatabaseWorker::addJob(std::function<void()> job,
+                            std::function<void()> callback)
+{
+    std::function<void()> f = job;
+    if (callback)
+    {
+        f = [this, job, callback]()
+            {
+                job();
+                std::lock_guard<std::mutex> lock(m_callbacks_mutex);
+                m_callbacks.push_back(callback);
+            };
+    }
+    std::unique_lock<std::mutex> ul(m_jobs_mutex);
+    m_jobs.push_back(f);
+    ul.unlock();
+    m_jobs_cv.notify_one();
+}   // addJob
+
+// ----------------------------------------------------------------------------
+/** Runs the callbacks of finished jobs, always from the same thread. */
+void DatabaseWorker::handleCallbacks()
+{
+    std::vector<std::function<void()> > callbacks;
+    std::unique_lock<std::mutex> ul(m_callbacks_mutex);
+    std::swap(callbacks, m_callbacks);
+    ul.unlock();
+    for (auto& c : callbacks)
+        c();
+}   // handleCallbacks
+
+// ----------------------------------------------------------------------------
+/** Returns a prepared statement for the query (database thread only). It is
+ *  kept for the same query later, so the caller must not finalize it, but
+ *  should call sqlite3_reset when done to release its locks. When too many
+ *  are cached, the least recently used one which is not running is
+ *  finalized. If the statement writes, the transaction of the current jobs
+ *  is started.
+ *  \return The statement, or NULL if the query has an error.
+ */
+sqlite3_stmt* DatabaseWorker::prepare(const std::string& query)
+{
+    m_prepare_count++;
+    auto it = m_statements.find(query);
+    if (it != m_statements.end())
+    {
+        sqlite3_stmt* stmt = it->second.first;
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        it->second.second = m_prepare_count;
+        beginTransactionFor(stmt);
+        return stmt;
+    }
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0) != SQLITE_OK)
+    {
+        Log::error("DatabaseWorker", "Error preparing database for query "
+            "%s: %s", query.c_str(), sqlite3_errmsg(m_db));
+        sqlite3_finalize(stmt);
+        return NULL;
+    }
+    if (m_statements.size() >= MAX_CACHED_STATEMENTS)
+        evictStatement();
+    m_statements[query] = std::make_pair(stmt, m_prepare_count);
+    beginTransactionFor(stmt);
+    return stmt;
+}   // prepare
+
+// ----------------------------------------------------------------------------
+/** Finalizes the least recently used cached statement which is not running
+ *  (a caller may still be stepping through the rows of a statement while
+ *  preparing another one). If all are running, the cache grows instead.
+ */
+void DatabaseWorker::evictStatement()
+{
+    auto lru = m_statements.end();
+    for (auto it = m_statements.begin(); it != m_statements.end(); it++)
+    {
+        if (sqlite3_stmt_busy(it->second.first))
+            continue;
+        if (lru == m_statements.end() || it->second.second < lru->second.second)
+            lru = it;
+    }
+    if (lru == m_statements.end())
+        return;
+    sqlite3_finalize(lru->second.first);
+    m_statements.erase(lru);
+}   // evictStatement
+
+// ----------------------------------------------------------------------------
+/** Run simple query with optional function to bind values, this function
+ *  has no callback for the return (if any) by the query (database thread
+ *  only).
+ *  \return True if no error occurs.
+ */
+bool DatabaseWorker::easyQuery(const std::string& query,
+                       std::function<void(sqlite3_stmt* stmt)> bind_function)
+{
+    sqlite3_stmt* stmt = prepare(query);
+    if (!stmt)
+        return false;
+    if (bind_function)
+        bind_function(stmt);
+    int ret = sqlite3_step(stmt);
+    if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+    {
+        Log::error("DatabaseWorker", "Error running easy query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+        sqlite3_reset(stmt);
+        return false;
+    }
+    sqlite3_reset(stmt);
+    return true;
+}   // easyQuery
+
+// ----------------------------------------------------------------------------
+/** Run a query and returns all rows of the first columns as strings
+ *  (database thread only).
+ *  \return If the query succeeded, and the values of each column.
+ */
+std::pair<bool, std::vector<std::vector<std::string> > >
+    DatabaseWorker::vectorQuery(const std::string& query, int columns,
+                       std::function<void(sqlite3_stmt* stmt)> bind_function)
+{
+    std::vector<std::vector<std::string> > ans(columns);
+    sqlite3_stmt* stmt = prepare(query);
+    if (!stmt)
+        return {false, {}};
+    if (bind_function)
+        bind_function(stmt);
+    int ret = sqlite3_step(stmt);
+    while (ret == SQLITE_ROW && sqlite3_column_text(stmt, 0))
+    {
+        for (int i = 0; i < columns; i++)
+        {
+            const char* text = (const char*)sqlite3_column_text(stmt, i);
+            ans[i].push_back(text ? text : "");
+        }
+        ret = sqlite3_step(stmt);
+    }
+    sqlite3_reset(stmt);
+    if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+    {
+        Log::error("DatabaseWorker", "Error running vector query %s: %s",
+            query.c_str(), sqlite3_errmsg(m_db));
+        return {false, {}};
+    }
+    return {true, ans};
+}   // vectorQuery
+
+#endif // ENABLE_SQLITE3
@@ -0,0 +1,131 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_DATABASE_WORKER_HPP
+#define HEADER_DATABASE_WORKER_HPP
+
+#ifdef ENABLE_SQLITE3
+
+#include "utils/no_copy.hpp"
+
+#include <sqlite3.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** A thread doing all the work with the sqlite database of a server, so the
+ *  lobby never waits for disk I/O (or a database locked by another process)
+ *  unless it needs the result right away. Jobs are run in the order they are
+ *  added. All jobs queued at the same time are run in a single transaction,
+ *  so e.g. the result rows of all players of a race are written at once. The
+ *  transaction is only started by the first statement which writes, so
+ *  batches which only read don't open one, and it's rolled back if a job
+ *  fails or it can't be committed.
+ *  Prepared statements are cached by the query string, so queries run often
+ *  should bind their values instead of writing them into the query.
+ */
+class DatabaseWorker : public NoCopy
+{
+private:
+    sqlite3* m_db;
+
+    std::thread m_thread;
+
+    std::mutex m_jobs_mutex;
+
+    std::condition_variable m_jobs_cv;
+
+    std::deque<std::function<void()> > m_jobs;
+
+    bool m_exit;
+
+    std::mutex m_callbacks_mutex;
+
+    /** Callbacks of finished jobs, which are run in handleCallbacks. */
+    std::vector<std::function<void()> > m_callbacks;
+
+    /** Cached prepared statements with the count of prepare calls when each
+     *  was last used, only used in the database thread. */
+    std::map<std::string, std::pair<sqlite3_stmt*, uint64_t> > m_statements;
+
+    /** Number of prepare calls, to find the least recently used statement. */
+    uint64_t m_prepare_count;
+
+    // ------------------------------------------------------------------------
+    void mainLoop();
+    // ------------------------------------------------------------------------
+    bool exec(const char* query);
+    // ------------------------------------------------------------------------
+    void beginTransactionFor(sqlite3_stmt* stmt);
+    // ------------------------------------------------------------------------
+    void endTransaction(bool failed);
+    // ------------------------------------------------------------------------
+    void evictStatement();
+
+public:
+    DatabaseWorker(sqlite3* db);
+    // ------------------------------------------------------------------------
+    ~DatabaseWorker();
+    // ------------------------------------------------------------------------
+    void addJob(std::function<void()> job,
+                std::function<void()> callback = nullptr);
+    // ------------------------------------------------------------------------
+    void handleCallbacks();
+    // ------------------------------------------------------------------------
+    /** True if called in the database thread. */
+    bool isWorkerThread() const
+                     { return std::this_thread::get_id() == m_thread.get_id(); }
+    // ------------------------------------------------------------------------
+    /** Runs job in the database thread after all jobs added before, and
+     *  waits for its result. If called from a job it's run directly. */
+    template<typename T> T waitFor(std::function<T()> job)
+    {
+        if (isWorkerThread())
+            return job();
+        auto task = std::make_shared<std::packaged_task<T()> >(job);
+        std::future<T> result = task->get_future();
+        addJob([task]() { (*task)(); });
+        return result.get();
+    }   // waitFor
+    // ------------------------------------------------------------------------
+    sqlite3_stmt* prepare(const std::string& query);
+    // ------------------------------------------------------------------------
+    bool easyQuery(const std::string& query,
+        std::function<void(sqlite3_stmt* stmt)> bind_function = nullptr);
+    // ------------------------------------------------------------------------
+    std::pair<bool, std::vector<std::vector<std::string> > >
+        vectorQuery(const std::string& query, int columns,
+        std::function<void(sqlite3_stmt* stmt)> bind_function = nullptr);
+    // ------------------------------------------------------------------------
+    sqlite3* getDB() const                                   { return m_db; }
+
+};   // DatabaseWorker
+
+#endif // ENABLE_SQLITE3
+
+#endif
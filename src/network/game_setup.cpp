@@ -64,13 +64,8 @@ void GameSetup::loadWorld()
     if (RaceManager::get()->isSoccerMode() ||
         RaceManager::get()->isBattleMode())
     {
-        const bool is_ctf = RaceManager::get()->getMinorMode() ==
-            RaceManager::MINOR_MODE_CAPTURE_THE_FLAG;
         bool prev_val = UserConfigParams::m_random_arena_item;
-        if (is_ctf)
-            UserConfigParams::m_random_arena_item = false;
-        else
-            UserConfigParams::m_random_arena_item = m_reverse;
+        UserConfigParams::m_random_arena_item = hasRandomArenaItems();
 
         RaceManager::get()->setReverseTrack(false);
         if (RaceManager::get()->isSoccerMode())
@@ -97,6 +92,19 @@ void GameSetup::loadWorld()
     }
 }   // loadWorld
 
+//-----------------------------------------------------------------------------
+/** Returns if the items of the current arena are placed randomly, for
+ *  battle and soccer the reverse setting of the vote is used for it.
+ */
+bool GameSetup::hasRandomArenaItems() const
+{
+    if (!RaceManager::get()->isSoccerMode() &&
+        !RaceManager::get()->isBattleMode())
+        return false;
+    return RaceManager::get()->getMinorMode() !=
+        RaceManager::MINOR_MODE_CAPTURE_THE_FLAG && m_reverse;
+}   // hasRandomArenaItems
+
 //-----------------------------------------------------------------------------
 void GameSetup::addServerInfo(NetworkString* ns)
 {
@@ -95,6 +95,8 @@ public:
     // ------------------------------------------------------------------------
     void loadWorld();
     // ------------------------------------------------------------------------
+    bool hasRandomArenaItems() const;
+    // ------------------------------------------------------------------------
     bool isGrandPrix() const                 { return m_is_grand_prix.load(); }
     // ------------------------------------------------------------------------
     bool hasExtraSeverInfo() const        { return m_extra_server_info != -1; }
@@ -0,0 +1,819 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/load_generator.hpp"
+
+#include "config/stk_config.hpp"
+#include "input/input.hpp"
+#include "karts/kart_properties_manager.hpp"
+#include "network/event.hpp"
+#include "network/network_string.hpp"
+#include "network/protocols/game_protocol.hpp"
+#include "network/protocols/lobby_protocol.hpp"
+#include "network/remote_kart_info.hpp"
+#include "network/server_config.hpp"
+#include "network/socket_address.hpp"
+#include "network/stk_ipv6.hpp"
+#include "tracks/track_manager.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/time.hpp"
+#include "utils/vs.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+LoadGenerator* LoadGenerator::m_load_generator = NULL;
+
+// ----------------------------------------------------------------------------
+LoadGenerator* LoadGenerator::create(const Settings& settings)
+{
+    assert(!m_load_generator);
+    m_load_generator = new LoadGenerator(settings);
+    return m_load_generator;
+}   // create
+
+// ----------------------------------------------------------------------------
+void LoadGenerator::destroy()
+{
+    delete m_load_generator;
+    m_load_generator = NULL;
+}   // destroy
+
+// ----------------------------------------------------------------------------
+LoadGenerator::LoadGenerator(const Settings& settings)
+              : m_settings(settings), m_random(42)
+{
+    m_server_address = {};
+    m_physics_fps = stk_config->getPhysicsFPS();
+    m_server_version = 0;
+    m_stop.store(false);
+    m_finished.store(false);
+    m_start_time = m_end_time = 0;
+    m_dropped_received = 0;
+
+    m_clients.resize(m_settings.m_num_clients);
+    for (unsigned int i = 0; i < m_clients.size(); i++)
+    {
+        SimulatedClient& c = m_clients[i];
+        c.m_index = i;
+        c.m_host = NULL;
+        c.m_peer = NULL;
+        c.m_state = CS_DISCONNECTED;
+        c.m_latency = m_settings.m_min_latency;
+        if (m_clients.size() > 1)
+        {
+            c.m_latency += (m_settings.m_max_latency -
+                m_settings.m_min_latency) * (int)i /
+                (int)(m_clients.size() - 1);
+        }
+        // Don't let all clients connect at the same time
+        c.m_reconnect_time = i * 50;
+        c.m_host_id = 0;
+        c.m_kart_id = -1;
+        c.m_last_state_ticks = -1;
+        c.m_last_state_time = 0;
+        c.m_steer_l = c.m_steer_r = 0;
+        c.m_next_input_time = 0;
+        c.m_input_step = 0;
+        c.m_bytes_sent = c.m_bytes_received = 0;
+        c.m_races = 0;
+        c.m_states = c.m_missing_baselines = 0;
+        c.m_actions_sent = c.m_remote_actions = c.m_late_actions = 0;
+        c.m_dropped_sent = 0;
+    }
+}   // LoadGenerator
+
+// ----------------------------------------------------------------------------
+LoadGenerator::~LoadGenerator()
+{
+    stop();
+}   // ~LoadGenerator
+
+// ----------------------------------------------------------------------------
+/** Changes the server config so the races start as soon as all simulated
+ *  clients are connected, must be called before the server lobby is created.
+ */
+void LoadGenerator::configServer(const Settings& settings)
+{
+    ServerConfig::m_owner_less = true;
+    if (ServerConfig::m_server_max_players < (int)settings.m_num_clients)
+        ServerConfig::m_server_max_players = settings.m_num_clients;
+    ServerConfig::m_min_start_game_players = settings.m_num_clients;
+    ServerConfig::m_start_game_counter = 3.0f;
+    ServerConfig::m_voting_timeout = 5.0f;
+}   // configServer
+
+// ----------------------------------------------------------------------------
+bool LoadGenerator::parseInputPattern(const std::string& name,
+                                      InputPattern* ip)
+{
+    if (name == "idle")
+        *ip = IP_IDLE;
+    else if (name == "accelerate")
+        *ip = IP_ACCELERATE;
+    else if (name == "zigzag")
+        *ip = IP_ZIGZAG;
+    else if (name == "random")
+        *ip = IP_RANDOM;
+    else
+        return false;
+    return true;
+}   // parseInputPattern
+
+// ----------------------------------------------------------------------------
+/** Parses a latency in ms, or a range of latencies like "20-150".
+ */
+bool LoadGenerator::parseLatency(const std::string& s, int* min_latency,
+                                 int* max_latency)
+{
+    std::vector<std::string> range = StringUtils::split(s, '-');
+    if (range.empty() || range.size() > 2)
+        return false;
+    int latency[2];
+    for (unsigned int i = 0; i < range.size(); i++)
+    {
+        if (range[i].empty() ||
+            range[i].find_first_not_of("0123456789") != std::string::npos ||
+            !StringUtils::fromString(range[i], latency[i]))
+            return false;
+    }
+    if (range.size() == 1)
+        latency[1] = latency[0];
+    if (latency[0] > latency[1])
+        return false;
+    *min_latency = latency[0];
+    *max_latency = latency[1];
+    return true;
+}   // parseLatency
+
+// ----------------------------------------------------------------------------
+/** Returns the value at a percentile (nearest rank), or 0 if there is no
+ *  value. The values are reordered.
+ *  \param percentile From 0 to 100.
+ */
+uint32_t LoadGenerator::getPercentile(std::vector<uint32_t>* values,
+                                      float percentile)
+{
+    if (values->empty())
+        return 0;
+    int rank = (int)std::ceil(percentile / 100.0f * values->size()) - 1;
+    rank = std::max(0, std::min(rank, (int)values->size() - 1));
+    std::nth_element(values->begin(), values->begin() + rank, values->end());
+    return (*values)[rank];
+}   // getPercentile
+
+// ----------------------------------------------------------------------------
+/** Starts the simulated clients.
+ *  \param server_port The port of the server in this process.
+ */
+void LoadGenerator::start(uint16_t server_port)
+{
+    SocketAddress addr("127.0.0.1", server_port);
+    addr.convertForIPv6Socket(isIPv6Socket());
+    m_server_address = addr.toENetAddress();
+    m_password = ServerConfig::m_private_server_password;
+    m_server_version = ServerConfig::m_server_version;
+    m_capabilities = stk_config->m_network_capabilities;
+    m_karts = kart_properties_manager->getAllAvailableKarts();
+    m_tracks = track_manager->getAllTrackIdentifiers();
+    if (m_karts.size() >= 65536)
+        m_karts.resize(65535);
+    if (m_tracks.size() >= 65536)
+        m_tracks.resize(65535);
+    Log::info("LoadGenerator", "Starting %d simulated clients for %.1f "
+        "seconds.", m_settings.m_num_clients, m_settings.m_duration);
+    m_thread = std::thread(std::bind(&LoadGenerator::run, this));
+}   // start
+
+// ----------------------------------------------------------------------------
+void LoadGenerator::stop()
+{
+    m_stop.store(true);
+    if (m_thread.joinable())
+        m_thread.join();
+}   // stop
+
+// ----------------------------------------------------------------------------
+/** The load test thread, it updates all clients until the test duration is
+ *  over.
+ */
+void LoadGenerator::run()
+{
+    VS::setThreadName("LoadGenerator");
+    m_start_time = StkTime::getMonoTimeMs();
+    const uint64_t end_time = m_start_time +
+        (uint64_t)(m_settings.m_duration * 1000.0f);
+    uint64_t now = m_start_time;
+    while (!m_stop.load() && now < end_time)
+    {
+        for (SimulatedClient& c : m_clients)
+            updateClient(&c, now - m_start_time);
+        StkTime::sleep(1);
+        now = StkTime::getMonoTimeMs();
+    }
+    m_end_time = now;
+
+    for (SimulatedClient& c : m_clients)
+    {
+        if (!c.m_host)
+            continue;
+        if (c.m_peer)
+            enet_peer_disconnect_now(c.m_peer, 0);
+        c.m_bytes_sent += c.m_host->totalSentData;
+        c.m_bytes_received += c.m_host->totalReceivedData;
+        enet_host_destroy(c.m_host);
+        c.m_host = NULL;
+        c.m_peer = NULL;
+    }
+    m_finished.store(true);
+}   // run
+
+// ----------------------------------------------------------------------------
+/** Drops received datagrams of the simulated clients to emulate packet loss,
+ *  called by ENet in the load test thread.
+ */
+int LoadGenerator::interceptDatagram(ENetHost* host, ENetEvent* event)
+{
+    LoadGenerator* lg = m_load_generator;
+    if (!lg || lg->m_settings.m_packet_loss <= 0.0f)
+        return 0;
+    std::uniform_real_distribution<float> percent(0.0f, 100.0f);
+    if (percent(lg->m_random) >= lg->m_settings.m_packet_loss)
+        return 0;
+    lg->m_dropped_received++;
+    return 1;
+}   // interceptDatagram
+
+// ----------------------------------------------------------------------------
+/** Handles the network events, the delayed packets and the input of a
+ *  client.
+ *  \param now Time since the start of the test in ms.
+ */
+void LoadGenerator::updateClient(SimulatedClient* c, uint64_t now)
+{
+    if (!c->m_host)
+    {
+        ENetAddress any = {};
+        c->m_host = enet_host_create(&any, 1, EVENT_CHANNEL_COUNT, 0, 0);
+        if (!c->m_host)
+        {
+            Log::error("LoadGenerator", "Failed to create socket of client "
+                "%d.", c->m_index);
+            m_stop.store(true);
+            return;
+        }
+        c->m_host->intercept = interceptDatagram;
+    }
+    if (c->m_state == CS_DISCONNECTED && now >= c->m_reconnect_time)
+        connect(c, now);
+
+    ENetEvent event;
+    while (enet_host_service(c->m_host, &event, 0) > 0)
+    {
+        switch (event.type)
+        {
+        case ENET_EVENT_TYPE_CONNECT:
+            sendConnectionRequest(c, now);
+            break;
+        case ENET_EVENT_TYPE_RECEIVE:
+        {
+            DelayedPacket p;
+            p.m_time = now + c->m_latency;
+            p.m_reliable = false;
+            p.m_data.assign(event.packet->data,
+                event.packet->data + event.packet->dataLength);
+            c->m_incoming.push_back(std::move(p));
+            enet_packet_destroy(event.packet);
+            break;
+        }
+        case ENET_EVENT_TYPE_DISCONNECT:
+            Log::warn("LoadGenerator", "Client %d disconnected.", c->m_index);
+            disconnected(c, now, 2000);
+            break;
+        default:
+            break;
+        }
+    }
+
+    while (!c->m_incoming.empty() && c->m_incoming.front().m_time <= now)
+    {
+        std::vector<uint8_t> data = std::move(c->m_incoming.front().m_data);
+        c->m_incoming.pop_front();
+        try
+        {
+            handlePacket(c, data, now);
+        }
+        catch (std::exception& e)
+        {
+            Log::warn("LoadGenerator", "Client %d received an invalid "
+                "packet: %s", c->m_index, e.what());
+        }
+    }
+
+    if (c->m_state == CS_RACING)
+        updateInput(c, now);
+
+    while (!c->m_outgoing.empty() && c->m_outgoing.front().m_time <= now)
+    {
+        const DelayedPacket& p = c->m_outgoing.front();
+        if (c->m_peer)
+        {
+            ENetPacket* packet = enet_packet_create(p.m_data.data(),
+                p.m_data.size(), p.m_reliable ? ENET_PACKET_FLAG_RELIABLE :
+                (ENET_PACKET_FLAG_UNSEQUENCED |
+                ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT));
+            if (enet_peer_send(c->m_peer, EVENT_CHANNEL_NORMAL, packet) < 0)
+                enet_packet_destroy(packet);
+        }
+        c->m_outgoing.pop_front();
+    }
+    enet_host_flush(c->m_host);
+
+    // The ENet counters are 32bit, so they are moved to the client
+    c->m_bytes_sent += c->m_host->totalSentData;
+    c->m_bytes_received += c->m_host->totalReceivedData;
+    c->m_host->totalSentData = 0;
+    c->m_host->totalReceivedData = 0;
+}   // updateClient
+
+// ----------------------------------------------------------------------------
+void LoadGenerator::connect(SimulatedClient* c, uint64_t now)
+{
+    c->m_peer = enet_host_connect(c->m_host, &m_server_address,
+        EVENT_CHANNEL_COUNT, 0);
+    if (!c->m_peer)
+    {
+        c->m_reconnect_time = now + 2000;
+        return;
+    }
+    c->m_state = CS_CONNECTING;
+}   // connect
+
+// ----------------------------------------------------------------------------
+/** Called when the server disconnected or refused a client, it connects
+ *  again after delay ms.
+ */
+void LoadGenerator::disconnected(SimulatedClient* c, uint64_t now,
+                                 uint64_t delay)
+{
+    c->m_peer = NULL;
+    c->m_state = CS_DISCONNECTED;
+    c->m_reconnect_time = now + delay;
+    c->m_kart_id = -1;
+    c->m_incoming.clear();
+    c->m_outgoing.clear();
+    c->m_states_history.clear();
+}   // disconnected
+
+// ----------------------------------------------------------------------------
+/** Sends a packet after the latency of the client. Unreliable packets can
+ *  be lost.
+ */
+void LoadGenerator::sendPacket(SimulatedClient* c, const NetworkString& ns,
+                               bool reliable, uint64_t now)
+{
+    if (!reliable && m_settings.m_packet_loss > 0.0f)
+    {
+        std::uniform_real_distribution<float> percent(0.0f, 100.0f);
+        if (percent(m_random) < m_settings.m_packet_loss)
+        {
+            c->m_dropped_sent++;
+            return;
+        }
+    }
+    DelayedPacket p;
+    p.m_time = now + c->m_latency;
+    p.m_reliable = reliable;
+    p.m_data.assign((const uint8_t*)ns.getData(),
+        (const uint8_t*)ns.getData() + ns.getTotalSize());
+    c->m_outgoing.push_back(std::move(p));
+}   // sendPacket
+
+// ----------------------------------------------------------------------------
+/** Sends the same connection request as a client in a LAN game, with one
+ *  player and all karts and tracks of this process.
+ */
+void LoadGenerator::sendConnectionRequest(SimulatedClient* c, uint64_t now)
+{
+    NetworkString ns(PROTOCOL_LOBBY_ROOM);
+    ns.addUInt8(LobbyProtocol::LE_CONNECTION_REQUESTED)
+        .addUInt32(m_server_version).encodeString(std::string("LoadTest"))
+        .addUInt16((uint16_t)m_capabilities.size());
+    for (const std::string& cap : m_capabilities)
+        ns.encodeString(cap);
+    ns.addUInt16((uint16_t)m_karts.size())
+        .addUInt16((uint16_t)m_tracks.size());
+    for (const std::string& kart : m_karts)
+        ns.encodeString(kart);
+    for (const std::string& track : m_tracks)
+        ns.encodeString(track);
+    // One player, no online id and no encryption
+    ns.addUInt8(1).addUInt32(0).addUInt32(0);
+    core::stringw name = StringUtils::utf8ToWide(
+        StringUtils::insertValues("Load test %d", c->m_index + 1));
+    ns.encodeString(m_password).addUInt8(1);
+    ns.encodeString(name).addFloat(0.0f).addUInt8(HANDICAP_NONE);
+    sendPacket(c, ns, /*reliable*/true, now);
+}   // sendConnectionRequest
+
+// ----------------------------------------------------------------------------
+void LoadGenerator::handlePacket(SimulatedClient* c,
+                                 const std::vector<uint8_t>& data,
+                                 uint64_t now)
+{
+    // Ping packets start with 255, which is no protocol type
+    if (data.size() < 2 || data[0] == 255)
+        return;
+    NetworkString ns(data.data(), (int)data.size());
+    if (ns.getProtocolType() == PROTOCOL_LOBBY_ROOM)
+        handleLobbyMessage(c, ns, now);
+    else if (ns.getProtocolType() == PROTOCOL_CONTROLLER_EVENTS)
+        handleGameMessage(c, ns, now);
+}   // handlePacket
+
+// ----------------------------------------------------------------------------
+void LoadGenerator::handleLobbyMessage(SimulatedClient* c, NetworkString& ns,
+                                       uint64_t now)
+{
+    switch (ns.getUInt8())
+    {
+    case LobbyProtocol::LE_CONNECTION_ACCEPTED:
+        c->m_host_id = ns.getUInt32();
+        c->m_state = CS_LOBBY;
+        Log::info("LoadGenerator", "Client %d connected with host id %d.",
+            c->m_index, c->m_host_id);
+        break;
+    case LobbyProtocol::LE_CONNECTION_REFUSED:
+    {
+        // The server is busy with a race, try again later
+        Log::info("LoadGenerator", "Client %d refused, reason %d.",
+            c->m_index, ns.getUInt8());
+        if (c->m_peer)
+            enet_peer_reset(c->m_peer);
+        disconnected(c, now, 5000);
+        break;
+    }
+    case LobbyProtocol::LE_LOAD_WORLD:
+    {
+        // Winner peer and vote
+        ns.getUInt32();
+        core::stringw name;
+        std::string s;
+        ns.decodeStringW(&name);
+        ns.decodeString(&s);
+        ns.skip(2/*laps and reverse*/ + 1/*live join*/);
+        c->m_kart_id = -1;
+        unsigned int player_count = ns.getUInt8();
+        for (unsigned int i = 0; i < player_count; i++)
+        {
+            ns.decodeStringW(&name);
+            uint32_t host_id = ns.getUInt32();
+            // Color, online id, handicap, local id and team
+            ns.skip(4 + 4 + 1 + 1 + 1);
+            ns.decodeString(&s);
+            ns.decodeString(&s);
+            if (host_id == c->m_host_id && c->m_kart_id == -1)
+                c->m_kart_id = i;
+        }
+        c->m_states_history.clear();
+        c->m_last_state_ticks = -1;
+        c->m_state = CS_WORLD_LOADED;
+        NetworkString loaded(PROTOCOL_LOBBY_ROOM);
+        loaded.addUInt8(LobbyProtocol::LE_CLIENT_LOADED_WORLD);
+        sendPacket(c, loaded, /*reliable*/true, now);
+        break;
+    }
+    case LobbyProtocol::LE_START_RACE:
+        c->m_state = CS_RACING;
+        c->m_steer_l = c->m_steer_r = 0;
+        c->m_next_input_time = now;
+        c->m_input_step = 0;
+        break;
+    case LobbyProtocol::LE_RACE_FINISHED:
+    {
+        c->m_races++;
+        c->m_state = CS_LOBBY;
+        NetworkString ack(PROTOCOL_LOBBY_ROOM);
+        ack.setSynchronous(true);
+        ack.addUInt8(LobbyProtocol::LE_RACE_FINISHED_ACK);
+        sendPacket(c, ack, /*reliable*/true, now);
+        break;
+    }
+    case LobbyProtocol::LE_BACK_LOBBY:
+        c->m_state = CS_LOBBY;
+        break;
+    default:
+        break;
+    }
+}   // handleLobbyMessage
+
+// ----------------------------------------------------------------------------
+/** Handles the states and the actions of other karts. A real client rewinds
+ *  for each state, and for each action older than its own world ticks.
+ */
+void LoadGenerator::handleGameMessage(SimulatedClient* c, NetworkString& ns,
+                                      uint64_t now)
+{
+    const unsigned int packet_size = ns.getTotalSize();
+    switch (ns.getUInt8())
+    {
+    case GameProtocol::GP_CONTROLLER_ACTION:
+    {
+        const int client_ticks = getClientTicks(c, now);
+        unsigned int count = ns.getUInt8();
+        for (unsigned int i = 0; i < count; i++)
+        {
+            int ticks = ns.getUInt32();
+            // Kart id, compressed action
+            ns.skip(1 + 1 + 2 + 2 + 2);
+            c->m_remote_actions++;
+            if (client_ticks != -1 && ticks < client_ticks)
+                c->m_late_actions++;
+        }
+        break;
+    }
+    case GameProtocol::GP_STATE:
+        c->m_states++;
+        m_state_sizes.push_back(packet_size);
+        c->m_last_state_ticks = ns.getUInt32();
+        c->m_last_state_time = now;
+        break;
+    case GameProtocol::GP_DELTA_STATE:
+    {
+        c->m_states++;
+        m_state_sizes.push_back(packet_size);
+        int ticks = ns.getUInt32();
+        int baseline_ticks = (int)ns.getUInt32();
+        c->m_last_state_ticks = ticks;
+        c->m_last_state_time = now;
+
+        const StateDelta::Snapshot* baseline = NULL;
+        if (baseline_ticks != -1)
+        {
+            for (const StateDelta::Snapshot& s : c->m_states_history)
+            {
+                if (s.m_ticks == baseline_ticks)
+                {
+                    baseline = &s;
+                    break;
+                }
+            }
+            if (!baseline)
+            {
+                c->m_missing_baselines++;
+                NetworkString nack(PROTOCOL_CONTROLLER_EVENTS);
+                nack.addUInt8(GameProtocol::GP_STATE_NACK)
+                    .addUInt32(baseline_ticks);
+                sendPacket(c, nack, /*reliable*/true, now);
+                return;
+            }
+        }
+        StateDelta::Snapshot snapshot;
+        snapshot.m_ticks = ticks;
+        StateDelta::decodeSnapshot(baseline, ns, &snapshot);
+        c->m_states_history.push_back(std::move(snapshot));
+        while (c->m_states_history.front().m_ticks < ticks - 2 * m_physics_fps)
+            c->m_states_history.pop_front();
+
+        NetworkString ack(PROTOCOL_CONTROLLER_EVENTS);
+        ack.addUInt8(GameProtocol::GP_STATE_ACK).addUInt32(ticks);
+        sendPacket(c, ack, /*reliable*/false, now);
+        break;
+    }
+    default:
+        break;
+    }
+}   // handleGameMessage
+
+// ----------------------------------------------------------------------------
+/** Estimates the world ticks of a real client, which is ahead of the server
+ *  by the round trip time so its actions arrive in time. Returns -1 if no
+ *  state was received yet.
+ */
+int LoadGenerator::getClientTicks(const SimulatedClient* c,
+                                  uint64_t now) const
+{
+    if (c->m_last_state_ticks == -1 || !c->m_peer)
+        return -1;
+    uint64_t ahead = now - c->m_last_state_time +
+        c->m_peer->roundTripTime + 2 * c->m_latency;
+    return c->m_last_state_ticks + (int)(ahead * m_physics_fps / 1000);
+}   // getClientTicks
+
+// ----------------------------------------------------------------------------
+/** Sends the actions of the input pattern which are due.
+ */
+void LoadGenerator::updateInput(SimulatedClient* c, uint64_t now)
+{
+    if (m_settings.m_input == IP_IDLE || c->m_kart_id == -1 ||
+        now < c->m_next_input_time)
+        return;
+    const int ticks = getClientTicks(c, now);
+    if (ticks == -1)
+        return;
+
+    const int max_value = Input::MAX_VALUE;
+    std::vector<std::pair<int, int> > actions;
+    if (c->m_input_step == 0)
+        actions.emplace_back(PA_ACCEL, max_value);
+    switch (m_settings.m_input)
+    {
+    case IP_ACCELERATE:
+        c->m_next_input_time = std::numeric_limits<uint64_t>::max();
+        break;
+    case IP_ZIGZAG:
+        if (c->m_input_step > 0)
+        {
+            bool left = c->m_input_step % 2 == 1;
+            actions.emplace_back(left ? PA_STEER_RIGHT : PA_STEER_LEFT, 0);
+            actions.emplace_back(left ? PA_STEER_LEFT : PA_STEER_RIGHT,
+                max_value);
+        }
+        c->m_next_input_time = now + 1000;
+        break;
+    case IP_RANDOM:
+    {
+        if (c->m_input_step > 0)
+        {
+            std::uniform_int_distribution<int> action(0, 3);
+            std::uniform_int_distribution<int> value(-max_value, max_value);
+            switch (action(m_random))
+            {
+            case 0:
+            {
+                int steer = value(m_random);
+                actions.emplace_back(steer < 0 ? PA_STEER_RIGHT :
+                    PA_STEER_LEFT, 0);
+                actions.emplace_back(steer < 0 ? PA_STEER_LEFT :
+                    PA_STEER_RIGHT, std::abs(steer));
+                break;
+            }
+            case 1:
+                actions.emplace_back(PA_NITRO, c->m_input_step % 2 ?
+                    max_value : 0);
+                break;
+            case 2:
+                actions.emplace_back(PA_DRIFT, c->m_input_step % 2 ?
+                    max_value : 0);
+                break;
+            default:
+                actions.emplace_back(PA_FIRE, max_value);
+                actions.emplace_back(PA_FIRE, 0);
+                break;
+            }
+        }
+        std::uniform_int_distribution<int> delay(200, 1000);
+        c->m_next_input_time = now + delay(m_random);
+        break;
+    }
+    default:
+        break;
+    }
+    c->m_input_step++;
+    if (actions.empty())
+        return;
+
+    NetworkString ns(PROTOCOL_CONTROLLER_EVENTS);
+    ns.addUInt8(GameProtocol::GP_CONTROLLER_ACTION)
+        .addUInt8((uint8_t)actions.size());
+    for (auto& a : actions)
+    {
+        ns.addUInt32(ticks);
+        addAction(c, a.first, a.second, &ns);
+    }
+    c->m_actions_sent += (unsigned int)actions.size();
+    sendPacket(c, ns, /*reliable*/true, now);
+}   // updateInput
+
+// ----------------------------------------------------------------------------
+/** Writes an action in the compressed format of GameProtocol, with the
+ *  steering values kept like a PlayerController does.
+ */
+void LoadGenerator::addAction(SimulatedClient* c, int action, int value,
+                              NetworkString* ns)
+{
+    if (action == PA_STEER_LEFT)
+        c->m_steer_l = value;
+    else if (action == PA_STEER_RIGHT)
+        c->m_steer_r = -value;
+    uint8_t w = (uint8_t)(action & 63) | (c->m_steer_l > 0 ? 64 : 0) |
+        (c->m_steer_r > 0 ? 128 : 0);
+    ns->addUInt8((uint8_t)c->m_kart_id).addUInt8(w).addUInt16((uint16_t)value)
+        .addUInt16((uint16_t)std::abs(c->m_steer_l))
+        .addUInt16((uint16_t)std::abs(c->m_steer_r));
+}   // addAction
+
+// ----------------------------------------------------------------------------
+/** Prints the results of the load test, must be called after stop().
+ */
+void LoadGenerator::report()
+{
+    static const char* input_names[] =
+        { "idle", "accelerate", "zigzag", "random" };
+    const float seconds = std::max(m_end_time - m_start_time,
+        (uint64_t)1) / 1000.0f;
+    Log::info("LoadGenerator", "%d clients, input %s, latency %d-%d ms, "
+        "packet loss %.1f%%, %.1f seconds.", m_settings.m_num_clients,
+        input_names[m_settings.m_input], m_settings.m_min_latency,
+        m_settings.m_max_latency, m_settings.m_packet_loss, seconds);
+
+    Log::info("LoadGenerator", "Server ticks: %d, 50%% %dus, 90%% %dus, "
+        "99%% %dus, max %dus.", (int)m_server_ticks.size(),
+        getPercentile(&m_server_ticks, 50.0f),
+        getPercentile(&m_server_ticks, 90.0f),
+        getPercentile(&m_server_ticks, 99.0f),
+        getPercentile(&m_server_ticks, 100.0f));
+
+    uint64_t state_bytes = 0;
+    for (uint32_t size : m_state_sizes)
+        state_bytes += size;
+    Log::info("LoadGenerator", "State packets: %d, average %d bytes, "
+        "50%% %d, 99%% %d, max %d.", (int)m_state_sizes.size(),
+        m_state_sizes.empty() ? 0 : (int)(state_bytes / m_state_sizes.size()),
+        getPercentile(&m_state_sizes, 50.0f),
+        getPercentile(&m_state_sizes, 99.0f),
+        getPercentile(&m_state_sizes, 100.0f));
+
+    uint64_t total_sent = 0, total_received = 0;
+    unsigned int total_rewinds = 0, dropped_sent = 0;
+    for (const SimulatedClient& c : m_clients)
+    {
+        const unsigned int rewinds = c.m_states + c.m_late_actions;
+        Log::info("LoadGenerator", "Client %d: latency %dms, %d races, "
+            "%d states (%d missing baseline), %d actions sent, %d rewinds "
+            "(%d late actions of %d), up %.2f KB/s, down %.2f KB/s.",
+            c.m_index, c.m_latency, c.m_races, c.m_states,
+            c.m_missing_baselines, c.m_actions_sent, rewinds,
+            c.m_late_actions, c.m_remote_actions,
+            c.m_bytes_sent / 1024.0f / seconds,
+            c.m_bytes_received / 1024.0f / seconds);
+        total_sent += c.m_bytes_sent;
+        total_received += c.m_bytes_received;
+        total_rewinds += rewinds;
+        dropped_sent += c.m_dropped_sent;
+    }
+    const unsigned int n = std::max(m_settings.m_num_clients, 1u);
+    Log::info("LoadGenerator", "Average per client: %.1f rewinds, "
+        "up %.2f KB/s, down %.2f KB/s. Dropped %d received datagrams and "
+        "%d unreliable packets sent.", (float)total_rewinds / n,
+        total_sent / 1024.0f / seconds / n,
+        total_received / 1024.0f / seconds / n, m_dropped_received,
+        dropped_sent);
+}   // report
+
+// ----------------------------------------------------------------------------
+void LoadGenerator::unitTesting()
+{
+    InputPattern ip = IP_IDLE;
+    (void)ip;
+    assert(parseInputPattern("zigzag", &ip) && ip == IP_ZIGZAG);
+    assert(parseInputPattern("random", &ip) && ip == IP_RANDOM);
+    assert(!parseInputPattern("fast", &ip) && ip == IP_RANDOM);
+
+    int min_latency = -1, max_latency = -1;
+    (void)min_latency;
+    (void)max_latency;
+    assert(parseLatency("50", &min_latency, &max_latency));
+    assert(min_latency == 50 && max_latency == 50);
+    assert(parseLatency("20-150", &min_latency, &max_latency));
+    assert(min_latency == 20 && max_latency == 150);
+    assert(!parseLatency("150-20", &min_latency, &max_latency));
+    assert(!parseLatency("-20", &min_latency, &max_latency));
+    assert(!parseLatency("x", &min_latency, &max_latency));
+    assert(!parseLatency("1-2-3", &min_latency, &max_latency));
+    assert(min_latency == 20 && max_latency == 150);
+
+    std::vector<uint32_t> values;
+    assert(getPercentile(&values, 50.0f) == 0);
+    for (uint32_t i = 100; i > 0; i--)
+        values.push_back(i);
+    std::shuffle(values.begin(), values.end(), std::mt19937(1));
+    assert(getPercentile(&values, 0.0f) == 1);
+    assert(getPercentile(&values, 50.0f) == 50);
+    assert(getPercentile(&values, 99.0f) == 99);
+    assert(getPercentile(&values, 99.5f) == 100);
+    assert(getPercentile(&values, 100.0f) == 100);
+    values.resize(1);
+    assert(getPercentile(&values, 99.0f) == values[0]);
+}   // unitTesting
@@ -0,0 +1,235 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_LOAD_GENERATOR_HPP
+#define HEADER_LOAD_GENERATOR_HPP
+
+#include "network/state_delta.hpp"
+#include "utils/no_copy.hpp"
+
+#include <enet/enet.h>
+
+#include <atomic>
+#include <deque>
+#include <random>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+class NetworkString;
+
+/** Load test of a local server: a thread runs a number of lightweight
+ *  simulated clients, each with its own ENet host, which join the server of
+ *  this process and play its races with a fixed input pattern. They speak
+ *  the network protocol without loading the world or simulating physics:
+ *  actions are sent with the estimated client ticks, and states are decoded
+ *  and acknowledged like a real client does. Each client has an artificial
+ *  one-way latency applied to the packets it sends and receives, and drops
+ *  a percentage of the received datagrams and the unreliable packets it
+ *  sends. At the end the duration of the server ticks, the size of the state
+ *  packets, the rewinds the clients would have done and the bandwidth of
+ *  each client are reported.
+ * \ingroup network
+ */
+class LoadGenerator : public NoCopy
+{
+public:
+    /** The actions a simulated client sends during a race. */
+    enum InputPattern
+    {
+        IP_IDLE,         //!< No action at all.
+        IP_ACCELERATE,   //!< Full acceleration.
+        IP_ZIGZAG,       //!< Full acceleration, steering left and right.
+        IP_RANDOM        //!< Random steering, nitro, drift and fire.
+    };
+
+    struct Settings
+    {
+        unsigned int m_num_clients;
+        InputPattern m_input;
+        /** The one-way latency of the clients in ms, spread evenly between
+         *  the minimum and the maximum. */
+        int m_min_latency, m_max_latency;
+        /** Percentage of packets lost, 0 to 100. */
+        float m_packet_loss;
+        /** Duration of the test in seconds. */
+        float m_duration;
+        Settings()
+        {
+            m_num_clients = 0;
+            m_input = IP_ACCELERATE;
+            m_min_latency = m_max_latency = 0;
+            m_packet_loss = 0.0f;
+            m_duration = 120.0f;
+        }
+    };   // Settings
+
+private:
+    enum ClientState
+    {
+        CS_DISCONNECTED,
+        CS_CONNECTING,
+        CS_LOBBY,
+        CS_WORLD_LOADED,
+        CS_RACING
+    };
+
+    /** A packet held back to emulate latency. */
+    struct DelayedPacket
+    {
+        uint64_t m_time;
+        bool m_reliable;
+        std::vector<uint8_t> m_data;
+    };   // DelayedPacket
+
+    struct SimulatedClient
+    {
+        unsigned int m_index;
+        ENetHost* m_host;
+        ENetPeer* m_peer;
+        ClientState m_state;
+        int m_latency;
+        uint64_t m_reconnect_time;
+        uint32_t m_host_id;
+        int m_kart_id;
+        /** Packets to send and received packets to handle, in time order. */
+        std::deque<DelayedPacket> m_outgoing, m_incoming;
+        /** Received states which can be the baseline of delta states. */
+        std::deque<StateDelta::Snapshot> m_states_history;
+        /** Ticks of the latest state received, and when it was received. */
+        int m_last_state_ticks;
+        uint64_t m_last_state_time;
+        /** Input state, as kept by a PlayerController. */
+        int m_steer_l, m_steer_r;
+        uint64_t m_next_input_time;
+        unsigned int m_input_step;
+        uint64_t m_bytes_sent, m_bytes_received;
+        unsigned int m_races;
+        unsigned int m_states, m_missing_baselines;
+        unsigned int m_actions_sent, m_remote_actions, m_late_actions;
+        unsigned int m_dropped_sent;
+    };   // SimulatedClient
+
+    static LoadGenerator* m_load_generator;
+
+    Settings m_settings;
+
+    ENetAddress m_server_address;
+
+    int m_physics_fps;
+
+    /** Copied in the main thread for the connection requests. */
+    std::string m_password;
+    uint32_t m_server_version;
+    std::set<std::string> m_capabilities;
+    std::vector<std::string> m_karts, m_tracks;
+
+    std::vector<SimulatedClient> m_clients;
+
+    std::thread m_thread;
+
+    std::atomic_bool m_stop, m_finished;
+
+    /** Only used in the load test thread. */
+    std::mt19937 m_random;
+
+    uint64_t m_start_time, m_end_time;
+
+    /** Size of each state packet received by all clients. */
+    std::vector<uint32_t> m_state_sizes;
+
+    /** Received datagrams dropped by all clients. */
+    unsigned int m_dropped_received;
+
+    /** Duration of each server tick during a race in microseconds, main
+     *  thread only. */
+    std::vector<uint32_t> m_server_ticks;
+
+    // ------------------------------------------------------------------------
+    LoadGenerator(const Settings& settings);
+    // ------------------------------------------------------------------------
+    ~LoadGenerator();
+    // ------------------------------------------------------------------------
+    void run();
+    // ------------------------------------------------------------------------
+    void updateClient(SimulatedClient* c, uint64_t now);
+    // ------------------------------------------------------------------------
+    void connect(SimulatedClient* c, uint64_t now);
+    // ------------------------------------------------------------------------
+    void disconnected(SimulatedClient* c, uint64_t now, uint64_t delay);
+    // ------------------------------------------------------------------------
+    void sendPacket(SimulatedClient* c, const NetworkString& ns,
+                    bool reliable, uint64_t now);
+    // ------------------------------------------------------------------------
+    void sendConnectionRequest(SimulatedClient* c, uint64_t now);
+    // ------------------------------------------------------------------------
+    void handlePacket(SimulatedClient* c, const std::vector<uint8_t>& data,
+                      uint64_t now);
+    // ------------------------------------------------------------------------
+    void handleLobbyMessage(SimulatedClient* c, NetworkString& ns,
+                            uint64_t now);
+    // ------------------------------------------------------------------------
+    void handleGameMessage(SimulatedClient* c, NetworkString& ns,
+                           uint64_t now);
+    // ------------------------------------------------------------------------
+    int getClientTicks(const SimulatedClient* c, uint64_t now) const;
+    // ------------------------------------------------------------------------
+    void updateInput(SimulatedClient* c, uint64_t now);
+    // ------------------------------------------------------------------------
+    void addAction(SimulatedClient* c, int action, int value,
+                   NetworkString* ns);
+    // ------------------------------------------------------------------------
+    static int interceptDatagram(ENetHost* host, ENetEvent* event);
+
+public:
+    static LoadGenerator* create(const Settings& settings);
+    // ------------------------------------------------------------------------
+    static void destroy();
+    // ------------------------------------------------------------------------
+    /** Returns the load generator, or NULL if no load test is running. */
+    static LoadGenerator* get()                    { return m_load_generator; }
+    // ------------------------------------------------------------------------
+    static void configServer(const Settings& settings);
+    // ------------------------------------------------------------------------
+    static bool parseInputPattern(const std::string& name, InputPattern* ip);
+    // ------------------------------------------------------------------------
+    static bool parseLatency(const std::string& s, int* min_latency,
+                             int* max_latency);
+    // ------------------------------------------------------------------------
+    static uint32_t getPercentile(std::vector<uint32_t>* values,
+                                  float percentile);
+    // ------------------------------------------------------------------------
+    void start(uint16_t server_port);
+    // ------------------------------------------------------------------------
+    void stop();
+    // ------------------------------------------------------------------------
+    /** Returns if the test duration is over and the clients disconnected. */
+    bool isFinished() const                      { return m_finished.load(); }
+    // ------------------------------------------------------------------------
+    /** Called in the main thread with the duration of a server tick. */
+    void addServerTick(uint32_t us)       { m_server_ticks.push_back(us); }
+    // ------------------------------------------------------------------------
+    void report();
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // LoadGenerator
+
+#endif
@@ -0,0 +1,873 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/match_log.hpp"
+
+#include "config/stk_config.hpp"
+#include "config/user_config.hpp"
+#include "items/item_manager.hpp"
+#include "items/powerup_manager.hpp"
+#include "karts/abstract_kart.hpp"
+#include "main_loop.hpp"
+#include "modes/world.hpp"
+#include "network/network_config.hpp"
+#include "network/network_string.hpp"
+#include "network/protocols/game_protocol.hpp"
+#include "network/rewind_manager.hpp"
+#include "network/server_config.hpp"
+#include "physics/physics.hpp"
+#include "race/race_manager.hpp"
+#include "states_screens/state_manager.hpp"
+#include "utils/constants.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/log.hpp"
+#include "utils/time.hpp"
+
+#include <zlib.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+MatchLog* MatchLog::m_match_log[PT_COUNT];
+
+const unsigned int MatchLog::FORMAT_VERSION;
+const int MatchLog::SAMPLE_INTERVAL;
+
+namespace
+{
+    const char MAGIC[8] = { 'S', 'T', 'K', 'M', 'A', 'T', 'C', 'H' };
+
+    /** Magic, format version, uncompressed and compressed size. */
+    const unsigned int PREAMBLE_SIZE = 20;
+
+    /** Upper limit for the size of a log, to reject corrupted files. */
+    const uint32_t MAX_SIZE = 256 * 1024 * 1024;
+
+    /** Positions in samples are stored in 1/1024 m. */
+    const float POSITION_SCALE = 1024.0f;
+
+    // ------------------------------------------------------------------------
+    int32_t quantize(float f)
+    {
+        float q = std::floor(f * POSITION_SCALE + 0.5f);
+        // Also handles NaN
+        if (!(std::fabs(q) < 2e9f))
+            return 0;
+        return (int32_t)q;
+    }   // quantize
+
+    // ------------------------------------------------------------------------
+    /** FNV-1a hash of the bits of a float. */
+    void hashFloat(uint32_t* hash, float f)
+    {
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            *hash ^= (u >> (8 * i)) & 0xff;
+            *hash *= 16777619u;
+        }
+    }   // hashFloat
+}   // namespace
+
+// ----------------------------------------------------------------------------
+MatchLog* MatchLog::create()
+{
+    ProcessType pt = STKProcess::getType();
+    assert(!m_match_log[pt]);
+    m_match_log[pt] = new MatchLog();
+    return m_match_log[pt];
+}   // create
+
+// ----------------------------------------------------------------------------
+void MatchLog::destroy()
+{
+    ProcessType pt = STKProcess::getType();
+    assert(m_match_log[pt]);
+    delete m_match_log[pt];
+    m_match_log[pt] = NULL;
+}   // destroy
+
+// ----------------------------------------------------------------------------
+MatchLog::MatchLog()
+{
+    m_replaying = false;
+    m_end_ticks = 0;
+    m_last_sample_ticks = -1;
+    m_next_event = m_next_sample = 0;
+    m_compared_samples = m_diverged_samples = 0;
+    m_first_divergence_ticks = m_first_divergence_kart = -1;
+    m_max_error = 0.0f;
+    m_max_error_ticks = m_max_error_kart = -1;
+    m_replay_start_time = 0;
+}   // MatchLog
+
+// ----------------------------------------------------------------------------
+/** Returns the setup of the current network race, called by the server once
+ *  the world is loaded and the random seeds are set.
+ *  \param random_arena_items If the items of an arena were placed randomly.
+ */
+MatchLog::Setup MatchLog::getCurrentSetup(bool random_arena_items)
+{
+    RaceManager* rm = RaceManager::get();
+    World* world = World::getWorld();
+    Setup setup;
+    setup.m_stk_version            = STK_VERSION;
+    setup.m_track_name             = rm->getTrackName();
+    setup.m_minor_mode             = rm->getMinorMode();
+    setup.m_difficulty             = rm->getDifficulty();
+    setup.m_reverse                = rm->getReverseTrack();
+    setup.m_random_arena_items     = random_arena_items;
+    setup.m_num_laps               = rm->modeHasLaps() ? rm->getNumLaps() : -1;
+    setup.m_time_target            = rm->getTimeTarget();
+    setup.m_goal_target            = rm->getMaxGoal();
+    setup.m_hit_capture_limit      = rm->getHitCaptureLimit();
+    setup.m_flag_return_ticks      = rm->getFlagReturnTicks();
+    setup.m_flag_deactivated_ticks = rm->getFlagDeactivatedTicks();
+    setup.m_item_seed              = ItemManager::getRandomSeed();
+    setup.m_powerup_seed           = powerup_manager->getRandomSeed();
+    setup.m_state_frequency        = NetworkConfig::get()->getStateFrequency();
+    for (unsigned int i = 0; i < world->getNumKarts(); i++)
+    {
+        KartInfo info;
+        info.m_kart_ident = world->getKart(i)->getIdent();
+        info.m_handicap   = rm->getPlayerHandicap(i);
+        info.m_color      = rm->getKartColor(i);
+        info.m_host_id    = 0;
+        info.m_team       = KART_TEAM_NONE;
+        const int global_id = rm->getKartGlobalPlayerId(i);
+        if (global_id >= 0)
+        {
+            const RemoteKartInfo& rki = rm->getKartInfo(global_id);
+            info.m_player_name = rki.getPlayerName();
+            info.m_host_id     = rki.getHostId();
+            info.m_team        = rki.getKartTeam();
+        }
+        setup.m_karts.push_back(info);
+    }
+    return setup;
+}   // getCurrentSetup
+
+// ----------------------------------------------------------------------------
+/** Starts recording a new match, discarding a previous unfinished one.
+ *  \param filename The file the log is saved to in stopRecording().
+ */
+void MatchLog::startRecording(const Setup& setup, const std::string& filename)
+{
+    assert(!m_replaying);
+    m_setup = setup;
+    m_filename = filename;
+    m_end_ticks = 0;
+    m_events.clear();
+    m_sample_ticks.clear();
+    m_samples.clear();
+    m_last_sample_ticks = -1;
+}   // startRecording
+
+// ----------------------------------------------------------------------------
+/** Records a controller action applied by the server.
+ *  \param ticks The world ticks at which the action is applied.
+ */
+void MatchLog::addAction(int ticks, uint8_t kart_id, uint8_t w, uint16_t x,
+                         uint16_t y, uint16_t z)
+{
+    ActionEvent e;
+    e.m_ticks = ticks;
+    e.m_kart_id = kart_id;
+    e.m_w = w;
+    e.m_x = x;
+    e.m_y = y;
+    e.m_z = z;
+    m_events.push_back(e);
+}   // addAction
+
+// ----------------------------------------------------------------------------
+/** Saves the match log when the race is over.
+ *  \param end_ticks World ticks at which the race was over.
+ *  \return True if the log was saved.
+ */
+bool MatchLog::stopRecording(int end_ticks)
+{
+    m_end_ticks = end_ticks;
+    FILE* fd = FileUtils::fopenU8Path(m_filename, "wb");
+    if (!fd)
+    {
+        Log::error("MatchLog", "Can't open '%s' for writing.",
+                   m_filename.c_str());
+        return false;
+    }
+    bool ok = write(fd);
+    ok = fclose(fd) == 0 && ok;
+    if (ok)
+    {
+        Log::info("MatchLog", "Saved match log '%s' with %d actions.",
+                  m_filename.c_str(), (int)m_events.size());
+    }
+    else
+        Log::error("MatchLog", "Can't write '%s'.", m_filename.c_str());
+    return ok;
+}   // stopRecording
+
+// ----------------------------------------------------------------------------
+bool MatchLog::write(FILE* fd) const
+{
+    BareNetworkString body;
+    body.encodeString(m_setup.m_stk_version)
+        .encodeString(m_setup.m_track_name)
+        .addUInt16((uint16_t)m_setup.m_minor_mode)
+        .addUInt8((uint8_t)m_setup.m_difficulty)
+        .addUInt8((m_setup.m_reverse ? 1 : 0) |
+                  (m_setup.m_random_arena_items ? 2 : 0))
+        .addUInt32((uint32_t)m_setup.m_num_laps)
+        .addFloat(m_setup.m_time_target)
+        .addUInt32((uint32_t)m_setup.m_goal_target)
+        .addUInt32((uint32_t)m_setup.m_hit_capture_limit)
+        .addUInt32(m_setup.m_flag_return_ticks)
+        .addUInt32(m_setup.m_flag_deactivated_ticks)
+        .addUInt32(m_setup.m_item_seed)
+        .addUInt64(m_setup.m_powerup_seed)
+        .addUInt8((uint8_t)m_setup.m_state_frequency)
+        .addUInt32((uint32_t)m_end_ticks)
+        .addUInt8((uint8_t)m_setup.m_karts.size());
+    for (const KartInfo& info : m_setup.m_karts)
+    {
+        body.encodeString(info.m_kart_ident).encodeString(info.m_player_name)
+            .addUInt32(info.m_host_id).addUInt8((uint8_t)info.m_handicap)
+            .addUInt8((uint8_t)info.m_team).addFloat(info.m_color);
+    }
+
+    body.addUInt32((uint32_t)m_events.size());
+    for (const ActionEvent& e : m_events)
+    {
+        body.addUInt32((uint32_t)e.m_ticks).addUInt8(e.m_kart_id)
+            .addUInt8(e.m_w).addUInt16(e.m_x).addUInt16(e.m_y)
+            .addUInt16(e.m_z);
+    }
+
+    const unsigned int num_karts = (unsigned int)m_setup.m_karts.size();
+    assert(m_samples.size() == m_sample_ticks.size() * num_karts);
+    body.addUInt32((uint32_t)m_sample_ticks.size());
+    for (unsigned int i = 0; i < m_sample_ticks.size(); i++)
+    {
+        body.addUInt32((uint32_t)m_sample_ticks[i]);
+        for (unsigned int k = 0; k < num_karts; k++)
+        {
+            const KartSample& s = m_samples[i * num_karts + k];
+            body.addUInt32((uint32_t)s.m_x).addUInt32((uint32_t)s.m_y)
+                .addUInt32((uint32_t)s.m_z).addUInt32(s.m_hash);
+        }
+    }
+
+    uLongf size = compressBound((uLong)body.getTotalSize());
+    std::vector<uint8_t> compressed(size);
+    if (compress2(compressed.data(), &size, (const Bytef*)body.getData(),
+                  (uLong)body.getTotalSize(), Z_BEST_COMPRESSION) != Z_OK)
+    {
+        Log::error("MatchLog", "Can't compress match log.");
+        return false;
+    }
+
+    BareNetworkString preamble;
+    preamble.addUInt32(FORMAT_VERSION).addUInt32(body.getTotalSize())
+        .addUInt32((uint32_t)size);
+    return fwrite(MAGIC, 1, sizeof(MAGIC), fd) == sizeof(MAGIC) &&
+        fwrite(preamble.getData(), 1, preamble.getTotalSize(), fd) ==
+        preamble.getTotalSize() &&
+        fwrite(compressed.data(), 1, size, fd) == size;
+}   // write
+
+// ----------------------------------------------------------------------------
+/** Loads a match log to re-simulate it.
+ *  \return True if the log was loaded.
+ */
+bool MatchLog::load(const std::string& filename)
+{
+    FILE* fd = FileUtils::fopenU8Path(filename, "rb");
+    if (!fd)
+    {
+        Log::error("MatchLog", "Can't open '%s'.", filename.c_str());
+        return false;
+    }
+    bool ok = read(fd);
+    fclose(fd);
+    if (!ok)
+    {
+        Log::error("MatchLog", "'%s' is not a valid match log.",
+                   filename.c_str());
+        return false;
+    }
+    m_filename = filename;
+    m_replaying = true;
+    Log::info("MatchLog", "Loaded '%s': %s on '%s' with %d karts, "
+              "%d actions.", filename.c_str(),
+              RaceManager::getIdentOf(m_setup.m_minor_mode).c_str(),
+              m_setup.m_track_name.c_str(), (int)m_setup.m_karts.size(),
+              (int)m_events.size());
+    return true;
+}   // load
+
+// ----------------------------------------------------------------------------
+bool MatchLog::read(FILE* fd)
+{
+    char magic[sizeof(MAGIC)];
+    char preamble_data[PREAMBLE_SIZE - sizeof(MAGIC)];
+    if (fread(magic, 1, sizeof(MAGIC), fd) != sizeof(MAGIC) ||
+        memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        fread(preamble_data, 1, sizeof(preamble_data), fd) !=
+        sizeof(preamble_data))
+        return false;
+    BareNetworkString preamble(preamble_data, (int)sizeof(preamble_data));
+    const uint32_t version = preamble.getUInt32();
+    uLongf raw_size = preamble.getUInt32();
+    const uint32_t compressed_size = preamble.getUInt32();
+    if (version != FORMAT_VERSION)
+    {
+        Log::warn("MatchLog", "Match log version %d is not supported.",
+                  version);
+        return false;
+    }
+    if (raw_size > MAX_SIZE || compressed_size > MAX_SIZE)
+        return false;
+
+    std::vector<uint8_t> compressed(compressed_size);
+    std::vector<char> raw(raw_size);
+    const uLongf expected_size = raw_size;
+    if (fread(compressed.data(), 1, compressed_size, fd) != compressed_size ||
+        uncompress((Bytef*)raw.data(), &raw_size, compressed.data(),
+                   compressed_size) != Z_OK || raw_size != expected_size)
+        return false;
+
+    BareNetworkString body(raw.data(), (int)raw.size());
+    try
+    {
+        Setup setup;
+        body.decodeString(&setup.m_stk_version);
+        body.decodeString(&setup.m_track_name);
+        setup.m_minor_mode =
+            (RaceManager::MinorRaceModeType)body.getUInt16();
+        setup.m_difficulty = (RaceManager::Difficulty)body.getUInt8();
+        const uint8_t flags = body.getUInt8();
+        setup.m_reverse = (flags & 1) != 0;
+        setup.m_random_arena_items = (flags & 2) != 0;
+        setup.m_num_laps = (int)body.getUInt32();
+        setup.m_time_target = body.getFloat();
+        setup.m_goal_target = (int)body.getUInt32();
+        setup.m_hit_capture_limit = (int)body.getUInt32();
+        setup.m_flag_return_ticks = body.getUInt32();
+        setup.m_flag_deactivated_ticks = body.getUInt32();
+        setup.m_item_seed = body.getUInt32();
+        setup.m_powerup_seed = body.getUInt64();
+        setup.m_state_frequency = body.getUInt8();
+        const int end_ticks = (int)body.getUInt32();
+        const unsigned int num_karts = body.getUInt8();
+        for (unsigned int i = 0; i < num_karts; i++)
+        {
+            KartInfo info;
+            body.decodeString(&info.m_kart_ident);
+            body.decodeStringW(&info.m_player_name);
+            info.m_host_id = body.getUInt32();
+            info.m_handicap = (HandicapLevel)body.getUInt8();
+            info.m_team = (KartTeam)body.getInt8();
+            info.m_color = body.getFloat();
+            setup.m_karts.push_back(info);
+        }
+
+        std::vector<ActionEvent> events(body.getUInt32());
+        if (events.size() * 12 > (size_t)body.size())
+            return false;
+        for (ActionEvent& e : events)
+        {
+            e.m_ticks = (int)body.getUInt32();
+            e.m_kart_id = body.getUInt8();
+            e.m_w = body.getUInt8();
+            e.m_x = body.getUInt16();
+            e.m_y = body.getUInt16();
+            e.m_z = body.getUInt16();
+        }
+
+        std::vector<int> sample_ticks(body.getUInt32());
+        if (sample_ticks.size() * (4 + 16 * num_karts) > (size_t)body.size())
+            return false;
+        std::vector<KartSample> samples(sample_ticks.size() * num_karts);
+        for (unsigned int i = 0; i < sample_ticks.size(); i++)
+        {
+            sample_ticks[i] = (int)body.getUInt32();
+            for (unsigned int k = 0; k < num_karts; k++)
+            {
+                KartSample& s = samples[i * num_karts + k];
+                s.m_x = (int32_t)body.getUInt32();
+                s.m_y = (int32_t)body.getUInt32();
+                s.m_z = (int32_t)body.getUInt32();
+                s.m_hash = body.getUInt32();
+            }
+        }
+        m_setup = setup;
+        m_end_ticks = end_ticks;
+        m_events.swap(events);
+        m_sample_ticks.swap(sample_ticks);
+        m_samples.swap(samples);
+    }
+    catch (std::out_of_range&)
+    {
+        return false;
+    }
+    return true;
+}   // read
+
+// ----------------------------------------------------------------------------
+/** Sets up the race of a loaded match log like the server did, and starts
+ *  it. The simulation runs as a server without network, so the rewinders
+ *  save their states (which quantizes the kart physics) as on the server.
+ */
+void MatchLog::startReplay()
+{
+    assert(m_replaying);
+    if (m_setup.m_stk_version != STK_VERSION)
+    {
+        Log::warn("MatchLog", "Match was recorded with version '%s', STK "
+                  "version is '%s'.", m_setup.m_stk_version.c_str(),
+                  STK_VERSION);
+    }
+    NetworkConfig::get()->setIsServer(true);
+    NetworkConfig::get()->setStateFrequency(m_setup.m_state_frequency);
+    ItemManager::updateRandomSeed(m_setup.m_item_seed);
+    powerup_manager->setRandomSeed(m_setup.m_powerup_seed);
+
+    RaceManager* rm = RaceManager::get();
+    const int num_karts = (int)m_setup.m_karts.size();
+    rm->setMinorMode(m_setup.m_minor_mode);
+    rm->setMajorMode(RaceManager::MAJOR_MODE_SINGLE);
+    rm->setDifficulty(m_setup.m_difficulty);
+    rm->setNumKarts(num_karts);
+    rm->setNumPlayers(num_karts, 0);
+    for (int i = 0; i < num_karts; i++)
+    {
+        const KartInfo& info = m_setup.m_karts[i];
+        int local_player_id =
+            (int)(StateManager::get()->createActivePlayer(NULL, NULL));
+        RemoteKartInfo rki(local_player_id, info.m_kart_ident,
+                           info.m_player_name, info.m_host_id,
+                           /*network*/true);
+        rki.setGlobalPlayerId(i);
+        rki.setDefaultKartColor(info.m_color);
+        rki.setHandicap(info.m_handicap);
+        if (rm->teamEnabled())
+            rki.setKartTeam(info.m_team);
+        rm->setPlayerKart(i, rki);
+    }
+    rm->computeRandomKartList();
+    rm->setFlagReturnTicks(m_setup.m_flag_return_ticks);
+    rm->setFlagDeactivatedTicks(m_setup.m_flag_deactivated_ticks);
+
+    m_next_event = m_next_sample = 0;
+    m_last_sample_ticks = -1;
+    m_replay_start_time = StkTime::getMonoTimeMs();
+    // Same as GameSetup::loadWorld
+    rm->setTimeTarget(0.0f);
+    if (rm->isSoccerMode() || rm->isBattleMode())
+    {
+        bool prev_val = UserConfigParams::m_random_arena_item;
+        UserConfigParams::m_random_arena_item =
+            m_setup.m_random_arena_items;
+        rm->setReverseTrack(false);
+        if (rm->isSoccerMode())
+        {
+            if (m_setup.m_goal_target > 0)
+                rm->setMaxGoal(m_setup.m_goal_target);
+            else
+                rm->setTimeTarget(m_setup.m_time_target);
+        }
+        else
+        {
+            rm->setHitCaptureTime(m_setup.m_hit_capture_limit,
+                                  m_setup.m_time_target);
+        }
+        rm->startSingleRace(m_setup.m_track_name, -1,
+                            false/*from_overworld*/);
+        UserConfigParams::m_random_arena_item = prev_val;
+    }
+    else
+    {
+        rm->setReverseTrack(m_setup.m_reverse);
+        rm->startSingleRace(m_setup.m_track_name, m_setup.m_num_laps,
+                            false/*from_overworld*/);
+    }
+}   // startReplay
+
+// ----------------------------------------------------------------------------
+/** Called from the main loop before each time step of a re-simulation: adds
+ *  the recorded actions of this time step as network events, and plays them
+ *  as RaceEventManager::update() does on the server. Stops the main loop
+ *  once the race was over on the server (or is over now).
+ *  \param ticks The current world ticks.
+ */
+void MatchLog::updateReplay(int ticks)
+{
+    World* world = World::getWorld();
+    if (main_loop->isAborted())
+        return;
+    if (ticks >= m_end_ticks ||
+        (world->getPhase() > WorldStatus::RACE_PHASE &&
+         world->getPhase() != WorldStatus::IN_GAME_MENU_PHASE))
+    {
+        report();
+        main_loop->abort();
+        return;
+    }
+
+    while (m_next_event < m_events.size() &&
+           m_events[m_next_event].m_ticks <= ticks)
+    {
+        const ActionEvent& e = m_events[m_next_event++];
+        const uint8_t data[8] =
+        {
+            e.m_kart_id, e.m_w,
+            (uint8_t)(e.m_x >> 8), (uint8_t)e.m_x,
+            (uint8_t)(e.m_y >> 8), (uint8_t)e.m_y,
+            (uint8_t)(e.m_z >> 8), (uint8_t)e.m_z
+        };
+        RewindManager::get()->addNetworkEvent(this, data, sizeof(data),
+                                              e.m_ticks);
+    }
+    RewindManager::get()->playEventsTill(ticks, /*fast_forward*/false);
+}   // updateReplay
+
+// ----------------------------------------------------------------------------
+/** Applies a recorded action, called by the RewindManager. */
+void MatchLog::rewind(BareNetworkString *buffer)
+{
+    uint8_t kart_id = buffer->getUInt8();
+    uint8_t w = buffer->getUInt8();
+    uint16_t x = buffer->getUInt16();
+    uint16_t y = buffer->getUInt16();
+    uint16_t z = buffer->getUInt16();
+    if (kart_id < World::getWorld()->getNumKarts())
+        GameProtocol::applyControllerAction(kart_id, w, x, y, z);
+}   // rewind
+
+// ----------------------------------------------------------------------------
+/** Called at the start of each world update: records the kart states every
+ *  SAMPLE_INTERVAL ticks, or compares them with the recorded ones.
+ *  \param ticks The current world ticks.
+ */
+void MatchLog::update(int ticks)
+{
+    // The ticks don't increase before the race starts
+    if (ticks <= 0 || ticks % SAMPLE_INTERVAL != 0 ||
+        ticks == m_last_sample_ticks)
+        return;
+    m_last_sample_ticks = ticks;
+
+    World* world = World::getWorld();
+    const unsigned int num_karts = (unsigned int)m_setup.m_karts.size();
+    if (!m_replaying)
+    {
+        m_sample_ticks.push_back(ticks);
+        for (unsigned int k = 0; k < num_karts; k++)
+        {
+            KartSample s = { 0, 0, 0, 0 };
+            if (k < world->getNumKarts())
+                s = getKartSample(world->getKart(k));
+            m_samples.push_back(s);
+        }
+        return;
+    }
+
+    while (m_next_sample < m_sample_ticks.size() &&
+           m_sample_ticks[m_next_sample] < ticks)
+        m_next_sample++;
+    if (m_next_sample < m_sample_ticks.size() &&
+        m_sample_ticks[m_next_sample] == ticks)
+        compareSample(m_next_sample++, ticks);
+}   // update
+
+// ----------------------------------------------------------------------------
+MatchLog::KartSample MatchLog::getKartSample(const AbstractKart* kart)
+{
+    KartSample s = { 0, 0, 0, 2166136261u };
+    const btRigidBody* body = kart->getBody();
+    if (!body)
+        return s;
+    const btTransform& t = body->getWorldTransform();
+    s.m_x = quantize(t.getOrigin().getX());
+    s.m_y = quantize(t.getOrigin().getY());
+    s.m_z = quantize(t.getOrigin().getZ());
+    const btQuaternion q = t.getRotation();
+    const btVector3& v = body->getLinearVelocity();
+    const btVector3& w = body->getAngularVelocity();
+    const float values[] =
+    {
+        t.getOrigin().getX(), t.getOrigin().getY(), t.getOrigin().getZ(),
+        q.getX(), q.getY(), q.getZ(), q.getW(),
+        v.getX(), v.getY(), v.getZ(), w.getX(), w.getY(), w.getZ()
+    };
+    for (float f : values)
+        hashFloat(&s.m_hash, f);
+    return s;
+}   // getKartSample
+
+// ----------------------------------------------------------------------------
+void MatchLog::compareSample(unsigned int sample, int ticks)
+{
+    World* world = World::getWorld();
+    const unsigned int num_karts = (unsigned int)m_setup.m_karts.size();
+    bool diverged = false;
+    for (unsigned int k = 0; k < num_karts && k < world->getNumKarts(); k++)
+    {
+        const KartSample& recorded = m_samples[sample * num_karts + k];
+        const KartSample s = getKartSample(world->getKart(k));
+        if (s.m_hash == recorded.m_hash && s.m_x == recorded.m_x &&
+            s.m_y == recorded.m_y && s.m_z == recorded.m_z)
+            continue;
+
+        diverged = true;
+        const float dx = (float)(s.m_x - recorded.m_x);
+        const float dy = (float)(s.m_y - recorded.m_y);
+        const float dz = (float)(s.m_z - recorded.m_z);
+        const float error =
+            std::sqrt(dx * dx + dy * dy + dz * dz) / POSITION_SCALE;
+        if (m_first_divergence_ticks == -1)
+        {
+            m_first_divergence_ticks = ticks;
+            m_first_divergence_kart = k;
+            Log::warn("MatchLog", "Kart %d (%s) diverges at %d ticks "
+                      "(%.2f s), %.3f m from the recorded position.", k,
+                      m_setup.m_karts[k].m_kart_ident.c_str(), ticks,
+                      stk_config->ticks2Time(ticks), error);
+        }
+        if (error > m_max_error)
+        {
+            m_max_error = error;
+            m_max_error_ticks = ticks;
+            m_max_error_kart = k;
+        }
+    }
+    m_compared_samples++;
+    if (diverged)
+        m_diverged_samples++;
+}   // compareSample
+
+// ----------------------------------------------------------------------------
+void MatchLog::report() const
+{
+    if (Physics::get())
+        reportPhysics(Physics::get());
+    const uint64_t duration = StkTime::getMonoTimeMs() - m_replay_start_time;
+    Log::info("MatchLog", "Re-simulated %d ticks of '%s' in %.2f s, played "
+              "%d of %d actions, compared %d of %d samples.",
+              World::getWorld()->getTicksSinceStart(), m_filename.c_str(),
+              duration / 1000.0f, m_next_event, (int)m_events.size(),
+              m_compared_samples, (int)m_sample_ticks.size());
+    if (!hasDiverged())
+    {
+        Log::info("MatchLog", "No divergence found.");
+        return;
+    }
+    Log::warn("MatchLog", "%d samples diverged, first at %d ticks (kart "
+              "%d), largest position error %.3f m at %d ticks (kart %d).",
+              m_diverged_samples, m_first_divergence_ticks,
+              m_first_divergence_kart, m_max_error, m_max_error_ticks,
+              m_max_error_kart);
+}   // report
+
+// ----------------------------------------------------------------------------
+/** Logs the physics counters summed over the steps of a world. */
+void MatchLog::reportPhysics(const Physics* physics)
+{
+    const Physics::StepStatistics& s = physics->getAllSteps();
+    const double steps = s.m_steps > 0 ? (double)s.m_steps : 1.0;
+    Log::info("MatchLog", "Physics with %s broadphase: %d steps, %.1f us per "
+              "step (max %d us), per step %.1f broadphase pairs, %.1f "
+              "manifolds and %.1f solver iterations.",
+              Physics::getBroadphaseName(physics->getBroadphaseType()),
+              s.m_steps, s.m_step_time / steps, (int)s.m_max_step_time,
+              s.m_broadphase_pairs / steps, s.m_manifolds / steps,
+              s.m_solver_iterations / steps);
+}   // reportPhysics
+
+// ----------------------------------------------------------------------------
+/** Re-simulates a match log once with each broadphase (see
+ *  --physics-benchmark) and compares the time spent in the physics steps.
+ *  The broadphase changes the order in which contacts are solved, so only
+ *  the broadphase the match was recorded with is expected to reproduce it.
+ *  The server config is changed in memory only.
+ *  \return False if the log can't be loaded.
+ */
+bool MatchLog::benchmarkPhysics(const std::string& filename)
+{
+    const Physics::BroadphaseType types[] =
+        { Physics::BP_AXIS_SWEEP, Physics::BP_DBVT };
+    const unsigned int num_types = sizeof(types) / sizeof(types[0]);
+    Physics::StepStatistics stats[num_types];
+    bool diverged[num_types];
+    const std::string previous_broadphase = ServerConfig::m_physics_broadphase;
+    for (unsigned int i = 0; i < num_types; i++)
+    {
+        ServerConfig::m_physics_broadphase =
+            Physics::getBroadphaseName(types[i]);
+        if (!create()->load(filename))
+        {
+            destroy();
+            ServerConfig::m_physics_broadphase = previous_broadphase;
+            return false;
+        }
+        get()->startReplay();
+        main_loop->run();
+        main_loop->resetAbort();
+        if (Physics::get())
+            stats[i] = Physics::get()->getAllSteps();
+        diverged[i] = get()->hasDiverged();
+        RaceManager::get()->exitRace();
+        StateManager::get()->resetActivePlayers();
+        destroy();
+    }
+    ServerConfig::m_physics_broadphase = previous_broadphase;
+
+    for (unsigned int i = 0; i < num_types; i++)
+    {
+        const double steps = stats[i].m_steps > 0 ? stats[i].m_steps : 1.0;
+        Log::info("MatchLog", "%-10s %8.1f ms in %d steps, %7.1f us per "
+                  "step, max %6d us, %s.",
+                  Physics::getBroadphaseName(types[i]),
+                  stats[i].m_step_time / 1000.0, stats[i].m_steps,
+                  stats[i].m_step_time / steps,
+                  (int)stats[i].m_max_step_time,
+                  diverged[i] ? "diverged" : "same race");
+    }
+    return true;
+}   // benchmarkPhysics
+
+// ----------------------------------------------------------------------------
+void MatchLog::unitTesting()
+{
+    MatchLog log;
+    Setup& setup = log.m_setup;
+    setup.m_stk_version = "1.4";
+    setup.m_track_name = "soccer_field";
+    setup.m_minor_mode = RaceManager::MINOR_MODE_SOCCER;
+    setup.m_difficulty = RaceManager::DIFFICULTY_BEST;
+    setup.m_reverse = false;
+    setup.m_random_arena_items = true;
+    setup.m_num_laps = -1;
+    setup.m_time_target = 0.0f;
+    setup.m_goal_target = 5;
+    setup.m_hit_capture_limit = 0;
+    setup.m_flag_return_ticks = 2400;
+    setup.m_flag_deactivated_ticks = 360;
+    setup.m_item_seed = 0xdeadbeef;
+    setup.m_powerup_seed = 0x123456789abcULL;
+    setup.m_state_frequency = 10;
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        KartInfo info;
+        info.m_kart_ident = i == 0 ? "tux" : "nolok";
+        info.m_player_name = i == 1 ? L"Bj\x00f6rn" : L"player";
+        info.m_host_id = i + 1;
+        info.m_handicap = i == 2 ? HANDICAP_MEDIUM : HANDICAP_NONE;
+        info.m_team = i == 0 ? KART_TEAM_RED : KART_TEAM_BLUE;
+        info.m_color = 0.25f * i;
+        setup.m_karts.push_back(info);
+    }
+    log.addAction(0, 0, 0x43, 32768, 0, 0);
+    log.addAction(5, 2, 0xc1, 0, 32767, 12);
+    log.addAction(5, 1, 0x02, 1, 2, 3);
+    log.addAction(7000, 0, 0x05, 32768, 65535, 65535);
+    for (unsigned int i = 1; i <= 2; i++)
+    {
+        log.m_sample_ticks.push_back(i * SAMPLE_INTERVAL);
+        for (int k = 0; k < 3; k++)
+        {
+            KartSample s = { -1000 * k, (int32_t)i, 2000000000,
+                             0x89abcdefu + k };
+            log.m_samples.push_back(s);
+        }
+    }
+    log.m_end_ticks = 7200;
+
+    FILE* fd = tmpfile();
+    assert(fd);
+    bool ok = log.write(fd);
+    assert(ok);
+    const long size = ftell(fd);
+    fseek(fd, 0, SEEK_SET);
+    MatchLog loaded;
+    ok = loaded.read(fd);
+    assert(ok);
+    (void)ok;
+    const Setup& s = loaded.m_setup;
+    assert(s.m_stk_version == "1.4" && s.m_track_name == "soccer_field");
+    assert(s.m_minor_mode == RaceManager::MINOR_MODE_SOCCER);
+    assert(s.m_difficulty == RaceManager::DIFFICULTY_BEST);
+    assert(!s.m_reverse && s.m_random_arena_items);
+    assert(s.m_num_laps == -1 && s.m_time_target == 0.0f);
+    assert(s.m_goal_target == 5 && s.m_hit_capture_limit == 0);
+    assert(s.m_flag_return_ticks == 2400 && s.m_flag_deactivated_ticks == 360);
+    assert(s.m_item_seed == 0xdeadbeef);
+    assert(s.m_powerup_seed == 0x123456789abcULL);
+    assert(s.m_state_frequency == 10 && loaded.m_end_ticks == 7200);
+    assert(s.m_karts.size() == 3);
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        const KartInfo& a = setup.m_karts[i];
+        const KartInfo& b = s.m_karts[i];
+        assert(a.m_kart_ident == b.m_kart_ident);
+        assert(a.m_player_name == b.m_player_name);
+        assert(a.m_host_id == b.m_host_id && a.m_handicap == b.m_handicap);
+        assert(a.m_team == b.m_team && a.m_color == b.m_color);
+        (void)a; (void)b;
+    }
+    assert(loaded.m_events.size() == log.m_events.size());
+    for (unsigned int i = 0; i < log.m_events.size(); i++)
+    {
+        const ActionEvent& a = log.m_events[i];
+        const ActionEvent& b = loaded.m_events[i];
+        assert(a.m_ticks == b.m_ticks && a.m_kart_id == b.m_kart_id);
+        assert(a.m_w == b.m_w && a.m_x == b.m_x && a.m_y == b.m_y &&
+               a.m_z == b.m_z);
+        (void)a; (void)b;
+    }
+    assert(loaded.m_sample_ticks == log.m_sample_ticks);
+    assert(loaded.m_samples.size() == log.m_samples.size());
+    for (unsigned int i = 0; i < log.m_samples.size(); i++)
+    {
+        const KartSample& a = log.m_samples[i];
+        const KartSample& b = loaded.m_samples[i];
+        assert(a.m_x == b.m_x && a.m_y == b.m_y && a.m_z == b.m_z &&
+               a.m_hash == b.m_hash);
+        (void)a; (void)b;
+    }
+
+    // A truncated log must be rejected
+    std::vector<char> data(size);
+    fseek(fd, 0, SEEK_SET);
+    size_t n = fread(data.data(), 1, data.size(), fd);
+    assert(n == data.size());
+    (void)n;
+    fclose(fd);
+    fd = tmpfile();
+    assert(fd);
+    fwrite(data.data(), 1, data.size() - 10, fd);
+    fseek(fd, 0, SEEK_SET);
+    MatchLog truncated;
+    ok = truncated.read(fd);
+    assert(!ok);
+    (void)ok;
+    fclose(fd);
+}   // unitTesting
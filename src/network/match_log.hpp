@@ -0,0 +1,214 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_MATCH_LOG_HPP
+#define HEADER_MATCH_LOG_HPP
+
+#include "network/event_rewinder.hpp"
+#include "race/race_manager.hpp"
+#include "utils/cpp2011.hpp"
+#include "utils/no_copy.hpp"
+#include "utils/stk_process.hpp"
+
+#include "irrString.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class AbstractKart;
+class Physics;
+
+/** A compact binary log of a network race, recorded by the server: the race
+ *  setup (track, mode, karts and the random seeds), every controller action
+ *  the server applied with the world ticks it was applied at, and samples of
+ *  the kart states every SAMPLE_INTERVAL ticks. The log can be re-simulated
+ *  offline: the race is set up with the same karts and seeds, the actions
+ *  are fed to the RewindManager as network events at their ticks (as the
+ *  server does), and the kart states are compared with the samples to
+ *  report where the simulation diverges.
+ * \ingroup network
+ */
+class MatchLog : public EventRewinder, public NoCopy
+{
+public:
+    /** The version of the file format written. */
+    static const unsigned int FORMAT_VERSION = 1;
+
+    /** Kart states are sampled every this many ticks. */
+    static const int SAMPLE_INTERVAL = 60;
+
+    struct KartInfo
+    {
+        std::string m_kart_ident;
+        irr::core::stringw m_player_name;
+        uint32_t m_host_id;
+        HandicapLevel m_handicap;
+        KartTeam m_team;
+        float m_color;
+    };   // KartInfo
+
+    /** Everything needed to set up the same race again. */
+    struct Setup
+    {
+        std::string m_stk_version;
+        std::string m_track_name;
+        RaceManager::MinorRaceModeType m_minor_mode;
+        RaceManager::Difficulty m_difficulty;
+        bool m_reverse;
+        /** Random item positions in arenas. */
+        bool m_random_arena_items;
+        /** -1 for modes without laps. */
+        int m_num_laps;
+        float m_time_target;
+        int m_goal_target;
+        int m_hit_capture_limit;
+        unsigned m_flag_return_ticks;
+        unsigned m_flag_deactivated_ticks;
+        uint32_t m_item_seed;
+        uint64_t m_powerup_seed;
+        int m_state_frequency;
+        /** The karts in world order. */
+        std::vector<KartInfo> m_karts;
+    };   // Setup
+
+private:
+    struct ActionEvent
+    {
+        int m_ticks;
+        uint8_t m_kart_id;
+        uint8_t m_w;
+        uint16_t m_x, m_y, m_z;
+    };   // ActionEvent
+
+    /** The state of a kart: position in 1/1024 m, and a hash of the exact
+     *  transform and velocities. */
+    struct KartSample
+    {
+        int32_t m_x, m_y, m_z;
+        uint32_t m_hash;
+    };   // KartSample
+
+    static MatchLog* m_match_log[PT_COUNT];
+
+    bool m_replaying;
+
+    std::string m_filename;
+
+    Setup m_setup;
+
+    /** World ticks when the race was over on the server. */
+    int m_end_ticks;
+
+    std::vector<ActionEvent> m_events;
+
+    /** Ticks of each sample. */
+    std::vector<int> m_sample_ticks;
+
+    /** For each sample the state of each kart. */
+    std::vector<KartSample> m_samples;
+
+    int m_last_sample_ticks;
+
+    /** Replay: index of the next event to add to the RewindManager, and of
+     *  the next sample to compare. */
+    unsigned int m_next_event, m_next_sample;
+
+    unsigned int m_compared_samples, m_diverged_samples;
+
+    int m_first_divergence_ticks, m_first_divergence_kart;
+
+    float m_max_error;
+
+    int m_max_error_ticks, m_max_error_kart;
+
+    uint64_t m_replay_start_time;
+
+    // ------------------------------------------------------------------------
+    MatchLog();
+    // ------------------------------------------------------------------------
+    static KartSample getKartSample(const AbstractKart* kart);
+    // ------------------------------------------------------------------------
+    void compareSample(unsigned int sample, int ticks);
+    // ------------------------------------------------------------------------
+    void report() const;
+    // ------------------------------------------------------------------------
+    static void reportPhysics(const Physics* physics);
+    // ------------------------------------------------------------------------
+    bool write(FILE* fd) const;
+    // ------------------------------------------------------------------------
+    bool read(FILE* fd);
+
+public:
+    static MatchLog* create();
+    // ------------------------------------------------------------------------
+    static void destroy();
+    // ------------------------------------------------------------------------
+    /** Returns the match log of this process, or NULL if there is none. */
+    static MatchLog* get()
+    {
+        ProcessType pt = STKProcess::getType();
+        return m_match_log[pt];
+    }   // get
+    // ------------------------------------------------------------------------
+    /** Returns if the server of this process records a match. */
+    static bool isRecording()
+    {
+        MatchLog* ml = get();
+        return ml && !ml->m_replaying;
+    }   // isRecording
+    // ------------------------------------------------------------------------
+    /** Returns if a match log is re-simulated. */
+    static bool isReplaying()
+    {
+        MatchLog* ml = get();
+        return ml && ml->m_replaying;
+    }   // isReplaying
+    // ------------------------------------------------------------------------
+    static Setup getCurrentSetup(bool random_arena_items);
+    // ------------------------------------------------------------------------
+    void startRecording(const Setup& setup, const std::string& filename);
+    // ------------------------------------------------------------------------
+    void addAction(int ticks, uint8_t kart_id, uint8_t w, uint16_t x,
+                   uint16_t y, uint16_t z);
+    // ------------------------------------------------------------------------
+    bool stopRecording(int end_ticks);
+    // ------------------------------------------------------------------------
+    bool load(const std::string& filename);
+    // ------------------------------------------------------------------------
+    void startReplay();
+    // ------------------------------------------------------------------------
+    static bool benchmarkPhysics(const std::string& filename);
+    // ------------------------------------------------------------------------
+    void updateReplay(int ticks);
+    // ------------------------------------------------------------------------
+    void update(int ticks);
+    // ------------------------------------------------------------------------
+    /** Returns if the re-simulation differed from the recorded states. */
+    bool hasDiverged() const                 { return m_diverged_samples > 0; }
+    // ------------------------------------------------------------------------
+    virtual void undo(BareNetworkString *buffer) OVERRIDE {}
+    // ------------------------------------------------------------------------
+    virtual void rewind(BareNetworkString *buffer) OVERRIDE;
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // MatchLog
+
+#endif
@@ -23,6 +23,7 @@
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "network/protocols/server_lobby.hpp"
+#include "utils/profiler.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
 #include "main_loop.hpp"
@@ -53,6 +54,9 @@ void showHelp()
     std::cout << "listpeers, List all peers with host ID and IP." << std::endl;
     std::cout << "listban, List IP ban list of server." << std::endl;
     std::cout << "speedstats, Show upload and download speed." << std::endl;
+    std::cout << "profile #, Write a trace of the profiler markers of the "
+        "next # seconds, or of the last ones with --profiler-trace." <<
+        std::endl;
 }   // showHelp
 
 // ----------------------------------------------------------------------------
@@ -178,6 +182,21 @@ void mainLoop(STKHost* host)
                 "   Download speed (KBps): " <<
                 (float)host->getDownloadSpeed() / 1024.0f  << std::endl;
         }
+        else if (str == "profile")
+        {
+            if (number > 0)
+            {
+                if (!profiler.captureTrace(number))
+                {
+                    std::cout << "A trace is already being captured." <<
+                        std::endl;
+                }
+            }
+            else if (profiler.isContinuousTrace())
+                profiler.writeTraceToFile();
+            else
+                std::cout << "Usage: profile seconds" << std::endl;
+        }
         else
         {
             std::cout << "Unknown command: " << str << std::endl;
@@ -17,6 +17,7 @@
 
 #include "network/protocols/game_protocol.hpp"
 
+#include "config/stk_config.hpp"
 #include "items/item_manager.hpp"
 #include "items/network_item_manager.hpp"
 #include "karts/abstract_kart.hpp"
@@ -25,12 +26,15 @@
 #include "network/event.hpp"
 #include "network/network_config.hpp"
 #include "network/game_setup.hpp"
+#include "network/match_log.hpp"
 #include "network/network.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
 #include "network/protocol_manager.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/rewinder.hpp"
+#include "network/server_config.hpp"
 #include "network/socket_address.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
@@ -63,12 +67,25 @@ GameProtocol::GameProtocol()
     m_network_item_manager = static_cast<NetworkItemManager*>
         (Track::getCurrentTrack()->getItemManager());
     m_data_to_send = getNetworkString();
+    m_full_state_bytes = 0;
+    m_sent_state_bytes = 0;
+    // Keep 2 seconds of states, a client with a higher round trip time than
+    // that will always receive full states
+    m_states_history_ticks = stk_config->time2Ticks(2.0f);
 }   // GameProtocol
 
 //-----------------------------------------------------------------------------
 GameProtocol::~GameProtocol()
 {
     delete m_data_to_send;
+    if (m_full_state_bytes > 0)
+    {
+        Log::info("GameProtocol", "Sent %lu of %lu bytes of states, "
+            "%lu bytes saved by delta states.",
+            (unsigned long)m_sent_state_bytes,
+            (unsigned long)m_full_state_bytes,
+            (unsigned long)getDeltaStateBytesSaved());
+    }
 }   // ~GameProtocol
 
 //-----------------------------------------------------------------------------
@@ -131,6 +148,9 @@ bool GameProtocol::notifyEventAsynchronous(Event* event)
     {
     case GP_CONTROLLER_ACTION: handleControllerAction(event); break;
     case GP_STATE:             handleState(event);            break;
+    case GP_DELTA_STATE:       handleDeltaState(event);       break;
+    case GP_STATE_ACK:         handleStateAck(event);         break;
+    case GP_STATE_NACK:        handleStateNack(event);        break;
     case GP_ITEM_CONFIRMATION: handleItemEventConfirmation(event); break;
     case GP_ADJUST_TIME:
     case GP_ITEM_UPDATE:
@@ -162,18 +182,24 @@ void GameProtocol::controllerAction(int kart_id, PlayerAction action,
     a.m_value   = value;
     a.m_value_l = val_l;
     a.m_value_r = val_r;
-    a.m_ticks   = World::getWorld()->getTicksSinceStart();
+    // While a re-simulation is spread over several frames the world is
+    // behind, the action happens at the ticks the world will catch up to
+    a.m_ticks   = World::getWorld()->getTicksSinceStart() +
+                  RewindManager::get()->getResimulationBacklog();
 
     m_all_actions.push_back(a);
     const auto& c = compressAction(a);
-    // Store the event in the rewind manager, which is responsible
-    // for freeing the allocated memory
-    BareNetworkString *s = new BareNetworkString(4);
-    s->addUInt8(kart_id).addUInt8(std::get<0>(c)).addUInt16(std::get<1>(c))
-        .addUInt16(std::get<2>(c)).addUInt16(std::get<3>(c));
-
-    RewindManager::get()->addEvent(this, s, /*confirmed*/true,
-                                   World::getWorld()->getTicksSinceStart());
+    // Store the event in the rewind manager, in the same format as the
+    // action in a network message (16 bit values in network byte order)
+    const uint8_t s[8] =
+    {
+        (uint8_t)kart_id, std::get<0>(c),
+        (uint8_t)(std::get<1>(c) >> 8), (uint8_t)std::get<1>(c),
+        (uint8_t)(std::get<2>(c) >> 8), (uint8_t)std::get<2>(c),
+        (uint8_t)(std::get<3>(c) >> 8), (uint8_t)std::get<3>(c)
+    };
+    RewindManager::get()->addEvent(this, s, sizeof(s), /*confirmed*/true,
+                                   a.m_ticks);
 }   // controllerAction
 
 // ----------------------------------------------------------------------------
@@ -206,6 +232,8 @@ void GameProtocol::handleControllerAction(Event *event)
             will_trigger_rewind = true;
             //rewind_delta = not_rewound - cur_ticks;
         }
+        // The action is stored in the event as it is in the message
+        const uint8_t* action = (const uint8_t*)data.getCurrentData();
         uint8_t kart_id = data.getUInt8();
         if (NetworkConfig::get()->isServer() &&
             !peer->availableKartID(kart_id))
@@ -227,10 +255,7 @@ void GameProtocol::handleControllerAction(Event *event)
                 cur_ticks, kart_id, std::get<0>(a), std::get<1>(a),
                 std::get<2>(a), std::get<3>(a));
         }
-        BareNetworkString *s = new BareNetworkString(3);
-        s->addUInt8(kart_id).addUInt8(w).addUInt16(x).addUInt16(y)
-            .addUInt16(z);
-        RewindManager::get()->addNetworkEvent(this, s, cur_ticks);
+        RewindManager::get()->addNetworkEvent(this, action, 8, cur_ticks);
     }
 
     if (data.size() > 0)
@@ -285,9 +310,10 @@ void GameProtocol::handleItemEventConfirmation(Event *event)
 void GameProtocol::startNewState()
 {
     assert(NetworkConfig::get()->isServer());
-    m_data_to_send->clear();
-    m_data_to_send->addUInt8(GP_STATE)
-        .addUInt32(World::getWorld()->getTicksSinceStart());
+    m_current_state.m_ticks = World::getWorld()->getTicksSinceStart();
+    m_current_state.m_rewinder_ids.clear();
+    m_current_state.m_rewinder_serials.clear();
+    m_current_state.m_data.clear();
 }   // startNewState
 
 // ----------------------------------------------------------------------------
@@ -298,44 +324,256 @@ void GameProtocol::startNewState()
 void GameProtocol::addState(BareNetworkString *buffer)
 {
     assert(NetworkConfig::get()->isServer());
-    m_data_to_send->addUInt16(buffer->size());
-    (*m_data_to_send) += *buffer;
+    const uint8_t* data = (const uint8_t*)buffer->getCurrentData();
+    m_current_state.m_data.emplace_back(data, data + buffer->size());
 }   // addState
 
 // ----------------------------------------------------------------------------
-/** Called by a server to finalize the current state, which add updated
- *  names of rewinder using to the beginning of state buffer
- *  \param cur_rewinder List of current rewinder using.
+/** Called by a server to finalize the current state, which sets the rewinder
+ *  ids and their serials of rewinders which added data.
+ *  \param rewinder_ids Rewinder id of each rewinder which added data.
  */
-void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
+void GameProtocol::finalizeState(std::vector<uint16_t>& rewinder_ids)
 {
     assert(NetworkConfig::get()->isServer());
-    auto& buffer = m_data_to_send->getBuffer();
-    auto pos = buffer.begin() + 1/*protocol type*/ + 1 /*gp event type*/+
-        4/*time*/;
-
-    m_data_to_send->reset();
-    std::vector<uint8_t> names;
-    names.push_back((uint8_t)cur_rewinder.size());
-    for (std::string& name : cur_rewinder)
+    assert(rewinder_ids.size() == m_current_state.m_data.size());
+    std::swap(m_current_state.m_rewinder_ids, rewinder_ids);
+    for (uint16_t id : m_current_state.m_rewinder_ids)
     {
-        names.push_back((uint8_t)name.size());
-        std::vector<uint8_t> rewinder(name.begin(), name.end());
-        names.insert(names.end(), rewinder.begin(), rewinder.end());
+        m_current_state.m_rewinder_serials.push_back(
+            RewindManager::get()->getRewinderSerial(id));
     }
-    buffer.insert(pos, names.begin(), names.end());
+    m_current_state.buildIndex();
 }   // finalizeState
 
+// ----------------------------------------------------------------------------
+/** Writes the current state to m_data_to_send in the format used by clients
+ *  without delta_state capability, with the unique identity of each rewinder
+ *  in front of the state.
+ *  \return False if there are too many rewinders for that format.
+ */
+bool GameProtocol::writeFullState()
+{
+    const StateDelta::Snapshot& cs = m_current_state;
+    if (cs.m_rewinder_ids.size() > 255)
+        return false;
+    m_data_to_send->clear();
+    m_data_to_send->addUInt8(GP_STATE).addUInt32(cs.m_ticks)
+        .addUInt8((uint8_t)cs.m_rewinder_ids.size());
+    for (uint16_t id : cs.m_rewinder_ids)
+    {
+        std::shared_ptr<Rewinder> r = RewindManager::get()->getRewinderByID(id);
+        if (!r)
+            return false;
+        m_data_to_send->encodeString(r->getUniqueIdentity());
+    }
+    for (const std::vector<uint8_t>& data : cs.m_data)
+    {
+        m_data_to_send->addUInt16((uint16_t)data.size());
+        m_data_to_send->getBuffer().insert(m_data_to_send->getBuffer().end(),
+            data.begin(), data.end());
+    }
+    return true;
+}   // writeFullState
+
 // ----------------------------------------------------------------------------
 /** Called when the last state information has been added and the message
- *  can be sent to the clients.
+ *  can be sent to the clients. Clients with delta_state capability receive
+ *  rewinder ids instead of unique identities, and the data of each rewinder
+ *  as delta against the last state they acknowledged if it is still in
+ *  m_states_history. All other clients receive the full state.
  */
 void GameProtocol::sendState()
 {
     assert(NetworkConfig::get()->isServer());
-    sendMessageToPeers(m_data_to_send, /*reliable*/false);
+    const StateDelta::Snapshot& cs = m_current_state;
+    // Size of the full state, used to count bytes saved by delta states
+    unsigned full_size = 1/*protocol type*/ + 1 /*gp event type*/+
+        4/*time*/ + 1/*rewinder count*/;
+    for (unsigned i = 0; i < cs.m_data.size(); i++)
+    {
+        std::shared_ptr<Rewinder> r =
+            RewindManager::get()->getRewinderByID(cs.m_rewinder_ids[i]);
+        full_size += 1 + (r ? (unsigned)r->getUniqueIdentity().size() : 0) +
+            2 + (unsigned)cs.m_data[i].size();
+    }
+
+    std::vector<std::shared_ptr<STKPeer> > full_state_peers;
+    // Peers acknowledging the same state share the same delta state, so
+    // it's only written once and sent to all of them together
+    std::map<int, std::pair<NetworkString*,
+        std::vector<std::shared_ptr<STKPeer> > > > delta_states;
+    for (auto& peer : STKHost::get()->getPeers())
+    {
+        if (!peer->isValidated() || peer->isWaitingForGame())
+            continue;
+        m_full_state_bytes += full_size;
+
+        if (!ServerConfig::m_delta_state ||
+            peer->getClientCapabilities().find("delta_state") ==
+            peer->getClientCapabilities().end())
+        {
+            full_state_peers.push_back(peer);
+            continue;
+        }
+
+        int ack_ticks = -1;
+        {
+            std::lock_guard<std::mutex> lock(m_state_ack_mutex);
+            auto it = m_state_ack.find(peer->getHostId());
+            if (it != m_state_ack.end())
+                ack_ticks = it->second;
+        }
+        const StateDelta::Snapshot* baseline = NULL;
+        for (const StateDelta::Snapshot& s : m_states_history)
+        {
+            if (s.m_ticks == ack_ticks)
+            {
+                baseline = &s;
+                break;
+            }
+        }
+        // Baseline lost or never acknowledged, all data is sent in full
+        if (!baseline)
+            ack_ticks = -1;
+
+        delta_states[ack_ticks].second.push_back(peer);
+        NetworkString*& ds = delta_states[ack_ticks].first;
+        if (!ds)
+        {
+            ds = getNetworkString(full_size);
+            ds->addUInt8(GP_DELTA_STATE).addUInt32(cs.m_ticks)
+                .addUInt32((uint32_t)ack_ticks)
+                .addUInt16((uint16_t)cs.m_rewinder_ids.size());
+            // The unique identity is only needed if the client doesn't have
+            // the same rewinder under the id in the baseline, the id can be
+            // reused for a new rewinder. Its data is then sent in full.
+            std::vector<const std::vector<uint8_t>*>
+                baseline_data(cs.m_rewinder_ids.size(), NULL);
+            for (unsigned i = 0; i < cs.m_rewinder_ids.size(); i++)
+            {
+                uint16_t id = cs.m_rewinder_ids[i];
+                if (baseline)
+                {
+                    baseline_data[i] =
+                        baseline->find(id, cs.m_rewinder_serials[i]);
+                }
+                if (baseline_data[i])
+                {
+                    ds->addUInt16(id);
+                    continue;
+                }
+                std::shared_ptr<Rewinder> r =
+                    RewindManager::get()->getRewinderByID(id);
+                ds->addUInt16(id | 0x8000)
+                    .encodeString(r ? r->getUniqueIdentity() : "");
+            }
+            for (unsigned i = 0; i < cs.m_data.size(); i++)
+                StateDelta::encode(baseline_data[i], cs.m_data[i], ds);
+        }
+    }
+
+    if (!full_state_peers.empty())
+    {
+        if (writeFullState())
+        {
+            STKHost::get()->sendPacketToPeers(full_state_peers,
+                m_data_to_send, /*reliable*/false);
+            m_sent_state_bytes += m_data_to_send->getTotalSize() *
+                full_state_peers.size();
+        }
+        else
+        {
+            Log::warn("GameProtocol", "Too many rewinders (%d) for "
+                "clients without delta_state capability.",
+                (int)cs.m_rewinder_ids.size());
+        }
+    }
+    for (auto& p : delta_states)
+    {
+        STKHost::get()->sendPacketToPeers(p.second.second, p.second.first,
+            /*reliable*/false);
+        m_sent_state_bytes += p.second.first->getTotalSize() *
+            p.second.second.size();
+        delete p.second.first;
+    }
+    addStateToHistory(m_current_state);
 }   // sendState
 
+// ----------------------------------------------------------------------------
+/** Saves a state sent (server) or received (client) so it can be used as
+ *  baseline of later delta states, and removes states too old to be used.
+ */
+void GameProtocol::addStateToHistory(StateDelta::Snapshot& snapshot)
+{
+    const int ticks = snapshot.m_ticks;
+    m_states_history.push_back(std::move(snapshot));
+    while (!m_states_history.empty() &&
+        m_states_history.front().m_ticks < ticks - m_states_history_ticks)
+        m_states_history.pop_front();
+}   // addStateToHistory
+
+// ----------------------------------------------------------------------------
+/** Tells the server that the state at ticks has been received, so it can be
+ *  used as baseline of the following delta states.
+ *  \param ticks Time of the received state.
+ */
+void GameProtocol::sendStateAck(int ticks)
+{
+    assert(NetworkConfig::get()->isClient());
+    NetworkString *ns = getNetworkString(5);
+    ns->addUInt8(GP_STATE_ACK).addUInt32(ticks);
+    // Losing an acknowledgement only makes the delta states larger
+    sendToServer(ns, /*reliable*/false);
+    delete ns;
+}   // sendStateAck
+
+// ----------------------------------------------------------------------------
+/** Handles a state acknowledgement from a client.
+ *  \param event The data from the client.
+ */
+void GameProtocol::handleStateAck(Event *event)
+{
+    if (!NetworkConfig::get()->isServer())
+        return;
+    int ticks = event->data().getUInt32();
+    std::lock_guard<std::mutex> lock(m_state_ack_mutex);
+    auto ret = m_state_ack.emplace(event->getPeer()->getHostId(), ticks);
+    // Acknowledgements are unreliable and can arrive in any order
+    if (!ret.second && ret.first->second < ticks)
+        ret.first->second = ticks;
+}   // handleStateAck
+
+// ----------------------------------------------------------------------------
+/** Tells the server that the baseline state at ticks is missing, so it
+ *  sends the data in full until a later state is acknowledged.
+ *  \param ticks Time of the missing baseline state.
+ */
+void GameProtocol::sendStateNack(int ticks)
+{
+    assert(NetworkConfig::get()->isClient());
+    NetworkString *ns = getNetworkString(5);
+    ns->addUInt8(GP_STATE_NACK).addUInt32(ticks);
+    sendToServer(ns, /*reliable*/true);
+    delete ns;
+}   // sendStateNack
+
+// ----------------------------------------------------------------------------
+/** Handles a client reporting a missing baseline state, by forgetting its
+ *  acknowledgement unless a later state was acknowledged meanwhile.
+ *  \param event The data from the client.
+ */
+void GameProtocol::handleStateNack(Event *event)
+{
+    if (!NetworkConfig::get()->isServer())
+        return;
+    int ticks = event->data().getUInt32();
+    std::lock_guard<std::mutex> lock(m_state_ack_mutex);
+    auto it = m_state_ack.find(event->getPeer()->getHostId());
+    if (it != m_state_ack.end() && it->second <= ticks)
+        m_state_ack.erase(it);
+}   // handleStateNack
+
 // ----------------------------------------------------------------------------
 /** Called when a new full state is received form the server.
  */
@@ -362,6 +600,65 @@ void GameProtocol::handleState(Event *event)
     RewindManager::get()->addNetworkRewindInfo(ris);
 }   // handleState
 
+// ----------------------------------------------------------------------------
+/** Called when a delta state is received from the server. It is decoded
+ *  using the acknowledged baseline state into a full state.
+ */
+void GameProtocol::handleDeltaState(Event *event)
+{
+    if (!NetworkConfig::get()->isClient())
+        return;
+    NetworkString &data = event->data();
+    int ticks = data.getUInt32();
+    int baseline_ticks = (int)data.getUInt32();
+
+    const StateDelta::Snapshot* baseline = NULL;
+    if (baseline_ticks != -1)
+    {
+        for (const StateDelta::Snapshot& s : m_states_history)
+        {
+            if (s.m_ticks == baseline_ticks)
+            {
+                baseline = &s;
+                break;
+            }
+        }
+        if (!baseline)
+        {
+            // The server sends full data again in the next state
+            Log::warn("GameProtocol", "Missing baseline state at %d for "
+                "state at %d.", baseline_ticks, ticks);
+            sendStateNack(baseline_ticks);
+            return;
+        }
+    }
+
+    StateDelta::Snapshot snapshot;
+    snapshot.m_ticks = ticks;
+    StateDelta::decodeSnapshot(baseline, data, &snapshot);
+
+    // Reassemble the same format as a full state for RewindInfoState
+    BareNetworkString full;
+    for (const std::vector<uint8_t>& d : snapshot.m_data)
+    {
+        full.addUInt16((uint16_t)d.size());
+        full.getBuffer().insert(full.getBuffer().end(), d.begin(), d.end());
+    }
+
+    // Only new or reused ids come with their unique identity
+    for (auto& nr : snapshot.m_new_rewinders)
+        RewindManager::get()->setNetworkRewinderName(nr.first, nr.second);
+    snapshot.m_new_rewinders.clear();
+    std::vector<uint16_t> rewinder_ids = snapshot.m_rewinder_ids;
+    addStateToHistory(snapshot);
+    sendStateAck(ticks);
+
+    // The memory for bns will be handled in the RewindInfoState object
+    RewindInfoState* ris = new RewindInfoState(ticks, rewinder_ids,
+        full.getBuffer());
+    RewindManager::get()->addNetworkRewindInfo(ris);
+}   // handleDeltaState
+
 // ----------------------------------------------------------------------------
 /** Called from the RewindManager when rolling back.
  *  \param buffer Pointer to the saved state information.
@@ -383,6 +680,20 @@ void GameProtocol::rewind(BareNetworkString *buffer)
     uint16_t x = buffer->getUInt16();
     uint16_t y = buffer->getUInt16();
     uint16_t z = buffer->getUInt16();
+    if (NetworkConfig::get()->isServer() && MatchLog::isRecording())
+    {
+        MatchLog::get()->addAction(World::getWorld()->getTicksSinceStart(),
+                                   (uint8_t)kart_id, w, x, y, z);
+    }
+    applyControllerAction(kart_id, w, x, y, z);
+}   // rewind
+
+// ----------------------------------------------------------------------------
+/** Applies a compressed controller action to the controller of a kart.
+ */
+void GameProtocol::applyControllerAction(int kart_id, uint8_t w, uint16_t x,
+                                         uint16_t y, uint16_t z)
+{
     const auto& a = decompressAction(w, x, y, z);
     Controller *c = World::getWorld()->getKart(kart_id)->getController();
     PlayerController *pc = dynamic_cast<PlayerController*>(c);
@@ -392,7 +703,7 @@ void GameProtocol::rewind(BareNetworkString *buffer)
         pc->actionFromNetwork(std::get<0>(a), std::get<1>(a), std::get<2>(a),
             std::get<3>(a));
     }
-}   // rewind
+}   // applyControllerAction
 
 // ----------------------------------------------------------------------------
 void GameProtocol::update(int ticks)
@@ -21,12 +21,15 @@
 
 #include "network/event_rewinder.hpp"
 #include "network/protocol.hpp"
+#include "network/state_delta.hpp"
 
 #include "input/input.hpp"                // for PlayerAction
 #include "utils/cpp2011.hpp"
 #include "utils/stk_process.hpp"
 
 #include <cstdlib>
+#include <deque>
+#include <map>
 #include <mutex>
 #include <vector>
 #include <tuple>
@@ -39,6 +42,8 @@ class STKPeer;
 class GameProtocol : public Protocol
                    , public EventRewinder
 {
+    /** Speaks the protocol with simulated clients. */
+    friend class LoadGenerator;
 private:
     /* Used to check if deleting world is doing at the same the for
      * asynchronous event update. */
@@ -49,11 +54,15 @@ private:
            GP_STATE,
            GP_ITEM_UPDATE,
            GP_ITEM_CONFIRMATION,
-           GP_ADJUST_TIME
+           GP_ADJUST_TIME,
+           GP_DELTA_STATE,
+           GP_STATE_ACK,
+           GP_STATE_NACK
     };
 
     /** A network string that collects all information from the server to be sent
-     *  next. */
+     *  next, states are only written to it for clients without delta_state
+     *  capability. */
     NetworkString *m_data_to_send;
 
     /** The server might request that the world clock of a client is adjusted
@@ -74,10 +83,37 @@ private:
     // List of all kart actions to send to the server
     std::vector<Action> m_all_actions;
 
+    /** Server: the state currently being assembled, split by rewinder. */
+    StateDelta::Snapshot m_current_state;
+
+    /** Server: recently sent states which can be used as baseline of a
+     *  delta state. Client: recently received states (main thread for
+     *  server, network thread for client). */
+    std::deque<StateDelta::Snapshot> m_states_history;
+
+    /** Server: latest state ticks acknowledged by each peer (host id). */
+    std::map<uint32_t, int> m_state_ack;
+
+    std::mutex m_state_ack_mutex;
+
+    /** Server: total size of states if all were sent in full, and the size
+     *  actually sent, to show bytes saved by delta states. */
+    uint64_t m_full_state_bytes, m_sent_state_bytes;
+
+    /** Number of ticks to keep states in m_states_history. */
+    int m_states_history_ticks;
+
     void handleControllerAction(Event *event);
     void handleState(Event *event);
     void handleAdjustTime(Event *event);
     void handleItemEventConfirmation(Event *event);
+    void handleDeltaState(Event *event);
+    void handleStateAck(Event *event);
+    void handleStateNack(Event *event);
+    void addStateToHistory(StateDelta::Snapshot& snapshot);
+    void sendStateAck(int ticks);
+    void sendStateNack(int ticks);
+    bool writeFullState();
     static std::weak_ptr<GameProtocol> m_game_protocol[PT_COUNT];
     NetworkItemManager* m_network_item_manager;
     // Maximum value of values are only 32768
@@ -91,7 +127,7 @@ private:
         uint16_t z = (uint16_t)std::abs(a.m_value_r);
         return std::make_tuple(w, x, y, z);
     }
-    std::tuple<PlayerAction, int, int, int>
+    static std::tuple<PlayerAction, int, int, int>
                decompressAction(uint8_t w, uint16_t x, uint16_t y , uint16_t z)
     {
         PlayerAction a = (PlayerAction)(w & 63);
@@ -114,12 +150,19 @@ public:
     void startNewState();
     void addState(BareNetworkString *buffer);
     void sendState();
-    void finalizeState(std::vector<std::string>& cur_rewinder);
+    void finalizeState(std::vector<uint16_t>& rewinder_ids);
     void sendItemEventConfirmation(int ticks);
+    // ------------------------------------------------------------------------
+    /** Returns the number of bytes saved by sending delta states. */
+    uint64_t getDeltaStateBytesSaved() const
+                             { return m_full_state_bytes - m_sent_state_bytes; }
 
     virtual void undo(BareNetworkString *buffer) OVERRIDE;
     virtual void rewind(BareNetworkString *buffer) OVERRIDE;
     // ------------------------------------------------------------------------
+    static void applyControllerAction(int kart_id, uint8_t w, uint16_t x,
+                                      uint16_t y, uint16_t z);
+    // ------------------------------------------------------------------------
     virtual void setup() OVERRIDE {};
     // ------------------------------------------------------------------------
     virtual void asynchronousUpdate() OVERRIDE {}
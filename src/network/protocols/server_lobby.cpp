@@ -20,6 +20,7 @@
 
 #include "addons/addon.hpp"
 #include "config/user_config.hpp"
+#include "io/file_manager.hpp"
 #include "items/network_item_manager.hpp"
 #include "items/powerup_manager.hpp"
 #include "karts/abstract_kart.hpp"
@@ -30,8 +31,11 @@
 #include "modes/soccer_world.hpp"
 #include "modes/linear_world.hpp"
 #include "network/crypto.hpp"
+#include "network/database_index.hpp"
+#include "network/database_worker.hpp"
 #include "network/event.hpp"
 #include "network/game_setup.hpp"
+#include "network/match_log.hpp"
 #include "network/network.hpp"
 #include "network/network_config.hpp"
 #include "network/network_player_profile.hpp"
@@ -348,6 +352,20 @@ void ServerLobby::initDatabase()
         m_ip_geolocation_table_exists);
     checkTableExists(ServerConfig::m_ipv6_geolocation_table,
         m_ipv6_geolocation_table_exists);
+    // Tables not found are left empty
+    m_db_index.reset(new DatabaseIndex(m_db,
+        m_ip_ban_table_exists ? ServerConfig::m_ip_ban_table.c_str() : "",
+        m_ipv6_ban_table_exists ? ServerConfig::m_ipv6_ban_table.c_str() : "",
+        m_online_id_ban_table_exists ?
+        ServerConfig::m_online_id_ban_table.c_str() : "",
+        m_ip_geolocation_table_exists ?
+        ServerConfig::m_ip_geolocation_table.c_str() : "",
+        m_ipv6_geolocation_table_exists ?
+        ServerConfig::m_ipv6_geolocation_table.c_str() : ""));
+    m_last_ban_test_time = StkTime::getTimeSinceEpoch();
+    m_db_worker.reset(new DatabaseWorker(m_db));
+    DatabaseIndex* index = m_db_index.get();
+    m_db_worker->addJob([index]() { index->refresh(); });
 #endif
 }   // initDatabase
 
@@ -357,6 +375,11 @@ void ServerLobby::initServerStatsTable()
 #ifdef ENABLE_SQLITE3
     if (!ServerConfig::m_sql_management || !m_db)
         return;
+    if (!m_db_worker->isWorkerThread())
+    {
+        m_db_worker->waitFor<void>([this]() { initServerStatsTable(); });
+        return;
+    }
     std::string table_name = std::string("v") +
         StringUtils::toString(ServerConfig::m_server_db_version) + "_" +
         ServerConfig::m_server_uid + "_stats";
@@ -593,6 +616,9 @@ void ServerLobby::destroyDatabase()
     auto peers = STKHost::get()->getPeers();
     for (auto& peer : peers)
         writeDisconnectInfoTable(peer.get());
+    // Finishes all queued queries first
+    m_db_worker.reset();
+    m_db_index.reset();
     if (m_db != NULL)
         sqlite3_close(m_db);
 #endif
@@ -606,11 +632,17 @@ void ServerLobby::writeDisconnectInfoTable(STKPeer* peer)
         return;
     std::string query = StringUtils::insertValues(
         "UPDATE %s SET disconnected_time = datetime('now'), "
-        "ping = %d, packet_loss = %d "
-        "WHERE host_id = %u;", m_server_stats_table.c_str(),
-        peer->getAveragePing(), peer->getPacketLoss(),
-        peer->getHostId());
-    easySQLQuery(query);
+        "ping = ?, packet_loss = ? WHERE host_id = ?;",
+        m_server_stats_table.c_str());
+    const unsigned ping = peer->getAveragePing();
+    const int packet_loss = peer->getPacketLoss();
+    const uint32_t host_id = peer->getHostId();
+    asyncSQLQuery(query, [ping, packet_loss, host_id](sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int64(stmt, 1, ping);
+            sqlite3_bind_int(stmt, 2, packet_loss);
+            sqlite3_bind_int64(stmt, 3, host_id);
+        });
 #endif
 }   // writeDisconnectInfoTable
 
@@ -664,6 +696,7 @@ void ServerLobby::updateAddons()
     //else
         m_available_kts.first = { all_k.begin(), all_k.end() };
     m_entering_kts = m_available_kts;
+    updateAssetBitsets();
 }   // updateAddons
 
 //-----------------------------------------------------------------------------
@@ -761,6 +794,7 @@ void ServerLobby::updateTracksForMode()
         }
     }*/
     m_entering_kts = m_available_kts;
+    updateAssetBitsets();
 }   // updateTracksForMode
 
 //-----------------------------------------------------------------------------
@@ -1131,123 +1165,73 @@ bool ServerLobby::notifyEventAsynchronous(Event* event)
  */
 void ServerLobby::pollDatabase()
 {
-    if (!ServerConfig::m_sql_management || !m_db)
+    if (!ServerConfig::m_sql_management || !m_db_worker)
         return;
 
     if (StkTime::getMonoTimeMs() < m_last_poll_db_time + 60000)
         return;
 
     m_last_poll_db_time = StkTime::getMonoTimeMs();
-
-    if (m_ip_ban_table_exists)
-    {
-        std::string query =
-            "SELECT ip_start, ip_end, reason, description FROM ";
-        query += ServerConfig::m_ip_ban_table;
-        query += " WHERE datetime('now') > datetime(starting_time) AND "
-            "(expired_days is NULL OR datetime"
-            "(starting_time, '+'||expired_days||' days') > datetime('now'));";
-        auto peers = STKHost::get()->getPeers();
-        sqlite3_exec(m_db, query.c_str(),
-            [](void* ptr, int count, char** data, char** columns)
-            {
-                std::vector<std::shared_ptr<STKPeer> >* peers_ptr =
-                    (std::vector<std::shared_ptr<STKPeer> >*)ptr;
-                for (std::shared_ptr<STKPeer>& p : *peers_ptr)
-                {
-                    // IPv4 ban list atm
-                    if (p->isAIPeer() || p->getAddress().isIPv6())
-                        continue;
-
-                    uint32_t ip_start = 0;
-                    uint32_t ip_end = 0;
-                    if (!StringUtils::fromString(data[0], ip_start))
-                        continue;
-                    if (!StringUtils::fromString(data[1], ip_end))
-                        continue;
-                    uint32_t peer_addr = p->getAddress().getIP();
-                    if (ip_start <= peer_addr && ip_end >= peer_addr)
-                    {
-                        Log::info("ServerLobby",
-                            "Kick %s, reason: %s, description: %s",
-                            p->getAddress().toString().c_str(),
-                            data[2], data[3]);
-                        p->kick();
-                    }
-                }
-                return 0;
-            }, &peers, NULL);
-    }
-
-    if (m_ipv6_ban_table_exists)
+    std::vector<std::shared_ptr<STKPeer> > peers = STKHost::get()->getPeers();
+    std::vector<uint32_t> exist_hosts;
+    for (auto& peer : peers)
     {
-        std::string query =
-            "SELECT ipv6_cidr, reason, description FROM ";
-        query += ServerConfig::m_ipv6_ban_table;
-        query += " WHERE datetime('now') > datetime(starting_time) AND "
-            "(expired_days is NULL OR datetime"
-            "(starting_time, '+'||expired_days||' days') > datetime('now'));";
-        auto peers = STKHost::get()->getPeers();
-        sqlite3_exec(m_db, query.c_str(),
-            [](void* ptr, int count, char** data, char** columns)
-            {
-                std::vector<std::shared_ptr<STKPeer> >* peers_ptr =
-                    (std::vector<std::shared_ptr<STKPeer> >*)ptr;
-                for (std::shared_ptr<STKPeer>& p : *peers_ptr)
-                {
-                    std::string ipv6;
-                    if (p->getAddress().isIPv6())
-                        ipv6 = p->getAddress().toString(false);
-                    // IPv6 ban list atm
-                    if (p->isAIPeer() || ipv6.empty())
-                        continue;
-
-                    char* ipv6_cidr = data[0];
-                    if (insideIPv6CIDR(ipv6_cidr, ipv6.c_str()) == 1)
-                    {
-                        Log::info("ServerLobby",
-                            "Kick %s, reason: %s, description: %s",
-                            ipv6.c_str(), data[1], data[2]);
-                        p->kick();
-                    }
-                }
-                return 0;
-            }, &peers, NULL);
+        if (!peer->isValidated())
+            continue;
+        exist_hosts.push_back(peer->getHostId());
     }
+    m_db_worker->addJob([this, peers, exist_hosts]() mutable
+        {
+            pollDatabase(peers, exist_hosts);
+        });
+}   // pollDatabase
 
-    if (m_online_id_ban_table_exists)
-    {
-        std::string query = "SELECT online_id, reason, description FROM ";
-        query += ServerConfig::m_online_id_ban_table;
-        query += " WHERE datetime('now') > datetime(starting_time) AND "
-            "(expired_days is NULL OR datetime"
-            "(starting_time, '+'||expired_days||' days') > datetime('now'));";
-        auto peers = STKHost::get()->getPeers();
-        sqlite3_exec(m_db, query.c_str(),
-            [](void* ptr, int count, char** data, char** columns)
+//-----------------------------------------------------------------------------
+/** Does the work of pollDatabase in the database thread.
+ *  \param peers Peers connected when polling.
+ *  \param exist_hosts Host ids of validated peers.
+ */
+void ServerLobby::pollDatabase(std::vector<std::shared_ptr<STKPeer> >& peers,
+                               const std::vector<uint32_t>& exist_hosts)
+{
+    // Peers were tested when connecting, so only test them again if bans
+    // were added or changed, or a ban started since last time. Then all
+    // peers are tested instead of only those matching the changed rows:
+    // each test is a lookup in the in-memory index (no query), which costs
+    // less than finding out which rows changed, and a table read again in
+    // full (after a row was removed) can change any ban anyway.
+    int64_t now = StkTime::getTimeSinceEpoch();
+    bool test_peers = m_db_index->refresh() ||
+        m_db_index->hasBanStarted(m_last_ban_test_time, now);
+    m_last_ban_test_time = now;
+    for (unsigned i = 0; test_peers && i < peers.size(); i++)
+    {
+        std::shared_ptr<STKPeer>& p = peers[i];
+        if (p->isAIPeer())
+            continue;
+        const DatabaseIndex::BanInfo* ban = NULL;
+        if (p->getAddress().isIPv6())
+        {
+            if (m_ipv6_ban_table_exists)
             {
-                std::vector<std::shared_ptr<STKPeer> >* peers_ptr =
-                    (std::vector<std::shared_ptr<STKPeer> >*)ptr;
-                for (std::shared_ptr<STKPeer>& p : *peers_ptr)
-                {
-                    if (p->isAIPeer()
-                        || p->getPlayerProfiles().empty())
-                        continue;
-
-                    uint32_t online_id = 0;
-                    if (!StringUtils::fromString(data[0], online_id))
-                        continue;
-                    if (online_id == p->getPlayerProfiles()[0]->getOnlineId())
-                    {
-                        Log::info("ServerLobby",
-                            "Kick %s, reason: %s, description: %s",
-                            p->getAddress().toString().c_str(),
-                            data[1], data[2]);
-                        p->kick();
-                    }
-                }
-                return 0;
-            }, &peers, NULL);
+                ban = m_db_index->findIPv6Ban(p->getAddress().toString(false),
+                    now);
+            }
+        }
+        else if (m_ip_ban_table_exists)
+            ban = m_db_index->findIPBan(p->getAddress().getIP(), now);
+        if (!ban && m_online_id_ban_table_exists && p->hasPlayerProfiles())
+        {
+            ban = m_db_index->findOnlineIdBan(
+                p->getPlayerProfiles()[0]->getOnlineId(), now);
+        }
+        if (ban)
+        {
+            Log::info("ServerLobby", "Kick %s, reason: %s, description: %s",
+                p->getAddress().toString().c_str(), ban->m_reason.c_str(),
+                ban->m_description.c_str());
+            p->kick();
+        }
     }
 
     if (m_player_reports_table_exists &&
@@ -1255,28 +1239,19 @@ void ServerLobby::pollDatabase()
     {
         std::string query = StringUtils::insertValues(
             "DELETE FROM %s "
-            "WHERE datetime"
-            "(reported_time, '+%f days') < datetime('now');",
-            ServerConfig::m_player_reports_table.c_str(),
-            ServerConfig::m_player_reports_expired_days);
-        easySQLQuery(query);
+            "WHERE julianday(reported_time) + ? < julianday('now');",
+            ServerConfig::m_player_reports_table.c_str());
+        double days = ServerConfig::m_player_reports_expired_days;
+        m_db_worker->easyQuery(query, [days](sqlite3_stmt* stmt)
+            {
+                sqlite3_bind_double(stmt, 1, days);
+            });
     }
     if (m_server_stats_table.empty())
         return;
 
     std::string query;
-    auto peers = STKHost::get()->getPeers();
-    std::vector<uint32_t> exist_hosts;
-    if (!peers.empty())
-    {
-        for (auto& peer : peers)
-        {
-            if (!peer->isValidated())
-                continue;
-            exist_hosts.push_back(peer->getHostId());
-        }
-    }
-    if (peers.empty() || exist_hosts.empty())
+    if (exist_hosts.empty())
     {
         query = StringUtils::insertValues(
             "UPDATE %s SET disconnected_time = datetime('now') "
@@ -1285,6 +1260,8 @@ void ServerLobby::pollDatabase()
     }
     else
     {
+        // Only the number of hosts changes the query, so it's prepared once
+        // for each number of hosts
         std::ostringstream oss;
         oss << "UPDATE " << m_server_stats_table
             << "    SET disconnected_time = datetime('now')"
@@ -1292,50 +1269,53 @@ void ServerLobby::pollDatabase()
             << "    host_id NOT IN (";
         for (unsigned i = 0; i < exist_hosts.size(); i++)
         {
-            oss << exist_hosts[i];
+            oss << "?";
             if (i != (exist_hosts.size() - 1))
                 oss << ",";
         }
         oss << ");";
         query = oss.str();
     }
-    easySQLQuery(query);
+    m_db_worker->easyQuery(query, [&exist_hosts](sqlite3_stmt* stmt)
+        {
+            for (unsigned i = 0; i < exist_hosts.size(); i++)
+                sqlite3_bind_int64(stmt, i + 1, exist_hosts[i]);
+        });
 }   // pollDatabase
 
+//-----------------------------------------------------------------------------
+/** Run simple query in the database thread without waiting for it, with
+ *  optional function to bind values (which must not use anything changing
+ *  meanwhile in other threads).
+ */
+void ServerLobby::asyncSQLQuery(const std::string& query,
+                         std::function<void(sqlite3_stmt* stmt)> bind_function)
+{
+    if (!m_db_worker)
+        return;
+    DatabaseWorker* worker = m_db_worker.get();
+    m_db_worker->addJob([worker, query, bind_function]()
+        {
+            worker->easyQuery(query, bind_function);
+        });
+}   // asyncSQLQuery
+
 //-----------------------------------------------------------------------------
 /** Run simple query with write lock waiting and optional function, this
- *  function has no callback for the return (if any) by the query.
+ *  function has no callback for the return (if any) by the query. It waits
+ *  for the database thread, so use asyncSQLQuery if the result is not needed.
  *  Return true if no error occurs
  */
 bool ServerLobby::easySQLQuery(const std::string& query,
                    std::function<void(sqlite3_stmt* stmt)> bind_function) const
 {
-    if (!m_db)
+    if (!m_db_worker)
         return false;
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        if (bind_function)
-            bind_function(stmt);
-        ret = sqlite3_step(stmt);
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
+    DatabaseWorker* worker = m_db_worker.get();
+    return worker->waitFor<bool>([worker, &query, &bind_function]()
         {
-            Log::error("ServerLobby",
-                "Error finalize database for easy query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-            return false;
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby",
-            "Error preparing database for easy query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return false;
-    }
-    return true;
+            return worker->easyQuery(query, bind_function);
+        });
 }   // easySQLQuery
 
 //-----------------------------------------------------------------------------
@@ -1343,42 +1323,15 @@ std::pair<bool, std::vector<std::vector<std::string>>>
 ServerLobby::vectorSQLQuery(const std::string& query,
     int columns, std::function<void(sqlite3_stmt* stmt)> bind_function) const
 {
-    std::vector<std::vector<std::string>> ans(columns);
-    if (!m_db)
+    typedef std::pair<bool, std::vector<std::vector<std::string> > > Result;
+    if (!m_db_worker)
         return {false, {}};
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        if (bind_function)
-            bind_function(stmt);
-        ret = sqlite3_step(stmt);
-        while (sqlite3_column_text(stmt, 0))
+    DatabaseWorker* worker = m_db_worker.get();
+    return worker->waitFor<Result>([worker, &query, columns,
+        &bind_function]()
         {
-            for (int i = 0; i < columns; i++)
-            {
-                ans[i].push_back(std::string(
-                    (char*)sqlite3_column_text(stmt, i)));
-            }
-            ret = sqlite3_step(stmt);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for vector query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-            return {false, {}};
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby",
-            "Error preparing database for vector query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return {false, {}};
-    }
-    return {true, ans};
+            return worker->vectorQuery(query, columns, bind_function);
+        });
 }   // vectorSQLQuery
 
 //-----------------------------------------------------------------------------
@@ -1425,86 +1378,23 @@ void ServerLobby::checkTableExists(const std::string& table, bool& result)
 }   // checkTableExists
 
 //-----------------------------------------------------------------------------
+/** Geolocates an IPv4 address, must be called in the database thread. */
 std::string ServerLobby::ip2Country(const SocketAddress& addr) const
 {
-    if (!m_db || !m_ip_geolocation_table_exists || addr.isLAN())
-        return "";
-
-    std::string cc_code;
-    std::string query = StringUtils::insertValues(
-        "SELECT country_code FROM %s "
-        "WHERE `ip_start` <= %d AND `ip_end` >= %d "
-        "ORDER BY `ip_start` DESC LIMIT 1;",
-        ServerConfig::m_ip_geolocation_table.c_str(), addr.getIP(),
-        addr.getIP());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            const char* country_code = (char*)sqlite3_column_text(stmt, 0);
-            cc_code = country_code;
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
+    if (!m_db_index || !m_ip_geolocation_table_exists || addr.isLAN())
         return "";
-    }
-    return cc_code;
+    assert(m_db_worker->isWorkerThread());
+    return m_db_index->ip2Country(addr.getIP());
 }   // ip2Country
 
 //-----------------------------------------------------------------------------
+/** Geolocates an IPv6 address, must be called in the database thread. */
 std::string ServerLobby::ipv62Country(const SocketAddress& addr) const
 {
-    if (!m_db || !m_ipv6_geolocation_table_exists)
-        return "";
-
-    std::string cc_code;
-    const std::string& ipv6 = addr.toString(false/*show_port*/);
-    std::string query = StringUtils::insertValues(
-        "SELECT country_code FROM %s "
-        "WHERE `ip_start` <= upperIPv6(\"%s\") AND `ip_end` >= upperIPv6(\"%s\") "
-        "ORDER BY `ip_start` DESC LIMIT 1;",
-        ServerConfig::m_ipv6_geolocation_table.c_str(), ipv6.c_str(),
-        ipv6.c_str());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            const char* country_code = (char*)sqlite3_column_text(stmt, 0);
-            cc_code = country_code;
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
+    if (!m_db_index || !m_ipv6_geolocation_table_exists)
         return "";
-    }
-    return cc_code;
+    assert(m_db_worker->isWorkerThread());
+    return m_db_index->ipv62Country(addr.toString(false/*show_port*/));
 }   // ipv62Country
 
 #endif
@@ -1513,7 +1403,7 @@ std::string ServerLobby::ipv62Country(const SocketAddress& addr) const
 void ServerLobby::writePlayerReport(Event* event)
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_player_reports_table_exists)
+    if (!m_db_worker || !m_player_reports_table_exists)
         return;
     STKPeer* reporter = event->getPeer();
     if (!reporter->hasPlayerProfiles())
@@ -1558,8 +1448,7 @@ void ServerLobby::writePlayerReport(Event* event)
             reporter->getAddress().getIP(), reporter_npp->getOnlineId(),
             reporting_peer->getAddress().getIP(), reporting_npp->getOnlineId());
     }
-    bool written = easySQLQuery(query,
-        [reporter_npp, reporting_npp, info](sqlite3_stmt* stmt)
+    auto bind = [reporter_npp, reporting_npp, info](sqlite3_stmt* stmt)
         {
             // SQLITE_TRANSIENT to copy string
             if (sqlite3_bind_text(stmt, 1, ServerConfig::m_server_uid.c_str(),
@@ -1589,16 +1478,26 @@ void ServerLobby::writePlayerReport(Event* event)
                 Log::error("easySQLQuery", "Failed to bind %s.",
                     StringUtils::wideToUtf8(reporting_npp->getName()).c_str());
             }
+        };
+    // Write it in the database thread, and tell the reporter when done
+    std::shared_ptr<STKPeer> reporter_peer = event->getPeerSP();
+    auto written = std::make_shared<bool>(false);
+    DatabaseWorker* worker = m_db_worker.get();
+    m_db_worker->addJob([worker, query, bind, written]()
+        {
+            *written = worker->easyQuery(query, bind);
+        },
+        [this, reporter_peer, reporting_npp, written]()
+        {
+            if (!*written)
+                return;
+            NetworkString* success = getNetworkString();
+            success->setSynchronous(true);
+            success->addUInt8(LE_REPORT_PLAYER).addUInt8(1)
+                .encodeString(reporting_npp->getName());
+            reporter_peer->sendPacket(success, true/*reliable*/);
+            delete success;
         });
-    if (written)
-    {
-        NetworkString* success = getNetworkString();
-        success->setSynchronous(true);
-        success->addUInt8(LE_REPORT_PLAYER).addUInt8(1)
-            .encodeString(reporting_npp->getName());
-        event->getPeer()->sendPacket(success, true/*reliable*/);
-        delete success;
-    }
 #endif
 }   // writePlayerReport
 
@@ -1615,6 +1514,8 @@ void ServerLobby::asynchronousUpdate()
 
 #ifdef ENABLE_SQLITE3
     pollDatabase();
+    if (m_db_worker)
+        m_db_worker->handleCallbacks();
 #endif
 
     // Check if server owner has left
@@ -1823,7 +1724,7 @@ void ServerLobby::asynchronousUpdate()
             for (auto peer : peers)
             {
                 if (peer->alwaysSpectate() &&
-                    peer->getClientAssets().second.count(track_name) == 0)
+                    !peerHasTrack(peer.get(), track_name))
                 {
                     peer->setAlwaysSpectate(false);
                     peer->setWaitingForGame(true);
@@ -2969,7 +2870,9 @@ void ServerLobby::startSelection(const Event *event)
     }
 
     // Remove karts / tracks from server that are not supported on all clients
-    std::set<std::string> karts_erase, tracks_erase;
+    std::pair<DynamicBitset, DynamicBitset> common_kts = std::make_pair(
+        m_kart_ids.add(m_available_kts.first),
+        m_track_ids.add(m_available_kts.second));
     auto peers = STKHost::get()->getPeers();
     std::set<STKPeer*> always_spectate_peers;
     bool has_peer_plays_game = false;
@@ -2999,8 +2902,10 @@ void ServerLobby::startSelection(const Event *event)
             always_spectate_peers.insert(peer.get());
             continue;
         }
-        peer->eraseServerKarts(m_available_kts.first, karts_erase);
-        peer->eraseServerTracks(m_available_kts.second, tracks_erase);
+        if (peer->hasAvailableKarts())
+            common_kts.first &= peer->getAvailableKarts();
+        if (peer->hasAvailableTracks())
+            common_kts.second &= peer->getAvailableTracks();
         if (!peer->isAIPeer())
             has_peer_plays_game = true;
         racing_players_count++;
@@ -3033,14 +2938,8 @@ void ServerLobby::startSelection(const Event *event)
     //     tracks_erase.insert("icy_soccer_field");
     // }
 
-    for (const std::string& kart_erase : karts_erase)
-    {
-        m_available_kts.first.erase(kart_erase);
-    }
-    for (const std::string& track_erase : tracks_erase)
-    {
-        m_available_kts.second.erase(track_erase);
-    }
+    m_available_kts.first = m_kart_ids.getNames(common_kts.first);
+    m_available_kts.second = m_track_ids.getNames(common_kts.second);
     
     // The host can set a soccer field using the command /setfield
 	if (m_set_field != "")
@@ -3164,17 +3063,21 @@ void ServerLobby::startSelection(const Event *event)
         // return;
     }
 
+    // Votes and the random default track use the final sets
+    m_available_kts_bits.first = m_kart_ids.add(m_available_kts.first);
+    m_available_kts_bits.second = m_track_ids.add(m_available_kts.second);
     RandomGenerator rg;
-    std::set<std::string>::iterator it = m_available_kts.second.begin();
-    std::advance(it, rg.get((int)m_available_kts.second.size()));
-    m_default_vote->m_track_name = *it;
+    int random_track = m_available_kts_bits.second.findNth(
+        rg.get((int)m_available_kts_bits.second.count()));
+    const std::string& default_track = m_track_ids.getName(random_track);
+    m_default_vote->m_track_name = default_track;
     switch (RaceManager::get()->getMinorMode())
     {
         case RaceManager::MINOR_MODE_NORMAL_RACE:
         case RaceManager::MINOR_MODE_TIME_TRIAL:
         case RaceManager::MINOR_MODE_FOLLOW_LEADER:
         {
-            Track* t = track_manager->getTrack(*it);
+            Track* t = track_manager->getTrack(default_track);
             assert(t);
             m_default_vote->m_num_laps = t->getDefaultNumberOfLaps();
             m_default_vote->m_reverse = rg.get(2) == 0;
@@ -3558,6 +3461,12 @@ void ServerLobby::checkRaceFinished()
         }
     }
     Log::info("ServerLobby", "The game is considered finished.");
+    if (MatchLog::isRecording())
+    {
+        MatchLog::get()->stopRecording(
+            World::getWorld()->getTicksSinceStart());
+        MatchLog::destroy();
+    }
     // notify the network world that it is stopped
     RaceEventManager::get()->stop();
 
@@ -4063,86 +3972,116 @@ void ServerLobby::saveIPBanTable(const SocketAddress& addr)
         "INSERT INTO %s (ip_start, ip_end) "
         "VALUES (%u, %u);",
         ServerConfig::m_ip_ban_table.c_str(), addr.getIP(), addr.getIP());
-    easySQLQuery(query);
+    asyncSQLQuery(query);
 #endif
 }   // saveIPBanTable
 
+//-----------------------------------------------------------------------------
+/** Adds all karts and tracks of the server to m_kart_ids and m_track_ids,
+ *  and updates the bitsets of the server sets, which must be done whenever
+ *  they change.
+ */
+void ServerLobby::updateAssetBitsets()
+{
+    unsigned kart_count = m_kart_ids.size();
+    unsigned track_count = m_track_ids.size();
+    m_official_kts_bits.first = m_kart_ids.add(m_official_kts.first);
+    m_official_kts_bits.second = m_track_ids.add(m_official_kts.second);
+    m_addon_kts_bits.first = m_kart_ids.add(m_addon_kts.first);
+    m_addon_kts_bits.second = m_track_ids.add(m_addon_kts.second);
+    m_addon_arenas_bits = m_track_ids.add(m_addon_arenas);
+    m_addon_soccers_bits = m_track_ids.add(m_addon_soccers);
+    m_available_kts_bits.first = m_kart_ids.add(m_available_kts.first);
+    m_available_kts_bits.second = m_track_ids.add(m_available_kts.second);
+    m_entering_kts_bits.first = m_kart_ids.add(m_entering_kts.first);
+    m_entering_kts_bits.second = m_track_ids.add(m_entering_kts.second);
+    m_must_have_tracks_bits = m_track_ids.add(m_must_have_tracks);
+
+    // Connected peers may have sent some of the new ones already
+    if ((m_kart_ids.size() == kart_count &&
+        m_track_ids.size() == track_count) || !STKHost::existHost())
+        return;
+    auto peers = STKHost::get()->getPeers();
+    for (auto& peer : peers)
+        peer->addKnownAssets(m_kart_ids, m_track_ids);
+}   // updateAssetBitsets
+
+//-----------------------------------------------------------------------------
+bool ServerLobby::peerHasKart(const STKPeer* peer,
+                              const std::string& kart) const
+{
+    int id = m_kart_ids.find(kart);
+    if (id != -1)
+        return peer->getAvailableKarts().test(id);
+    return peer->getUnknownKartsTracks().first.count(kart) != 0;
+}   // peerHasKart
+
+//-----------------------------------------------------------------------------
+bool ServerLobby::peerHasTrack(const STKPeer* peer,
+                               const std::string& track) const
+{
+    int id = m_track_ids.find(track);
+    if (id != -1)
+        return peer->getAvailableTracks().test(id);
+    return peer->getUnknownKartsTracks().second.count(track) != 0;
+}   // peerHasTrack
+
 //-----------------------------------------------------------------------------
 bool ServerLobby::handleAssets(const NetworkString& ns, STKPeer* peer)
 {
-    std::set<std::string> client_karts, client_tracks;
+    // Assets known by the server are stored as bits of their ids, so all
+    // checks below are a few bit operations even with thousands of addons
+    std::pair<DynamicBitset, DynamicBitset> client_kts;
+    std::pair<std::set<std::string>, std::set<std::string> > unknown_kts;
     const unsigned kart_num = ns.getUInt16();
     const unsigned track_num = ns.getUInt16();
     for (unsigned i = 0; i < kart_num; i++)
     {
         std::string kart;
         ns.decodeString(&kart);
-        client_karts.insert(kart);
+        int id = m_kart_ids.find(kart);
+        if (id != -1)
+            client_kts.first.set(id);
+        else
+            unknown_kts.first.insert(kart);
     }
     for (unsigned i = 0; i < track_num; i++)
     {
         std::string track;
         ns.decodeString(&track);
-        client_tracks.insert(track);
+        int id = m_track_ids.find(track);
+        if (id != -1)
+            client_kts.second.set(id);
+        else
+            unknown_kts.second.insert(track);
     }
+    const DynamicBitset& client_karts = client_kts.first;
+    const DynamicBitset& client_tracks = client_kts.second;
 
     // Drop this player if he doesn't have at least 1 kart / track the same
     // as server
-    float okt = 0.0f;
-    float ott = 0.0f;
-    int addon_karts = 0;
-    int addon_tracks = 0;
-    int addon_arenas = 0;
-    int addon_soccers = 0;
-    for (auto& client_kart : client_karts)
-    {
-        if (m_official_kts.first.find(client_kart) !=
-            m_official_kts.first.end())
-            okt += 1.0f;
-        if (m_addon_kts.first.find(client_kart) !=
-            m_addon_kts.first.end())
-            ++addon_karts;
-    }
-    okt = okt / (float)m_official_kts.first.size();
-    for (auto& client_track : client_tracks)
-    {
-        if (m_official_kts.second.find(client_track) !=
-            m_official_kts.second.end())
-            ott += 1.0f;
-        if (m_addon_kts.second.find(client_track) !=
-            m_addon_kts.second.end())
-            ++addon_tracks;
-        if (m_addon_arenas.find(client_track) !=
-            m_addon_arenas.end())
-            ++addon_arenas;
-        if (m_addon_soccers.find(client_track) !=
-            m_addon_soccers.end())
-            ++addon_soccers;
-    }
-    ott = ott / (float)m_official_kts.second.size();
-
-    std::set<std::string> karts_erase, tracks_erase;
-    for (const std::string& server_kart : m_entering_kts.first)
-    {
-        if (client_karts.find(server_kart) == client_karts.end())
-        {
-            karts_erase.insert(server_kart);
-        }
-    }
-    for (const std::string& server_track : m_entering_kts.second)
-    {
-        if (client_tracks.find(server_track) == client_tracks.end())
-        {
-            tracks_erase.insert(server_track);
-        }
-    }
-
-    bool has_required_tracks = true;
+    float okt = (float)client_karts.countAnd(m_official_kts_bits.first) /
+        (float)m_official_kts.first.size();
+    float ott = (float)client_tracks.countAnd(m_official_kts_bits.second) /
+        (float)m_official_kts.second.size();
+    int addon_karts = client_karts.countAnd(m_addon_kts_bits.first);
+    int addon_tracks = client_tracks.countAnd(m_addon_kts_bits.second);
+    int addon_arenas = client_tracks.countAnd(m_addon_arenas_bits);
+    int addon_soccers = client_tracks.countAnd(m_addon_soccers_bits);
+
+    bool no_common_karts =
+        client_karts.countAnd(m_entering_kts_bits.first) == 0;
+    bool no_common_tracks =
+        client_tracks.countAnd(m_entering_kts_bits.second) == 0;
+
+    bool has_required_tracks = client_tracks.containsAll(
+        m_must_have_tracks_bits);
     for (const std::string& required_track : m_must_have_tracks)
     {
-        if (client_tracks.find(required_track) == client_tracks.end())
+        if (has_required_tracks)
+            break;
+        if (!m_track_ids.test(client_tracks, required_track))
         {
-            has_required_tracks = false;
             Log::info("ServerLobby", "Player does not have a required track '%s'.", required_track.c_str());
             break;
         }
@@ -4160,9 +4099,9 @@ bool ServerLobby::handleAssets(const NetworkString& ns, STKPeer* peer)
     peer->addon_arenas_count = addon_arenas;
     peer->addon_soccers_count = addon_soccers;
 
-    if (karts_erase.size() == m_entering_kts.first.size())
+    if (no_common_karts)
         Log::verbose("ServerLobby", "Bad player: no common karts with server");
-    if (tracks_erase.size() == m_entering_kts.second.size())
+    if (no_common_tracks)
         Log::verbose("ServerLobby", "Bad player: no common tracks with server");
     if (okt < ServerConfig::m_official_karts_threshold)
         Log::verbose("ServerLobby", "Bad player: bad official kart threshold");
@@ -4179,8 +4118,7 @@ bool ServerLobby::handleAssets(const NetworkString& ns, STKPeer* peer)
     if (!has_required_tracks)
         Log::verbose("ServerLobby", "Bad player: no required tracks");
 
-    if (karts_erase.size() == m_entering_kts.first.size() ||
-        tracks_erase.size() == m_entering_kts.second.size() ||
+    if (no_common_karts || no_common_tracks ||
         okt < ServerConfig::m_official_karts_threshold ||
         ott < ServerConfig::m_official_tracks_threshold ||
         addon_karts < (int)ServerConfig::m_addon_karts_threshold ||
@@ -4217,56 +4155,30 @@ bool ServerLobby::handleAssets(const NetworkString& ns, STKPeer* peer)
     }
 
     std::array<int, AS_TOTAL> addons_scores = {{ -1, -1, -1, -1 }};
-    size_t addon_kart = 0;
-    size_t addon_track = 0;
-    size_t addon_arena = 0;
-    size_t addon_soccer = 0;
-
-    for (auto& kart : m_addon_kts.first)
-    {
-        if (client_karts.find(kart) != client_karts.end())
-            addon_kart++;
-    }
-    for (auto& track : m_addon_kts.second)
-    {
-        if (client_tracks.find(track) != client_tracks.end())
-            addon_track++;
-    }
-    for (auto& arena : m_addon_arenas)
-    {
-        if (client_tracks.find(arena) != client_tracks.end())
-            addon_arena++;
-    }
-    for (auto& soccer : m_addon_soccers)
-    {
-        if (client_tracks.find(soccer) != client_tracks.end())
-            addon_soccer++;
-    }
-
     if (!m_addon_kts.first.empty())
     {
         addons_scores[AS_KART] = int
-            ((float)addon_kart / (float)m_addon_kts.first.size() * 100.0);
+            ((float)addon_karts / (float)m_addon_kts.first.size() * 100.0);
     }
     if (!m_addon_kts.second.empty())
     {
         addons_scores[AS_TRACK] = int
-            ((float)addon_track / (float)m_addon_kts.second.size() * 100.0);
+            ((float)addon_tracks / (float)m_addon_kts.second.size() * 100.0);
     }
     if (!m_addon_arenas.empty())
     {
         addons_scores[AS_ARENA] = int
-            ((float)addon_arena / (float)m_addon_arenas.size() * 100.0);
+            ((float)addon_arenas / (float)m_addon_arenas.size() * 100.0);
     }
     if (!m_addon_soccers.empty())
     {
         addons_scores[AS_SOCCER] = int
-            ((float)addon_soccer / (float)m_addon_soccers.size() * 100.0);
+            ((float)addon_soccers / (float)m_addon_soccers.size() * 100.0);
     }
 
     // Save available karts and tracks from clients in STKPeer so if this peer
     // disconnects later in lobby it won't affect current players
-    peer->setAvailableKartsTracks(client_karts, client_tracks);
+    peer->setAvailableKartsTracks(client_kts, unknown_kts);
     peer->setAddonsScores(addons_scores);
 
     if (m_process_type == PT_CHILD &&
@@ -4288,21 +4200,8 @@ void ServerLobby::connectionRequested(Event* event)
 
     peer->cleanPlayerProfiles();
 
-    // can we add the player ?
-    if (!allowJoinedPlayersWaiting() &&
-        (m_state.load() != WAITING_FOR_START_GAME /*||
-        m_game_setup->isGrandPrixStarted()*/))
-    {
-        NetworkString *message = getNetworkString(2);
-        message->setSynchronous(true);
-        message->addUInt8(LE_CONNECTION_REFUSED).addUInt8(RR_BUSY);
-        // send only to the peer that made the request and disconnect it now
-        peer->sendPacket(message, true/*reliable*/, false/*encrypted*/);
-        peer->reset();
-        delete message;
-        Log::verbose("ServerLobby", "Player refused: selection started");
+    if (refuseIfJoiningClosed(peer))
         return;
-    }
 
     // Check server version
     int version = data.getUInt32();
@@ -4341,27 +4240,96 @@ void ServerLobby::connectionRequested(Event* event)
     online_id = data.getUInt32();
     encrypted_size = data.getUInt32();
 
-    // Will be disconnected if banned by IP
-    testBannedForIP(peer.get());
-    if (peer->isDisconnected())
-        return;
-
-    testBannedForIPv6(peer.get());
-    if (peer->isDisconnected())
-        return;
-
-    if (online_id != 0)
-        testBannedForOnlineId(peer.get(), online_id);
-    // Will be disconnected if banned by online id
-    if (peer->isDisconnected())
+#ifdef ENABLE_SQLITE3
+    if (m_db_worker)
+    {
+        // Test bans and geolocate the peer in the database thread, the
+        // connection continues in the callback after that
+        auto remaining = std::make_shared<BareNetworkString>(
+            data.getCurrentData(), data.size());
+        auto banned = std::make_shared<bool>(false);
+        auto reason = std::make_shared<std::string>();
+        auto country_code = std::make_shared<std::string>();
+        m_db_worker->addJob([this, peer, online_id, banned, reason,
+            country_code]()
+            {
+                *banned = testBannedForIP(peer.get(), reason.get()) ||
+                    testBannedForIPv6(peer.get(), reason.get()) ||
+                    (online_id != 0 && testBannedForOnlineId(peer.get(),
+                    online_id, reason.get()));
+                if (*banned)
+                    return;
+                if (peer->getAddress().isIPv6())
+                    *country_code = ipv62Country(peer->getAddress());
+                else
+                    *country_code = ip2Country(peer->getAddress());
+            },
+            [this, peer, remaining, player_count, online_id, encrypted_size,
+            banned, reason, country_code]()
+            {
+                if (*banned)
+                    kickPlayerWithReason(peer.get(), reason->c_str());
+                else if (!peer->isDisconnected())
+                {
+                    continueConnectionRequest(peer, *remaining, player_count,
+                        online_id, encrypted_size, *country_code);
+                }
+            });
         return;
+    }
+#endif
+    continueConnectionRequest(peer, data, player_count, online_id,
+        encrypted_size, "");
+}   // connectionRequested
 
-    unsigned total_players = 0;
-    STKHost::get()->updatePlayers(NULL, NULL, &total_players);
-    unsigned max_players_mode = (unsigned)ServerConfig::m_server_max_players;
-    if (RaceManager::get()->getMinorMode() ==
-        RaceManager::MINOR_MODE_FREE_FOR_ALL)
-        max_players_mode = std::min<unsigned>(10, max_players_mode);
+//-----------------------------------------------------------------------------
+/** Refuses a connecting peer if players can't join now, e.g. because the
+ *  selection or the race started.
+ *  \return True if the peer was refused.
+ */
+bool ServerLobby::refuseIfJoiningClosed(std::shared_ptr<STKPeer>& peer)
+{
+    // can we add the player ?
+    if (!allowJoinedPlayersWaiting() &&
+        (m_state.load() != WAITING_FOR_START_GAME /*||
+        m_game_setup->isGrandPrixStarted()*/))
+    {
+        NetworkString *message = getNetworkString(2);
+        message->setSynchronous(true);
+        message->addUInt8(LE_CONNECTION_REFUSED).addUInt8(RR_BUSY);
+        // send only to the peer that made the request and disconnect it now
+        peer->sendPacket(message, true/*reliable*/, false/*encrypted*/);
+        peer->reset();
+        delete message;
+        Log::verbose("ServerLobby", "Player refused: selection started");
+        return true;
+    }
+    return false;
+}   // refuseIfJoiningClosed
+
+//-----------------------------------------------------------------------------
+/** Checks the player count and validation of a connecting peer after ban
+ *  tests, then handles its (possibly encrypted) player info.
+ *  \param data The connection request at the player info.
+ *  \param country_code Country code found by IP geolocation.
+ */
+void ServerLobby::continueConnectionRequest(std::shared_ptr<STKPeer> peer,
+                                            BareNetworkString& data,
+                                            unsigned player_count,
+                                            uint32_t online_id,
+                                            uint32_t encrypted_size,
+                                            const std::string& country_code)
+{
+    // The lobby may have changed while the database was tested
+    if (refuseIfJoiningClosed(peer))
+        return;
+
+    unsigned total_players = 0;
+    STKHost::get()->updatePlayers(NULL, NULL, &total_players);
+    unsigned max_players_mode = (unsigned)ServerConfig::m_server_max_players;
+    if (RaceManager::get()->getMinorMode() ==
+        RaceManager::MINOR_MODE_FREE_FOR_ALL)
+        max_players_mode = std::min<unsigned>(10, max_players_mode);
     if (RaceManager::get()->getMinorMode() ==
         RaceManager::MINOR_MODE_CAPTURE_THE_FLAG)
         max_players_mode = std::min<unsigned>(14, max_players_mode);
@@ -4420,8 +4388,9 @@ void ServerLobby::connectionRequested(Event* event)
 
     if (encrypted_size != 0)
     {
-        m_pending_connection[peer] = std::make_pair(online_id,
-            BareNetworkString(data.getCurrentData(), encrypted_size));
+        m_pending_connection[peer] = std::make_tuple(online_id,
+            BareNetworkString(data.getCurrentData(), encrypted_size),
+            country_code);
     }
     else
     {
@@ -4429,9 +4398,9 @@ void ServerLobby::connectionRequested(Event* event)
         if (online_id > 0)
             data.decodeStringW(&online_name);
         handleUnencryptedConnection(peer, data, online_id, online_name,
-            false/*is_pending_connection*/);
+            false/*is_pending_connection*/, country_code);
     }
-}   // connectionRequested
+}   // continueConnectionRequest
 
 //-----------------------------------------------------------------------------
 void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
@@ -4526,13 +4495,6 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
         }
     }
 
-#ifdef ENABLE_SQLITE3
-    if (country_code.empty() && !peer->getAddress().isIPv6())
-        country_code = ip2Country(peer->getAddress());
-    if (country_code.empty() && peer->getAddress().isIPv6())
-        country_code = ipv62Country(peer->getAddress());
-#endif
-
     auto red_blue = STKHost::get()->getAllPlayersTeamInfo();
     std::string utf8_online_name = StringUtils::wideToUtf8(online_name);
     for (unsigned i = 0; i < player_count; i++)
@@ -4631,9 +4593,12 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
     message_ack->addUInt8(LE_CONNECTION_ACCEPTED).addUInt32(peer->getHostId())
         .addUInt32(ServerConfig::m_server_version);
 
-    message_ack->addUInt16(
-        (uint16_t)stk_config->m_network_capabilities.size());
-    for (const std::string& cap : stk_config->m_network_capabilities)
+    // Clients only need to acknowledge states if delta states are sent
+    std::set<std::string> capabilities = stk_config->m_network_capabilities;
+    if (!ServerConfig::m_delta_state)
+        capabilities.erase("delta_state");
+    message_ack->addUInt16((uint16_t)capabilities.size());
+    for (const std::string& cap : capabilities)
         message_ack->encodeString(cap);
 
     message_ack->addFloat(auto_start_timer)
@@ -4702,20 +4667,19 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
 #ifdef ENABLE_SQLITE3
     if (m_server_stats_table.empty() || peer->isAIPeer())
         return;
+    // Values are bound so the prepared statement is reused for all players
     std::string query;
+    std::string ipv6;
     if (ServerConfig::m_ipv6_connection && peer->getAddress().isIPv6())
     {
+        ipv6 = peer->getAddress().toString(false);
         query = StringUtils::insertValues(
             "INSERT INTO %s "
             "(host_id, ip, ipv6 ,port, online_id, username, player_num, "
             "country_code, version, os, ping, addon_karts_count, addon_tracks_count, "
             "addon_arenas_count, addon_soccers_count) "
-            "VALUES (%u, 0, \"%s\" ,%u, %u, ?, %u, ?, ?, ?, %u, %d, %d, %d, %d);",
-            m_server_stats_table.c_str(), peer->getHostId(),
-            peer->getAddress().toString(false), peer->getAddress().getPort(),
-            online_id, player_count, peer->getAveragePing(), peer->addon_karts_count,
-            peer->addon_tracks_count, peer->addon_arenas_count,
-            peer->addon_soccers_count);
+            "VALUES (?1, 0, ?15, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, "
+            "?13, ?14);", m_server_stats_table.c_str());
     }
     else
     {
@@ -4724,26 +4688,43 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
             "(host_id, ip, port, online_id, username, player_num, "
             "country_code, version, os, ping, addon_karts_count, addon_tracks_count, "
             "addon_arenas_count, addon_soccers_count) "
-            "VALUES (%u, %u, %u, %u, ?, %u, ?, ?, ?, %u, %d, %d, %d, %d);",
-            m_server_stats_table.c_str(), peer->getHostId(),
-            peer->getAddress().getIP(), peer->getAddress().getPort(),
-            online_id, player_count, peer->getAveragePing(), peer->addon_karts_count,
-            peer->addon_tracks_count, peer->addon_arenas_count,
-            peer->addon_soccers_count);
-    }
-    easySQLQuery(query, [peer, country_code](sqlite3_stmt* stmt)
-        {
-            if (sqlite3_bind_text(stmt, 1, StringUtils::wideToUtf8(
-                peer->getPlayerProfiles()[0]->getName()).c_str(),
+            "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, "
+            "?13, ?14);", m_server_stats_table.c_str());
+    }
+    const uint32_t host_id = peer->getHostId();
+    const uint32_t ip = peer->getAddress().getIP();
+    const uint16_t port = peer->getAddress().getPort();
+    const uint32_t ping = peer->getAveragePing();
+    const int addon_counts[4] = { peer->addon_karts_count,
+        peer->addon_tracks_count, peer->addon_arenas_count,
+        peer->addon_soccers_count };
+    const std::string name =
+        StringUtils::wideToUtf8(peer->getPlayerProfiles()[0]->getName());
+    auto version_os = StringUtils::extractVersionOS(peer->getUserVersion());
+    asyncSQLQuery(query, [host_id, ip, ipv6, port, online_id, player_count,
+        ping, addon_counts, name, country_code, version_os]
+        (sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int64(stmt, 1, host_id);
+            if (ipv6.empty())
+                sqlite3_bind_int64(stmt, 2, ip);
+            else
+            {
+                sqlite3_bind_text(stmt, 15, ipv6.c_str(), -1,
+                    SQLITE_TRANSIENT);
+            }
+            sqlite3_bind_int(stmt, 3, port);
+            sqlite3_bind_int64(stmt, 4, online_id);
+            if (sqlite3_bind_text(stmt, 5, name.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(
-                    peer->getPlayerProfiles()[0]->getName()).c_str());
+                    name.c_str());
             }
+            sqlite3_bind_int(stmt, 6, player_count);
             if (country_code.empty())
             {
-                if (sqlite3_bind_null(stmt, 2) != SQLITE_OK)
+                if (sqlite3_bind_null(stmt, 7) != SQLITE_OK)
                 {
                     Log::error("easySQLQuery",
                         "Failed to bind NULL for country code.");
@@ -4751,27 +4732,28 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
             }
             else
             {
-                if (sqlite3_bind_text(stmt, 2, country_code.c_str(),
+                if (sqlite3_bind_text(stmt, 7, country_code.c_str(),
                     -1, SQLITE_TRANSIENT) != SQLITE_OK)
                 {
                     Log::error("easySQLQuery", "Failed to bind country: %s.",
                         country_code.c_str());
                 }
             }
-            auto version_os =
-                StringUtils::extractVersionOS(peer->getUserVersion());
-            if (sqlite3_bind_text(stmt, 3, version_os.first.c_str(),
+            if (sqlite3_bind_text(stmt, 8, version_os.first.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
                     version_os.first.c_str());
             }
-            if (sqlite3_bind_text(stmt, 4, version_os.second.c_str(),
+            if (sqlite3_bind_text(stmt, 9, version_os.second.c_str(),
                 -1, SQLITE_TRANSIENT) != SQLITE_OK)
             {
                 Log::error("easySQLQuery", "Failed to bind %s.",
                     version_os.second.c_str());
             }
+            sqlite3_bind_int64(stmt, 10, ping);
+            for (int i = 0; i < 4; i++)
+                sqlite3_bind_int(stmt, 11 + i, addon_counts[i]);
         }
     );
 #endif
@@ -5047,7 +5029,8 @@ void ServerLobby::handlePlayerVote(Event* event)
         vote.m_num_laps, vote.m_reverse);
 
     Track* t = track_manager->getTrack(vote.m_track_name);
-    if (!t)
+    if (!t || !m_track_ids.test(m_available_kts_bits.second,
+        vote.m_track_name))
     {
         vote.m_track_name = *m_available_kts.second.begin();
         t = track_manager->getTrack(vote.m_track_name);
@@ -5477,15 +5460,18 @@ void ServerLobby::handlePendingConnection()
         }
         else
         {
-            const uint32_t online_id = it->second.first;
+            const uint32_t online_id = std::get<0>(it->second);
             auto key = m_keys.find(online_id);
             if (key != m_keys.end() && key->second.m_tried == false)
             {
+                const std::string& country_code =
+                    key->second.m_country_code.empty() ?
+                    std::get<2>(it->second) : key->second.m_country_code;
                 try
                 {
-                    if (decryptConnectionRequest(peer, it->second.second,
+                    if (decryptConnectionRequest(peer, std::get<1>(it->second),
                         key->second.m_aes_key, key->second.m_aes_iv, online_id,
-                        key->second.m_name, key->second.m_country_code))
+                        key->second.m_name, country_code))
                     {
                         it = m_pending_connection.erase(it);
                         m_keys.erase(online_id);
@@ -5673,6 +5659,15 @@ void ServerLobby::configPeersStartTime()
     // (due to packet loss), the start time will still ahead of current time
     uint64_t start_time = STKHost::get()->getNetworkTimer() + (uint64_t)2500;
     powerup_manager->setRandomSeed(start_time);
+    if (ServerConfig::m_record_matches)
+    {
+        MatchLog* ml = MatchLog::get() ? MatchLog::get() : MatchLog::create();
+        std::string filename = file_manager->getReplayDir() + "match_" +
+            StringUtils::toString(StkTime::getTimeSinceEpoch()) + "_" +
+            RaceManager::get()->getTrackName() + ".stkmatch";
+        ml->startRecording(MatchLog::getCurrentSetup(
+            m_game_setup->hasRandomArenaItems()), filename);
+    }
     NetworkString* ns = getNetworkString(10);
     ns->setSynchronous(true);
     ns->addUInt8(LE_START_RACE).addUInt64(start_time);
@@ -5772,207 +5767,113 @@ void ServerLobby::resetServer()
 }   // resetServer
 
 //-----------------------------------------------------------------------------
-void ServerLobby::testBannedForIP(STKPeer* peer) const
+#ifdef ENABLE_SQLITE3
+/** Counts a triggered ban in the database (database thread only). */
+void ServerLobby::triggerBan(const std::string& table, int64_t row_id) const
+{
+    std::string query = StringUtils::insertValues(
+        "UPDATE %s SET trigger_count = trigger_count + 1, "
+        "last_trigger = datetime('now') WHERE rowid = ?;", table.c_str());
+    m_db_worker->easyQuery(query, [row_id](sqlite3_stmt* stmt)
+        {
+            sqlite3_bind_int64(stmt, 1, row_id);
+        });
+}   // triggerBan
+#endif
+
+//-----------------------------------------------------------------------------
+/** Tests if the IPv4 address of peer is banned, must be called in the
+ *  database thread.
+ *  \param reason Set to the reason of the ban if banned.
+ *  \return True if banned.
+ */
+bool ServerLobby::testBannedForIP(STKPeer* peer, std::string* reason) const
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_ip_ban_table_exists)
-        return;
+    if (!m_db_index || !m_ip_ban_table_exists)
+        return false;
+    assert(m_db_worker->isWorkerThread());
 
     // Test for IPv4
     if (peer->getAddress().isIPv6())
-        return;
-
-    int row_id = -1;
-    unsigned ip_start = 0;
-    unsigned ip_end = 0;
-    std::string query = StringUtils::insertValues(
-        "SELECT rowid, ip_start, ip_end, reason, description FROM %s "
-        "WHERE ip_start <= %u AND ip_end >= %u "
-        "AND datetime('now') > datetime(starting_time) AND "
-        "(expired_days is NULL OR datetime"
-        "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_ip_ban_table.c_str(),
-        peer->getAddress().getIP(), peer->getAddress().getIP());
+        return false;
 
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            row_id = sqlite3_column_int(stmt, 0);
-            ip_start = (unsigned)sqlite3_column_int64(stmt, 1);
-            ip_end = (unsigned)sqlite3_column_int64(stmt, 2);
-            const char* reason = (char*)sqlite3_column_text(stmt, 3);
-            const char* desc = (char*)sqlite3_column_text(stmt, 4);
-            Log::info("ServerLobby", "%s banned by IP: %s "
-                "(rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE ip_start = %u AND ip_end = %u;",
-            ServerConfig::m_ip_ban_table.c_str(), ip_start, ip_end);
-        easySQLQuery(query);
-    }
+    const DatabaseIndex::BanInfo* ban = m_db_index->findIPBan(
+        peer->getAddress().getIP(), StkTime::getTimeSinceEpoch());
+    if (!ban)
+        return false;
+    Log::info("ServerLobby", "%s banned by IP: %s "
+        "(rowid: %d, description: %s).",
+        peer->getAddress().toString().c_str(), ban->m_reason.c_str(),
+        (int)ban->m_row_id, ban->m_description.c_str());
+    *reason = ban->m_reason;
+    triggerBan(ServerConfig::m_ip_ban_table, ban->m_row_id);
+    return true;
+#else
+    return false;
 #endif
 }   // testBannedForIP
 
 //-----------------------------------------------------------------------------
-void ServerLobby::testBannedForIPv6(STKPeer* peer) const
+/** Tests if the IPv6 address of peer is banned, must be called in the
+ *  database thread.
+ *  \param reason Set to the reason of the ban if banned.
+ *  \return True if banned.
+ */
+bool ServerLobby::testBannedForIPv6(STKPeer* peer, std::string* reason) const
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_ipv6_ban_table_exists)
-        return;
+    if (!m_db_index || !m_ipv6_ban_table_exists)
+        return false;
+    assert(m_db_worker->isWorkerThread());
 
     // Test for IPv6
     if (!peer->getAddress().isIPv6())
-        return;
-
-    int row_id = -1;
-    std::string ipv6_cidr;
-    std::string query = StringUtils::insertValues(
-        "SELECT rowid, ipv6_cidr, reason, description FROM %s "
-        "WHERE insideIPv6CIDR(ipv6_cidr, ?) = 1 "
-        "AND datetime('now') > datetime(starting_time) AND "
-        "(expired_days is NULL OR datetime"
-        "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_ipv6_ban_table.c_str());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        if (sqlite3_bind_text(stmt, 1,
-            peer->getAddress().toString(false).c_str(), -1, SQLITE_TRANSIENT)
-            != SQLITE_OK)
-        {
-            Log::error("ServerLobby", "Error binding ipv6 addr for query: %s",
-                sqlite3_errmsg(m_db));
-        }
+        return false;
 
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            row_id = sqlite3_column_int(stmt, 0);
-            ipv6_cidr = (char*)sqlite3_column_text(stmt, 1);
-            const char* reason = (char*)sqlite3_column_text(stmt, 2);
-            const char* desc = (char*)sqlite3_column_text(stmt, 3);
-            Log::info("ServerLobby", "%s banned by IP: %s "
-                "(rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
-                query.c_str(), sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE ipv6_cidr = ?;", ServerConfig::m_ipv6_ban_table.c_str());
-        easySQLQuery(query, [ipv6_cidr](sqlite3_stmt* stmt)
-            {
-                if (sqlite3_bind_text(stmt, 1, ipv6_cidr.c_str(),
-                    -1, SQLITE_TRANSIENT) != SQLITE_OK)
-                {
-                    Log::error("easySQLQuery", "Failed to bind %s.",
-                        ipv6_cidr.c_str());
-                }
-            });
-    }
+    const DatabaseIndex::BanInfo* ban = m_db_index->findIPv6Ban(
+        peer->getAddress().toString(false), StkTime::getTimeSinceEpoch());
+    if (!ban)
+        return false;
+    Log::info("ServerLobby", "%s banned by IP: %s "
+        "(rowid: %d, description: %s).",
+        peer->getAddress().toString().c_str(), ban->m_reason.c_str(),
+        (int)ban->m_row_id, ban->m_description.c_str());
+    *reason = ban->m_reason;
+    triggerBan(ServerConfig::m_ipv6_ban_table, ban->m_row_id);
+    return true;
+#else
+    return false;
 #endif
 }   // testBannedForIPv6
 
 //-----------------------------------------------------------------------------
-void ServerLobby::testBannedForOnlineId(STKPeer* peer,
-                                        uint32_t online_id) const
+/** Tests if the online id of peer is banned, must be called in the database
+ *  thread.
+ *  \param reason Set to the reason of the ban if banned.
+ *  \return True if banned.
+ */
+bool ServerLobby::testBannedForOnlineId(STKPeer* peer, uint32_t online_id,
+                                        std::string* reason) const
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db || !m_online_id_ban_table_exists)
-        return;
-
-    int row_id = -1;
-    std::string query = StringUtils::insertValues(
-        "SELECT rowid, reason, description FROM %s "
-        "WHERE online_id = %u "
-        "AND datetime('now') > datetime(starting_time) AND "
-        "(expired_days is NULL OR datetime"
-        "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_online_id_ban_table.c_str(), online_id);
+    if (!m_db_index || !m_online_id_ban_table_exists)
+        return false;
+    assert(m_db_worker->isWorkerThread());
 
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
-    {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
-        {
-            row_id = sqlite3_column_int(stmt, 0);
-            const char* reason = (char*)sqlite3_column_text(stmt, 1);
-            const char* desc = (char*)sqlite3_column_text(stmt, 2);
-            Log::info("ServerLobby", "%s banned by online id: %s "
-                "(online id: %u rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, online_id,
-                row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby", "Error finalize database: %s",
-                sqlite3_errmsg(m_db));
-        }
-    }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database: %s",
-            sqlite3_errmsg(m_db));
-        return;
-    }
-    if (row_id != -1)
-    {
-        query = StringUtils::insertValues(
-            "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE online_id = %u;",
-            ServerConfig::m_online_id_ban_table.c_str(), online_id);
-        easySQLQuery(query);
-    }
+    const DatabaseIndex::BanInfo* ban = m_db_index->findOnlineIdBan(
+        online_id, StkTime::getTimeSinceEpoch());
+    if (!ban)
+        return false;
+    Log::info("ServerLobby", "%s banned by online id: %s "
+        "(online id: %u rowid: %d, description: %s).",
+        peer->getAddress().toString().c_str(), ban->m_reason.c_str(),
+        online_id, (int)ban->m_row_id, ban->m_description.c_str());
+    *reason = ban->m_reason;
+    triggerBan(ServerConfig::m_online_id_ban_table, ban->m_row_id);
+    return true;
+#else
+    return false;
 #endif
 }   // testBannedForOnlineId
 
@@ -5980,7 +5881,7 @@ void ServerLobby::testBannedForOnlineId(STKPeer* peer,
 void ServerLobby::listBanTable()
 {
 #ifdef ENABLE_SQLITE3
-    if (!m_db)
+    if (!m_db_worker)
         return;
     auto printer = [](void* data, int argc, char** argv, char** name)
         {
@@ -5992,22 +5893,25 @@ void ServerLobby::listBanTable()
             std::cout << "\n";
             return 0;
         };
-    if (m_ip_ban_table_exists)
-    {
-        std::string query = "SELECT * FROM ";
-        query += ServerConfig::m_ip_ban_table;
-        query += ";";
-        std::cout << "IP ban list:\n";
-        sqlite3_exec(m_db, query.c_str(), printer, NULL, NULL);
-    }
-    if (m_online_id_ban_table_exists)
-    {
-        std::string query = "SELECT * FROM ";
-        query += ServerConfig::m_online_id_ban_table;
-        query += ";";
-        std::cout << "Online Id ban list:\n";
-        sqlite3_exec(m_db, query.c_str(), printer, NULL, NULL);
-    }
+    m_db_worker->waitFor<void>([this, printer]()
+        {
+            if (m_ip_ban_table_exists)
+            {
+                std::string query = "SELECT * FROM ";
+                query += ServerConfig::m_ip_ban_table;
+                query += ";";
+                std::cout << "IP ban list:\n";
+                sqlite3_exec(m_db, query.c_str(), printer, NULL, NULL);
+            }
+            if (m_online_id_ban_table_exists)
+            {
+                std::string query = "SELECT * FROM ";
+                query += ServerConfig::m_online_id_ban_table;
+                query += ";";
+                std::cout << "Online Id ban list:\n";
+                sqlite3_exec(m_db, query.c_str(), printer, NULL, NULL);
+            }
+        });
 #endif
 }   // listBanTable
 
@@ -6151,18 +6055,10 @@ void ServerLobby::handleServerConfiguration(Event* event)
     auto peers = STKHost::get()->getPeers();
     for (auto& peer : peers)
     {
-        auto assets = peer->getClientAssets();
-        if (!peer->isValidated() || assets.second.empty())
+        if (!peer->isValidated() || !peer->hasAvailableTracks())
             continue;
-        std::set<std::string> tracks_erase;
-        for (const std::string& server_track : m_available_kts.second)
-        {
-            if (assets.second.find(server_track) == assets.second.end())
-            {
-                tracks_erase.insert(server_track);
-            }
-        }
-        if (tracks_erase.size() == m_available_kts.second.size())
+        if (peer->getAvailableTracks().countAnd(
+            m_available_kts_bits.second) == 0)
         {
             NetworkString *message = getNetworkString(2);
             message->setSynchronous(true);
@@ -6353,14 +6249,16 @@ void ServerLobby::setPlayerKarts(const NetworkString& ns, STKPeer* peer) const
         ns.decodeString(&kart);
         if (kart.find("randomkart") != std::string::npos ||
             (kart.find("addon_") == std::string::npos &&
-            m_available_kts.first.find(kart) == m_available_kts.first.end()))
+            !m_kart_ids.test(m_available_kts_bits.first, kart)))
         {
             RandomGenerator rg;
-            std::set<std::string>::iterator it =
-                m_available_kts.first.begin();
-            std::advance(it,
-                rg.get((int)m_available_kts.first.size()));
-            peer->getPlayerProfiles()[i]->setKartName(*it);
+            int id = m_available_kts_bits.first.findNth(
+                rg.get((int)m_available_kts_bits.first.count()));
+            if (id != -1)
+            {
+                peer->getPlayerProfiles()[i]->setKartName(
+                    m_kart_ids.getName(id));
+            }
         }
         else
         {
@@ -6606,6 +6504,15 @@ bool ServerLobby::checkPeersReady(bool ignore_ai_peer) const
 void ServerLobby::handleServerCommand(Event* event,
                                       std::shared_ptr<STKPeer> peer)
 {
+    // Checked before anything else, so spamming commands costs almost nothing
+    if (!peer->consumeCommandToken(ServerConfig::m_command_rate_limit,
+        ServerConfig::m_command_burst_limit))
+    {
+        std::string msg = "Too many commands, please wait a moment.";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+
     NetworkString& data = event->data();
     std::string language;
     data.decodeString(&language);
@@ -6614,14 +6521,13 @@ void ServerLobby::handleServerCommand(Event* event,
     auto argv = StringUtils::split(cmd, ' ');
     if (argv.size() == 0)
         return;
-    
+
     bool hostRights = hasHostRights(peer);
-	std::string peer_username = StringUtils::wideToUtf8(
-		peer->getPlayerProfiles()[0]->getName());
 
 	// Even if a player has host rights, he can be fair and vote for a command.
 	// Example: /vote gnu nolok
-	if (argv[0] == "vote")
+	bool vote = argv[0] == "vote";
+	if (vote)
 	{
 		if (ServerConfig::m_command_voting == false)
 		{
@@ -6643,1664 +6549,1969 @@ void ServerLobby::handleServerCommand(Event* event,
 		cmd = cmd.substr(5, cmd.length());
 	}
 
-    if (argv[0] == "spectate")
+    const auto& commands = getServerCommands();
+    auto it = commands.find(argv[0]);
+    if (it == commands.end())
     {
-        if (ServerConfig::m_soccer_tournament || ServerConfig::m_only_host_riding || ServerConfig::m_race_tournament)
+        // These commands are also accepted by their prefix (like /kickplayer
+        // for /kick), checked in the same order as before the table
+        static const char* prefix_commands[] =
         {
-            std::string msg = "All spectators already have auto spectate ability";
-            sendStringToPeer(msg, peer);
-            return;
-        }
-        if (/*m_game_setup->isGrandPrix() || */!ServerConfig::m_live_players)
+            "playerhasaddon", "kick", "unban", "ban", "playeraddonscore"
+        };
+        for (const char* prefix : prefix_commands)
         {
-            std::string msg = "Server doesn't support spectate";
-            sendStringToPeer(msg, peer);
-            return;
+            if (StringUtils::startsWith(argv[0], prefix))
+            {
+                it = commands.find(prefix);
+                break;
+            }
         }
-
-        if (argv.size() != 2 || (argv[1] != "0" && argv[1] != "1"))
-        {
-            std::string msg = "Usage: spectate [0 or 1], before game started";
-            sendStringToPeer(msg, peer);
+        if (it == commands.end())
             return;
-        }
+    }
+    const ServerCommand& command = it->second;
 
-        if (m_state.load() != WAITING_FOR_START_GAME)
-        {
-            if (argv[1] == "1")
-                m_default_always_spectate_peers.insert(peer.get());
-            else
-                m_default_always_spectate_peers.erase(peer.get());
+    if (vote && !command.m_votable)
+    {
+        std::string msg = "You cannot vote for /" + argv[0] + ".";
+        sendStringToPeer(msg, peer);
+        return;
+    }
 
-			if (m_player_queue_limit > 0)
-				addDeletePlayersFromQueue(peer, argv[1] == "0");
-			
+    switch (command.m_permission)
+    {
+    case CP_EVERYONE:
+        break;
+    case CP_SUPER_TOURNAMENT:
+        if (!ServerConfig::m_super_tournament)
             return;
-        }
-
-        if (argv[1] == "1")
+        break;
+    case CP_REFEREE:
+    case CP_SOCCER_REFEREE:
+    {
+        std::string peer_username = StringUtils::wideToUtf8(
+            peer->getPlayerProfiles()[0]->getName());
+        bool referee = false;
+        if (ServerConfig::m_soccer_tournament)
+            referee = m_tournament_referees.count(peer_username) != 0;
+        else if (ServerConfig::m_race_tournament &&
+            command.m_permission == CP_REFEREE)
+            referee = m_race_tournament_referees.count(peer_username) != 0;
+        else
+            return;
+        if (!referee && !isVIP(peer))
         {
-            if (m_process_type == PT_CHILD &&
-                peer->getHostId() == m_client_server_host_id.load())
+            // The super tournament has its own commands for everyone
+            if (!ServerConfig::m_soccer_tournament ||
+                !ServerConfig::m_super_tournament)
             {
-                std::string msg = "Graphical client server cannot spectate";
+                std::string msg = "You are not a referee";
                 sendStringToPeer(msg, peer);
-                return;
             }
-            peer->setAlwaysSpectate(true);
+            return;
         }
-        else
-            peer->setAlwaysSpectate(false);
+        break;
+    }
+    }
 
-		if (m_player_queue_limit > 0)
-			addDeletePlayersFromQueue(peer, argv[1] == "0");
+    if (argv.size() - 1 < command.m_min_args)
+    {
+        std::string msg = command.m_usage;
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    (this->*command.m_handler)(peer, argv, cmd, hostRights);
+}   // handleServerCommand
 
-        updatePlayerList();
+//-----------------------------------------------------------------------------
+/** Returns all commands of handleServerCommand by their name (without the
+ *  leading slash), commands with the same handler check argv[0] or cmd
+ *  themselves if needed.
+ */
+const std::unordered_map<std::string, ServerLobby::ServerCommand>&
+    ServerLobby::getServerCommands()
+{
+    static const std::unordered_map<std::string, ServerCommand> commands =
+    {
+        { "spectate", { &ServerLobby::handleSpectateCommand, 0, CP_EVERYONE, false, NULL } },
+        { "listserveraddon", { &ServerLobby::handleListServerAddonCommand, 0, CP_EVERYONE, false, NULL } },
+        { "playerhasaddon", { &ServerLobby::handlePlayerHasAddonCommand, 0, CP_EVERYONE, false, NULL } },
+        { "kick", { &ServerLobby::handleKickCommand, 0, CP_EVERYONE, true, NULL } },
+        { "kickban", { &ServerLobby::handleKickCommand, 0, CP_EVERYONE, true, NULL } },
+        { "unban", { &ServerLobby::handleUnbanCommand, 0, CP_EVERYONE, true, NULL } },
+        { "ban", { &ServerLobby::handleBanCommand, 0, CP_EVERYONE, true, NULL } },
+        { "playeraddonscore", { &ServerLobby::handlePlayerAddonScoreCommand, 0, CP_EVERYONE, false, NULL } },
+        { "serverhasaddon", { &ServerLobby::handleServerHasAddonCommand, 0, CP_EVERYONE, false, NULL } },
+        { "help", { &ServerLobby::handleHelpCommand, 0, CP_EVERYONE, false, NULL } },
+        { "commands", { &ServerLobby::handleCommandsCommand, 0, CP_EVERYONE, false, NULL } },
+        { "gnu2addtrack", { &ServerLobby::handleGnu2AddTrackCommand, 0, CP_EVERYONE, true, NULL } },
+        { "gnu", { &ServerLobby::handleGnuCommand, 0, CP_EVERYONE, true, NULL } },
+        { "gnu2", { &ServerLobby::handleGnuCommand, 0, CP_EVERYONE, true, NULL } },
+        { "nognu", { &ServerLobby::handleNoGnuCommand, 0, CP_EVERYONE, true, NULL } },
+        { "tell", { &ServerLobby::handleTellCommand, 0, CP_EVERYONE, false, NULL } },
+        { "queue", { &ServerLobby::handleQueueCommand, 0, CP_EVERYONE, false, NULL } },
+        { "fake", { &ServerLobby::handleFakeCommand, 0, CP_EVERYONE, false, NULL } },
+        { "unfake", { &ServerLobby::handleUnfakeCommand, 0, CP_EVERYONE, false, NULL } },
+        { "standings", { &ServerLobby::handleStandingsCommand, 0, CP_EVERYONE, false, NULL } },
+        { "teamchat", { &ServerLobby::handleTeamChatCommand, 0, CP_EVERYONE, false, NULL } },
+        { "to", { &ServerLobby::handleToCommand, 0, CP_EVERYONE, false, NULL } },
+        { "public", { &ServerLobby::handlePublicCommand, 0, CP_EVERYONE, false, NULL } },
+        { "record", { &ServerLobby::handleRecordCommand, 0, CP_EVERYONE, false, NULL } },
+        { "power", { &ServerLobby::handlePowerCommand, 0, CP_EVERYONE, false, NULL } },
+        { "admin", { &ServerLobby::handleAdminCommand, 0, CP_EVERYONE, false, NULL } },
+        { "version", { &ServerLobby::handleVersionCommand, 0, CP_EVERYONE, false, NULL } },
+#ifdef ENABLE_WEB_SUPPORT
+        { "token", { &ServerLobby::handleTokenCommand, 0, CP_EVERYONE, false, NULL } },
+#endif
+        { "setfield", { &ServerLobby::handleSetTrackCommand, 0, CP_EVERYONE, true, NULL } },
+        { "settrack", { &ServerLobby::handleSetTrackCommand, 0, CP_EVERYONE, true, NULL } },
+        { "setkart", { &ServerLobby::handleSetKartCommand, 0, CP_EVERYONE, true, NULL } },
+        { "sethost", { &ServerLobby::handleSetHostCommand, 0, CP_EVERYONE, true, NULL } },
+        { "mode", { &ServerLobby::handleModeCommand, 0, CP_EVERYONE, true, NULL } },
+        { "join", { &ServerLobby::handleJoinCommand, 0, CP_SUPER_TOURNAMENT, false, NULL } },
+        { "ican", { &ServerLobby::handleTimePollCommand, 0, CP_SUPER_TOURNAMENT, false, NULL } },
+        { "icant", { &ServerLobby::handleTimePollCommand, 0, CP_SUPER_TOURNAMENT, false, NULL } },
+        { "count", { &ServerLobby::handleCountCommand, 0, CP_SUPER_TOURNAMENT, false, NULL } },
+        { "nocount", { &ServerLobby::handleNoCountCommand, 0, CP_SUPER_TOURNAMENT, false, NULL } },
+        { "setteams", { &ServerLobby::handleSetTeamsCommand, 2, CP_SUPER_TOURNAMENT, false, "Usage: /setteams [red team] [blue team]" } },
+        { "yellow", { &ServerLobby::handleYellowCommand, 1, CP_SUPER_TOURNAMENT, false, "Usage: /yellow [player name] [reason]" } },
+        { "addon", { &ServerLobby::handleMatchAddonCommand, 1, CP_SUPER_TOURNAMENT, false, "Usage: /addon [addon]" } },
+        { "server", { &ServerLobby::handleMatchServerCommand, 1, CP_SUPER_TOURNAMENT, false, "Usage: /server [server]" } },
+        { "referee", { &ServerLobby::handleMatchRefereeCommand, 1, CP_SUPER_TOURNAMENT, false, "Usage: /referee [referee]" } },
+        { "video", { &ServerLobby::handleMatchVideoCommand, 1, CP_SUPER_TOURNAMENT, false, "Usage: /video [link]" } },
+        { "notes", { &ServerLobby::handleMatchNotesCommand, 1, CP_SUPER_TOURNAMENT, false, "Usage: /notes [notes]" } },
+        { "skip", { &ServerLobby::handleSkipCommand, 0, CP_SUPER_TOURNAMENT, false, NULL } },
+        { "noskip", { &ServerLobby::handleNoSkipCommand, 0, CP_SUPER_TOURNAMENT, false, NULL } },
+        { "stop", { &ServerLobby::handleStopCommand, 0, CP_SOCCER_REFEREE, false, NULL } },
+        { "go", { &ServerLobby::handleResumeCommand, 0, CP_SOCCER_REFEREE, false, NULL } },
+        { "play", { &ServerLobby::handleResumeCommand, 0, CP_SOCCER_REFEREE, false, NULL } },
+        { "resume", { &ServerLobby::handleResumeCommand, 0, CP_SOCCER_REFEREE, false, NULL } },
+        { "lobby", { &ServerLobby::handleLobbyCommand, 0, CP_SOCCER_REFEREE, false, NULL } },
+        { "init", { &ServerLobby::handleInitCommand, 0, CP_SOCCER_REFEREE, false, NULL } },
+        { "game", { &ServerLobby::handleGameCommand, 0, CP_REFEREE, false, NULL } },
+        { "role", { &ServerLobby::handleRoleCommand, 0, CP_REFEREE, false, NULL } },
+    };
+    return commands;
+}   // getServerCommands
+
+//-----------------------------------------------------------------------------
+/** /game and /role exist in both soccer and race tournaments. */
+void ServerLobby::handleGameCommand(std::shared_ptr<STKPeer>& peer,
+                                    std::vector<std::string>& argv,
+                                    std::string& cmd, bool hostRights)
+{
+    if (!ServerConfig::m_soccer_tournament)
+    {
+        handleRaceGameCommand(peer, argv, cmd, hostRights);
+        return;
     }
-    if (argv[0] == "listserveraddon")
+    if (argv.size() < 2)
     {
-        NetworkString* chat = getNetworkString();
-        chat->addUInt8(LE_CHAT);
-        chat->setSynchronous(true);
-        bool has_options = argv.size() > 1 &&
-            (argv[1].compare("-track") == 0 ||
-            argv[1].compare("-arena") == 0 ||
-            argv[1].compare("-kart") == 0 ||
-            argv[1].compare("-soccer") == 0);
-        if (argv.size() == 1 || argv.size() > 3 || argv[1].size() < 3 ||
-            (argv.size() == 2 && (argv[1].size() < 3 || has_options)) ||
-            (argv.size() == 3 && (!has_options || argv[2].size() < 3)))
-        {
-            chat->encodeString16(
-                L"Usage: /listserveraddon [option][addon string to find "
-                "(at least 3 characters)]. Available options: "
-                "-track, -arena, -kart, -soccer.");
-        }
-        else
-        {
-            std::string type = "";
-            std::string text = "";
-            if(argv.size() > 1)
-            {
-                if(argv[1].compare("-track") == 0 ||
-                   argv[1].compare("-arena") == 0 ||
-                   argv[1].compare("-kart" ) == 0 ||
-                   argv[1].compare("-soccer" ) == 0)
-                    type = argv[1].substr(1);
-                if((argv.size() == 2 && type.empty()) || argv.size() == 3)
-                    text = argv[argv.size()-1];
-            }
+        std::string msg = "Please specify a correct number. "
+            "Format: /game [number][length]";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    handleSoccerGameCommand(peer, argv, cmd, hostRights);
+}   // handleGameCommand
 
-            std::set<std::string> total_addons;
-            if (type.empty() || // not specify addon type
-               (!type.empty() && type.compare("kart") == 0)) // list kart addon
-            {
-                total_addons.insert(m_addon_kts.first.begin(), m_addon_kts.first.end());
-            }
-            if (type.empty() || // not specify addon type
-               (!type.empty() && type.compare("track") == 0))
-            {
-                total_addons.insert(m_addon_kts.second.begin(), m_addon_kts.second.end());
-            }
-            if (type.empty() || // not specify addon type
-               (!type.empty() && type.compare("arena") == 0))
-            {
-                total_addons.insert(m_addon_arenas.begin(), m_addon_arenas.end());
-            }
-            if (type.empty() || // not specify addon type
-               (!type.empty() && type.compare("soccer") == 0))
-            {
-                total_addons.insert(m_addon_soccers.begin(), m_addon_soccers.end());
-            }
-            std::string msg = "";
-            for (auto& addon : total_addons)
-            {
-                // addon_ (6 letters)
-                if (!text.empty() && addon.find(text, 6) == std::string::npos)
-                    continue;
+//-----------------------------------------------------------------------------
+void ServerLobby::handleRoleCommand(std::shared_ptr<STKPeer>& peer,
+                                    std::vector<std::string>& argv,
+                                    std::string& cmd, bool hostRights)
+{
+    if (ServerConfig::m_soccer_tournament)
+        handleSoccerRoleCommand(peer, argv, cmd, hostRights);
+    else
+        handleRaceRoleCommand(peer, argv, cmd, hostRights);
+}   // handleRoleCommand
 
-                msg += addon.substr(6);
-                msg += ", ";
-            }
-            if (msg.empty())
-                chat->encodeString16(L"Addon not found");
-            else
-            {
-                msg = msg.substr(0, msg.size() - 2);
-                chat->encodeString16(StringUtils::utf8ToWide(
-                    std::string("Server addon: ") + msg));
-            }
-        }
-        peer->sendPacket(chat, true/*reliable*/);
-        delete chat;
+//-----------------------------------------------------------------------------
+void ServerLobby::handleSpectateCommand(std::shared_ptr<STKPeer>& peer,
+                                        std::vector<std::string>& argv,
+                                        std::string& cmd, bool hostRights)
+{
+    if (ServerConfig::m_soccer_tournament || ServerConfig::m_only_host_riding || ServerConfig::m_race_tournament)
+    {
+        std::string msg = "All spectators already have auto spectate ability";
+        sendStringToPeer(msg, peer);
+        return;
     }
-    if (StringUtils::startsWith(cmd, "playerhasaddon"))
+    if (/*m_game_setup->isGrandPrix() || */!ServerConfig::m_live_players)
     {
-        NetworkString* chat = getNetworkString();
-        chat->addUInt8(LE_CHAT);
-        chat->setSynchronous(true);
-        std::string part;
-        if (cmd.length() > 15)
-            part = cmd.substr(15);
-        std::string addon_id = part.substr(0, part.find(' '));
-        std::string player_name;
-        if (part.length() > addon_id.length() + 1)
-            player_name = part.substr(addon_id.length() + 1);
-        std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(
-            StringUtils::utf8ToWide(player_name));
-        if (player_name.empty() || !player_peer || addon_id.empty())
-        {
-            chat->encodeString16(
-                L"Usage: /playerhasaddon [addon_identity] [player name]");
-        }
+        std::string msg = "Server doesn't support spectate";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+
+    if (argv.size() != 2 || (argv[1] != "0" && argv[1] != "1"))
+    {
+        std::string msg = "Usage: spectate [0 or 1], before game started";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+
+    if (m_state.load() != WAITING_FOR_START_GAME)
+    {
+        if (argv[1] == "1")
+            m_default_always_spectate_peers.insert(peer.get());
         else
-        {
-            std::string addon_id_test = Addon::createAddonId(addon_id);
-            bool found = false;
-            const auto& kt = player_peer->getClientAssets();
-            for (auto& kart : kt.first)
-            {
-                if (kart == addon_id_test)
-                {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found)
-            {
-                for (auto& track : kt.second)
-                {
-                    if (track == addon_id_test)
-                    {
-                        found = true;
-                        break;
-                    }
-                }
-            }
-            if (found)
-            {
-                chat->encodeString16(StringUtils::utf8ToWide
-                    (player_name + " has addon " + addon_id));
-            }
-            else
-            {
-                chat->encodeString16(StringUtils::utf8ToWide
-                    (player_name + " has no addon " + addon_id));
-            }
-        }
-        peer->sendPacket(chat, true/*reliable*/);
-        delete chat;
+            m_default_always_spectate_peers.erase(peer.get());
+
+        if (m_player_queue_limit > 0)
+            addDeletePlayersFromQueue(peer, argv[1] == "0");
+
+        return;
     }
-    if (StringUtils::startsWith(cmd, "kick"))
+
+    if (argv[1] == "1")
     {
-        std::string player_name;
-        if (StringUtils::startsWith(cmd, "kickban"))
-        {
-            if (cmd.length() > 8)
-                player_name = cmd.substr(8);
-        }
-        else if (cmd.length() > 5)
-        {
-            player_name = cmd.substr(5);
-        }
-        std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(
-            StringUtils::utf8ToWide(player_name));
-        if (player_name.empty() || !player_peer || player_peer->isAIPeer())
+        if (m_process_type == PT_CHILD &&
+            peer->getHostId() == m_client_server_host_id.load())
         {
-			std::string msg = "Usage: /kick [player name]";
-			sendStringToPeer(msg, peer);
-			return;
+            std::string msg = "Graphical client server cannot spectate";
+            sendStringToPeer(msg, peer);
+            return;
         }
-        else
-        {
-            if (!isVIP(peer) && !ServerConfig::m_kicks_allowed)
-            {
-                std::string msg = "Kicking players is not allowed on this server";
-                sendStringToPeer(msg, peer);
-                return;
-            }
+        peer->setAlwaysSpectate(true);
+    }
+    else
+        peer->setAlwaysSpectate(false);
 
-			if (!commandPermitted(cmd, peer, hostRights)) return;
+    if (m_player_queue_limit > 0)
+        addDeletePlayersFromQueue(peer, argv[1] == "0");
 
-            Log::info("ServerLobby", "Player %s kicks %s using /kick", peer_username.c_str(), player_name.c_str());
-            player_peer->kick();
-            if (ServerConfig::m_track_kicks) {
-                std::string auto_report = "[ Auto report caused by kick ]";
-                writeOwnReport(player_peer.get(), peer.get(), auto_report);
-            }
-            if (StringUtils::startsWith(cmd, "kickban"))
-            {
-                if (isVIP(peer) || (ServerConfig::m_soccer_tournament && hasHostRights(peer)))
-                {
-                    Log::info("ServerLobby", "%s is now banned", player_name.c_str());
-                    m_temp_banned.insert(player_name);
-                    std::string msg = StringUtils::insertValues(
-                        "%s is now banned", player_name.c_str());
-                    sendStringToPeer(msg, peer);
-                }
-                else
-                {
-                    std::string msg = "You cannot ban players";
-                    sendStringToPeer(msg, peer);
-                }
-            }
-        }
+    updatePlayerList();
+}   // handleSpectateCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleListServerAddonCommand(std::shared_ptr<STKPeer>& peer,
+                                               std::vector<std::string>& argv,
+                                               std::string& cmd, bool hostRights)
+{
+    NetworkString* chat = getNetworkString();
+    chat->addUInt8(LE_CHAT);
+    chat->setSynchronous(true);
+    bool has_options = argv.size() > 1 &&
+        (argv[1].compare("-track") == 0 ||
+        argv[1].compare("-arena") == 0 ||
+        argv[1].compare("-kart") == 0 ||
+        argv[1].compare("-soccer") == 0);
+    if (argv.size() == 1 || argv.size() > 3 || argv[1].size() < 3 ||
+        (argv.size() == 2 && (argv[1].size() < 3 || has_options)) ||
+        (argv.size() == 3 && (!has_options || argv[2].size() < 3)))
+    {
+        chat->encodeString16(
+            L"Usage: /listserveraddon [option][addon string to find "
+            "(at least 3 characters)]. Available options: "
+            "-track, -arena, -kart, -soccer.");
     }
-    if (StringUtils::startsWith(cmd, "unban"))
+    else
     {
-		if (!isVIP(peer) && !(ServerConfig::m_soccer_tournament && hasHostRights(peer)))
+        std::string type = "";
+        std::string text = "";
+        if(argv.size() > 1)
         {
-			std::string msg = "You cannot unban players";
-			sendStringToPeer(msg, peer);
-            return;
+            if(argv[1].compare("-track") == 0 ||
+               argv[1].compare("-arena") == 0 ||
+               argv[1].compare("-kart" ) == 0 ||
+               argv[1].compare("-soccer" ) == 0)
+                type = argv[1].substr(1);
+            if((argv.size() == 2 && type.empty()) || argv.size() == 3)
+                text = argv[argv.size()-1];
         }
-        std::string player_name;
-        if (cmd.length() > 6)
+
+        std::set<std::string> total_addons;
+        if (type.empty() || // not specify addon type
+           (!type.empty() && type.compare("kart") == 0)) // list kart addon
         {
-            player_name = cmd.substr(6);
+            total_addons.insert(m_addon_kts.first.begin(), m_addon_kts.first.end());
         }
-        if (player_name.empty())
+        if (type.empty() || // not specify addon type
+           (!type.empty() && type.compare("track") == 0))
         {
-			std::string msg = "Usage: /unban [player name]";
-			sendStringToPeer(msg, peer);
+            total_addons.insert(m_addon_kts.second.begin(), m_addon_kts.second.end());
         }
-        else
+        if (type.empty() || // not specify addon type
+           (!type.empty() && type.compare("arena") == 0))
         {
-			if (!commandPermitted(cmd, peer, hostRights)) return;
-
-            Log::info("ServerLobby", "%s is now unbanned", player_name.c_str());
-            m_temp_banned.erase(player_name);
-
-			std::string msg = StringUtils::insertValues(
-				"%s is now unbanned", player_name.c_str());
-			sendStringToPeer(msg, peer);
+            total_addons.insert(m_addon_arenas.begin(), m_addon_arenas.end());
         }
-    }
-    if (StringUtils::startsWith(cmd, "ban"))
-    {
-		if (!isVIP(peer) && !(ServerConfig::m_soccer_tournament && hasHostRights(peer)))
-		{
-			std::string msg = "You cannot ban players";
-			sendStringToPeer(msg, peer);
-			return;
-		}
-        
-        std::string player_name;
-        if (cmd.length() > 4)
+        if (type.empty() || // not specify addon type
+           (!type.empty() && type.compare("soccer") == 0))
         {
-            player_name = cmd.substr(4);
+            total_addons.insert(m_addon_soccers.begin(), m_addon_soccers.end());
         }
-        if (player_name.empty())
+        std::string msg = "";
+        for (auto& addon : total_addons)
         {
-            NetworkString* chat = getNetworkString();
-            chat->addUInt8(LE_CHAT);
-            chat->setSynchronous(true);
-            chat->encodeString16(
-                L"Usage: /ban [player name]");
-            peer->sendPacket(chat, true/*reliable*/);
-            delete chat;
+            // addon_ (6 letters)
+            if (!text.empty() && addon.find(text, 6) == std::string::npos)
+                continue;
+
+            msg += addon.substr(6);
+            msg += ", ";
         }
+        if (msg.empty())
+            chat->encodeString16(L"Addon not found");
         else
         {
-			if (!commandPermitted(cmd, peer, hostRights)) return;
-
-            Log::info("ServerLobby", "%s is now banned", player_name.c_str());
-            m_temp_banned.insert(player_name);
-
-            std::string msg = StringUtils::insertValues(
-                "%s is now banned", player_name.c_str());
-            sendStringToPeer(msg, peer);
+            msg = msg.substr(0, msg.size() - 2);
+            chat->encodeString16(StringUtils::utf8ToWide(
+                std::string("Server addon: ") + msg));
         }
     }
-    if (StringUtils::startsWith(cmd, "playeraddonscore"))
+    peer->sendPacket(chat, true/*reliable*/);
+    delete chat;
+}   // handleListServerAddonCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handlePlayerHasAddonCommand(std::shared_ptr<STKPeer>& peer,
+                                              std::vector<std::string>& argv,
+                                              std::string& cmd, bool hostRights)
+{
+    NetworkString* chat = getNetworkString();
+    chat->addUInt8(LE_CHAT);
+    chat->setSynchronous(true);
+    std::string part;
+    if (cmd.length() > 15)
+        part = cmd.substr(15);
+    std::string addon_id = part.substr(0, part.find(' '));
+    std::string player_name;
+    if (part.length() > addon_id.length() + 1)
+        player_name = part.substr(addon_id.length() + 1);
+    std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(
+        StringUtils::utf8ToWide(player_name));
+    if (player_name.empty() || !player_peer || addon_id.empty())
+    {
+        chat->encodeString16(
+            L"Usage: /playerhasaddon [addon_identity] [player name]");
+    }
+    else
     {
-        NetworkString* chat = getNetworkString();
-        chat->addUInt8(LE_CHAT);
-        chat->setSynchronous(true);
-        std::string player_name;
-        if (cmd.length() > 17)
-            player_name = cmd.substr(17);
-        std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(
-            StringUtils::utf8ToWide(player_name));
-        if (player_name.empty() || !player_peer)
+        std::string addon_id_test = Addon::createAddonId(addon_id);
+        bool found = peerHasKart(player_peer.get(), addon_id_test) ||
+            peerHasTrack(player_peer.get(), addon_id_test);
+        if (found)
         {
-            chat->encodeString16(
-                L"Usage: /playeraddonscore [player name] (return 0-100)");
+            chat->encodeString16(StringUtils::utf8ToWide
+                (player_name + " has addon " + addon_id));
         }
         else
         {
-            auto& scores = player_peer->getAddonsScores();
-            if (scores[AS_KART] == -1 && scores[AS_TRACK] == -1 &&
-                scores[AS_ARENA] == -1 && scores[AS_SOCCER] == -1)
-            {
-                chat->encodeString16(StringUtils::utf8ToWide
-                    (player_name + " has no addon"));
-            }
-            else
-            {
-                std::string msg = player_name;
-                msg += " addon:";
-                if (scores[AS_KART] != -1)
-                    msg += " kart: " + StringUtils::toString(scores[AS_KART]) + ",";
-                if (scores[AS_TRACK] != -1)
-                    msg += " track: " + StringUtils::toString(scores[AS_TRACK]) + ",";
-                if (scores[AS_ARENA] != -1)
-                    msg += " arena: " + StringUtils::toString(scores[AS_ARENA]) + ",";
-                if (scores[AS_SOCCER] != -1)
-                    msg += " soccer: " + StringUtils::toString(scores[AS_SOCCER]) + ",";
-                msg = msg.substr(0, msg.size() - 1);
-                chat->encodeString16(StringUtils::utf8ToWide(msg));
-            }
+            chat->encodeString16(StringUtils::utf8ToWide
+                (player_name + " has no addon " + addon_id));
         }
-        peer->sendPacket(chat, true/*reliable*/);
-        delete chat;
     }
-    if (argv[0] == "serverhasaddon")
+    peer->sendPacket(chat, true/*reliable*/);
+    delete chat;
+}   // handlePlayerHasAddonCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleKickCommand(std::shared_ptr<STKPeer>& peer,
+                                    std::vector<std::string>& argv,
+                                    std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    std::string player_name;
+    if (StringUtils::startsWith(cmd, "kickban"))
     {
-        NetworkString* chat = getNetworkString();
-        chat->addUInt8(LE_CHAT);
-        chat->setSynchronous(true);
-        if (argv.size() != 2)
+        if (cmd.length() > 8)
+            player_name = cmd.substr(8);
+    }
+    else if (cmd.length() > 5)
+    {
+        player_name = cmd.substr(5);
+    }
+    std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(
+        StringUtils::utf8ToWide(player_name));
+    if (player_name.empty() || !player_peer || player_peer->isAIPeer())
+    {
+        std::string msg = "Usage: /kick [player name]";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    else
+    {
+        if (!isVIP(peer) && !ServerConfig::m_kicks_allowed)
         {
-            chat->encodeString16(
-                L"Usage: /serverhasaddon [addon_identity]");
+            std::string msg = "Kicking players is not allowed on this server";
+            sendStringToPeer(msg, peer);
+            return;
         }
-        else
+
+        if (!commandPermitted(cmd, peer, hostRights)) return;
+
+        Log::info("ServerLobby", "Player %s kicks %s using /kick", peer_username.c_str(), player_name.c_str());
+        player_peer->kick();
+        if (ServerConfig::m_track_kicks) {
+            std::string auto_report = "[ Auto report caused by kick ]";
+            writeOwnReport(player_peer.get(), peer.get(), auto_report);
+        }
+        if (StringUtils::startsWith(cmd, "kickban"))
         {
-            std::set<std::string> total_addons;
-            total_addons.insert(m_addon_kts.first.begin(), m_addon_kts.first.end());
-            total_addons.insert(m_addon_kts.second.begin(), m_addon_kts.second.end());
-            total_addons.insert(m_addon_arenas.begin(), m_addon_arenas.end());
-            total_addons.insert(m_addon_soccers.begin(), m_addon_soccers.end());
-            std::string addon_id_test = Addon::createAddonId(argv[1]);
-            bool found = total_addons.find(addon_id_test) != total_addons.end();
-            if (found)
+            if (isVIP(peer) || (ServerConfig::m_soccer_tournament && hasHostRights(peer)))
             {
-                chat->encodeString16(StringUtils::utf8ToWide(std::string
-                    ("Server has addon ") + argv[1]));
+                Log::info("ServerLobby", "%s is now banned", player_name.c_str());
+                m_temp_banned.insert(player_name);
+                std::string msg = StringUtils::insertValues(
+                    "%s is now banned", player_name.c_str());
+                sendStringToPeer(msg, peer);
             }
             else
             {
-                chat->encodeString16(StringUtils::utf8ToWide(std::string
-                    ("Server has no addon ") + argv[1]));
+                std::string msg = "You cannot ban players";
+                sendStringToPeer(msg, peer);
             }
         }
-        peer->sendPacket(chat, true/*reliable*/);
-        delete chat;
     }
-    if (argv[0] == "help")
+}   // handleKickCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleUnbanCommand(std::shared_ptr<STKPeer>& peer,
+                                     std::vector<std::string>& argv,
+                                     std::string& cmd, bool hostRights)
+{
+    if (!isVIP(peer) && !(ServerConfig::m_soccer_tournament && hasHostRights(peer)))
     {
-        NetworkString* chat = getNetworkString();
-        chat->addUInt8(LE_CHAT);
-        chat->setSynchronous(true);
-        chat->encodeString16(m_help_message);
-        peer->sendPacket(chat, true/*reliable*/);
-        delete chat;
+        std::string msg = "You cannot unban players";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    std::string player_name;
+    if (cmd.length() > 6)
+    {
+        player_name = cmd.substr(6);
+    }
+    if (player_name.empty())
+    {
+        std::string msg = "Usage: /unban [player name]";
+        sendStringToPeer(msg, peer);
+    }
+    else
+    {
+        if (!commandPermitted(cmd, peer, hostRights)) return;
+
+        Log::info("ServerLobby", "%s is now unbanned", player_name.c_str());
+        m_temp_banned.erase(player_name);
+
+        std::string msg = StringUtils::insertValues(
+            "%s is now unbanned", player_name.c_str());
+        sendStringToPeer(msg, peer);
+    }
+}   // handleUnbanCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleBanCommand(std::shared_ptr<STKPeer>& peer,
+                                   std::vector<std::string>& argv,
+                                   std::string& cmd, bool hostRights)
+{
+    if (!isVIP(peer) && !(ServerConfig::m_soccer_tournament && hasHostRights(peer)))
+    {
+        std::string msg = "You cannot ban players";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+
+    std::string player_name;
+    if (cmd.length() > 4)
+    {
+        player_name = cmd.substr(4);
     }
-    if (argv[0] == "commands")
+    if (player_name.empty())
     {
         NetworkString* chat = getNetworkString();
         chat->addUInt8(LE_CHAT);
-        chat->setSynchronous(true);chat->encodeString16
-            (StringUtils::utf8ToWide(m_available_commands));
+        chat->setSynchronous(true);
+        chat->encodeString16(
+            L"Usage: /ban [player name]");
         peer->sendPacket(chat, true/*reliable*/);
         delete chat;
     }
-	if (argv[0] == "gnu2addtrack")
-	{
-		if (argv.size() > 1)
-		{
-			std::string newTrack = argv[1];
-
-			if (serverAndPeerHaveTrack(peer, newTrack))
-			{
-				if (!commandPermitted(cmd, peer, hostRights)) return;
+    else
+    {
+        if (!commandPermitted(cmd, peer, hostRights)) return;
 
-				m_gnu2_available_tracks.insert(m_gnu2_available_tracks.begin(), newTrack);
+        Log::info("ServerLobby", "%s is now banned", player_name.c_str());
+        m_temp_banned.insert(player_name);
 
-				NetworkString* chat = getNetworkString();
-				chat->addUInt8(LE_CHAT);
-				chat->setSynchronous(true);
-				std::string message = "Track "+ newTrack +" was added to gnu2 elimination!";
-				chat->encodeString16(StringUtils::utf8ToWide(message));
-				sendMessageToPeers(chat);
-				delete chat;
-				return;
-			}
-			else
-			{
-				std::string message = "Track " + newTrack + " does not exist or is not installed.";
-				sendStringToPeer(message, peer);
-				return;
-			}
-		}
-	}
-    if (argv[0] == "gnu" || argv[0] == "gnu2")
+        std::string msg = StringUtils::insertValues(
+            "%s is now banned", player_name.c_str());
+        sendStringToPeer(msg, peer);
+    }
+}   // handleBanCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handlePlayerAddonScoreCommand(std::shared_ptr<STKPeer>& peer,
+                                                std::vector<std::string>& argv,
+                                                std::string& cmd, bool hostRights)
+{
+    NetworkString* chat = getNetworkString();
+    chat->addUInt8(LE_CHAT);
+    chat->setSynchronous(true);
+    std::string player_name;
+    if (cmd.length() > 17)
+        player_name = cmd.substr(17);
+    std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(
+        StringUtils::utf8ToWide(player_name));
+    if (player_name.empty() || !player_peer)
     {
-        if (m_gnu_elimination)
-        {
-            NetworkString* chat = getNetworkString();
-            chat->addUInt8(LE_CHAT);
-            chat->setSynchronous(true);
-            chat->encodeString16(
-                    L"Gnu Elimination mode was already enabled!");
-            peer->sendPacket(chat, true/*reliable*/);
-            delete chat;
-        }
-        else if (
-            RaceManager::get()->getMinorMode() != RaceManager::MINOR_MODE_NORMAL_RACE &&
-            RaceManager::get()->getMinorMode() != RaceManager::MINOR_MODE_TIME_TRIAL)
+        chat->encodeString16(
+            L"Usage: /playeraddonscore [player name] (return 0-100)");
+    }
+    else
+    {
+        auto& scores = player_peer->getAddonsScores();
+        if (scores[AS_KART] == -1 && scores[AS_TRACK] == -1 &&
+            scores[AS_ARENA] == -1 && scores[AS_SOCCER] == -1)
         {
-            NetworkString* chat = getNetworkString();
-            chat->addUInt8(LE_CHAT);
-            chat->setSynchronous(true);
-            chat->encodeString16(
-                    L"Gnu Elimination is available only with racing modes");
-            peer->sendPacket(chat, true/*reliable*/);
-            delete chat;
+            chat->encodeString16(StringUtils::utf8ToWide
+                (player_name + " has no addon"));
         }
         else
         {
-			if (!commandPermitted(cmd, peer, hostRights)) return;
-
-			if (argv[0] == "gnu2")
-			{
-				m_gnu2_activated = true;
-				m_gnu2_initialized = false;
-				m_gnu2_available_tracks.clear();
-
-				std::vector<std::string> gnu2_available_tracks = StringUtils::split(ServerConfig::m_gnu2_available_tracks, ' ');
-
-				for (std::string track : gnu2_available_tracks)
-				{
-					if (serverAndPeerHaveTrack(peer, track))
-						m_gnu2_available_tracks.push_back(track);
-				}
-			}
-
-            //if (argv.size() > 1 && m_available_kts.first.count(argv[1]) > 0) {
-			if (argv.size() > 1 && serverAndPeerHaveKart(peer, argv[1])) {
-                m_gnu_kart = argv[1];
-            } else {
-                m_gnu_kart = "gnu";
-            }
-            NetworkString* chat = getNetworkString();
-            m_gnu_elimination = true;
-            m_gnu_remained = -1;
-            m_gnu_participants.clear();
-            chat->addUInt8(LE_CHAT);
-            chat->setSynchronous(true);
-            if (m_gnu_kart == "gnu")
-            {
-                chat->encodeString16(
-                    L"Gnu Elimination starts now! Use /standings "
-                    "after each race for results.");
-            }
-            else
-            {
-                chat->encodeString16(StringUtils::utf8ToWide(
-                    StringUtils::insertValues("Gnu Elimination starts now "
-                        "(elimination kart: %s)! Use /standings "
-                        "after each race for results.", m_gnu_kart)));
-            }
-            sendMessageToPeers(chat);
-            delete chat;
+            std::string msg = player_name;
+            msg += " addon:";
+            if (scores[AS_KART] != -1)
+                msg += " kart: " + StringUtils::toString(scores[AS_KART]) + ",";
+            if (scores[AS_TRACK] != -1)
+                msg += " track: " + StringUtils::toString(scores[AS_TRACK]) + ",";
+            if (scores[AS_ARENA] != -1)
+                msg += " arena: " + StringUtils::toString(scores[AS_ARENA]) + ",";
+            if (scores[AS_SOCCER] != -1)
+                msg += " soccer: " + StringUtils::toString(scores[AS_SOCCER]) + ",";
+            msg = msg.substr(0, msg.size() - 1);
+            chat->encodeString16(StringUtils::utf8ToWide(msg));
         }
     }
-    if (argv[0] == "nognu")
-    {        
-		if (!m_gnu_elimination)
+    peer->sendPacket(chat, true/*reliable*/);
+    delete chat;
+}   // handlePlayerAddonScoreCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleServerHasAddonCommand(std::shared_ptr<STKPeer>& peer,
+                                              std::vector<std::string>& argv,
+                                              std::string& cmd, bool hostRights)
+{
+    NetworkString* chat = getNetworkString();
+    chat->addUInt8(LE_CHAT);
+    chat->setSynchronous(true);
+    if (argv.size() != 2)
+    {
+        chat->encodeString16(
+            L"Usage: /serverhasaddon [addon_identity]");
+    }
+    else
+    {
+        std::set<std::string> total_addons;
+        total_addons.insert(m_addon_kts.first.begin(), m_addon_kts.first.end());
+        total_addons.insert(m_addon_kts.second.begin(), m_addon_kts.second.end());
+        total_addons.insert(m_addon_arenas.begin(), m_addon_arenas.end());
+        total_addons.insert(m_addon_soccers.begin(), m_addon_soccers.end());
+        std::string addon_id_test = Addon::createAddonId(argv[1]);
+        bool found = total_addons.find(addon_id_test) != total_addons.end();
+        if (found)
         {
-            NetworkString* chat = getNetworkString();
-            chat->addUInt8(LE_CHAT);
-            chat->setSynchronous(true);
-            chat->encodeString16(
-                    L"Gnu Elimination mode was already off!");
-            peer->sendPacket(chat, true/*reliable*/);
-            delete chat;
+            chat->encodeString16(StringUtils::utf8ToWide(std::string
+                ("Server has addon ") + argv[1]));
         }
         else
         {
-			if (!commandPermitted(cmd, peer, hostRights)) return;
-
-            NetworkString* chat = getNetworkString();
-            m_gnu_elimination = false;
-            m_gnu_remained = 0;
-            m_gnu_participants.clear();
-			ServerConfig::m_live_players = false;
-			m_gnu2_activated = false;
-			m_gnu2_initialized = false;
-			m_gnu2_available_tracks.clear();
-            chat->addUInt8(LE_CHAT);
-            chat->setSynchronous(true);
-            chat->encodeString16(
-                    L"Gnu Elimination is now off");
-            sendMessageToPeers(chat);
-            delete chat;
+            chat->encodeString16(StringUtils::utf8ToWide(std::string
+                ("Server has no addon ") + argv[1]));
         }
     }
-    if (argv[0] == "tell")
-    {        
-        if (argv.size() == 1)
+    peer->sendPacket(chat, true/*reliable*/);
+    delete chat;
+}   // handleServerHasAddonCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleHelpCommand(std::shared_ptr<STKPeer>& peer,
+                                    std::vector<std::string>& argv,
+                                    std::string& cmd, bool hostRights)
+{
+    NetworkString* chat = getNetworkString();
+    chat->addUInt8(LE_CHAT);
+    chat->setSynchronous(true);
+    chat->encodeString16(m_help_message);
+    peer->sendPacket(chat, true/*reliable*/);
+    delete chat;
+}   // handleHelpCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleCommandsCommand(std::shared_ptr<STKPeer>& peer,
+                                        std::vector<std::string>& argv,
+                                        std::string& cmd, bool hostRights)
+{
+    NetworkString* chat = getNetworkString();
+    chat->addUInt8(LE_CHAT);
+    chat->setSynchronous(true);chat->encodeString16
+        (StringUtils::utf8ToWide(m_available_commands));
+    peer->sendPacket(chat, true/*reliable*/);
+    delete chat;
+}   // handleCommandsCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleGnu2AddTrackCommand(std::shared_ptr<STKPeer>& peer,
+                                            std::vector<std::string>& argv,
+                                            std::string& cmd, bool hostRights)
+{
+    if (argv.size() > 1)
+    {
+        std::string newTrack = argv[1];
+
+        if (serverAndPeerHaveTrack(peer, newTrack))
         {
+            if (!commandPermitted(cmd, peer, hostRights)) return;
+
+            m_gnu2_available_tracks.insert(m_gnu2_available_tracks.begin(), newTrack);
+
             NetworkString* chat = getNetworkString();
             chat->addUInt8(LE_CHAT);
             chat->setSynchronous(true);
-            chat->encodeString16(L"Tell something non-empty");
-            peer->sendPacket(chat, true/*reliable*/);
+            std::string message = "Track "+ newTrack +" was added to gnu2 elimination!";
+            chat->encodeString16(StringUtils::utf8ToWide(message));
+            sendMessageToPeers(chat);
             delete chat;
             return;
         }
         else
         {
-            std::string ans;
-            for (unsigned i = 1; i < argv.size(); ++i)
-            {
-                if (i > 1)
-                    ans.push_back(' ');
-                ans += argv[i];
-            }
-            writeOwnReport(peer.get(), peer.get(), ans);
+            std::string message = "Track " + newTrack + " does not exist or is not installed.";
+            sendStringToPeer(message, peer);
+            return;
         }
     }
-    if (argv[0] == "queue")
+}   // handleGnu2AddTrackCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleGnuCommand(std::shared_ptr<STKPeer>& peer,
+                                   std::vector<std::string>& argv,
+                                   std::string& cmd, bool hostRights)
+{
+    if (m_gnu_elimination)
     {
-		if (!isVIP(peer) && !( hasHostRights(peer)))
-        {
-            std::string msg = "You cannot change queue length";
-            sendStringToPeer(msg, peer);
-            return;
-		}
-		if(ServerConfig::m_rank_1vs1 || ServerConfig::m_rank_1vs1_2 || ServerConfig::m_rank_1vs1_3) return;
-		if (argv.size() == 1)
-		{
-				std::string msg = "Please use the command in the form /queue [number]";
-				sendStringToPeer(msg, peer);
-			return;
-		}
-		if(ServerConfig::m_rank_3vs3)
-		{
-			if (std::stoi(argv[1])>6 || std::stoi(argv[1])<2)
-			{
-				return;
-			}
-		}
-		if (std::stoi(argv[1])<2) m_player_queue_limit = -1;
-		else m_player_queue_limit = std::stoi(argv[1]);
-		updatePlayerList();
-		std::string message="The host or server owner changed the queue length to "+argv[1];
-		sendStringToAllPeers(message);
+        NetworkString* chat = getNetworkString();
+        chat->addUInt8(LE_CHAT);
+        chat->setSynchronous(true);
+        chat->encodeString16(
+                L"Gnu Elimination mode was already enabled!");
+        peer->sendPacket(chat, true/*reliable*/);
+        delete chat;
     }
-	if (argv[0] == "fake")
-	{
-		if (isVIP(peer))
-		{
-			if (argv.size() < 3 || argv.size() > 4)
-			{
-				std::string msg = "Format: /fake [player_name] [fake_player_name] (fake_country_code)";
-				sendStringToPeer(msg, peer);
-				return;
-			}
-			std::string fake_name = argv[2];
-			std::string fake_country_code = "";
-			if (argv.size() == 4)
-			{
-				fake_country_code = argv[3];
-				if (fake_country_code.length() != 2)
-				{
-					std::string msg = "Country codes must have two capital letters.";
-					sendStringToPeer(msg, peer);
-					return;
-				}
-			}
-			std::string original_name = argv[1];
-			m_faked_players[original_name] = std::pair<std::string, std::string>(fake_name, fake_country_code);
-			std::string msg = "Player " + original_name + " will play as " + fake_name + " with country " + fake_country_code;
-			sendStringToPeer(msg, peer);
-			return;
-		}
-		else
-		{
-			return;
-		}
-	}
-	if (argv[0] == "unfake")
-	{
-		if (isVIP(peer))
-		{
-			if (argv.size() != 2)
-			{
-				std::string msg = "Format: /unfake [player_name]";
-				sendStringToPeer(msg, peer);
-				return;
-			}
-			std::string player_name = argv[1];
-			if (player_name == "all")
-			{
-				m_faked_players.clear();
-				std::string msg = "No player is faked any more.";
-				sendStringToPeer(msg, peer);
-				return;
-			}
-			else
-			{
-				if (m_faked_players.count(player_name))
-					m_faked_players.erase(player_name);
-
-				std::string msg = player_name + " is not faked any more.";
-				sendStringToPeer(msg, peer);
-				return;
-			}
-		}
-	}
-    if (argv[0] == "standings")
+    else if (
+        RaceManager::get()->getMinorMode() != RaceManager::MINOR_MODE_NORMAL_RACE &&
+        RaceManager::get()->getMinorMode() != RaceManager::MINOR_MODE_TIME_TRIAL)
+    {
+        NetworkString* chat = getNetworkString();
+        chat->addUInt8(LE_CHAT);
+        chat->setSynchronous(true);
+        chat->encodeString16(
+                L"Gnu Elimination is available only with racing modes");
+        peer->sendPacket(chat, true/*reliable*/);
+        delete chat;
+    }
+    else
     {
-        if (argv.size() > 1)
+        if (!commandPermitted(cmd, peer, hostRights)) return;
+
+        if (argv[0] == "gnu2")
         {
-            if (argv[1] == "gp")
-                sendGrandPrixStandingsToPeer(peer);
-            else if (argv[1] == "gnu")
-                sendGnuStandingsToPeer(peer);
-            else
+            m_gnu2_activated = true;
+            m_gnu2_initialized = false;
+            m_gnu2_available_tracks.clear();
+
+            std::vector<std::string> gnu2_available_tracks = StringUtils::split(ServerConfig::m_gnu2_available_tracks, ' ');
+
+            for (std::string track : gnu2_available_tracks)
             {
-                std::string msg = "Usage: /standings [gp | gnu]";
-                sendStringToPeer(msg, peer);
+                if (serverAndPeerHaveTrack(peer, track))
+                    m_gnu2_available_tracks.push_back(track);
             }
-            return;
         }
-        if (m_game_setup->isGrandPrix())
+
+        //if (argv.size() > 1 && m_available_kts.first.count(argv[1]) > 0) {
+        if (argv.size() > 1 && serverAndPeerHaveKart(peer, argv[1])) {
+            m_gnu_kart = argv[1];
+        } else {
+            m_gnu_kart = "gnu";
+        }
+        NetworkString* chat = getNetworkString();
+        m_gnu_elimination = true;
+        m_gnu_remained = -1;
+        m_gnu_participants.clear();
+        chat->addUInt8(LE_CHAT);
+        chat->setSynchronous(true);
+        if (m_gnu_kart == "gnu")
+        {
+            chat->encodeString16(
+                L"Gnu Elimination starts now! Use /standings "
+                "after each race for results.");
+        }
+        else
         {
-            sendGrandPrixStandingsToPeer(peer);
-            return;
+            chat->encodeString16(StringUtils::utf8ToWide(
+                StringUtils::insertValues("Gnu Elimination starts now "
+                    "(elimination kart: %s)! Use /standings "
+                    "after each race for results.", m_gnu_kart)));
         }
-        sendGnuStandingsToPeer(peer);
+        sendMessageToPeers(chat);
+        delete chat;
     }
-    if (argv[0] == "teamchat")
+}   // handleGnuCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleNoGnuCommand(std::shared_ptr<STKPeer>& peer,
+                                     std::vector<std::string>& argv,
+                                     std::string& cmd, bool hostRights)
+{
+    if (!m_gnu_elimination)
     {
         NetworkString* chat = getNetworkString();
         chat->addUInt8(LE_CHAT);
         chat->setSynchronous(true);
-        m_team_speakers.insert(peer.get());
-        chat->encodeString16(L"Your messages are now addressed to team only");        
+        chat->encodeString16(
+                L"Gnu Elimination mode was already off!");
         peer->sendPacket(chat, true/*reliable*/);
         delete chat;
     }
-    if (argv[0] == "to")
-    {
-        if (argv.size() == 1) {
-            NetworkString* chat = getNetworkString();
-            chat->addUInt8(LE_CHAT);
-            chat->setSynchronous(true);
-            chat->encodeString16(L"Usage: /to (username1) ... (usernameN)");
-            peer->sendPacket(chat, true/*reliable*/);
-            delete chat;
-        } else {
-            NetworkString* chat = getNetworkString();
-            chat->addUInt8(LE_CHAT);
-            chat->setSynchronous(true);
-            m_message_receivers[peer.get()].clear();
-            for (unsigned i = 1; i < argv.size(); ++i) {
-                m_message_receivers[peer.get()].insert(
-                    StringUtils::utf8ToWide(argv[i]));
-            }
-            chat->encodeString16(L"Successfully changed chat settings");
-            peer->sendPacket(chat, true/*reliable*/);
-            delete chat;
-        }
-    }
-    if (argv[0] == "public")
+    else
     {
-        m_message_receivers[peer.get()].clear();
-        m_team_speakers.erase(peer.get());
-        std::string s = "Your messages are now public";
-        sendStringToPeer(s, peer);
+        if (!commandPermitted(cmd, peer, hostRights)) return;
+
+        NetworkString* chat = getNetworkString();
+        m_gnu_elimination = false;
+        m_gnu_remained = 0;
+        m_gnu_participants.clear();
+        ServerConfig::m_live_players = false;
+        m_gnu2_activated = false;
+        m_gnu2_initialized = false;
+        m_gnu2_available_tracks.clear();
+        chat->addUInt8(LE_CHAT);
+        chat->setSynchronous(true);
+        chat->encodeString16(
+                L"Gnu Elimination is now off");
+        sendMessageToPeers(chat);
+        delete chat;
     }
-    if (argv[0] == "record")
+}   // handleNoGnuCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleTellCommand(std::shared_ptr<STKPeer>& peer,
+                                    std::vector<std::string>& argv,
+                                    std::string& cmd, bool hostRights)
+{
+    if (argv.size() == 1)
     {
         NetworkString* chat = getNetworkString();
         chat->addUInt8(LE_CHAT);
         chat->setSynchronous(true);
-#ifdef ENABLE_SQLITE3
-        if (argv.size() < 5)
-        {
-            chat->encodeString16(L"Usage: /record (track id) "
-                "(normal/time-trial) (normal/reverse) (laps)\n"
-                "Receives the server record for the race settings if any");
-        } else {
-            bool error = false;
-            std::string track_name = argv[1];
-            std::string mode_name = (argv[2] == "t" || argv[2] == "tt"
-                || argv[2] == "time-trial" || argv[2] == "timetrial" ?
-                "time-trial" : "normal");
-            std::string reverse_name = (argv[3] == "r" ||
-                argv[3] == "rev" || argv[3] == "reverse" ? "reverse" : 
-                "normal");
-            int laps_count = -1;
-            if (!StringUtils::parseString<int>(argv[4], &laps_count))
-                error = true;
-            if (!error && laps_count < 0)
-                error = true;
-            if (error)
-            {
-                chat->encodeString16(L"Invalid lap count");
-            }
-            else
-            {
-                std::string records_table_name = ServerConfig::m_records_table_name;
-                if (!records_table_name.empty())
-                {
-                    std::string get_query = StringUtils::insertValues("SELECT username, "
-                        "result FROM %s LEFT JOIN "
-                        "(SELECT venue as v, reverse as r, mode as m, laps as l, "
-                        "min(result) as min_res FROM %s group by v, r, m, l) "
-                        "ON venue = v and reverse = r and mode = m and laps = l "
-                        "WHERE venue = '%s' and reverse = '%s' "
-                        "and mode = '%s' and laps = %d and result = min_res;",
-                        records_table_name.c_str(), records_table_name.c_str(),
-                        track_name.c_str(), reverse_name.c_str(), mode_name.c_str(),
-                        laps_count);
-                    auto ret = vectorSQLQuery(get_query, 2);
-                    if (!ret.first)
-                    {
-                        chat->encodeString16(L"Failed to make a query");
-                    }
-                    else if (ret.second[0].size() > 0)
-                    {
-                        double best_result = 1e18;
-                        if (!StringUtils::parseString<double>(
-                            ret.second[1][0], &best_result))
-                        {
-                            chat->encodeString16(L"A strange error occured, "
-                                "please take a screenshot "
-                                "and contact the server owner.");
-                        }
-                        else
-                        {
-                            std::string message = StringUtils::insertValues(
-                                "The record is %s by %s",
-                                StringUtils::timeToString(best_result),
-                                ret.second[0][0]);
-                            chat->encodeString16(
-                                StringUtils::utf8ToWide(message));
-                        }
-                    }
-                    else
-                    {
-                        chat->encodeString16(L"No time set yet. Or there is a typo.");
-                    }
-                }
-                else 
-                {
-                    chat->encodeString16(L"No table storing records!");
-                }
-            }
-        }
-#else
-        chat->encodeString16(L"This command is not supported.");
-#endif
+        chat->encodeString16(L"Tell something non-empty");
         peer->sendPacket(chat, true/*reliable*/);
         delete chat;
+        return;
     }
-    if (argv[0] == "power")
+    else
     {
-        if (peer->isAngryHost())
+        std::string ans;
+        for (unsigned i = 1; i < argv.size(); ++i)
         {
-            peer->setAngryHost(false);
-            std::string msg = "You are now a normal player";
+            if (i > 1)
+                ans.push_back(' ');
+            ans += argv[i];
+        }
+        writeOwnReport(peer.get(), peer.get(), ans);
+    }
+}   // handleTellCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleQueueCommand(std::shared_ptr<STKPeer>& peer,
+                                     std::vector<std::string>& argv,
+                                     std::string& cmd, bool hostRights)
+{
+    if (!isVIP(peer) && !( hasHostRights(peer)))
+    {
+        std::string msg = "You cannot change queue length";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    if(ServerConfig::m_rank_1vs1 || ServerConfig::m_rank_1vs1_2 || ServerConfig::m_rank_1vs1_3) return;
+    if (argv.size() == 1)
+    {
+            std::string msg = "Please use the command in the form /queue [number]";
             sendStringToPeer(msg, peer);
-            updatePlayerList();
+        return;
+    }
+    if(ServerConfig::m_rank_3vs3)
+    {
+        if (std::stoi(argv[1])>6 || std::stoi(argv[1])<2)
+        {
             return;
         }
-        std::string password = ServerConfig::m_power_password;
-        if (password.empty() || argv.size() <= 1 || argv[1] != password)
+    }
+    if (std::stoi(argv[1])<2) m_player_queue_limit = -1;
+    else m_player_queue_limit = std::stoi(argv[1]);
+    updatePlayerList();
+    std::string message="The host or server owner changed the queue length to "+argv[1];
+    sendStringToAllPeers(message);
+}   // handleQueueCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleFakeCommand(std::shared_ptr<STKPeer>& peer,
+                                    std::vector<std::string>& argv,
+                                    std::string& cmd, bool hostRights)
+{
+    if (isVIP(peer))
+    {
+        if (argv.size() < 3 || argv.size() > 4)
         {
-            std::string msg = "You need to provide the password to have the power";
+            std::string msg = "Format: /fake [player_name] [fake_player_name] (fake_country_code)";
             sendStringToPeer(msg, peer);
             return;
         }
-        peer->setAngryHost(true);
-        std::string msg = "Now you finally have the power!";
+        std::string fake_name = argv[2];
+        std::string fake_country_code = "";
+        if (argv.size() == 4)
+        {
+            fake_country_code = argv[3];
+            if (fake_country_code.length() != 2)
+            {
+                std::string msg = "Country codes must have two capital letters.";
+                sendStringToPeer(msg, peer);
+                return;
+            }
+        }
+        std::string original_name = argv[1];
+        m_faked_players[original_name] = std::pair<std::string, std::string>(fake_name, fake_country_code);
+        std::string msg = "Player " + original_name + " will play as " + fake_name + " with country " + fake_country_code;
         sendStringToPeer(msg, peer);
-        updatePlayerList();
         return;
     }
-    else if (argv[0] == "admin")
+    else
+    {
+        return;
+    }
+}   // handleFakeCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleUnfakeCommand(std::shared_ptr<STKPeer>& peer,
+                                      std::vector<std::string>& argv,
+                                      std::string& cmd, bool hostRights)
+{
+    if (isVIP(peer))
     {
-        std::string msg;
-        if (!peer->isAngryHost() && !ServerConfig::m_soccer_tournament) {
-            msg = "You cannot control this server";
+        if (argv.size() != 2)
+        {
+            std::string msg = "Format: /unfake [player_name]";
             sendStringToPeer(msg, peer);
             return;
         }
-        if (argv.size() == 1) {
-            msg = "Usage: /admin command arg1 arg2 ...";
+        std::string player_name = argv[1];
+        if (player_name == "all")
+        {
+            m_faked_players.clear();
+            std::string msg = "No player is faked any more.";
             sendStringToPeer(msg, peer);
             return;
         }
-        if (argv[1] == "start") {
-            if (argv.size() == 2 || !(argv[2] == "0" || argv[2] == "1")) {
-                msg = "Usage: /admin start [0/1] - allow or forbid starting a race";
-                sendStringToPeer(msg, peer);
-                return;
-            }
-            if (argv[2] == "0") {
-                m_allowed_to_start = false;
-                msg = "Now starting a race is forbidden";
-            } else {
-                m_allowed_to_start = true;
-                msg = "Now starting a race is allowed";
-            }
+        else
+        {
+            if (m_faked_players.count(player_name))
+                m_faked_players.erase(player_name);
+
+            std::string msg = player_name + " is not faked any more.";
             sendStringToPeer(msg, peer);
             return;
         }
     }
-    if (argv[0] == "version")
-    {
-        std::string msg = "1.2-rc1-kimden 200824 including Rocker/Waldlaubsaengernest changes";
-        sendStringToPeer(msg, peer);
-    }
-#ifdef ENABLE_WEB_SUPPORT
-    if (argv[0] == "token")
+}   // handleUnfakeCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleStandingsCommand(std::shared_ptr<STKPeer>& peer,
+                                         std::vector<std::string>& argv,
+                                         std::string& cmd, bool hostRights)
+{
+    if (argv.size() > 1)
     {
-        int online_id = peer->getPlayerProfiles()[0]->getOnlineId();
-        if (online_id <= 0)
+        if (argv[1] == "gp")
+            sendGrandPrixStandingsToPeer(peer);
+        else if (argv[1] == "gnu")
+            sendGnuStandingsToPeer(peer);
+        else
         {
-            std::string msg = "Please join with a valid online STK account.";
+            std::string msg = "Usage: /standings [gp | gnu]";
             sendStringToPeer(msg, peer);
-            return;
         }
-        std::string username = StringUtils::wideToUtf8(
-            peer->getPlayerProfiles()[0]->getName());
-        std::string token = getToken();
-        while (m_web_tokens.count(token))
-            token = getToken();
-        m_web_tokens.insert(token);
-        std::string msg = "Your token is " + token;
+        return;
+    }
+    if (m_game_setup->isGrandPrix())
+    {
+        sendGrandPrixStandingsToPeer(peer);
+        return;
+    }
+    sendGnuStandingsToPeer(peer);
+}   // handleStandingsCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleTeamChatCommand(std::shared_ptr<STKPeer>& peer,
+                                        std::vector<std::string>& argv,
+                                        std::string& cmd, bool hostRights)
+{
+    NetworkString* chat = getNetworkString();
+    chat->addUInt8(LE_CHAT);
+    chat->setSynchronous(true);
+    m_team_speakers.insert(peer.get());
+    chat->encodeString16(L"Your messages are now addressed to team only");
+    peer->sendPacket(chat, true/*reliable*/);
+    delete chat;
+}   // handleTeamChatCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleToCommand(std::shared_ptr<STKPeer>& peer,
+                                  std::vector<std::string>& argv,
+                                  std::string& cmd, bool hostRights)
+{
+    if (argv.size() == 1) {
+        NetworkString* chat = getNetworkString();
+        chat->addUInt8(LE_CHAT);
+        chat->setSynchronous(true);
+        chat->encodeString16(L"Usage: /to (username1) ... (usernameN)");
+        peer->sendPacket(chat, true/*reliable*/);
+        delete chat;
+    } else {
+        NetworkString* chat = getNetworkString();
+        chat->addUInt8(LE_CHAT);
+        chat->setSynchronous(true);
+        m_message_receivers[peer.get()].clear();
+        for (unsigned i = 1; i < argv.size(); ++i) {
+            m_message_receivers[peer.get()].insert(
+                StringUtils::utf8ToWide(argv[i]));
+        }
+        chat->encodeString16(L"Successfully changed chat settings");
+        peer->sendPacket(chat, true/*reliable*/);
+        delete chat;
+    }
+}   // handleToCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handlePublicCommand(std::shared_ptr<STKPeer>& peer,
+                                      std::vector<std::string>& argv,
+                                      std::string& cmd, bool hostRights)
+{
+    m_message_receivers[peer.get()].clear();
+    m_team_speakers.erase(peer.get());
+    std::string s = "Your messages are now public";
+    sendStringToPeer(s, peer);
+}   // handlePublicCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleRecordCommand(std::shared_ptr<STKPeer>& peer,
+                                      std::vector<std::string>& argv,
+                                      std::string& cmd, bool hostRights)
+{
+    NetworkString* chat = getNetworkString();
+    chat->addUInt8(LE_CHAT);
+    chat->setSynchronous(true);
 #ifdef ENABLE_SQLITE3
-        std::string tokens_table_name = ServerConfig::m_tokens_table;
-        std::string query = StringUtils::insertValues(
-            "INSERT INTO %s (username, token) "
-            "VALUES (\"%s\", \"%s\");",
-            tokens_table_name.c_str(), username.c_str(), token.c_str()
-        );
-        if (easySQLQuery(query))
-            msg += "\nRetype it on the website to connect your STK account. ";
+    if (argv.size() < 5)
+    {
+        chat->encodeString16(L"Usage: /record (track id) "
+            "(normal/time-trial) (normal/reverse) (laps)\n"
+            "Receives the server record for the race settings if any");
+    } else {
+        bool error = false;
+        std::string track_name = argv[1];
+        std::string mode_name = (argv[2] == "t" || argv[2] == "tt"
+            || argv[2] == "time-trial" || argv[2] == "timetrial" ?
+            "time-trial" : "normal");
+        std::string reverse_name = (argv[3] == "r" ||
+            argv[3] == "rev" || argv[3] == "reverse" ? "reverse" :
+            "normal");
+        int laps_count = -1;
+        if (!StringUtils::parseString<int>(argv[4], &laps_count))
+            error = true;
+        if (!error && laps_count < 0)
+            error = true;
+        if (error)
+        {
+            chat->encodeString16(L"Invalid lap count");
+        }
         else
-            msg = "An error occurred, please try again.";
+        {
+            std::string records_table_name = ServerConfig::m_records_table_name;
+            if (!records_table_name.empty())
+            {
+                std::string get_query = StringUtils::insertValues("SELECT username, "
+                    "result FROM %s LEFT JOIN "
+                    "(SELECT venue as v, reverse as r, mode as m, laps as l, "
+                    "min(result) as min_res FROM %s group by v, r, m, l) "
+                    "ON venue = v and reverse = r and mode = m and laps = l "
+                    "WHERE venue = '%s' and reverse = '%s' "
+                    "and mode = '%s' and laps = %d and result = min_res;",
+                    records_table_name.c_str(), records_table_name.c_str(),
+                    track_name.c_str(), reverse_name.c_str(), mode_name.c_str(),
+                    laps_count);
+                auto ret = vectorSQLQuery(get_query, 2);
+                if (!ret.first)
+                {
+                    chat->encodeString16(L"Failed to make a query");
+                }
+                else if (ret.second[0].size() > 0)
+                {
+                    double best_result = 1e18;
+                    if (!StringUtils::parseString<double>(
+                        ret.second[1][0], &best_result))
+                    {
+                        chat->encodeString16(L"A strange error occured, "
+                            "please take a screenshot "
+                            "and contact the server owner.");
+                    }
+                    else
+                    {
+                        std::string message = StringUtils::insertValues(
+                            "The record is %s by %s",
+                            StringUtils::timeToString(best_result),
+                            ret.second[0][0]);
+                        chat->encodeString16(
+                            StringUtils::utf8ToWide(message));
+                    }
+                }
+                else
+                {
+                    chat->encodeString16(L"No time set yet. Or there is a typo.");
+                }
+            }
+            else
+            {
+                chat->encodeString16(L"No table storing records!");
+            }
+        }
+    }
 #else
-        msg += "\nThough it is useless...";
+    chat->encodeString16(L"This command is not supported.");
 #endif
+    peer->sendPacket(chat, true/*reliable*/);
+    delete chat;
+}   // handleRecordCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handlePowerCommand(std::shared_ptr<STKPeer>& peer,
+                                     std::vector<std::string>& argv,
+                                     std::string& cmd, bool hostRights)
+{
+    if (peer->isAngryHost())
+    {
+        peer->setAngryHost(false);
+        std::string msg = "You are now a normal player";
+        sendStringToPeer(msg, peer);
+        updatePlayerList();
+        return;
+    }
+    std::string password = ServerConfig::m_power_password;
+    if (password.empty() || argv.size() <= 1 || argv[1] != password)
+    {
+        std::string msg = "You need to provide the password to have the power";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    peer->setAngryHost(true);
+    std::string msg = "Now you finally have the power!";
+    sendStringToPeer(msg, peer);
+    updatePlayerList();
+    return;
+}   // handlePowerCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleAdminCommand(std::shared_ptr<STKPeer>& peer,
+                                     std::vector<std::string>& argv,
+                                     std::string& cmd, bool hostRights)
+{
+    std::string msg;
+    if (!peer->isAngryHost() && !ServerConfig::m_soccer_tournament) {
+        msg = "You cannot control this server";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    if (argv.size() == 1) {
+        msg = "Usage: /admin command arg1 arg2 ...";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    if (argv[1] == "start") {
+        if (argv.size() == 2 || !(argv[2] == "0" || argv[2] == "1")) {
+            msg = "Usage: /admin start [0/1] - allow or forbid starting a race";
+            sendStringToPeer(msg, peer);
+            return;
+        }
+        if (argv[2] == "0") {
+            m_allowed_to_start = false;
+            msg = "Now starting a race is forbidden";
+        } else {
+            m_allowed_to_start = true;
+            msg = "Now starting a race is allowed";
+        }
+        sendStringToPeer(msg, peer);
+        return;
+    }
+}   // handleAdminCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleVersionCommand(std::shared_ptr<STKPeer>& peer,
+                                       std::vector<std::string>& argv,
+                                       std::string& cmd, bool hostRights)
+{
+    std::string msg = "1.2-rc1-kimden 200824 including Rocker/Waldlaubsaengernest changes";
+    sendStringToPeer(msg, peer);
+}   // handleVersionCommand
+#ifdef ENABLE_WEB_SUPPORT
+//-----------------------------------------------------------------------------
+void ServerLobby::handleTokenCommand(std::shared_ptr<STKPeer>& peer,
+                                     std::vector<std::string>& argv,
+                                     std::string& cmd, bool hostRights)
+{
+    int online_id = peer->getPlayerProfiles()[0]->getOnlineId();
+    if (online_id <= 0)
+    {
+        std::string msg = "Please join with a valid online STK account.";
         sendStringToPeer(msg, peer);
+        return;
     }
+    std::string username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    std::string token = getToken();
+    while (m_web_tokens.count(token))
+        token = getToken();
+    m_web_tokens.insert(token);
+    std::string msg = "Your token is " + token;
+#ifdef ENABLE_SQLITE3
+    std::string tokens_table_name = ServerConfig::m_tokens_table;
+    std::string query = StringUtils::insertValues(
+        "INSERT INTO %s (username, token) "
+        "VALUES (\"%s\", \"%s\");",
+        tokens_table_name.c_str(), username.c_str(), token.c_str()
+    );
+    if (easySQLQuery(query))
+        msg += "\nRetype it on the website to connect your STK account. ";
+    else
+        msg = "An error occurred, please try again.";
+#else
+    msg += "\nThough it is useless...";
 #endif
-	if (argv[0] == "setfield" || argv[0] == "settrack")
-	{
-		bool isField = (argv[0] == "setfield");
-
-		if (argv.size() != 2)
-		{
-			std::string msg = isField ? "Format: /setfield soccer_field_id" : "Format: /settrack track_id";
-			sendStringToPeer(msg, peer);
-			return;
-		}
-
-		std::string peer_username = StringUtils::wideToUtf8(peer->getPlayerProfiles()[0]->getName());
-
-		std::string soccer_field_id = argv[1];
-
-		if (soccer_field_id == "ice") soccer_field_id = "icy_soccer_field";
-		else if (soccer_field_id == "grass") soccer_field_id = "soccer_field";
-		else if (soccer_field_id == "lasdunas") soccer_field_id = "lasdunassoccer";
-		else if (soccer_field_id == "egypt") soccer_field_id = "addon_egypt_1";
-		else if (soccer_field_id == "tourn") soccer_field_id = "addon_tournament-field";
-		else if (soccer_field_id == "zen") soccer_field_id = "addon_zen";
-		else if (soccer_field_id == "cosmic") soccer_field_id = "addon_cosmic";
-		else if (soccer_field_id == "holedrop") soccer_field_id = "addon_hole-drop";
-		else if (soccer_field_id == "forest") soccer_field_id = "addon_forest_1";
-		else if (soccer_field_id == "another") soccer_field_id = "addon_another-soccer-field";
-		else if (soccer_field_id == "airhockey") soccer_field_id = "addon_air-hockey";
-		else if (soccer_field_id == "database") soccer_field_id = "addon_database";
-		else if (soccer_field_id == "math" || soccer_field_id == "pidgin") soccer_field_id = "addon_math-class";
-		else if (soccer_field_id == "ex1") soccer_field_id = "addon_experimental-plane---field-1";
-		else if (soccer_field_id == "ex2") soccer_field_id = "addon_experimental-plane---field-2";
-		else if (soccer_field_id == "ex3") soccer_field_id = "addon_experimental-plane---field-3";
-		else if (soccer_field_id == "inapit" || soccer_field_id == "roml") soccer_field_id = "addon_inapit";
-		else if (soccer_field_id == "nitro") soccer_field_id = "addon_nitro-soccer-field";
-		else if (soccer_field_id == "vacuum") soccer_field_id = "addon_vivid-vacuum";
-		else if (soccer_field_id == "mountain") soccer_field_id = "addon_mountain-soccer--updated-";
-		else if (soccer_field_id == "box") soccer_field_id = "addon_box";
-		else if (soccer_field_id == "soccerarena") soccer_field_id = "addon_soccer-arena-x";
-		else if (soccer_field_id == "super") soccer_field_id = "addon_supertournament-field";
-		else if (soccer_field_id == "asteroid") soccer_field_id = "addon_asteroid-soccer";
-
-		else if (soccer_field_id == "myoldtrack") soccer_field_id = "addon_myoldtrack";
-		else if (soccer_field_id == "xtreme" || soccer_field_id == "xtremetrack") soccer_field_id = "addon_x-treme-track";
-		else if (soccer_field_id == "mini") soccer_field_id = "addon_minigolf";
-		else if (soccer_field_id == "animtrack") soccer_field_id = "addon_animtrack_1";
-		else if (soccer_field_id == "aroundthebox") soccer_field_id = "addon_around-the-box_2";
-		else if (soccer_field_id == "bowling") soccer_field_id = "addon_bowling";
-		else if (soccer_field_id == "gravity") soccer_field_id = "addon_gravitytrack";
-		else if (soccer_field_id == "wrecktrack") soccer_field_id = "addon_wrecktrack";
-		else if (soccer_field_id == "escape" || soccer_field_id == "escaperoom") soccer_field_id = "addon_escape-room";
-		else if (soccer_field_id == "escape-multi") soccer_field_id = "addon_escape-room-mp";
-		else if (soccer_field_id == "teamwork") soccer_field_id = "addon_teamwork_1";
-		else if (soccer_field_id == "jumptrack") soccer_field_id = "addon_jumptrack";
-
-
-		// Check that peer and server have the track
-		std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(StringUtils::utf8ToWide(peer_username));
-
-		bool found = serverAndPeerHaveTrack(player_peer, soccer_field_id) || soccer_field_id == "all";
-
-		if (!(found))
-		{
-			std::string addon_id = "addon_" + soccer_field_id;
-			bool found_addon = serverAndPeerHaveTrack(player_peer, addon_id);
-			if (found_addon)
-			{
-				soccer_field_id = addon_id;
-				found = true;
-			}
-		}
-
-		if (found)
-		{
-			if (!commandPermitted(cmd, peer, hostRights)) return;
-
-			if (soccer_field_id == "all")
-			{
-				m_set_field = "";
-				std::string msg = isField ? "All soccer fields can be played again" : "All tracks can be played again";
-				sendStringToPeer(msg, peer);
-				Log::info("ServerLobby", "setfield all");
-				return;
-			}
-			else
-			{
-				m_set_field = soccer_field_id;
-
-				std::string msg = isField ? "Next played soccer field will be " + soccer_field_id + "." :
-					"Next played track will be " + soccer_field_id + ".";
+    sendStringToPeer(msg, peer);
+}   // handleTokenCommand
+#endif
+//-----------------------------------------------------------------------------
+void ServerLobby::handleSetTrackCommand(std::shared_ptr<STKPeer>& peer,
+                                        std::vector<std::string>& argv,
+                                        std::string& cmd, bool hostRights)
+{
+    bool isField = (argv[0] == "setfield");
 
-				// Send message to the lobby
-				sendStringToAllPeers(msg);
+    if (argv.size() != 2)
+    {
+        std::string msg = isField ? "Format: /setfield soccer_field_id" : "Format: /settrack track_id";
+        sendStringToPeer(msg, peer);
+        return;
+    }
 
-				std::string msg2 = "setfield " + soccer_field_id;
-				Log::info("ServerLobby", msg2.c_str());
-			}
-		}
-		else
-		{
-			std::string msg = isField ? "Soccer field \'" + soccer_field_id + "\' does not exist or is not installed." :
-				"Track \'" + soccer_field_id + "\' does not exist or is not installed.";
-			sendStringToPeer(msg, peer);
-			return;
-		}
-	}
-	
-	if (argv[0] == "setkart")
-	{
-		if (argv.size() != 2 && argv.size() != 3)
-		{
-			std::string msg = "Format: /setkart kart_name [player_name]";
-			sendStringToPeer(msg, peer);
-			return;
-		}
+    std::string peer_username = StringUtils::wideToUtf8(peer->getPlayerProfiles()[0]->getName());
 
-		std::string peer_username = StringUtils::wideToUtf8(peer->getPlayerProfiles()[0]->getName());
+    std::string soccer_field_id = argv[1];
 
-		std::string kart_name = argv[1];
-		std::string user_name = (argv.size() == 3 ? argv[2] : peer_username);
+    if (soccer_field_id == "ice") soccer_field_id = "icy_soccer_field";
+    else if (soccer_field_id == "grass") soccer_field_id = "soccer_field";
+    else if (soccer_field_id == "lasdunas") soccer_field_id = "lasdunassoccer";
+    else if (soccer_field_id == "egypt") soccer_field_id = "addon_egypt_1";
+    else if (soccer_field_id == "tourn") soccer_field_id = "addon_tournament-field";
+    else if (soccer_field_id == "zen") soccer_field_id = "addon_zen";
+    else if (soccer_field_id == "cosmic") soccer_field_id = "addon_cosmic";
+    else if (soccer_field_id == "holedrop") soccer_field_id = "addon_hole-drop";
+    else if (soccer_field_id == "forest") soccer_field_id = "addon_forest_1";
+    else if (soccer_field_id == "another") soccer_field_id = "addon_another-soccer-field";
+    else if (soccer_field_id == "airhockey") soccer_field_id = "addon_air-hockey";
+    else if (soccer_field_id == "database") soccer_field_id = "addon_database";
+    else if (soccer_field_id == "math" || soccer_field_id == "pidgin") soccer_field_id = "addon_math-class";
+    else if (soccer_field_id == "ex1") soccer_field_id = "addon_experimental-plane---field-1";
+    else if (soccer_field_id == "ex2") soccer_field_id = "addon_experimental-plane---field-2";
+    else if (soccer_field_id == "ex3") soccer_field_id = "addon_experimental-plane---field-3";
+    else if (soccer_field_id == "inapit" || soccer_field_id == "roml") soccer_field_id = "addon_inapit";
+    else if (soccer_field_id == "nitro") soccer_field_id = "addon_nitro-soccer-field";
+    else if (soccer_field_id == "vacuum") soccer_field_id = "addon_vivid-vacuum";
+    else if (soccer_field_id == "mountain") soccer_field_id = "addon_mountain-soccer--updated-";
+    else if (soccer_field_id == "box") soccer_field_id = "addon_box";
+    else if (soccer_field_id == "soccerarena") soccer_field_id = "addon_soccer-arena-x";
+    else if (soccer_field_id == "super") soccer_field_id = "addon_supertournament-field";
+    else if (soccer_field_id == "asteroid") soccer_field_id = "addon_asteroid-soccer";
 
-		bool serverHasKart = (m_official_kts.first.find(kart_name) != m_official_kts.first.end()) ||
-			(m_addon_kts.first.find(kart_name) != m_addon_kts.first.end());
+    else if (soccer_field_id == "myoldtrack") soccer_field_id = "addon_myoldtrack";
+    else if (soccer_field_id == "xtreme" || soccer_field_id == "xtremetrack") soccer_field_id = "addon_x-treme-track";
+    else if (soccer_field_id == "mini") soccer_field_id = "addon_minigolf";
+    else if (soccer_field_id == "animtrack") soccer_field_id = "addon_animtrack_1";
+    else if (soccer_field_id == "aroundthebox") soccer_field_id = "addon_around-the-box_2";
+    else if (soccer_field_id == "bowling") soccer_field_id = "addon_bowling";
+    else if (soccer_field_id == "gravity") soccer_field_id = "addon_gravitytrack";
+    else if (soccer_field_id == "wrecktrack") soccer_field_id = "addon_wrecktrack";
+    else if (soccer_field_id == "escape" || soccer_field_id == "escaperoom") soccer_field_id = "addon_escape-room";
+    else if (soccer_field_id == "escape-multi") soccer_field_id = "addon_escape-room-mp";
+    else if (soccer_field_id == "teamwork") soccer_field_id = "addon_teamwork_1";
+    else if (soccer_field_id == "jumptrack") soccer_field_id = "addon_jumptrack";
 
-		if (!serverHasKart)
-		{
-			std::string addon_kart_name = "addon_" + kart_name;
-			bool serverHasAddonKart = (m_official_kts.first.find(addon_kart_name) != m_official_kts.first.end()) ||
-				(m_addon_kts.first.find(addon_kart_name) != m_addon_kts.first.end());
 
-			if (serverHasAddonKart)
-			{
-				serverHasKart = true;
-				kart_name = addon_kart_name;
-			}
-		}
+    // Check that peer and server have the track
+    std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(StringUtils::utf8ToWide(peer_username));
 
-		if (serverHasKart || kart_name == "all")
-		{
-			if (!commandPermitted(cmd, peer, hostRights)) return;
+    bool found = serverAndPeerHaveTrack(player_peer, soccer_field_id) || soccer_field_id == "all";
 
-			if (kart_name == "all")
-			{
-				m_set_field = "";
-				if (m_set_kart.count(user_name))
-					m_set_kart.erase(user_name);
-				std::string msg = user_name + " can use all karts again.";
-				sendStringToAllPeers(msg);
-				Log::info("ServerLobby", "setkart all");
-				return;
-			}
-			else
-			{
-				m_set_kart[user_name] = kart_name;
-				std::string msg = user_name + " will play with " + kart_name + ".";
+    if (!(found))
+    {
+        std::string addon_id = "addon_" + soccer_field_id;
+        bool found_addon = serverAndPeerHaveTrack(player_peer, addon_id);
+        if (found_addon)
+        {
+            soccer_field_id = addon_id;
+            found = true;
+        }
+    }
 
-				// Send message to the lobby
-				sendStringToAllPeers(msg);
+    if (found)
+    {
+        if (!commandPermitted(cmd, peer, hostRights)) return;
 
-				std::string msg2 = "setkart " + kart_name;
-				Log::info("ServerLobby", msg2.c_str());
-			}
-		}
-		else
-		{
-			std::string msg = "Kart \'" + kart_name + "\' does not exist or is not installed.";
-			sendStringToPeer(msg, peer);
-			return;
-		}
+        if (soccer_field_id == "all")
+        {
+            m_set_field = "";
+            std::string msg = isField ? "All soccer fields can be played again" : "All tracks can be played again";
+            sendStringToPeer(msg, peer);
+            Log::info("ServerLobby", "setfield all");
+            return;
+        }
+        else
+        {
+            m_set_field = soccer_field_id;
 
-	}
+            std::string msg = isField ? "Next played soccer field will be " + soccer_field_id + "." :
+                "Next played track will be " + soccer_field_id + ".";
 
-	if (argv[0] == "sethost")
-	{
-		if (argv.size() != 1 && argv.size() != 2)
-		{
-			std::string msg = "Format: /sethost [player_name]";
-			sendStringToPeer(msg, peer);
-			return;
-		}
+            // Send message to the lobby
+            sendStringToAllPeers(msg);
 
-		std::string peer_username = StringUtils::wideToUtf8(peer->getPlayerProfiles()[0]->getName());
-		std::string user_name = (argv.size() == 2 ? argv[1] : peer_username);
-		if (argv.size() == 1)
-			cmd += " " + user_name;
+            std::string msg2 = "setfield " + soccer_field_id;
+            Log::info("ServerLobby", msg2.c_str());
+        }
+    }
+    else
+    {
+        std::string msg = isField ? "Soccer field \'" + soccer_field_id + "\' does not exist or is not installed." :
+            "Track \'" + soccer_field_id + "\' does not exist or is not installed.";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+}   // handleSetTrackCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleSetKartCommand(std::shared_ptr<STKPeer>& peer,
+                                       std::vector<std::string>& argv,
+                                       std::string& cmd, bool hostRights)
+{
+    if (argv.size() != 2 && argv.size() != 3)
+    {
+        std::string msg = "Format: /setkart kart_name [player_name]";
+        sendStringToPeer(msg, peer);
+        return;
+    }
 
-		std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(StringUtils::utf8ToWide(user_name));
+    std::string peer_username = StringUtils::wideToUtf8(peer->getPlayerProfiles()[0]->getName());
 
-		if (player_peer)
-		{
-			if (!commandPermitted(cmd, peer, hostRights)) return;
-
-			// updateServerOwner()
-			NetworkString* ns = getNetworkString();
-			ns->setSynchronous(true);
-			ns->addUInt8(LE_SERVER_OWNERSHIP);
-			player_peer->sendPacket(ns);
-			delete ns;
-			m_server_owner = player_peer;
-			m_server_owner_id.store(player_peer->getHostId());
-			updatePlayerList();
-			
-			std::string msg = "New server host is " + user_name;
-			sendStringToAllPeers(msg);
-
-			std::string msg2 = "sethost " + user_name;
-			Log::info("ServerLobby", msg2.c_str());
-		}
-		else
-		{
-			std::string msg = "Player " + user_name + " is not in the lobby.";
-			sendStringToPeer(msg, peer);
-			return;
-		}
-	}
-	
-	if (argv[0] == "mode")
-	{
-		if (argv.size() != 2)
-		{
-			std::string msg = "Format: /mode {grand-prix-normal, grand-prix-time, normal, time, soccer-time, soccer-goal, free-for-all, capture-the-flag}";
-			sendStringToPeer(msg, peer);
-			return;
-		}
-		else
-		{
-			unsigned char difficulty = m_difficulty.load();
-			unsigned char gameMode = 0;
-			unsigned char soccerGoalTarget = 0;
-			bool serverModeValid = stringToServerMode(argv[1], gameMode, soccerGoalTarget);
+    std::string kart_name = argv[1];
+    std::string user_name = (argv.size() == 3 ? argv[2] : peer_username);
 
-			if (serverModeValid)
-			{
-				if (m_available_modes.count(gameMode) == 0)
-				{
-					std::string msg = "Mode \"" + serverModeToString(gameMode, soccerGoalTarget) + "\" is not available on this server.";
-					sendStringToPeer(msg, peer);
-					return;
-				}
+    bool serverHasKart = (m_official_kts.first.find(kart_name) != m_official_kts.first.end()) ||
+        (m_addon_kts.first.find(kart_name) != m_addon_kts.first.end());
 
-				if (!commandPermitted(cmd, peer, hostRights)) return;
+    if (!serverHasKart)
+    {
+        std::string addon_kart_name = "addon_" + kart_name;
+        bool serverHasAddonKart = (m_official_kts.first.find(addon_kart_name) != m_official_kts.first.end()) ||
+            (m_addon_kts.first.find(addon_kart_name) != m_addon_kts.first.end());
 
-				setServerMode(difficulty, gameMode, soccerGoalTarget, peer);
-			}
-			else
-			{
-				std::string msg = "Mode \"" + argv[1] + "\" does not exist.";
-				sendStringToPeer(msg, peer);
-				return;
-			}
-		}
-	}
-	if (ServerConfig::m_super_tournament)
-        {
-        std::string peer_username = StringUtils::wideToUtf8(peer->getPlayerProfiles()[0]->getName());
-        if (argv[0] == "join")
+        if (serverHasAddonKart)
         {
-            std::string kali="python3 join.py " +peer_username;
-            system(kali.c_str());
-            std::string msg = "Successfully joined the tournament.";
-            sendStringToPeer(msg, peer);
+            serverHasKart = true;
+            kart_name = addon_kart_name;
         }
-        if (argv[0] == "ican" || argv[0] == "icant")
-        {
-            if (argv.size() == 1)
-            {
-                std::string msg = "None good - u wrong use command";
-                sendStringToPeer(msg, peer);
-		return;
-            }
-            bool valid_time=(argv[1]=="mo16" || argv[1]=="mo17" || argv[1]=="mo18" || argv[1]=="mo19" || argv[1]=="tu16" || argv[1]=="tu17" || argv[1]=="tu18" || argv[1]=="tu19" || argv[1]=="we16" || argv[1]=="we17" || argv[1]=="we18" || argv[1]=="we19" || argv[1]=="th16" || argv[1]=="th17" || argv[1]=="th18" || argv[1]=="th19" ||argv[1]=="fr16" || argv[1]=="fr17" || argv[1]=="fr18" || argv[1]=="fr19" ||argv[1]=="sa16" || argv[1]=="sa17" || argv[1]=="sa18" || argv[1]=="sa19" || argv[1]=="su16" || argv[1]=="su17" || argv[1]=="su18" || argv[1]=="su19" || argv[1]=="mo" || argv[1]=="tu" || argv[1]=="we" || argv[1]=="th" || argv[1]=="fr" || argv[1]=="sa" ||argv[1]=="su" || argv[1]=="weekdays" || argv[1]=="weekends" || argv[1]=="weekdays16" || argv[1]=="weekends16" ||argv[1]=="weekdays17" || argv[1]=="weekends17" ||argv[1]=="weekdays18" || argv[1]=="weekends18" || argv[1]=="weekdays19" || argv[1]=="weekends19" ||argv[1]=="16" || argv[1]=="17" || argv[1]=="18" || argv[1]=="19"||argv[1]=="all");
-            if(valid_time)
-            {
-                std::string kali="python3 time_poll.py " +peer_username+" "+argv[1]+" "+argv[0];
-                system(kali.c_str());
-                std::string msg = "Successfully edited timepoll.";
-                sendStringToPeer(msg, peer);
-            }
-            else
-            {
-                std::string msg = "Please specify a valid time. Format: /ican mo16 (meaning I can Monday 16 UTC), /ican tu (I can on Tuesdays), /ican weekdays (I can on weekdays), /ican weekends17 (I can on weekends at 17 UTC), /ican 18 (I can each day on 18 UTC), /all (I can at every time). Same format for /icant. Note that /icant only has an effect after using /ican at least once.";
-                sendStringToPeer(msg, peer);
-            }
-        }
-        if (argv[0] == "count")
-        {
-	    if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
-            {
-                std::string msg = "You are not a referee";
-                sendStringToPeer(msg, peer);
-                return;
-            }
+    }
 
-            ServerConfig::m_count_supertournament_game=true;
-            std::string msg = "Counting enabled.";
-            sendStringToPeer(msg, peer);
-        }
-        if (argv[0] == "nocount")
-        {
-	    if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
-            {
-                std::string msg = "You are not a referee";
-                sendStringToPeer(msg, peer);
-                return;
-            } 
-            ServerConfig::m_count_supertournament_game=false;
-            std::string msg = "Counting disabled.";
-            sendStringToPeer(msg, peer);
-        }
-        if (argv[0] == "setteams")
-        {
-	    if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
-            {
-                std::string msg = "You are not a referee";
-                sendStringToPeer(msg, peer);
-                return;
-            }
-            if (argv[1]=="A" || argv[1]=="B" || argv[1]=="C" || argv[1]=="D" || argv[1]=="E" || argv[1]=="F" || argv[1]=="G")
-            {
-                if (argv[2]=="A" || argv[2]=="B" || argv[2]=="C" || argv[2]=="D" || argv[2]=="E" || argv[2]=="F" || argv[2]=="G")
-		{
-                    ServerConfig::m_red_team_name=argv[1];
-                    ServerConfig::m_blue_team_name=argv[2];
-                    std::string msg = "Next match will be "+argv[1]+" vs "+argv[2]+".";
-                    sendStringToAllPeers(msg);
-		}
-	    }
-	    else
-	    {
-                std::string msg = "Please use A, B, C or D as team name.";                                                                 
-                sendStringToPeer(msg, peer); 
-	    }
-        }
-        if (argv[0] == "yellow")
+    if (serverHasKart || kart_name == "all")
+    {
+        if (!commandPermitted(cmd, peer, hostRights)) return;
+
+        if (kart_name == "all")
         {
-	    if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
-            {
-                std::string msg = "You are not a referee";
-                sendStringToPeer(msg, peer);
-                return;
-            }
-            int len_argv = argv.size();
-            int v1=2;
-            std::string msg = argv[1]+" was shown a yellow card by the Referee. Reason:";
-            printf("%i",len_argv);
-            while (v1<len_argv)
-            {
-                msg+=(" "+argv[v1]);
-                v1++;
-            }
+            m_set_field = "";
+            if (m_set_kart.count(user_name))
+                m_set_kart.erase(user_name);
+            std::string msg = user_name + " can use all karts again.";
             sendStringToAllPeers(msg);
-            std::string ringdrossel="python3 supertournament_yellow.py "+argv[1]+" &";
-            system(ringdrossel.c_str());
+            Log::info("ServerLobby", "setkart all");
+            return;
         }
-	if (argv[0] == "addon")
+        else
         {
-            if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
-            {
-                std::string msg = "You are not a referee";
-                sendStringToPeer(msg, peer);
-                return;
-            }
-            std::string blau=ServerConfig::m_blue_team_name;
-            std::string rot=ServerConfig::m_red_team_name;
-            std::string ringdrossel="python3 supertournament_match_info.py "+argv[1]+" Addon "+rot+" "+blau+" &";
-            system(ringdrossel.c_str());
-            std::string msg = "Succesfully edited Addon.";
-            sendStringToPeer(msg, peer);
+            m_set_kart[user_name] = kart_name;
+            std::string msg = user_name + " will play with " + kart_name + ".";
+
+            // Send message to the lobby
+            sendStringToAllPeers(msg);
+
+            std::string msg2 = "setkart " + kart_name;
+            Log::info("ServerLobby", msg2.c_str());
         }
-	if (argv[0] == "server")
+    }
+    else
+    {
+        std::string msg = "Kart \'" + kart_name + "\' does not exist or is not installed.";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+}   // handleSetKartCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleSetHostCommand(std::shared_ptr<STKPeer>& peer,
+                                       std::vector<std::string>& argv,
+                                       std::string& cmd, bool hostRights)
+{
+    if (argv.size() != 1 && argv.size() != 2)
+    {
+        std::string msg = "Format: /sethost [player_name]";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+
+    std::string peer_username = StringUtils::wideToUtf8(peer->getPlayerProfiles()[0]->getName());
+    std::string user_name = (argv.size() == 2 ? argv[1] : peer_username);
+    if (argv.size() == 1)
+        cmd += " " + user_name;
+
+    std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(StringUtils::utf8ToWide(user_name));
+
+    if (player_peer)
+    {
+        if (!commandPermitted(cmd, peer, hostRights)) return;
+
+        // updateServerOwner()
+        NetworkString* ns = getNetworkString();
+        ns->setSynchronous(true);
+        ns->addUInt8(LE_SERVER_OWNERSHIP);
+        player_peer->sendPacket(ns);
+        delete ns;
+        m_server_owner = player_peer;
+        m_server_owner_id.store(player_peer->getHostId());
+        updatePlayerList();
+
+        std::string msg = "New server host is " + user_name;
+        sendStringToAllPeers(msg);
+
+        std::string msg2 = "sethost " + user_name;
+        Log::info("ServerLobby", msg2.c_str());
+    }
+    else
+    {
+        std::string msg = "Player " + user_name + " is not in the lobby.";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+}   // handleSetHostCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleModeCommand(std::shared_ptr<STKPeer>& peer,
+                                    std::vector<std::string>& argv,
+                                    std::string& cmd, bool hostRights)
+{
+    if (argv.size() != 2)
+    {
+        std::string msg = "Format: /mode {grand-prix-normal, grand-prix-time, normal, time, soccer-time, soccer-goal, free-for-all, capture-the-flag}";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    else
+    {
+        unsigned char difficulty = m_difficulty.load();
+        unsigned char gameMode = 0;
+        unsigned char soccerGoalTarget = 0;
+        bool serverModeValid = stringToServerMode(argv[1], gameMode, soccerGoalTarget);
+
+        if (serverModeValid)
         {
-            if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+            if (m_available_modes.count(gameMode) == 0)
             {
-                std::string msg = "You are not a referee";
+                std::string msg = "Mode \"" + serverModeToString(gameMode, soccerGoalTarget) + "\" is not available on this server.";
                 sendStringToPeer(msg, peer);
                 return;
             }
-            std::string blau=ServerConfig::m_blue_team_name;
-            std::string rot=ServerConfig::m_red_team_name;
-            std::string ringdrossel="python3 supertournament_match_info.py "+argv[1]+" Server "+rot+" "+blau+" &";
-            system(ringdrossel.c_str());
-            std::string msg = "Succesfully edited Server.";
-            sendStringToPeer(msg, peer);
+
+            if (!commandPermitted(cmd, peer, hostRights)) return;
+
+            setServerMode(difficulty, gameMode, soccerGoalTarget, peer);
         }
-	if (argv[0] == "referee")
+        else
         {
-            if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
-            {
-                std::string msg = "You are not a referee";
-                sendStringToPeer(msg, peer);
-                return;
-            }
-            std::string blau=ServerConfig::m_blue_team_name;
-            std::string rot=ServerConfig::m_red_team_name;
-            std::string ringdrossel="python3 supertournament_match_info.py "+argv[1]+" Referee "+rot+" "+blau+" &";
-            system(ringdrossel.c_str());
-            std::string msg = "Succesfully edited Referee.";
+            std::string msg = "Mode \"" + argv[1] + "\" does not exist.";
             sendStringToPeer(msg, peer);
+            return;
         }
-	if (argv[0] == "video")
+    }
+}   // handleModeCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleJoinCommand(std::shared_ptr<STKPeer>& peer,
+                                    std::vector<std::string>& argv,
+                                    std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    std::string kali="python3 join.py " +peer_username;
+    system(kali.c_str());
+    std::string msg = "Successfully joined the tournament.";
+    sendStringToPeer(msg, peer);
+}   // handleJoinCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleTimePollCommand(std::shared_ptr<STKPeer>& peer,
+                                        std::vector<std::string>& argv,
+                                        std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    if (argv.size() == 1)
+    {
+        std::string msg = "None good - u wrong use command";
+        sendStringToPeer(msg, peer);
+return;
+    }
+    bool valid_time=(argv[1]=="mo16" || argv[1]=="mo17" || argv[1]=="mo18" || argv[1]=="mo19" || argv[1]=="tu16" || argv[1]=="tu17" || argv[1]=="tu18" || argv[1]=="tu19" || argv[1]=="we16" || argv[1]=="we17" || argv[1]=="we18" || argv[1]=="we19" || argv[1]=="th16" || argv[1]=="th17" || argv[1]=="th18" || argv[1]=="th19" ||argv[1]=="fr16" || argv[1]=="fr17" || argv[1]=="fr18" || argv[1]=="fr19" ||argv[1]=="sa16" || argv[1]=="sa17" || argv[1]=="sa18" || argv[1]=="sa19" || argv[1]=="su16" || argv[1]=="su17" || argv[1]=="su18" || argv[1]=="su19" || argv[1]=="mo" || argv[1]=="tu" || argv[1]=="we" || argv[1]=="th" || argv[1]=="fr" || argv[1]=="sa" ||argv[1]=="su" || argv[1]=="weekdays" || argv[1]=="weekends" || argv[1]=="weekdays16" || argv[1]=="weekends16" ||argv[1]=="weekdays17" || argv[1]=="weekends17" ||argv[1]=="weekdays18" || argv[1]=="weekends18" || argv[1]=="weekdays19" || argv[1]=="weekends19" ||argv[1]=="16" || argv[1]=="17" || argv[1]=="18" || argv[1]=="19"||argv[1]=="all");
+    if(valid_time)
+    {
+        std::string kali="python3 time_poll.py " +peer_username+" "+argv[1]+" "+argv[0];
+        system(kali.c_str());
+        std::string msg = "Successfully edited timepoll.";
+        sendStringToPeer(msg, peer);
+    }
+    else
+    {
+        std::string msg = "Please specify a valid time. Format: /ican mo16 (meaning I can Monday 16 UTC), /ican tu (I can on Tuesdays), /ican weekdays (I can on weekdays), /ican weekends17 (I can on weekends at 17 UTC), /ican 18 (I can each day on 18 UTC), /all (I can at every time). Same format for /icant. Note that /icant only has an effect after using /ican at least once.";
+        sendStringToPeer(msg, peer);
+    }
+}   // handleTimePollCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleCountCommand(std::shared_ptr<STKPeer>& peer,
+                                     std::vector<std::string>& argv,
+                                     std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+    {
+        std::string msg = "You are not a referee";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+
+    ServerConfig::m_count_supertournament_game=true;
+    std::string msg = "Counting enabled.";
+    sendStringToPeer(msg, peer);
+}   // handleCountCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleNoCountCommand(std::shared_ptr<STKPeer>& peer,
+                                       std::vector<std::string>& argv,
+                                       std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+    {
+        std::string msg = "You are not a referee";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    ServerConfig::m_count_supertournament_game=false;
+    std::string msg = "Counting disabled.";
+    sendStringToPeer(msg, peer);
+}   // handleNoCountCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleSetTeamsCommand(std::shared_ptr<STKPeer>& peer,
+                                        std::vector<std::string>& argv,
+                                        std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+    {
+        std::string msg = "You are not a referee";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    if (argv[1]=="A" || argv[1]=="B" || argv[1]=="C" || argv[1]=="D" || argv[1]=="E" || argv[1]=="F" || argv[1]=="G")
+    {
+        if (argv[2]=="A" || argv[2]=="B" || argv[2]=="C" || argv[2]=="D" || argv[2]=="E" || argv[2]=="F" || argv[2]=="G")
+{
+            ServerConfig::m_red_team_name=argv[1];
+            ServerConfig::m_blue_team_name=argv[2];
+            std::string msg = "Next match will be "+argv[1]+" vs "+argv[2]+".";
+            sendStringToAllPeers(msg);
+}
+}
+else
+{
+        std::string msg = "Please use A, B, C or D as team name.";
+        sendStringToPeer(msg, peer);
+}
+}   // handleSetTeamsCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleYellowCommand(std::shared_ptr<STKPeer>& peer,
+                                      std::vector<std::string>& argv,
+                                      std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+    {
+        std::string msg = "You are not a referee";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    int len_argv = argv.size();
+    int v1=2;
+    std::string msg = argv[1]+" was shown a yellow card by the Referee. Reason:";
+    while (v1<len_argv)
+    {
+        msg+=(" "+argv[v1]);
+        v1++;
+    }
+    sendStringToAllPeers(msg);
+    std::string ringdrossel="python3 supertournament_yellow.py "+argv[1]+" &";
+    system(ringdrossel.c_str());
+}   // handleYellowCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleMatchAddonCommand(std::shared_ptr<STKPeer>& peer,
+                                          std::vector<std::string>& argv,
+                                          std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+    {
+        std::string msg = "You are not a referee";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    std::string blau=ServerConfig::m_blue_team_name;
+    std::string rot=ServerConfig::m_red_team_name;
+    std::string ringdrossel="python3 supertournament_match_info.py "+argv[1]+" Addon "+rot+" "+blau+" &";
+    system(ringdrossel.c_str());
+    std::string msg = "Succesfully edited Addon.";
+    sendStringToPeer(msg, peer);
+}   // handleMatchAddonCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleMatchServerCommand(std::shared_ptr<STKPeer>& peer,
+                                           std::vector<std::string>& argv,
+                                           std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+    {
+        std::string msg = "You are not a referee";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    std::string blau=ServerConfig::m_blue_team_name;
+    std::string rot=ServerConfig::m_red_team_name;
+    std::string ringdrossel="python3 supertournament_match_info.py "+argv[1]+" Server "+rot+" "+blau+" &";
+    system(ringdrossel.c_str());
+    std::string msg = "Succesfully edited Server.";
+    sendStringToPeer(msg, peer);
+}   // handleMatchServerCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleMatchRefereeCommand(std::shared_ptr<STKPeer>& peer,
+                                            std::vector<std::string>& argv,
+                                            std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+    {
+        std::string msg = "You are not a referee";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    std::string blau=ServerConfig::m_blue_team_name;
+    std::string rot=ServerConfig::m_red_team_name;
+    std::string ringdrossel="python3 supertournament_match_info.py "+argv[1]+" Referee "+rot+" "+blau+" &";
+    system(ringdrossel.c_str());
+    std::string msg = "Succesfully edited Referee.";
+    sendStringToPeer(msg, peer);
+}   // handleMatchRefereeCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleMatchVideoCommand(std::shared_ptr<STKPeer>& peer,
+                                          std::vector<std::string>& argv,
+                                          std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+    {
+        std::string msg = "You are not a referee";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    std::string blau=ServerConfig::m_blue_team_name;
+    std::string rot=ServerConfig::m_red_team_name;
+    std::string ringdrossel="python3 supertournament_match_info.py "+argv[1]+" Video "+rot+" "+blau+" &";
+    system(ringdrossel.c_str());
+    std::string msg = "Succesfully edited video link.";
+    sendStringToPeer(msg, peer);
+}   // handleMatchVideoCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleMatchNotesCommand(std::shared_ptr<STKPeer>& peer,
+                                          std::vector<std::string>& argv,
+                                          std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+    {
+        std::string msg = "You are not a referee";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    std::string blau=ServerConfig::m_blue_team_name;
+    std::string rot=ServerConfig::m_red_team_name;
+    std::string ringdrossel="python3 supertournament_match_info.py "+argv[1]+" Notes "+rot+" "+blau+" &";
+    system(ringdrossel.c_str());
+    std::string msg = "Succesfully edited notes.";
+    sendStringToPeer(msg, peer);
+}   // handleMatchNotesCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleSkipCommand(std::shared_ptr<STKPeer>& peer,
+                                    std::vector<std::string>& argv,
+                                    std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+    {
+        std::string msg = "You are not a referee";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+ServerConfig::m_skip_end=true;
+    std::string msg = "Skipping end enabled.";
+    sendStringToPeer(msg, peer);
+}   // handleSkipCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleNoSkipCommand(std::shared_ptr<STKPeer>& peer,
+                                      std::vector<std::string>& argv,
+                                      std::string& cmd, bool hostRights)
+{
+    std::string peer_username = StringUtils::wideToUtf8(
+        peer->getPlayerProfiles()[0]->getName());
+    if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+    {
+        std::string msg = "You are not a referee";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    ServerConfig::m_skip_end=false;
+    std::string msg = "Skipping end disabled.";
+    sendStringToPeer(msg, peer);
+}   // handleNoSkipCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleSoccerGameCommand(std::shared_ptr<STKPeer>& peer,
+                                          std::vector<std::string>& argv,
+                                          std::string& cmd, bool hostRights)
+{
+    bool ok=false;
+    if (std::stoi(argv[1])>0 && std::stoi(argv[1])<=5) ok=true;
+std::string msg;
+    if (argv.size() >= 3)
+    {
+    ok=false;
+    if (std::stoi(argv[2])>0 && std::stoi(argv[2])<=15) ok=true;
+}
+    if (argv.size() < 2 || ok==false)
+{
+        msg = "Please specify a correct number. Format: /game [number][length]";
+        sendStringToPeer(msg, peer);
+return;
+    }
+
+    int length=7;
+    m_fixed_lap = length;
+if (argv.size() >=3) m_fixed_lap = std::stoi(argv[2]);
+
+    switch(std::stoi(argv[1]))
+{
+        case 1:
+    {
+                m_available_kts.second.clear();
+                m_available_kts.second.insert("icy_soccer_field");
+    break;
+}
+    case 5:
+{
+                m_available_kts.second.clear();
+                m_available_kts.second.insert("addon_supertournament-field");
+    break;
+}
+    case 3:
+{
+                m_available_kts.second.clear();
+                m_available_kts.second.insert("addon_tournament-field");
+                m_available_kts.second.insert("soccer_field");
+                m_available_kts.second.insert("lasdunassoccer");
+    break;
+}
+    }
+    msg = "Ready to start game "+argv[1]+" for "+ std::to_string(m_fixed_lap)+" minutes!";
+    sendStringToAllPeers(msg);
+}   // handleSoccerGameCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleSoccerRoleCommand(std::shared_ptr<STKPeer>& peer,
+                                          std::vector<std::string>& argv,
+                                          std::string& cmd, bool hostRights)
+{
+    if (argv.size() < 3)
+    {
+        std::string msg = "Format: /role (R|B|J|S) username";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    std::string role = argv[1];
+    std::string username = argv[2];
+    bool permanent = (argv.size() >= 4 &&
+        (argv[3] == "p" || argv[3] == "permanent"));
+    if (role.length() != 1)
+        std::swap(role, username);
+    if (role.length() != 1)
+    {
+        std::string msg = "Please specify one-letter role (R/B/J/S) and player";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    m_tournament_red_players.erase(username);
+    m_tournament_blue_players.erase(username);
+    m_tournament_referees.erase(username);
+    if (permanent)
+    {
+        m_tournament_init_red.erase(username);
+        m_tournament_init_blue.erase(username);
+        m_tournament_init_ref.erase(username);
+    }
+    std::string role_changed = "The referee has updated your role - you are now %s";
+    std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(
+        StringUtils::utf8ToWide(username));
+    switch (role[0])
+    {
+        case 'R':
+        case 'r':
         {
-            if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+            m_tournament_red_players.insert(username);
+            if (player_peer)
             {
-                std::string msg = "You are not a referee";
-                sendStringToPeer(msg, peer);
-                return;
+                role_changed = StringUtils::insertValues(role_changed, "red player");
+                player_peer->getPlayerProfiles()[0]->setTeam(KART_TEAM_RED);
+                player_peer->setAlwaysSpectate(false);
+                sendStringToPeer(role_changed, player_peer);
             }
-            std::string blau=ServerConfig::m_blue_team_name;
-            std::string rot=ServerConfig::m_red_team_name;
-            std::string ringdrossel="python3 supertournament_match_info.py "+argv[1]+" Video "+rot+" "+blau+" &";
-            system(ringdrossel.c_str());
-            std::string msg = "Succesfully edited video link.";
-            sendStringToPeer(msg, peer);
+            break;
         }
-	if (argv[0] == "notes")
+        case 'B':
+        case 'b':
         {
-            if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+            m_tournament_blue_players.insert(username);
+            if (player_peer)
             {
-                std::string msg = "You are not a referee";
-                sendStringToPeer(msg, peer);
-                return;
+                role_changed = StringUtils::insertValues(role_changed, "blue player");
+                player_peer->getPlayerProfiles()[0]->setTeam(KART_TEAM_BLUE);
+                player_peer->setAlwaysSpectate(false);
+                sendStringToPeer(role_changed, player_peer);
             }
-            std::string blau=ServerConfig::m_blue_team_name;
-            std::string rot=ServerConfig::m_red_team_name;
-            std::string ringdrossel="python3 supertournament_match_info.py "+argv[1]+" Notes "+rot+" "+blau+" &";
-            system(ringdrossel.c_str());
-            std::string msg = "Succesfully edited notes.";
-            sendStringToPeer(msg, peer);
+            break;
         }
-	if (argv[0] == "skip")
+        case 'J':
+        case 'j':
         {
-            if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+            m_tournament_referees.insert(username);
+            if (permanent)
+                m_tournament_init_ref.insert(username);
+            if (player_peer)
             {
-                std::string msg = "You are not a referee";
-                sendStringToPeer(msg, peer);
-                return;
+                role_changed = StringUtils::insertValues(role_changed, "referee");
+                player_peer->getPlayerProfiles()[0]->setTeam(KART_TEAM_NONE);
+                sendStringToPeer(role_changed, player_peer);
             }
-	    ServerConfig::m_skip_end=true;
-            std::string msg = "Skipping end enabled.";
-            sendStringToPeer(msg, peer);
+            break;
         }
-	if (argv[0] == "noskip")
+        case 'S':
+        case 's':
         {
-            if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer)))
+            if (player_peer)
             {
-                std::string msg = "You are not a referee";
-                sendStringToPeer(msg, peer);
-                return;
+                role_changed = StringUtils::insertValues(role_changed, "spectator");
+                player_peer->getPlayerProfiles()[0]->setTeam(KART_TEAM_NONE);
+                sendStringToPeer(role_changed, player_peer);
             }
-            ServerConfig::m_skip_end=false;
-            std::string msg = "Skipping end disabled.";
-            sendStringToPeer(msg, peer);
+            break;
         }
     }
-    if (ServerConfig::m_soccer_tournament)
+    std::string msg = StringUtils::insertValues(
+        "Successfully changed role to %s for %s", role, username);
+    sendStringToPeer(msg, peer);
+    updatePlayerList();
+}   // handleSoccerRoleCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleStopCommand(std::shared_ptr<STKPeer>& peer,
+                                    std::vector<std::string>& argv,
+                                    std::string& cmd, bool hostRights)
+{
+    World* w = World::getWorld();
+    if (!w)
+        return;
+    SoccerWorld *sw = dynamic_cast<SoccerWorld*>(w);
+    sw->stop();
+    std::string msg = "The game is stopped.";
+    sendStringToAllPeers(msg);
+}   // handleStopCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleResumeCommand(std::shared_ptr<STKPeer>& peer,
+                                      std::vector<std::string>& argv,
+                                      std::string& cmd, bool hostRights)
+{
+    World* w = World::getWorld();
+    if (!w)
+        return;
+    SoccerWorld *sw = dynamic_cast<SoccerWorld*>(w);
+    sw->resume();
+    std::string msg = "The game is resumed.";
+    sendStringToAllPeers(msg);
+}   // handleResumeCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleLobbyCommand(std::shared_ptr<STKPeer>& peer,
+                                     std::vector<std::string>& argv,
+                                     std::string& cmd, bool hostRights)
+{
+    World* w = World::getWorld();
+    if (!w)
+        return;
+    SoccerWorld *sw = dynamic_cast<SoccerWorld*>(w);
+    sw->allToLobby();
+    std::string msg = "The game will be restarted or continued.";
+    sendStringToAllPeers(msg);
+}   // handleLobbyCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleInitCommand(std::shared_ptr<STKPeer>& peer,
+                                    std::vector<std::string>& argv,
+                                    std::string& cmd, bool hostRights)
+{
+    int red, blue;
+    if (argv.size() < 3 ||
+        !StringUtils::parseString<int>(argv[1], &red) ||
+        !StringUtils::parseString<int>(argv[2], &blue))
     {
-        std::string peer_username = StringUtils::wideToUtf8(
-            peer->getPlayerProfiles()[0]->getName());
-        if (m_tournament_referees.count(peer_username) == 0 && !(isVIP(peer))) 
-	{
-            if(!ServerConfig::m_super_tournament)
-	        {
-		        std::string msg = "You are not a referee";
-                sendStringToPeer(msg, peer);
-	        }
+        std::string msg = "Usage: /init [red_count] [blue_count]";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    World* w = World::getWorld();
+    if (!w)
+    {
+        std::string msg = "Please set the count when the karts "
+            "are ready. Setting the initial count in lobby is "
+            "not implemented yet, sorry.";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    SoccerWorld *sw = dynamic_cast<SoccerWorld*>(w);
+    sw->setInitialCount(red, blue);
+    sw->tellCount();
+}   // handleInitCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleRaceGameCommand(std::shared_ptr<STKPeer>& peer,
+                                        std::vector<std::string>& argv,
+                                        std::string& cmd, bool hostRights)
+{
+    int old_game = m_tournament_game;
+    if (argv.size() < 2) {
+        ++m_tournament_game;
+        m_fixed_lap = 3;
+    } else {
+        if (!StringUtils::parseString(argv[1], &m_tournament_game))
+        {
+            std::string msg = "Please specify a correct number. "
+                "Format: /game [number] [length]";
+            sendStringToPeer(msg, peer);
             return;
         }
-        if (argv[0] == "game")
+        int length = 3;
+        if (argv.size() >= 3)
         {
-            bool ok=false;
-            if (std::stoi(argv[1])>0 && std::stoi(argv[1])<=5) ok=true;
-	    std::string msg;
-            if (argv.size() >= 3) 
+            bool ok = StringUtils::parseString(argv[2], &length);
+            if (!ok || length <= 0)
             {
-	        ok=false;
-	        if (std::stoi(argv[2])>0 && std::stoi(argv[2])<=15) ok=true;
-	    }
-            if (argv.size() < 2 || ok==false)
-	    {
-                msg = "Please specify a correct number. Format: /game [number][length]";
+                std::string msg = "Please specify a correct number. "
+                    "Format: /game [number] [length]";
                 sendStringToPeer(msg, peer);
-		return;
-            }
-
-            int length=7;
-            m_fixed_lap = length;
-	    if (argv.size() >=3) m_fixed_lap = std::stoi(argv[2]);
-             
-            switch(std::stoi(argv[1]))
-	    {
-                case 1:
-	        {
-                        m_available_kts.second.clear();
-                        m_available_kts.second.insert("icy_soccer_field");
-			break;
-		}
-	        case 5:
-		{
-                        m_available_kts.second.clear();
-                        m_available_kts.second.insert("addon_supertournament-field");
-			break;
-		}
-	        case 3:
-		{
-                        m_available_kts.second.clear();
-                        m_available_kts.second.insert("addon_tournament-field");
-                        m_available_kts.second.insert("soccer_field");
-                        m_available_kts.second.insert("lasdunassoccer");
-			break;
-		}
+                return;
             }
-            msg = "Ready to start game "+argv[1]+" for "+ std::to_string(m_fixed_lap)+" minutes!";
-            sendStringToAllPeers(msg);
         }
-        else if (argv[0] == "role")
+        m_fixed_lap = length;
+    }
+    std::string msg = StringUtils::insertValues(
+        "Ready to start game %d for %d laps.", m_tournament_game, m_fixed_lap);
+    sendStringToAllPeers(msg);
+}   // handleRaceGameCommand
+//-----------------------------------------------------------------------------
+void ServerLobby::handleRaceRoleCommand(std::shared_ptr<STKPeer>& peer,
+                                        std::vector<std::string>& argv,
+                                        std::string& cmd, bool hostRights)
+{
+    if (argv.size() < 3)
+    {
+        std::string msg = "Format: /role (J|P|S) username";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    std::string role = argv[1];
+    std::string username = argv[2];
+    if (role.length() != 1)
+        std::swap(role, username);
+    if (role.length() != 1)
+    {
+        std::string msg = "Please specify one-letter role (J/P/S) and player";
+        sendStringToPeer(msg, peer);
+        return;
+    }
+    m_race_tournament_players.erase(username);
+    m_race_tournament_referees.erase(username);
+    std::string role_changed = "The referee has updated your role - you are now %s";
+    std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(
+        StringUtils::utf8ToWide(username));
+    switch (role[0])
+    {
+        case 'P':
+        case 'p':
         {
-            if (argv.size() < 3)
-            {
-                std::string msg = "Format: /role (R|B|J|S) username";
-                sendStringToPeer(msg, peer);
-                return;
-            }
-            std::string role = argv[1];
-            std::string username = argv[2];
-            bool permanent = (argv.size() >= 4 &&
-                (argv[3] == "p" || argv[3] == "permanent"));
-            if (role.length() != 1)
-                std::swap(role, username);
-            if (role.length() != 1)
-            {
-                std::string msg = "Please specify one-letter role (R/B/J/S) and player";
-                sendStringToPeer(msg, peer);
-                return;
-            }
-            m_tournament_red_players.erase(username);
-            m_tournament_blue_players.erase(username);
-            m_tournament_referees.erase(username);
-            if (permanent)
+            m_race_tournament_players.insert(username);
+            if (player_peer)
             {
-                m_tournament_init_red.erase(username);
-                m_tournament_init_blue.erase(username);
-                m_tournament_init_ref.erase(username);
-            }
-            std::string role_changed = "The referee has updated your role - you are now %s";
-            std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(
-                StringUtils::utf8ToWide(username));
-            switch (role[0])
-            {
-                case 'R':
-                case 'r':
-                {
-                    m_tournament_red_players.insert(username);
-                    if (player_peer)
-                    {
-                        role_changed = StringUtils::insertValues(role_changed, "red player");
-                        player_peer->getPlayerProfiles()[0]->setTeam(KART_TEAM_RED);
-                        player_peer->setAlwaysSpectate(false);
-                        sendStringToPeer(role_changed, player_peer);
-                    }
-                    break;
-                }
-                case 'B':
-                case 'b':
-                {
-                    m_tournament_blue_players.insert(username);
-                    if (player_peer)
-                    {
-                        role_changed = StringUtils::insertValues(role_changed, "blue player");
-                        player_peer->getPlayerProfiles()[0]->setTeam(KART_TEAM_BLUE);
-                        player_peer->setAlwaysSpectate(false);
-                        sendStringToPeer(role_changed, player_peer);
-                    }
-                    break;
-                }
-                case 'J':
-                case 'j':
-                {
-                    m_tournament_referees.insert(username);
-                    if (permanent)
-                        m_tournament_init_ref.insert(username);
-                    if (player_peer)
-                    {
-                        role_changed = StringUtils::insertValues(role_changed, "referee");
-                        player_peer->getPlayerProfiles()[0]->setTeam(KART_TEAM_NONE);
-                        sendStringToPeer(role_changed, player_peer);
-                    }
-                    break;
-                }
-                case 'S':
-                case 's':
-                {
-                    if (player_peer)
-                    {
-                        role_changed = StringUtils::insertValues(role_changed, "spectator");
-                        player_peer->getPlayerProfiles()[0]->setTeam(KART_TEAM_NONE);
-                        sendStringToPeer(role_changed, player_peer);
-                    }
-                    break;
-                }
+                role_changed = StringUtils::insertValues(role_changed, "player");
+                player_peer->setAlwaysSpectate(false);
+                sendStringToPeer(role_changed, player_peer);
             }
-            std::string msg = StringUtils::insertValues(
-                "Successfully changed role to %s for %s", role, username);
-            sendStringToPeer(msg, peer);
-            updatePlayerList();
-        }
-	else if (argv[0] == "stop")
-        {
-            World* w = World::getWorld();
-            if (!w)
-                return;
-            SoccerWorld *sw = dynamic_cast<SoccerWorld*>(w);
-            sw->stop();
-            std::string msg = "The game is stopped.";
-            sendStringToAllPeers(msg);
-        }
-        else if (argv[0] == "go" || argv[0] == "play" || argv[0] == "resume")
-        {
-            World* w = World::getWorld();
-            if (!w)
-                return;
-            SoccerWorld *sw = dynamic_cast<SoccerWorld*>(w);
-            sw->resume();
-            std::string msg = "The game is resumed.";
-            sendStringToAllPeers(msg);
-        }
-        else if (argv[0] == "lobby")
-        {
-            World* w = World::getWorld();
-            if (!w)
-                return;
-            SoccerWorld *sw = dynamic_cast<SoccerWorld*>(w);
-            sw->allToLobby();
-            std::string msg = "The game will be restarted or continued.";
-            sendStringToAllPeers(msg);
+            break;
         }
-        else if (argv[0] == "init")
+        case 'J':
+        case 'j':
         {
-            int red, blue;
-            if (argv.size() < 3 ||
-                !StringUtils::parseString<int>(argv[1], &red) ||
-                !StringUtils::parseString<int>(argv[2], &blue))
-            {
-                std::string msg = "Usage: /init [red_count] [blue_count]";
-                sendStringToPeer(msg, peer);
-                return;
-            }
-            World* w = World::getWorld();
-            if (!w)
+            m_tournament_referees.insert(username);
+            if (player_peer)
             {
-                std::string msg = "Please set the count when the karts "
-                    "are ready. Setting the initial count in lobby is "
-                    "not implemented yet, sorry.";
-                sendStringToPeer(msg, peer);
-                return;
-            }
-            SoccerWorld *sw = dynamic_cast<SoccerWorld*>(w);
-            sw->setInitialCount(red, blue);
-            sw->tellCount();
-        }
-    }
-	if (ServerConfig::m_race_tournament)
-	{
-		std::string peer_username = StringUtils::wideToUtf8(
-            peer->getPlayerProfiles()[0]->getName());
-        if (m_race_tournament_referees.count(peer_username) == 0 && !(isVIP(peer))) 
-		{
-            std::string msg = "You are not a referee";
-            sendStringToPeer(msg, peer);
-            return;
-        }
-        if (argv[0] == "game")
-        {
-            int old_game = m_tournament_game;
-            if (argv.size() < 2) {
-                ++m_tournament_game;
-                m_fixed_lap = 3;
-            } else {
-                if (!StringUtils::parseString(argv[1], &m_tournament_game))
-                { 
-                    std::string msg = "Please specify a correct number. "
-                        "Format: /game [number] [length]";
-                    sendStringToPeer(msg, peer);
-                    return;
-                }
-                int length = 3;
-                if (argv.size() >= 3)
-                {
-                    bool ok = StringUtils::parseString(argv[2], &length);
-                    if (!ok || length <= 0)
-                    {
-                        std::string msg = "Please specify a correct number. "
-                            "Format: /game [number] [length]";
-                        sendStringToPeer(msg, peer);
-                        return;
-                    }
-                }
-                m_fixed_lap = length;
+                role_changed = StringUtils::insertValues(role_changed, "referee");
+                player_peer->setAlwaysSpectate(true);
+                sendStringToPeer(role_changed, player_peer);
             }
-            std::string msg = StringUtils::insertValues(
-                "Ready to start game %d for %d laps.", m_tournament_game, m_fixed_lap);
-            sendStringToAllPeers(msg);
+            break;
         }
-        else if (argv[0] == "role")
+        case 'S':
+        case 's':
         {
-            if (argv.size() < 3)
-            {
-                std::string msg = "Format: /role (J|P|S) username";
-                sendStringToPeer(msg, peer);
-                return;
-            }
-            std::string role = argv[1];
-            std::string username = argv[2];
-            if (role.length() != 1)
-                std::swap(role, username);
-            if (role.length() != 1)
-            {
-                std::string msg = "Please specify one-letter role (J/P/S) and player";
-                sendStringToPeer(msg, peer);
-                return;
-            }
-            m_race_tournament_players.erase(username);
-            m_race_tournament_referees.erase(username);
-            std::string role_changed = "The referee has updated your role - you are now %s";
-            std::shared_ptr<STKPeer> player_peer = STKHost::get()->findPeerByName(
-                StringUtils::utf8ToWide(username));
-            switch (role[0])
+            if (player_peer)
             {
-                case 'P':
-                case 'p':
-                {
-					m_race_tournament_players.insert(username);
-                    if (player_peer)
-                    {
-                        role_changed = StringUtils::insertValues(role_changed, "player");
-						player_peer->setAlwaysSpectate(false);
-                        sendStringToPeer(role_changed, player_peer);
-                    }
-                    break;
-                }
-                case 'J':
-                case 'j':
-                {
-                    m_tournament_referees.insert(username);
-                    if (player_peer)
-                    {
-                        role_changed = StringUtils::insertValues(role_changed, "referee");
-						player_peer->setAlwaysSpectate(true);
-                        sendStringToPeer(role_changed, player_peer);
-                    }
-                    break;
-                }
-                case 'S':
-                case 's':
-                {
-                    if (player_peer)
-                    {
-                        role_changed = StringUtils::insertValues(role_changed, "spectator");
-						player_peer->setAlwaysSpectate(true);
-                        sendStringToPeer(role_changed, player_peer);
-                    }
-                    break;
-                }
+                role_changed = StringUtils::insertValues(role_changed, "spectator");
+                player_peer->setAlwaysSpectate(true);
+                sendStringToPeer(role_changed, player_peer);
             }
-            std::string msg = StringUtils::insertValues(
-                "Successfully changed role to %s for %s", role, username);
-            sendStringToPeer(msg, peer);
-            updatePlayerList();
+            break;
         }
-	}
-}   // handleServerCommand
+    }
+    std::string msg = StringUtils::insertValues(
+        "Successfully changed role to %s for %s", role, username);
+    sendStringToPeer(msg, peer);
+    updatePlayerList();
+}   // handleRaceRoleCommand
 //-----------------------------------------------------------------------------
 void ServerLobby::updateGnuElimination()
 {
@@ -8449,24 +8660,22 @@ bool ServerLobby::serverAndPeerHaveTrack(std::shared_ptr<STKPeer>& peer, std::st
 
 bool ServerLobby::serverAndPeerHaveTrack(STKPeer* peer, std::string track_id) const
 {
-	std::pair<std::set<std::string>, std::set<std::string>> kt = peer->getClientAssets();
-	bool peerHasTrack = kt.second.find(track_id) != kt.second.end();
+	int id = m_track_ids.find(track_id);
+	if (id == -1 || !peer->getAvailableTracks().test(id))
+		return false;
 
-	bool serverHasTrack = (m_official_kts.second.find(track_id) != m_official_kts.second.end()) || 
-						  (m_addon_kts.second.find(track_id) != m_addon_kts.second.end()) ||
-						  (m_addon_soccers.find(track_id) != m_addon_soccers.end()) ||
-						  (m_addon_arenas.find(track_id) != m_addon_arenas.end());
-
-	return peerHasTrack && serverHasTrack;
+	return m_official_kts_bits.second.test(id) ||
+		m_addon_kts_bits.second.test(id) || m_addon_soccers_bits.test(id) ||
+		m_addon_arenas_bits.test(id);
 }  // serverAndPeerHaveTrack
 //-----------------------------------------------------------------------------
 bool ServerLobby::serverAndPeerHaveKart(std::shared_ptr<STKPeer>& peer, std::string kart_id) const
 {
-	std::pair<std::set<std::string>, std::set<std::string>> kt = peer->getClientAssets();
-	bool peerHasTrack = kt.first.find(kart_id) != kt.first.end();
+	int id = m_kart_ids.find(kart_id);
+	bool peerHasTrack = peerHasKart(peer.get(), kart_id);
 
-	bool serverHasTrack = (m_official_kts.first.find(kart_id) != m_official_kts.first.end()) ||
-		(m_addon_kts.first.find(kart_id) != m_addon_kts.first.end());
+	bool serverHasTrack = id != -1 &&
+		(m_official_kts_bits.first.test(id) || m_addon_kts_bits.first.test(id));
 		
 	if (peerHasTrack == false)
 	{
@@ -8599,6 +8808,8 @@ std::string ServerLobby::serverModeToString(unsigned char game_mode, unsigned ch
 void ServerLobby::storeResults()
 {
 #ifdef ENABLE_SQLITE3
+    if (!m_db_worker)
+        return;
     World* w = World::getWorld();
     assert(w);
     std::string records_table_name = ServerConfig::m_records_table_name;
@@ -8609,37 +8820,10 @@ void ServerLobby::storeResults()
     std::string reverse_string = 
         (RaceManager::get()->getReverseTrack() ? "reverse" : "normal");
 
-    bool record_fetched = false;
-    bool record_exists = false;
-    double best_result = 0.0;
-    std::string best_user = "";
-
-    if (!records_table_name.empty())
-    {
-        std::string get_query = StringUtils::insertValues("SELECT username, "
-            "result FROM %s INNER JOIN "
-            "(SELECT venue as v, reverse as r, mode as m, laps as l, "
-            "min(result) as min_res FROM %s group by v, r, m, l) "
-            "ON venue = v and reverse = r and mode = m and laps = l "
-            "and result = min_res "
-            "WHERE venue = '%s' and reverse = '%s' "
-            "and mode = '%s' and laps = %d;",
-            records_table_name.c_str(), records_table_name.c_str(),
-            track_name.c_str(), reverse_string.c_str(), mode_name.c_str(),
-            laps_number);
-        auto ret = vectorSQLQuery(get_query, 2);
-        record_fetched = ret.first;
-        if (record_fetched && ret.second[0].size() > 0){
-            record_exists = true;
-            best_user = ret.second[0][0];
-            if (!StringUtils::parseString<double>(ret.second[1][0], &best_result))
-                record_fetched = false;
-        }
-    }
-
     int best_cur_player_idx = -1;
     std::string best_cur_player_name = "";
     double best_cur_time = 1e18;
+    std::vector<std::string> queries;
     for (int i = 0; i < player_count; i++)
     {
         if (w->getKart(i)->isEliminated())
@@ -8655,41 +8839,89 @@ void ServerLobby::storeResults()
             best_cur_time = elapsed_time;
             best_cur_player_name = username;
         }
-        std::string query = StringUtils::insertValues(
+        queries.push_back(StringUtils::insertValues(
             "INSERT INTO %s "
             "(username, venue, reverse, mode, laps, result) "
             "VALUES ('%s', '%s', '%s', '%s', %d, '%s');",
             m_results_table_name.c_str(), username.c_str(), track_name.c_str(),
             reverse_string.c_str(), mode_name.c_str(), laps_number, elapsed_string.str()
-        );
-        easySQLQuery(query);
+        ));
     }
-    if (record_fetched && best_cur_player_idx != -1)
+
+    std::string get_query;
+    if (!records_table_name.empty())
     {
-        NetworkString* chat = getNetworkString();
-        chat->addUInt8(LE_CHAT);
-        chat->setSynchronous(true);
-        std::string message;
-        if (!record_exists)
+        get_query = StringUtils::insertValues("SELECT username, "
+            "result FROM %s INNER JOIN "
+            "(SELECT venue as v, reverse as r, mode as m, laps as l, "
+            "min(result) as min_res FROM %s group by v, r, m, l) "
+            "ON venue = v and reverse = r and mode = m and laps = l "
+            "and result = min_res "
+            "WHERE venue = '%s' and reverse = '%s' "
+            "and mode = '%s' and laps = %d;",
+            records_table_name.c_str(), records_table_name.c_str(),
+            track_name.c_str(), reverse_string.c_str(), mode_name.c_str(),
+            laps_number);
+    }
+
+    // The previous record is read before writing the results of this race,
+    // all in the database thread, then the record is announced in lobby
+    struct Record
+    {
+        bool m_fetched = false;
+        bool m_exists = false;
+        double m_best_result = 0.0;
+        std::string m_best_user;
+    };
+    auto record = std::make_shared<Record>();
+    DatabaseWorker* worker = m_db_worker.get();
+    m_db_worker->addJob([worker, get_query, queries, record]()
         {
-            message = StringUtils::insertValues(
-                "%s has just set a server record: %s\nThis is the first time set.",
-                best_cur_player_name, StringUtils::timeToString(best_cur_time));
-        }
-        else if (best_result > best_cur_time)
+            if (!get_query.empty())
+            {
+                auto ret = worker->vectorQuery(get_query, 2);
+                record->m_fetched = ret.first;
+                if (record->m_fetched && ret.second[0].size() > 0)
+                {
+                    record->m_exists = true;
+                    record->m_best_user = ret.second[0][0];
+                    if (!StringUtils::parseString<double>(ret.second[1][0],
+                        &record->m_best_result))
+                        record->m_fetched = false;
+                }
+            }
+            for (const std::string& query : queries)
+                worker->easyQuery(query);
+        },
+        [this, record, best_cur_player_idx, best_cur_player_name,
+        best_cur_time]()
         {
-            message = StringUtils::insertValues(
-                "%s has just beaten a server record: %s\nPrevious record: %s by %s",
-                best_cur_player_name, StringUtils::timeToString(best_cur_time),
-                StringUtils::timeToString(best_result), best_user);
-        } else {
+            if (!record->m_fetched || best_cur_player_idx == -1)
+                return;
+            std::string message;
+            if (!record->m_exists)
+            {
+                message = StringUtils::insertValues(
+                    "%s has just set a server record: %s\nThis is the first time set.",
+                    best_cur_player_name, StringUtils::timeToString(best_cur_time));
+            }
+            else if (record->m_best_result > best_cur_time)
+            {
+                message = StringUtils::insertValues(
+                    "%s has just beaten a server record: %s\nPrevious record: %s by %s",
+                    best_cur_player_name, StringUtils::timeToString(best_cur_time),
+                    StringUtils::timeToString(record->m_best_result),
+                    record->m_best_user);
+            }
+            else
+                return;
+            NetworkString* chat = getNetworkString();
+            chat->addUInt8(LE_CHAT);
+            chat->setSynchronous(true);
+            chat->encodeString16(StringUtils::utf8ToWide(message));
+            sendMessageToPeers(chat);
             delete chat;
-            return;
-        }
-        chat->encodeString16(StringUtils::utf8ToWide(message));
-        sendMessageToPeers(chat);
-        delete chat;
-    }
+        });
 #endif
 }  // storeResults
 //-----------------------------------------------------------------------------
@@ -8981,19 +9213,7 @@ bool ServerLobby::canRace(STKPeer* peer) const
 	// Players who do not have the addon defined via /setfield are not allowed to play.
 	if (m_set_field != "")
 	{
-		bool has_addon = false;
-		const auto& kt = peer->getClientAssets();
-
-		for (auto& track : kt.second)
-		{
-			if (track == m_set_field)
-			{
-				has_addon = true;
-				break;
-			}
-		}
-
-		if (has_addon == false) return false;
+		if (!peerHasTrack(peer, m_set_field)) return false;
 	}
 
 	if (m_player_queue_limit > 0)
@@ -9008,24 +9228,12 @@ bool ServerLobby::canRace(STKPeer* peer) const
 
 	if (m_gnu_elimination && m_gnu2_activated)
 	{
-		const auto& kt = peer->getClientAssets();
-
-		for (std::string required_track : m_gnu2_available_tracks)
+		for (const std::string& required_track : m_gnu2_available_tracks)
 		{
-			bool has_addon = false;
-			for (auto& track : kt.second)
-			{
-				if (track == required_track)
-				{
-					has_addon = true;
-					break;
-				}
-			}
-			if (has_addon == false) return false;
+			if (!peerHasTrack(peer, required_track)) return false;
 		}
 
-		bool hasGnuKart = kt.first.find(m_gnu_kart) != kt.first.end();
-		if (hasGnuKart == false) return false;
+		if (!peerHasKart(peer, m_gnu_kart)) return false;
 	}
 
     if (ServerConfig::m_soccer_tournament)
@@ -9043,7 +9251,7 @@ bool ServerLobby::canRace(STKPeer* peer) const
     }
     else if (!m_tracks_queue.empty())
     {
-        return peer->getClientAssets().second.count(m_tracks_queue.front());
+        return peerHasTrack(peer, m_tracks_queue.front());
     }
     else
     {
@@ -9460,6 +9668,7 @@ void ServerLobby::initAvailableTracks()
     m_global_filter = TrackFilter(ServerConfig::m_only_played_tracks_string);
     m_must_have_tracks = StringUtils::split(
         ServerConfig::m_must_have_tracks_string, ' ', false);
+    m_must_have_tracks_bits = m_track_ids.add(m_must_have_tracks);
     /*m_inverted_config_restriction = false;
     m_restricting_config = true;
     if (((std::string)(ServerConfig::m_only_played_tracks_string)).empty())
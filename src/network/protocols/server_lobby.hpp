@@ -19,6 +19,7 @@
 #ifndef SERVER_LOBBY_HPP
 #define SERVER_LOBBY_HPP
 
+#include "network/asset_ids.hpp"
 #include "network/protocols/lobby_protocol.hpp"
 #include "utils/cpp2011.hpp"
 #include "utils/time.hpp"
@@ -34,6 +35,8 @@
 #include <memory>
 #include <mutex>
 #include <set>
+#include <tuple>
+#include <unordered_map>
 #include <deque>
 
 #ifdef ENABLE_SQLITE3
@@ -41,6 +44,8 @@
 #endif
 
 class BareNetworkString;
+class DatabaseIndex;
+class DatabaseWorker;
 class NetworkItemManager;
 class NetworkString;
 class NetworkPlayerProfile;
@@ -97,11 +102,50 @@ private:
         std::string m_country_code;
         bool m_tried = false;
     };
+
+    typedef void (ServerLobby::*CommandHandler)(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+
+    /** Who can use a server command, checked before its handler. Commands
+     *  needing host rights (or a vote) check it in the handler after their
+     *  arguments, so players don't vote for wrong commands. */
+    enum CommandPermission : uint8_t
+    {
+        CP_EVERYONE,
+        CP_SUPER_TOURNAMENT,     // Everyone in a super tournament only
+        CP_REFEREE,              // Referees of a soccer or race tournament
+        CP_SOCCER_REFEREE        // Referees of a soccer tournament
+    };
+
+    struct ServerCommand
+    {
+        CommandHandler m_handler;
+
+        /** Number of arguments needed after the command name. */
+        unsigned m_min_args;
+
+        CommandPermission m_permission;
+
+        /** If players can use /vote for it. */
+        bool m_votable;
+
+        /** Message sent if there are less than m_min_args arguments. */
+        const char* m_usage;
+    };
     bool m_player_reports_table_exists;
 
 #ifdef ENABLE_SQLITE3
     sqlite3* m_db;
 
+    /** Runs all database queries after initDatabase, see DatabaseWorker. */
+    std::unique_ptr<DatabaseWorker> m_db_worker;
+
+    /** Ban and geolocation tables in memory, used in the database thread. */
+    std::unique_ptr<DatabaseIndex> m_db_index;
+
+    /** Seconds since epoch of the last time pollDatabase tested bans. */
+    int64_t m_last_ban_test_time;
+
     std::string m_server_stats_table;
 
     std::string m_results_table_name;
@@ -120,6 +164,12 @@ private:
 
     void pollDatabase();
 
+    void pollDatabase(std::vector<std::shared_ptr<STKPeer> >& peers,
+                      const std::vector<uint32_t>& exist_hosts);
+
+    void asyncSQLQuery(const std::string& query,
+        std::function<void(sqlite3_stmt* stmt)> bind_function = nullptr);
+
     bool easySQLQuery(const std::string& query,
         std::function<void(sqlite3_stmt* stmt)> bind_function = nullptr) const;
 
@@ -132,6 +182,8 @@ private:
     std::string ip2Country(const SocketAddress& addr) const;
 
     std::string ipv62Country(const SocketAddress& addr) const;
+
+    void triggerBan(const std::string& table, int64_t row_id) const;
 #endif
     void initDatabase();
 
@@ -184,6 +236,27 @@ private:
      *  with data in server first. */
     std::pair<std::set<std::string>, std::set<std::string> > m_entering_kts;
 
+    /** Ids of all karts and tracks of the server, so the sets above and the
+     *  assets of peers can be compared as bitsets. */
+    AssetIds m_kart_ids;
+
+    AssetIds m_track_ids;
+
+    /** The sets above as bitsets, see updateAssetBitsets. */
+    std::pair<DynamicBitset, DynamicBitset> m_official_kts_bits;
+
+    std::pair<DynamicBitset, DynamicBitset> m_addon_kts_bits;
+
+    DynamicBitset m_addon_arenas_bits;
+
+    DynamicBitset m_addon_soccers_bits;
+
+    std::pair<DynamicBitset, DynamicBitset> m_available_kts_bits;
+
+    std::pair<DynamicBitset, DynamicBitset> m_entering_kts_bits;
+
+    DynamicBitset m_must_have_tracks_bits;
+
     /** Keeps track of the server state. */
     std::atomic_bool m_server_has_loaded_world;
 
@@ -204,8 +277,10 @@ private:
 
     std::map<uint32_t, KeyData> m_keys;
 
+    /** Online id, encrypted connection request and country code found by
+     *  IP geolocation of peers waiting for their key from STK server. */
     std::map<std::weak_ptr<STKPeer>,
-        std::pair<uint32_t, BareNetworkString>,
+        std::tuple<uint32_t, BareNetworkString, std::string>,
         std::owner_less<std::weak_ptr<STKPeer> > > m_pending_connection;
 
     std::map<std::string, uint64_t> m_pending_peer_connection;
@@ -436,6 +511,12 @@ private:
         std::swap(m_keys, new_keys);
     }
     void handlePendingConnection();
+    bool refuseIfJoiningClosed(std::shared_ptr<STKPeer>& peer);
+    void continueConnectionRequest(std::shared_ptr<STKPeer> peer,
+                                   BareNetworkString& data,
+                                   unsigned player_count, uint32_t online_id,
+                                   uint32_t encrypted_size,
+                                   const std::string& country_code);
     void handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
                                      BareNetworkString& data,
                                      uint32_t online_id,
@@ -478,7 +559,120 @@ private:
     std::vector<std::shared_ptr<NetworkPlayerProfile> > getLivePlayers() const;
     void setPlayerKarts(const NetworkString& ns, STKPeer* peer) const;
     bool handleAssets(const NetworkString& ns, STKPeer* peer);
+    void updateAssetBitsets();
+    bool peerHasKart(const STKPeer* peer, const std::string& kart) const;
+    bool peerHasTrack(const STKPeer* peer, const std::string& track) const;
     void handleServerCommand(Event* event, std::shared_ptr<STKPeer> peer);
+    static const std::unordered_map<std::string, ServerCommand>&
+        getServerCommands();
+    void handleGameCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleRoleCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleSpectateCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleListServerAddonCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handlePlayerHasAddonCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleKickCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleUnbanCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleBanCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handlePlayerAddonScoreCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleServerHasAddonCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleHelpCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleCommandsCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleGnu2AddTrackCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleGnuCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleNoGnuCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleTellCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleQueueCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleFakeCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleUnfakeCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleStandingsCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleTeamChatCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleToCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handlePublicCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleRecordCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handlePowerCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleAdminCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleVersionCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+#ifdef ENABLE_WEB_SUPPORT
+    void handleTokenCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+#endif
+    void handleSetTrackCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleSetKartCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleSetHostCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleModeCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleJoinCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleTimePollCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleCountCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleNoCountCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleSetTeamsCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleYellowCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleMatchAddonCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleMatchServerCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleMatchRefereeCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleMatchVideoCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleMatchNotesCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleSkipCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleNoSkipCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleSoccerGameCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleSoccerRoleCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleStopCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleResumeCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleLobbyCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleInitCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleRaceGameCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
+    void handleRaceRoleCommand(std::shared_ptr<STKPeer>& peer,
+        std::vector<std::string>& argv, std::string& cmd, bool hostRights);
     void liveJoinRequest(Event* event);
     void rejectLiveJoin(STKPeer* peer, BackLobbyReason blr);
     bool canLiveJoinNow() const;
@@ -489,9 +683,10 @@ private:
     void clientInGameWantsToBackLobby(Event* event);
     void clientSelectingAssetsWantsToBackLobby(Event* event);
     void kickPlayerWithReason(STKPeer* peer, const char* reason) const;
-    void testBannedForIP(STKPeer* peer) const;
-    void testBannedForIPv6(STKPeer* peer) const;
-    void testBannedForOnlineId(STKPeer* peer, uint32_t online_id) const;
+    bool testBannedForIP(STKPeer* peer, std::string* reason) const;
+    bool testBannedForIPv6(STKPeer* peer, std::string* reason) const;
+    bool testBannedForOnlineId(STKPeer* peer, uint32_t online_id,
+                               std::string* reason) const;
     void writeDisconnectInfoTable(STKPeer* peer);
     void writePlayerReport(Event* event);
     bool supportsAI();
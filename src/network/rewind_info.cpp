@@ -24,6 +24,95 @@
 #include "items/projectile_manager.hpp"
 #include "utils/log.hpp"
 
+#include <mutex>
+#include <string.h>
+
+namespace
+{
+    /** Memory for the RewindInfo objects. It is allocated in slabs of
+     *  SLAB_SLOTS slots which are large enough for each RewindInfo class,
+     *  and freed slots are reused. The slabs are only freed at exit, so
+     *  the memory used is the largest number of rewind infos alive at the
+     *  same time. Rewind infos are created in the network thread and
+     *  deleted in the main thread, so a mutex is used.
+     */
+    class RewindInfoPool
+    {
+    public:
+        static const size_t MAX_EVENT_SIZE =
+            sizeof(RewindInfoEvent) > sizeof(RewindInfoEventFunction) ?
+            sizeof(RewindInfoEvent) : sizeof(RewindInfoEventFunction);
+        static const size_t SLOT_SIZE =
+            ((sizeof(RewindInfoState) > MAX_EVENT_SIZE ?
+              sizeof(RewindInfoState) : MAX_EVENT_SIZE) + 15) & ~(size_t)15;
+        static const unsigned SLAB_SLOTS = 256;
+
+    private:
+        std::mutex m_mutex;
+        std::vector<uint8_t*> m_slabs;
+        std::vector<void*> m_free_slots;
+
+    public:
+        ~RewindInfoPool()
+        {
+            for (uint8_t* slab : m_slabs)
+                ::operator delete(slab);
+        }   // ~RewindInfoPool
+        // --------------------------------------------------------------------
+        void* allocate()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_free_slots.empty())
+            {
+                uint8_t* slab =
+                    (uint8_t*)::operator new(SLOT_SIZE * SLAB_SLOTS);
+                m_slabs.push_back(slab);
+                m_free_slots.reserve(m_slabs.size() * SLAB_SLOTS);
+                for (unsigned i = SLAB_SLOTS; i > 0; i--)
+                    m_free_slots.push_back(slab + (i - 1) * SLOT_SIZE);
+            }
+            void* p = m_free_slots.back();
+            m_free_slots.pop_back();
+            return p;
+        }   // allocate
+        // --------------------------------------------------------------------
+        void free(void* p)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free_slots.push_back(p);
+        }   // free
+    };   // RewindInfoPool
+
+    RewindInfoPool g_rewind_info_pool;
+}   // anonymous namespace
+
+// ----------------------------------------------------------------------------
+/** Allocates a rewind info from the slabs of RewindInfoPool, unless it is
+ *  larger than a slot (i.e. a new subclass which is not in SLOT_SIZE).
+ */
+void* RewindInfo::operator new(size_t size)
+{
+    if (size > RewindInfoPool::SLOT_SIZE)
+        return ::operator new(size);
+    return g_rewind_info_pool.allocate();
+}   // operator new
+
+// ----------------------------------------------------------------------------
+/** Returns the memory of a rewind info, size is the size of the subclass.
+ */
+void RewindInfo::operator delete(void* p, size_t size)
+{
+    if (!p)
+        return;
+    if (size > RewindInfoPool::SLOT_SIZE)
+        ::operator delete(p);
+    else
+        g_rewind_info_pool.free(p);
+}   // operator delete
+
+BareNetworkString RewindInfoEvent::m_data_buffer[PT_COUNT];
+
+// ----------------------------------------------------------------------------
 /** Constructor for a state: it only takes the size, and allocates a buffer
  *  for all state info.
  *  \param size Necessary buffer size for a state.
@@ -54,19 +143,36 @@ RewindInfoState::RewindInfoState(int ticks, int start_offset,
 {
     std::swap(m_rewinder_using, rewinder_using);
     m_start_offset = start_offset;
-    m_buffer = new BareNetworkString();
-    std::swap(m_buffer->getBuffer(), buffer);
+    std::swap(m_buffer.getBuffer(), buffer);
+}   // RewindInfoState
+
+// ------------------------------------------------------------------------
+/** Constructor for a state received with the rewinder id of each rewinder,
+ *  the buffer only contains the data of rewinders. The unique identities of
+ *  the ids are set in RewindManager::setNetworkRewinderName.
+ */
+RewindInfoState::RewindInfoState(int ticks,
+                                 std::vector<uint16_t>& rewinder_ids,
+                                 std::vector<uint8_t>& buffer)
+               : RewindInfo(ticks, true/*is_confirmed*/)
+{
+    std::swap(m_rewinder_ids, rewinder_ids);
+    m_start_offset = 0;
+    std::swap(m_buffer.getBuffer(), buffer);
 }   // RewindInfoState
 
 // ------------------------------------------------------------------------
 /** Constructor used only in unit testing (without list of rewinder using).
+ *  The buffer is freed.
  */
 RewindInfoState::RewindInfoState(int ticks, BareNetworkString* buffer,
                                  bool is_confirmed)
                : RewindInfo(ticks, is_confirmed)
 {
     m_start_offset = 0;
-    m_buffer = buffer;
+    if (buffer)
+        std::swap(m_buffer.getBuffer(), buffer->getBuffer());
+    delete buffer;
 }   // RewindInfoState
 
 // ------------------------------------------------------------------------
@@ -76,47 +182,54 @@ RewindInfoState::RewindInfoState(int ticks, BareNetworkString* buffer,
  */
 void RewindInfoState::restore()
 {
-    m_buffer->reset();
-    m_buffer->skip(m_start_offset);
-    for (const std::string& name : m_rewinder_using)
+    m_buffer.reset();
+    m_buffer.skip(m_start_offset);
+    const bool use_ids = !m_rewinder_ids.empty();
+    const unsigned rewinder_size = use_ids ?
+        (unsigned)m_rewinder_ids.size() : (unsigned)m_rewinder_using.size();
+    for (unsigned i = 0; i < rewinder_size; i++)
     {
-        const uint16_t data_size = m_buffer->getUInt16();
-        const unsigned current_offset_now = m_buffer->getCurrentOffset();
-        std::shared_ptr<Rewinder> r =
-            RewindManager::get()->getRewinder(name);
+        const uint16_t data_size = m_buffer.getUInt16();
+        const unsigned current_offset_now = m_buffer.getCurrentOffset();
+        std::shared_ptr<Rewinder> r = use_ids ?
+            RewindManager::get()->getNetworkRewinder(m_rewinder_ids[i]) :
+            RewindManager::get()->getRewinder(m_rewinder_using[i]);
 
         if (!r)
         {
             // For now we only need to get missing rewinder from
             // projectile_manager
+            const std::string& name = use_ids ? RewindManager::get()
+                ->getNetworkRewinderName(m_rewinder_ids[i]) :
+                m_rewinder_using[i];
             r = ProjectileManager::get()->addRewinderFromNetworkState(name);
-        }
-        if (!r)
-        {
-            Log::error("RewindInfoState", "Missing rewinder %s",
-                name.c_str());
-            m_buffer->skip(data_size);
-            continue;
+            if (!r)
+            {
+                Log::error("RewindInfoState", "Missing rewinder %s",
+                    name.c_str());
+                m_buffer.skip(data_size);
+                continue;
+            }
         }
         try
         {
-            r->restoreState(m_buffer, data_size);
+            r->restoreState(&m_buffer, data_size);
         }
         catch (std::exception& e)
         {
             Log::error("RewindInfoState", "Restore state error: %s",
                 e.what());
-            m_buffer->reset();
-            m_buffer->skip(current_offset_now + data_size);
+            m_buffer.reset();
+            m_buffer.skip(current_offset_now + data_size);
             continue;
         }
 
-        if (m_buffer->getCurrentOffset() - current_offset_now != data_size)
+        if (m_buffer.getCurrentOffset() - current_offset_now != data_size)
         {
             Log::error("RewindInfoState", "Wrong size read when restore "
                 "state, incompatible binary?");
-            m_buffer->reset();
-            m_buffer->skip(current_offset_now + data_size);
+            m_buffer.reset();
+            m_buffer.skip(current_offset_now + data_size);
         }
     }   // for all rewinder
 }   // restore
@@ -128,5 +241,43 @@ RewindInfoEvent::RewindInfoEvent(int ticks, EventRewinder *event_rewinder,
 {
     m_event_rewinder = event_rewinder;
     m_buffer         = buffer;
+    m_data_size      = 0;
 }   // RewindInfoEvent
 
+// ----------------------------------------------------------------------------
+/** Constructor for an event with a small payload, which is copied into the
+ *  event so no buffer needs to be allocated.
+ *  \param data The event data.
+ *  \param size Size of the data, at most MAX_DATA_SIZE.
+ */
+RewindInfoEvent::RewindInfoEvent(int ticks, EventRewinder *event_rewinder,
+                                 const uint8_t *data, unsigned size,
+                                 bool is_confirmed)
+               : RewindInfo(ticks, is_confirmed)
+{
+    assert(size <= MAX_DATA_SIZE);
+    m_event_rewinder = event_rewinder;
+    m_buffer         = NULL;
+    m_data_size      = (uint8_t)size;
+    memcpy(m_data, data, size);
+}   // RewindInfoEvent
+
+// ----------------------------------------------------------------------------
+/** Returns the buffer with the event information in it, ready to be read
+ *  from the beginning. For an event with the data stored in place the
+ *  buffer of the current process is filled, so it is only valid until the
+ *  next call.
+ */
+BareNetworkString* RewindInfoEvent::getBuffer()
+{
+    BareNetworkString* buffer = m_buffer;
+    if (!buffer)
+    {
+        buffer = &m_data_buffer[STKProcess::getType()];
+        buffer->getBuffer().assign(m_data, m_data + m_data_size);
+    }
+    // Make sure to reset the buffer so we read from the beginning
+    buffer->reset();
+    return buffer;
+}   // getBuffer
+
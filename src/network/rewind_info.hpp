@@ -24,8 +24,10 @@
 #include "utils/cpp2011.hpp"
 #include "utils/leak_check.hpp"
 #include "utils/ptr_vector.hpp"
+#include "utils/stk_process.hpp"
 
 #include <assert.h>
+#include <cstddef>
 #include <functional>
 #include <string>
 #include <vector>
@@ -39,6 +41,9 @@
  *  and might be released (to save memory) differently: A state can be
  *  reproduced from a previous state by replaying the simulation taking
  *  all events into account.
+ *  A RewindInfo is created for each event and state on clients and server,
+ *  so they are allocated from slabs of memory which are reused (see
+ *  operator new).
  */
 
 class RewindInfo
@@ -59,6 +64,9 @@ public:
 
     void setTicks(int ticks);
 
+    static void* operator new(size_t size);
+    static void operator delete(void* p, size_t size);
+
     /** Called when going back in time to undo any rewind information. */
     virtual void undo() = 0;
     /** This is called to restore a state before replaying the events. */
@@ -92,12 +100,19 @@ public:
 class RewindInfoState: public RewindInfo
 {
 private:
+    /** Unique identity of each rewinder in the state, empty if the state
+     *  was received with rewinder ids. */
     std::vector<std::string> m_rewinder_using;
 
+    /** Rewinder id used by server for each rewinder in the state, empty if
+     *  the state was received with unique identities. */
+    std::vector<uint16_t> m_rewinder_ids;
+
     int m_start_offset;
 
-    /** Pointer to the buffer which stores all states. */
-    BareNetworkString *m_buffer;
+    /** The buffer which stores all states. It takes over the memory of the
+     *  received message. */
+    BareNetworkString m_buffer;
 
 public:
     // ------------------------------------------------------------------------
@@ -105,14 +120,15 @@ public:
                     std::vector<std::string>& rewinder_using,
                     std::vector<uint8_t>& buffer);
     // ------------------------------------------------------------------------
-    RewindInfoState(int ticks, BareNetworkString *buffer, bool is_confirmed);
+    RewindInfoState(int ticks, std::vector<uint16_t>& rewinder_ids,
+                    std::vector<uint8_t>& buffer);
     // ------------------------------------------------------------------------
-    virtual ~RewindInfoState()                             { delete m_buffer; }
+    RewindInfoState(int ticks, BareNetworkString *buffer, bool is_confirmed);
     // ------------------------------------------------------------------------
     virtual void restore();
     // ------------------------------------------------------------------------
     /** Returns a pointer to the state buffer. */
-    BareNetworkString *getBuffer() const { return m_buffer; }
+    BareNetworkString *getBuffer()                        { return &m_buffer; }
     // ------------------------------------------------------------------------
     virtual bool isState() const { return true; }
     // ------------------------------------------------------------------------
@@ -134,15 +150,34 @@ public:
 // ============================================================================
 class RewindInfoEvent : public RewindInfo
 {
+public:
+    /** Maximum size of the event data stored in the event itself. */
+    static const unsigned MAX_DATA_SIZE = 16;
+
 private:
     /** Pointer to the event rewinder responsible for this event. */
     EventRewinder *m_event_rewinder;
 
-    /** Buffer with the event data. */
+    /** Buffer with the event data, or NULL if the data is in m_data. */
     BareNetworkString *m_buffer;
+
+    /** Small event data (e.g. a controller action) stored in place. */
+    uint8_t m_data[MAX_DATA_SIZE];
+
+    uint8_t m_data_size;
+
+    /** The buffer the event data in m_data is passed in to the event
+     *  rewinder, one for each process, so its memory is reused. */
+    static BareNetworkString m_data_buffer[PT_COUNT];
+
 public:
              RewindInfoEvent(int ticks, EventRewinder *event_rewinder,
                              BareNetworkString *buffer, bool is_confirmed);
+    // ------------------------------------------------------------------------
+             RewindInfoEvent(int ticks, EventRewinder *event_rewinder,
+                             const uint8_t *data, unsigned size,
+                             bool is_confirmed);
+    // ------------------------------------------------------------------------
     virtual ~RewindInfoEvent()
     {
         delete m_buffer;
@@ -158,8 +193,7 @@ public:
      *  It calls undoEvent in the rewinder. */
     virtual void undo()
     {
-        m_buffer->reset();
-        m_event_rewinder->undo(m_buffer);
+        m_event_rewinder->undo(getBuffer());
     }   // undo
     // ------------------------------------------------------------------------
     /** This is called while going forwards in time again to reach current
@@ -167,13 +201,10 @@ public:
      */
     virtual void replay()
     {
-        // Make sure to reset the buffer so we read from the beginning
-        m_buffer->reset();
-        m_event_rewinder->rewind(m_buffer);
+        m_event_rewinder->rewind(getBuffer());
     }   // rewind
     // ------------------------------------------------------------------------
-    /** Returns the buffer with the event information in it. */
-    BareNetworkString *getBuffer() { return m_buffer; }
+    BareNetworkString *getBuffer();
 };   // class RewindIndoEvent
 
 
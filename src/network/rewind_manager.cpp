@@ -18,6 +18,7 @@
 
 #include "network/rewind_manager.hpp"
 
+#include "config/user_config.hpp"
 #include "graphics/irr_driver.hpp"
 #include "modes/world.hpp"
 #include "network/network_config.hpp"
@@ -33,6 +34,7 @@
 #include "tracks/track_object_manager.hpp"
 #include "utils/log.hpp"
 #include "utils/profiler.hpp"
+#include "utils/time.hpp"
 
 #include <algorithm>
 
@@ -63,6 +65,9 @@ void RewindManager::destroy()
  */
 RewindManager::RewindManager()
 {
+    m_next_rewinder_serial = 0;
+    m_network_rewinder_name_changes.store(0);
+    m_network_rewinder_name_changes_seen = 0;
     reset();
 }   // RewindManager
 
@@ -87,13 +92,54 @@ void RewindManager::reset()
     m_overall_state_size = 0;
     m_state_frequency = stk_config->getPhysicsFPS() /
         NetworkConfig::get()->getStateFrequency();
+    m_pending_rewind_ticks = -1;
+    m_resimulation_backlog = 0;
+    m_rewound_this_frame = false;
+    m_frame_resimulated_ticks = 0;
+    m_second_rewinds = m_second_resimulated_ticks = 0;
+    m_rewinds_per_second = m_resimulated_ticks_per_second = 0;
+    m_total_rewinds = m_total_resimulated_ticks = 0;
+    m_second_start = StkTime::getMonoTimeMs();
+    m_local_state_ticks.assign(
+        stk_config->time2Ticks((float)LOCAL_STATE_WINDOW) /
+        m_state_frequency + 1, -1);
 
     if (!m_enable_rewind_manager) return;
 
     clearExpiredRewinder();
+    m_network_rewinder.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_network_rewinder_name_mutex);
+        m_network_rewinder_name.clear();
+        m_network_rewinder_name_changes_seen =
+            m_network_rewinder_name_changes.load();
+    }
     m_rewind_queue.reset();
 }   // reset
 
+// ----------------------------------------------------------------------------
+/** Called by the main loop before the ticks of a frame are simulated. Allows
+ *  a new rewind in this frame, and updates the rewind statistics.
+ */
+void RewindManager::newFrame()
+{
+    PROFILER_SET_COUNTER("Re-simulated ticks",
+                         (int64_t)m_frame_resimulated_ticks);
+    m_rewound_this_frame = false;
+    m_frame_resimulated_ticks = 0;
+
+    uint64_t now = StkTime::getMonoTimeMs();
+    if (now - m_second_start < 1000)
+        return;
+    m_rewinds_per_second = m_second_rewinds;
+    m_resimulated_ticks_per_second = m_second_resimulated_ticks;
+    m_second_rewinds = m_second_resimulated_ticks = 0;
+    // Don't accumulate the lost time if frames took longer than a second
+    m_second_start = now - (now - m_second_start) % 1000;
+    PROFILER_SET_COUNTER("Rewinds per second",
+                         (int64_t)m_rewinds_per_second);
+}   // newFrame
+
 // ----------------------------------------------------------------------------    
 /** Adds an event to the rewind data. The data to be stored must be allocated
  *  and not freed by the caller!
@@ -114,9 +160,50 @@ void RewindManager::addEvent(EventRewinder *event_rewinder,
 
     if (ticks < 0)
         ticks = World::getWorld()->getTicksSinceStart();
+    // An event after the world ticks (while a re-simulation is spread over
+    // several frames) is merged when the world reaches its ticks
+    if (ticks > World::getWorld()->getTicksSinceStart())
+    {
+        m_rewind_queue.addNetworkRewindInfo(new RewindInfoEvent(ticks,
+            event_rewinder, buffer, confirmed));
+        return;
+    }
     m_rewind_queue.addLocalEvent(event_rewinder, buffer, confirmed, ticks);
 }   // addEvent
 
+// ----------------------------------------------------------------------------
+/** Adds an event with a small payload (at most RewindInfoEvent::
+ *  MAX_DATA_SIZE bytes) to the rewind data. The data is copied into the
+ *  event, so no memory is allocated for it.
+ *  \param data Pointer to the event data.
+ *  \param size Size of the event data.
+ *  \param ticks Time at which the event was recorded. If time is not
+ *          specified (or set to -1), the current world time is used.
+ */
+void RewindManager::addEvent(EventRewinder *event_rewinder,
+                             const uint8_t *data, unsigned size,
+                             bool confirmed, int ticks)
+{
+    if (m_is_rewinding)
+    {
+        Log::error("RewindManager", "Adding event when rewinding");
+        return;
+    }
+
+    if (ticks < 0)
+        ticks = World::getWorld()->getTicksSinceStart();
+    // An event after the world ticks (while a re-simulation is spread over
+    // several frames) is merged when the world reaches its ticks
+    if (ticks > World::getWorld()->getTicksSinceStart())
+    {
+        m_rewind_queue.addNetworkRewindInfo(new RewindInfoEvent(ticks,
+            event_rewinder, data, size, confirmed));
+        return;
+    }
+    m_rewind_queue.addLocalEvent(event_rewinder, data, size, confirmed,
+                                 ticks);
+}   // addEvent
+
 // ----------------------------------------------------------------------------
 /** Adds an event to the list of network rewind data. This function is
  *  threadsafe so can be called by the network thread. The data is synched
@@ -131,6 +218,20 @@ void RewindManager::addNetworkEvent(EventRewinder *event_rewinder,
     m_rewind_queue.addNetworkEvent(event_rewinder, buffer, ticks);
 }   // addNetworkEvent
 
+// ----------------------------------------------------------------------------
+/** Adds an event with a small payload to the list of network rewind data,
+ *  the data is copied into the event. This function is threadsafe.
+ *  \param data Pointer to the event data.
+ *  \param size Size of the event data.
+ *  \param ticks Time at which the event was recorded.
+ */
+void RewindManager::addNetworkEvent(EventRewinder *event_rewinder,
+                                    const uint8_t *data, unsigned size,
+                                    int ticks)
+{
+    m_rewind_queue.addNetworkEvent(event_rewinder, data, size, ticks);
+}   // addNetworkEvent
+
 // ----------------------------------------------------------------------------
 /** Adds a state to the list of network rewind data. This function is
  *  threadsafe so can be called by the network thread. The data is synched
@@ -152,13 +253,14 @@ void RewindManager::addNetworkState(BareNetworkString *buffer, int ticks)
 void RewindManager::saveState()
 {
     PROFILER_PUSH_CPU_MARKER("RewindManager - save state", 0x20, 0x7F, 0x20);
+    // Without a GameProtocol (when re-simulating a match log) the states
+    // are still saved, since saving quantizes the physics of the karts
     auto gp = GameProtocol::lock();
-    if (!gp)
-        return;
-    gp->startNewState();
+    if (gp)
+        gp->startNewState();
 
     m_overall_state_size = 0;
-    std::vector<std::string> rewinder_using;
+    std::vector<uint16_t> rewinder_ids;
 
     for (auto& p : m_all_rewinder)
     {
@@ -166,15 +268,17 @@ void RewindManager::saveState()
         // GameProtocol - this would save the copy operation.
         BareNetworkString* buffer = NULL;
         if (auto r = p.second.lock())
-            buffer = r->saveState(&rewinder_using);
+            buffer = r->saveState(&rewinder_ids);
         if (buffer != NULL)
         {
             m_overall_state_size += buffer->size();
-            gp->addState(buffer);
+            if (gp)
+                gp->addState(buffer);
         }
         delete buffer;    // buffer can be freed
     }
-    gp->finalizeState(rewinder_using);
+    if (gp)
+        gp->finalizeState(rewinder_ids);
     PROFILER_POP_CPU_MARKER();
 }   // saveState
 
@@ -201,11 +305,17 @@ void RewindManager::update(int ticks_not_used)
     clearExpiredRewinder();
     if (NetworkConfig::get()->isClient())
     {
-        auto& ret = m_local_state[ticks];
+        // A slot is overwritten by a newer state, or by the same ticks
+        // after a re-simulation spread over several frames
+        unsigned slot = getLocalStateSlot(ticks);
+        m_local_state_ticks[slot] = ticks;
         for (auto& p : m_all_rewinder)
         {
             if (auto r = p.second.lock())
-                ret.push_back(r->getLocalStateRestoreFunction());
+            {
+                r->saveLocalState(ticks, slot,
+                                  (unsigned)m_local_state_ticks.size());
+            }
         }
     }
     else
@@ -239,16 +349,42 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
     // be getTime()+dt - world time has not been updated yet).
     m_rewind_queue.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
 
+    // Only one rewind is done per frame. The earliest tick which must be
+    // re-simulated is the one of the latest state received: a state is a
+    // complete confirmed snapshot of all rewinders, so restoring it
+    // overwrites everything an earlier state would restore, and all events
+    // after it are replayed anyway (late events never cause a rewind on
+    // their own, see RewindQueue::mergeNetworkData). If more states are
+    // received in later ticks of this frame, the rewind to the latest of
+    // them is done in the next frame.
     if (needs_rewind)
+    {
+        m_pending_rewind_ticks = std::max(m_pending_rewind_ticks,
+                                          rewind_ticks);
+    }
+
+    if (!m_rewound_this_frame && m_pending_rewind_ticks > -1)
     {
         Log::setPrefix("Rewind");
         PROFILER_PUSH_CPU_MARKER("Rewind", 128, 128, 128);
-        rewindTo(rewind_ticks, world_ticks, fast_forward);
-        // This should replay everything up to 'now'
-        assert(World::getWorld()->getTicksSinceStart() == world_ticks);
+        m_rewound_this_frame = true;
+        int now_ticks = world_ticks + m_resimulation_backlog;
+        rewindTo(m_pending_rewind_ticks, now_ticks, fast_forward);
+        m_pending_rewind_ticks = -1;
+        // This should replay everything up to 'now', except the ticks left
+        // for the next frames
+        assert(World::getWorld()->getTicksSinceStart() +
+               m_resimulation_backlog == now_ticks);
         PROFILER_POP_CPU_MARKER();
         Log::setPrefix("");
     }
+    else if (!m_rewound_this_frame && m_resimulation_backlog > 0)
+    {
+        PROFILER_PUSH_CPU_MARKER("Rewind", 128, 128, 128);
+        m_rewound_this_frame = true;
+        continueResimulation(fast_forward);
+        PROFILER_POP_CPU_MARKER();
+    }
 
     assert(!m_is_rewinding);
     if (m_rewind_queue.isEmpty()) return;
@@ -257,8 +393,9 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
     // event again as a seemingly new event.
     m_is_rewinding = true;
 
-    // Now play all events that happened at the current time stamp.
-    m_rewind_queue.replayAllEvents(world_ticks);
+    // Now play all events that happened at the current time stamp, which
+    // is behind world_ticks if the re-simulation is not finished.
+    m_rewind_queue.replayAllEvents(World::getWorld()->getTicksSinceStart());
 
     m_is_rewinding = false;
 }   // playEventsTill
@@ -270,13 +407,88 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
 bool RewindManager::addRewinder(std::shared_ptr<Rewinder> rewinder)
 {
     if (!m_enable_rewind_manager) return false;
-    // Maximum 1 bit to store no of rewinder used
-    if (m_all_rewinder.size() == 255)
+
+    auto it = m_all_rewinder.find(rewinder->getUniqueIdentity());
+    if (it != m_all_rewinder.end() && it->second.lock() == rewinder)
+        return true;
+
+    // Reuse the id of an expired rewinder first, the highest bit of id is
+    // used in delta states to indicate that the unique identity follows
+    unsigned id = 0;
+    while (id < m_rewinder_by_id.size() && !m_rewinder_by_id[id].expired())
+        id++;
+    if (id > 0x7fff)
         return false;
+    if (id == m_rewinder_by_id.size())
+    {
+        m_rewinder_by_id.push_back(rewinder);
+        m_rewinder_serial.push_back(0);
+    }
+    else
+        m_rewinder_by_id[id] = rewinder;
+    m_rewinder_serial[id] = m_next_rewinder_serial++;
+    rewinder->setRewinderID((uint16_t)id);
     m_all_rewinder[rewinder->getUniqueIdentity()] = rewinder;
     return true;
 }   // addRewinder
 
+// ----------------------------------------------------------------------------
+/** Client: sets the unique identity of a rewinder id used in the states of
+ *  server, called by the network thread when a state contains the unique
+ *  identity of an id (new or reused id).
+ *  \param id Rewinder id in the states of server.
+ *  \param name Unique identity of the rewinder.
+ */
+void RewindManager::setNetworkRewinderName(uint16_t id,
+                                           const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_network_rewinder_name_mutex);
+    if (id >= m_network_rewinder_name.size())
+        m_network_rewinder_name.resize(id + 1);
+    if (m_network_rewinder_name[id] == name)
+        return;
+    m_network_rewinder_name[id] = name;
+    m_network_rewinder_name_changes.fetch_add(1);
+}   // setNetworkRewinderName
+
+// ----------------------------------------------------------------------------
+/** Client: returns the rewinder with the rewinder id used by server. The
+ *  result is cached, so the unique identity is only looked up after it was
+ *  set for a new or reused id by setNetworkRewinderName.
+ *  \param id Rewinder id in the states of server.
+ */
+std::shared_ptr<Rewinder> RewindManager::getNetworkRewinder(uint16_t id)
+{
+    if (m_network_rewinder_name_changes.load() !=
+        m_network_rewinder_name_changes_seen)
+    {
+        std::lock_guard<std::mutex> lock(m_network_rewinder_name_mutex);
+        m_network_rewinder_name_changes_seen =
+            m_network_rewinder_name_changes.load();
+        if (m_network_rewinder.size() < m_network_rewinder_name.size())
+            m_network_rewinder.resize(m_network_rewinder_name.size());
+        for (unsigned i = 0; i < m_network_rewinder_name.size(); i++)
+        {
+            auto& nr = m_network_rewinder[i];
+            if (nr.first != m_network_rewinder_name[i])
+            {
+                nr.first = m_network_rewinder_name[i];
+                nr.second.reset();
+            }
+        }
+    }
+    if (id >= m_network_rewinder.size())
+        m_network_rewinder.resize(id + 1);
+    auto& nr = m_network_rewinder[id];
+    if (auto r = nr.second.lock())
+        return r;
+    if (nr.first.empty())
+        return nullptr;
+    std::shared_ptr<Rewinder> r = getRewinder(nr.first);
+    nr.second = r;
+    return r;
+}   // getNetworkRewinder
+
 // ----------------------------------------------------------------------------
 /** Rewinds to the specified time, then goes forward till the current
  *  World::getTime() is reached again: it will replay everything before
@@ -285,6 +497,8 @@ bool RewindManager::addRewinder(std::shared_ptr<Rewinder> rewinder)
  *  \param now_ticks Up to which ticks events are replayed: up to but 
  *         EXCLUDING new_ticks (the event at now_ticks are played in
  *         the calling subroutine playEventsTill).
+ *         If the re-simulation is limited (see resimulate) the world
+ *         ticks are still before now_ticks afterwards.
  *  \param fast_forward If true, then only rewinders in network will be
  *  updated, but not the physics.
  */
@@ -328,20 +542,13 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
 
     // Restore states from the exact rewind time
     // -----------------------------------------
-    auto it = m_local_state.find(exact_rewind_ticks);
-    if (it != m_local_state.end())
+    unsigned slot = getLocalStateSlot(exact_rewind_ticks);
+    if (m_local_state_ticks[slot] == exact_rewind_ticks)
     {
-        for (auto& restore_local_state : it->second)
-        {
-            if (restore_local_state)
-                restore_local_state();
-        }
-        for (auto it = m_local_state.begin(); it != m_local_state.end();)
+        for (auto& p : m_all_rewinder)
         {
-            if (it->first <= exact_rewind_ticks)
-                it = m_local_state.erase(it);
-            else
-                break;
+            if (auto r = p.second.lock())
+                r->restoreLocalState(exact_rewind_ticks, slot);
         }
     }
     else if (!fast_forward)
@@ -376,14 +583,55 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
         world->setTicksForRewind(exact_rewind_ticks);
     }
 
+    m_second_rewinds++;
+    m_total_rewinds++;
+
     // Now go forward through the list of rewind infos till we reach 'now':
+    resimulate(now_ticks, fast_forward);
+
+    // Now compute the errors which need to be visually smoothed
+    for (auto& p : m_all_rewinder)
+    {
+        if (auto r = p.second.lock())
+            r->computeError();
+    }
+
+    history->setReplayHistory(is_history);
+    m_is_rewinding = false;
+    mergeRewindInfoEventFunction();
+}   // rewindTo
+
+// ----------------------------------------------------------------------------
+/** Goes forward from the current world ticks, replaying the rewind infos,
+ *  till now_ticks is reached. At most UserConfigParams::
+ *  m_max_rewind_ticks_per_frame ticks are simulated in a frame; if more are
+ *  needed the world stays behind and the remaining ticks are re-simulated
+ *  in the next frames (see continueResimulation).
+ *  \param now_ticks Up to which ticks events are replayed, excluding
+ *         now_ticks.
+ *  \param fast_forward If true, then only rewinders in network will be
+ *  updated, but not the physics (which is never limited).
+ */
+void RewindManager::resimulate(int now_ticks, bool fast_forward)
+{
+    World* world = World::getWorld();
+    const int max_ticks = UserConfigParams::m_max_rewind_ticks_per_frame;
     while (world->getTicksSinceStart() < now_ticks)
-    { 
+    {
+        if (!fast_forward && max_ticks > 0 &&
+            m_frame_resimulated_ticks >= max_ticks)
+            break;
+
         m_rewind_queue.replayAllEvents(world->getTicksSinceStart());
 
         // Now simulate the next time step
         if (!fast_forward)
+        {
             world->updateWorld(1);
+            m_frame_resimulated_ticks++;
+            m_second_resimulated_ticks++;
+            m_total_resimulated_ticks++;
+        }
 #undef SHOW_ROLLBACK
 #ifdef SHOW_ROLLBACK
         irr_driver->update(stk_config->ticks2Time(1));
@@ -391,8 +639,31 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
         world->updateTime(1);
 
     }   // while (world->getTicks() < current_ticks)
+    m_resimulation_backlog = now_ticks - world->getTicksSinceStart();
+}   // resimulate
+
+// ----------------------------------------------------------------------------
+/** Re-simulates the ticks which were left by the re-simulation of a rewind
+ *  in an earlier frame.
+ *  \param fast_forward If true, then only rewinders in network will be
+ *  updated, but not the physics.
+ */
+void RewindManager::continueResimulation(bool fast_forward)
+{
+    assert(!m_is_rewinding);
+    bool is_history = history->replayHistory();
+    history->setReplayHistory(false);
+
+    for (auto& p : m_all_rewinder)
+    {
+        if (auto r = p.second.lock())
+            r->saveTransform();
+    }
+    m_is_rewinding = true;
+
+    resimulate(World::getWorld()->getTicksSinceStart() +
+               m_resimulation_backlog, fast_forward);
 
-    // Now compute the errors which need to be visually smoothed
     for (auto& p : m_all_rewinder)
     {
         if (auto r = p.second.lock())
@@ -402,7 +673,7 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks,
     history->setReplayHistory(is_history);
     m_is_rewinding = false;
     mergeRewindInfoEventFunction();
-}   // rewindTo
+}   // continueResimulation
 
 // ----------------------------------------------------------------------------
 bool RewindManager::useLocalEvent() const
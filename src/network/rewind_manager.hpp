@@ -24,10 +24,11 @@
 
 #include <assert.h>
 #include <atomic>
-#include <functional>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <set>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -91,11 +92,51 @@ private:
      *  rewind data in case of local races only. */
     static std::atomic_bool m_enable_rewind_manager;
 
-    std::map<int, std::vector<std::function<void()> > > m_local_state;
+    /** Client: how many seconds of local states are kept. A rewind to an
+     *  older state can not restore the local state. */
+    static const int LOCAL_STATE_WINDOW = 5;
+
+    /** Client: the ticks of the local states saved in each slot of the
+     *  local state ring of the rewinders (see Rewinder::saveLocalState),
+     *  or -1. */
+    std::vector<int> m_local_state_ticks;
 
     /** A list of all objects that can be rewound. */
     std::map<std::string, std::weak_ptr<Rewinder> > m_all_rewinder;
 
+    /** Server: all rewinders indexed by their rewinder id, expired slots
+     *  are reused for new rewinders. */
+    std::vector<std::weak_ptr<Rewinder> > m_rewinder_by_id;
+
+    /** Server: serial of the rewinder using each rewinder id, it changes
+     *  when an id is reused so states can tell if they have the same
+     *  rewinder under an id without comparing unique identities. */
+    std::vector<uint32_t> m_rewinder_serial;
+
+    /** Server: serial given to the next added rewinder. */
+    uint32_t m_next_rewinder_serial;
+
+    /** Client: rewinders indexed by the rewinder id used in the states of
+     *  server, with the unique identity it was resolved from. Only used in
+     *  main thread. */
+    std::vector<std::pair<std::string, std::weak_ptr<Rewinder> > >
+        m_network_rewinder;
+
+    /** Client: unique identity of each rewinder id, set by the network
+     *  thread when a state introduces a new or reused id. */
+    std::vector<std::string> m_network_rewinder_name;
+
+    /** Protects m_network_rewinder_name. */
+    std::mutex m_network_rewinder_name_mutex;
+
+    /** Client: increased every time m_network_rewinder_name changes, so the
+     *  main thread only copies the names into m_network_rewinder then. */
+    std::atomic<unsigned> m_network_rewinder_name_changes;
+
+    /** Client: value of m_network_rewinder_name_changes when the names were
+     *  last copied into m_network_rewinder. */
+    unsigned m_network_rewinder_name_changes_seen;
+
     /** The queue that stores all rewind infos. */
     RewindQueue m_rewind_queue;
 
@@ -115,6 +156,34 @@ private:
 
     std::vector<RewindInfoEventFunction*> m_pending_rief;
 
+    /** Client: ticks of the latest state received which was not rewound to
+     *  yet, or -1. At most one rewind is done per frame, so all states
+     *  received in a frame cause only one rewind. Rewinding to the latest
+     *  of them is enough, since a state restores all rewinders. */
+    int m_pending_rewind_ticks;
+
+    /** Client: if a re-simulation could not be finished in a frame (see
+     *  UserConfigParams::m_max_rewind_ticks_per_frame), the number of ticks
+     *  the world is behind. They are re-simulated in the next frames. */
+    int m_resimulation_backlog;
+
+    /** If a rewind was done in the current frame. */
+    bool m_rewound_this_frame;
+
+    /** Ticks re-simulated in the current frame. */
+    int m_frame_resimulated_ticks;
+
+    /** Rewinds and re-simulated ticks in the current second, and in the
+     *  last full second. */
+    unsigned int m_second_rewinds, m_second_resimulated_ticks;
+    unsigned int m_rewinds_per_second, m_resimulated_ticks_per_second;
+
+    /** Start of the current second in ms. */
+    uint64_t m_second_start;
+
+    /** Rewinds and re-simulated ticks since the last reset. */
+    unsigned int m_total_rewinds, m_total_resimulated_ticks;
+
     RewindManager();
    ~RewindManager();
     // ------------------------------------------------------------------------
@@ -132,6 +201,10 @@ private:
     }
     // ------------------------------------------------------------------------
     void mergeRewindInfoEventFunction();
+    // ------------------------------------------------------------------------
+    void resimulate(int now_ticks, bool fast_forward);
+    // ------------------------------------------------------------------------
+    void continueResimulation(bool fast_forward);
 
 public:
     // First static functions to manage rewinding.
@@ -157,13 +230,18 @@ public:
     // Non-static function declarations:
 
     void reset();
+    void newFrame();
     void update(int ticks);
     void rewindTo(int target_ticks, int ticks_now, bool fast_forward);
     void playEventsTill(int world_ticks, bool fast_forward);
     void addEvent(EventRewinder *event_rewinder, BareNetworkString *buffer,
                   bool confirmed, int ticks = -1);
+    void addEvent(EventRewinder *event_rewinder, const uint8_t *data,
+                  unsigned size, bool confirmed, int ticks = -1);
     void addNetworkEvent(EventRewinder *event_rewinder,
                          BareNetworkString *buffer, int ticks);
+    void addNetworkEvent(EventRewinder *event_rewinder, const uint8_t *data,
+                         unsigned size, int ticks);
     void addNetworkState(BareNetworkString *buffer, int ticks);
     void saveState();
     // ------------------------------------------------------------------------
@@ -178,6 +256,26 @@ public:
         return nullptr;
     }
     // ------------------------------------------------------------------------
+    /** Server: returns the rewinder using rewinder id, or nullptr. */
+    std::shared_ptr<Rewinder> getRewinderByID(uint16_t id) const
+    {
+        return id < m_rewinder_by_id.size() ?
+            m_rewinder_by_id[id].lock() : nullptr;
+    }
+    // ------------------------------------------------------------------------
+    /** Server: returns the serial of the rewinder using rewinder id. */
+    uint32_t getRewinderSerial(uint16_t id) const
+                                            { return m_rewinder_serial[id]; }
+    // ------------------------------------------------------------------------
+    void setNetworkRewinderName(uint16_t id, const std::string& name);
+    // ------------------------------------------------------------------------
+    std::shared_ptr<Rewinder> getNetworkRewinder(uint16_t id);
+    // ------------------------------------------------------------------------
+    /** Client: returns the unique identity of a rewinder id used in the
+     *  states of server, valid after getNetworkRewinder was called. */
+    const std::string& getNetworkRewinderName(uint16_t id) const
+                                      { return m_network_rewinder[id].first; }
+    // ------------------------------------------------------------------------
     bool addRewinder(std::shared_ptr<Rewinder> rewinder);
     // ------------------------------------------------------------------------
     /** Returns true if currently a rewind is happening. */
@@ -189,6 +287,25 @@ public:
         return m_not_rewound_ticks.load(std::memory_order_relaxed);
     }   // getNotRewoundWorldTicks
     // ------------------------------------------------------------------------
+    /** Returns the number of rewinds in the last second. */
+    unsigned int getRewindsPerSecond() const  { return m_rewinds_per_second; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of ticks re-simulated in the last second. */
+    unsigned int getResimulatedTicksPerSecond() const
+                                      { return m_resimulated_ticks_per_second; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of rewinds since the start of the race. */
+    unsigned int getTotalRewinds() const           { return m_total_rewinds; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of ticks re-simulated since the start of the
+     *  race. */
+    unsigned int getTotalResimulatedTicks() const
+                                           { return m_total_resimulated_ticks; }
+    // ------------------------------------------------------------------------
+    /** Returns how many ticks the world is behind because a re-simulation
+     *  is spread over several frames. */
+    int getResimulationBacklog() const       { return m_resimulation_backlog; }
+    // ------------------------------------------------------------------------
     /** Returns the time of the latest confirmed state. */
     int getLatestConfirmedState() const
     {
@@ -209,6 +326,13 @@ public:
         return ticks != 0 && a >= 0 && a % m_state_frequency == 0;
     }
     // ------------------------------------------------------------------------
+    /** Returns the slot of the local state ring for the state at ticks. */
+    unsigned getLocalStateSlot(int ticks) const
+    {
+        return (unsigned)(ticks / m_state_frequency) %
+            (unsigned)m_local_state_ticks.size();
+    }
+    // ------------------------------------------------------------------------
     void resetSmoothNetworkBody();
 };   // RewindManager
 
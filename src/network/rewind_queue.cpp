@@ -74,9 +74,8 @@ void RewindQueue::reset()
     m_network_events.getData().clear();
     m_network_events.unlock();
 
-    AllRewindInfo::const_iterator i;
-    for (i = m_all_rewind_info.begin(); i != m_all_rewind_info.end(); ++i)
-        delete *i;
+    for (unsigned i = 0; i < m_all_rewind_info.size(); i++)
+        delete m_all_rewind_info[i];
 
     m_all_rewind_info.clear();
     m_current = m_all_rewind_info.end();
@@ -94,25 +93,66 @@ void RewindQueue::reset()
  */
 void RewindQueue::insertRewindInfo(RewindInfo *ri)
 {
-    AllRewindInfo::iterator i = m_all_rewind_info.end();
+    unsigned i = m_all_rewind_info.size();
 
-    while (i != m_all_rewind_info.begin())
+    while (i > 0)
     {
-        AllRewindInfo::iterator i_prev = i;
-        i_prev--;
+        RewindInfo* prev = m_all_rewind_info[i - 1];
         // Now test if 'ri' needs to be inserted after the
         // previous element, i.e. before the current element:
-        if ((*i_prev)->getTicks() < ri->getTicks()) break;
-        if ((*i_prev)->getTicks() == ri->getTicks() &&
-            ri->isEvent()                              ) break;
-        i = i_prev;
+        if (prev->getTicks() < ri->getTicks()) break;
+        if (prev->getTicks() == ri->getTicks() && ri->isEvent()) break;
+        i--;
     }
-    if(m_current == m_all_rewind_info.end())
-        m_current = m_all_rewind_info.insert(i, ri);
-    else
-        m_all_rewind_info.insert(i, ri);  
+    const unsigned current = m_current.getPosition();
+    const bool current_at_end = current == m_all_rewind_info.size();
+    m_all_rewind_info.insert(i, ri);
+    if (current_at_end)
+        m_current = AllRewindInfo::iterator(&m_all_rewind_info, i);
+    else if (i <= current)
+        m_current++;    // Keep pointing to the same rewind info
 }   // insertRewindInfo
 
+// ----------------------------------------------------------------------------
+/** Inserts a rewind info at the specified position in the queue, the ring
+ *  is enlarged if it is full. The elements on the shorter side of the
+ *  position are moved.
+ */
+void RewindQueue::AllRewindInfo::insert(unsigned position, RewindInfo* ri)
+{
+    assert(position <= m_size);
+    if (m_size == m_ring.size())
+        grow();
+
+    const unsigned mask = (unsigned)m_ring.size() - 1;
+    if (position >= m_size / 2)
+    {
+        for (unsigned i = m_size; i > position; i--)
+            at(i) = at(i - 1);
+    }
+    else
+    {
+        m_first = (m_first + mask) & mask;
+        for (unsigned i = 0; i < position; i++)
+            at(i) = at(i + 1);
+    }
+    m_size++;
+    at(position) = ri;
+}   // insert
+
+// ----------------------------------------------------------------------------
+/** Doubles the size of the ring, and moves the rewind infos to the start of
+ *  the new ring.
+ */
+void RewindQueue::AllRewindInfo::grow()
+{
+    std::vector<RewindInfo*> ring(m_ring.empty() ? 256 : m_ring.size() * 2);
+    for (unsigned i = 0; i < m_size; i++)
+        ring[i] = at(i);
+    std::swap(m_ring, ring);
+    m_first = 0;
+}   // grow
+
 // ----------------------------------------------------------------------------
 /** Adds an event to the rewind data. The data to be stored must be allocated
  *  and not freed by the caller!
@@ -128,6 +168,22 @@ void RewindQueue::addLocalEvent(EventRewinder *event_rewinder,
     insertRewindInfo(ri);
 }   // addLocalEvent
 
+// ----------------------------------------------------------------------------
+/** Adds an event with a small payload, which is copied into the event.
+ *  \param data The event data.
+ *  \param size Size of the event data, at most
+ *         RewindInfoEvent::MAX_DATA_SIZE bytes.
+ *  \param ticks Time at which the event happened.
+ */
+void RewindQueue::addLocalEvent(EventRewinder *event_rewinder,
+                                const uint8_t *data, unsigned size,
+                                bool confirmed, int ticks)
+{
+    RewindInfo *ri = new RewindInfoEvent(ticks, event_rewinder, data, size,
+                                         confirmed);
+    insertRewindInfo(ri);
+}   // addLocalEvent
+
 // ----------------------------------------------------------------------------
 /** Adds a state from the local simulation to the last created TimeStepInfo
  *  container with the current world time. It is not thread-safe, so needs
@@ -170,6 +226,26 @@ void RewindQueue::addNetworkEvent(EventRewinder *event_rewinder,
     m_network_events.unlock();
 }   // addNetworkEvent
 
+// ----------------------------------------------------------------------------
+/** Adds an event with a small payload to the list of network rewind data,
+ *  the payload is copied into the event. This function is threadsafe.
+ *  \param data The event data.
+ *  \param size Size of the event data, at most
+ *         RewindInfoEvent::MAX_DATA_SIZE bytes.
+ *  \param ticks Time at which the event happened.
+ */
+void RewindQueue::addNetworkEvent(EventRewinder *event_rewinder,
+                                  const uint8_t *data, unsigned size,
+                                  int ticks)
+{
+    RewindInfo *ri = new RewindInfoEvent(ticks, event_rewinder, data, size,
+                                         /*confirmed*/true);
+
+    m_network_events.lock();
+    m_network_events.getData().push_back(ri);
+    m_network_events.unlock();
+}   // addNetworkEvent
+
 // ----------------------------------------------------------------------------
 /** Adds a state to the list of network rewind data. This function is
  *  threadsafe so can be called by the network thread. The data is synched
@@ -327,25 +403,22 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
  */
 void RewindQueue::cleanupOldRewindInfo(int ticks)
 {
-    auto i = m_all_rewind_info.begin();
-
     while (!m_all_rewind_info.empty() &&
-        (*i)->getTicks() < ticks)
+        m_all_rewind_info.front()->getTicks() < ticks)
     {
-        if (m_current == i) next();
-        delete *i;
-        i = m_all_rewind_info.erase(i);
+        // If current is the first element it points to the next one
+        // afterwards, which is then the first
+        if (m_current != m_all_rewind_info.begin())
+            m_current--;
+        delete m_all_rewind_info.front();
+        m_all_rewind_info.pop_front();
     }
-
-    if (m_all_rewind_info.empty())
-        m_current = m_all_rewind_info.end();
-
 }   // cleanupOldRewindInfo
 
 // ----------------------------------------------------------------------------
 bool RewindQueue::isEmpty() const
 {
-    return m_current == m_all_rewind_info.end();
+    return m_current.getPosition() == m_all_rewind_info.size();
 }   // isEmpty
 
 // ----------------------------------------------------------------------------
@@ -353,7 +426,7 @@ bool RewindQueue::isEmpty() const
  */
 bool RewindQueue::hasMoreRewindInfo() const
 {
-    return m_current != m_all_rewind_info.end();
+    return m_current.getPosition() < m_all_rewind_info.size();
 }   // hasMoreRewindInfo
 
 // ----------------------------------------------------------------------------
@@ -383,6 +456,7 @@ int RewindQueue::undoUntil(int undo_ticks)
                        "At %d rewinding to %d current = %d = begin",
                        World::getWorld()->getTicksSinceStart(), undo_ticks, 
                        (*m_current)->getTicks());
+            break;
         }
         m_current--;
     }
@@ -520,5 +594,39 @@ void RewindQueue::unitTesting()
     b2.mergeNetworkData(4, &needs_rewind, &rewind_ticks);
     assert((*b2.m_current)->getTicks() == 3);
 
+    // 4) The ring buffer keeps the infos sorted when it wraps around and
+    //    grows, and current keeps pointing to the same info when an info
+    //    is inserted before it.
+    RewindQueue b3;
+    for (int ticks = 0; ticks < 200; ticks++)
+        b3.addLocalEvent(NULL, NULL, true, ticks);
+    b3.cleanupOldRewindInfo(150);
+    for (int ticks = 200; ticks < 700; ticks++)
+        b3.addLocalEvent(NULL, NULL, true, ticks);
+    assert(b3.m_all_rewind_info.size() == 550);
+    while ((*b3.m_current)->getTicks() < 400)
+        b3.next();
+    RewindInfo* current = b3.getCurrent();
+    b3.addLocalEvent(NULL, NULL, true, 160);
+    b3.addLocalEvent(NULL, NULL, true, 650);
+    assert(b3.getCurrent() == current);
+    (void)current;
+    for (unsigned i = 1; i < b3.m_all_rewind_info.size(); i++)
+    {
+        assert(b3.m_all_rewind_info[i - 1]->getTicks() <=
+               b3.m_all_rewind_info[i]->getTicks());
+    }
+    b3.cleanupOldRewindInfo(500);
+    assert(b3.getCurrent()->getTicks() == 500);
+    assert(b3.m_all_rewind_info.front()->getTicks() == 500);
+
+    // 5) Small event data is stored in the event
+    const uint8_t data[3] = { 1, 2, 3 };
+    RewindInfoEvent rie(0, dummy_rewinder.get(), data, 3, true);
+    BareNetworkString* bns = rie.getBuffer();
+    assert(bns->size() == 3);
+    assert(bns->getUInt8() == 1 && bns->getUInt16() == 0x0203);
+    (void)bns;
+
 
 }   // unitTesting
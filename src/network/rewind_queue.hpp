@@ -22,7 +22,7 @@
 #include "utils/synchronised.hpp"
 
 #include <assert.h>
-#include <list>
+#include <stdint.h>
 #include <vector>
 
 class BareNetworkString;
@@ -37,7 +37,100 @@ class RewindQueue
 {
 private:
 
-    typedef std::list<RewindInfo*> AllRewindInfo;
+    /** All rewind infos sorted by ticks, in a ring buffer: almost all
+     *  infos are added at the end and removed at the front, so no memory
+     *  is allocated once the buffer is large enough. An iterator is the
+     *  position in the queue, so it is only adjusted when an info is
+     *  inserted or removed before it (see insertRewindInfo and
+     *  cleanupOldRewindInfo). */
+    class AllRewindInfo
+    {
+    private:
+        /** The ring, its size is a power of 2. */
+        std::vector<RewindInfo*> m_ring;
+
+        /** Index in m_ring of the first rewind info. */
+        unsigned m_first;
+
+        /** Number of rewind infos in the ring. */
+        unsigned m_size;
+
+        // --------------------------------------------------------------------
+        RewindInfo*& at(unsigned i)
+        {
+            return m_ring[(m_first + i) & ((unsigned)m_ring.size() - 1)];
+        }   // at
+        // --------------------------------------------------------------------
+        void grow();
+
+    public:
+        class iterator
+        {
+        private:
+            AllRewindInfo* m_all;
+            unsigned m_position;
+        public:
+            iterator(AllRewindInfo* all = NULL, unsigned position = 0)
+                : m_all(all), m_position(position)                        {}
+            // ----------------------------------------------------------------
+            RewindInfo* operator*() const    { return m_all->at(m_position); }
+            // ----------------------------------------------------------------
+            iterator& operator++()           { m_position++; return *this; }
+            // ----------------------------------------------------------------
+            iterator& operator--()           { m_position--; return *this; }
+            // ----------------------------------------------------------------
+            iterator operator++(int)
+            {
+                iterator i = *this;
+                m_position++;
+                return i;
+            }   // operator++
+            // ----------------------------------------------------------------
+            iterator operator--(int)
+            {
+                iterator i = *this;
+                m_position--;
+                return i;
+            }   // operator--
+            // ----------------------------------------------------------------
+            bool operator==(const iterator& i) const
+                                       { return m_position == i.m_position; }
+            // ----------------------------------------------------------------
+            bool operator!=(const iterator& i) const
+                                       { return m_position != i.m_position; }
+            // ----------------------------------------------------------------
+            /** Returns the position in the queue. */
+            unsigned getPosition() const                { return m_position; }
+        };   // iterator
+
+        // --------------------------------------------------------------------
+        AllRewindInfo() : m_first(0), m_size(0)                           {}
+        // --------------------------------------------------------------------
+        void insert(unsigned position, RewindInfo* ri);
+        // --------------------------------------------------------------------
+        /** Removes the first rewind info, it must be freed by the caller. */
+        void pop_front()
+        {
+            assert(m_size > 0);
+            m_first = (m_first + 1) & ((unsigned)m_ring.size() - 1);
+            m_size--;
+        }   // pop_front
+        // --------------------------------------------------------------------
+        /** Removes all rewind infos, they must be freed by the caller. */
+        void clear()                              { m_first = m_size = 0; }
+        // --------------------------------------------------------------------
+        RewindInfo* operator[](unsigned i)                { return at(i); }
+        // --------------------------------------------------------------------
+        RewindInfo* front()                               { return at(0); }
+        // --------------------------------------------------------------------
+        unsigned size() const                              { return m_size; }
+        // --------------------------------------------------------------------
+        bool empty() const                            { return m_size == 0; }
+        // --------------------------------------------------------------------
+        iterator begin()                          { return iterator(this, 0); }
+        // --------------------------------------------------------------------
+        iterator end()                       { return iterator(this, m_size); }
+    };   // AllRewindInfo
 
     AllRewindInfo m_all_rewind_info;
 
@@ -66,9 +159,13 @@ public:
     void reset();
     void addLocalEvent(EventRewinder *event_rewinder, BareNetworkString *buffer,
                        bool confirmed, int ticks);
+    void addLocalEvent(EventRewinder *event_rewinder, const uint8_t *data,
+                       unsigned size, bool confirmed, int ticks);
     void addLocalState(BareNetworkString *buffer, bool confirmed, int ticks);
     void addNetworkEvent(EventRewinder *event_rewinder,
                          BareNetworkString *buffer, int ticks);
+    void addNetworkEvent(EventRewinder *event_rewinder, const uint8_t *data,
+                         unsigned size, int ticks);
     void addNetworkState(BareNetworkString *buffer, int ticks);
     void addNetworkRewindInfo(RewindInfo* ri)
     {
@@ -28,3 +28,37 @@ bool Rewinder::rewinderAdd()
 {
     return RewindManager::get()->addRewinder(shared_from_this());
 }   // rewinderAdd
+
+// ----------------------------------------------------------------------------
+/** Saves the local state in a slot of the ring of snapshots.
+ *  \param ticks The ticks of the state.
+ *  \param slot The slot for these ticks.
+ *  \param num_slots Number of slots of the ring.
+ */
+void Rewinder::saveLocalState(int ticks, unsigned slot, unsigned num_slots)
+{
+    const size_t size = getLocalStateSize();
+    if (size == 0)
+        return;
+    if (m_local_state_ticks.size() != num_slots)
+    {
+        m_local_states.resize(size * num_slots);
+        m_local_state_ticks.assign(num_slots, -1);
+    }
+    assert(slot < num_slots);
+    m_local_state_ticks[slot] =
+        writeLocalState(&m_local_states[slot * size]) ? ticks : -1;
+}   // saveLocalState
+
+// ----------------------------------------------------------------------------
+/** Restores the local state saved at the specified ticks.
+ *  \return False if no local state was saved at these ticks.
+ */
+bool Rewinder::restoreLocalState(int ticks, unsigned slot)
+{
+    if (slot >= m_local_state_ticks.size() ||
+        m_local_state_ticks[slot] != ticks)
+        return false;
+    readLocalState(&m_local_states[slot * getLocalStateSize()]);
+    return true;
+}   // restoreLocalState
@@ -20,7 +20,8 @@
 #define HEADER_REWINDER_HPP
 
 #include <cassert>
-#include <functional>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <memory>
 #include <vector>
@@ -56,8 +57,24 @@ private:
     */
     std::string m_unique_identity;
 
+    /** Id of this rewinder used in the states sent by server, assigned by
+     *  RewindManager::addRewinder. */
+    uint16_t m_rewinder_id;
+
+    /** Client: ring of local state snapshots of getLocalStateSize() bytes,
+     *  one slot for each state tick in the rewind window of the
+     *  RewindManager. Allocated once when the first state is saved. */
+    std::vector<uint8_t> m_local_states;
+
+    /** The ticks of the snapshot in each slot of m_local_states, or -1. */
+    std::vector<int> m_local_state_ticks;
+
 public:
-    Rewinder(const std::string& ui = "")             { m_unique_identity = ui; }
+    Rewinder(const std::string& ui = "")
+    {
+        m_unique_identity = ui;
+        m_rewinder_id = 0;
+    }
 
     virtual ~Rewinder() {}
 
@@ -72,10 +89,10 @@ public:
 
     /** Provides a copy of the state of the object in one memory buffer.
      *  The memory is managed by the RewindManager.
-     *  \param[out] ru The unique identity of rewinder writing to.
+     *  \param[out] ru The rewinder id of rewinder writing to.
      *  \return The address of the memory buffer with the state.
      */
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru) = 0;
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru) = 0;
 
     /** Called when an event needs to be undone. This is called while going
      *  backwards for rewinding - all stored events will get an 'undo' call.
@@ -103,8 +120,21 @@ public:
     /** Nothing to do here. */
     virtual void reset() {}
     // -------------------------------------------------------------------------
-    virtual std::function<void()> getLocalStateRestoreFunction()
-                                                             { return nullptr; }
+    /** Returns the size of the local state snapshot of this rewinder, i.e.
+     *  the client state which is not sent by server but must be restored
+     *  on a rewind. 0 if there is no local state. */
+    virtual size_t getLocalStateSize() const                     { return 0; }
+    // -------------------------------------------------------------------------
+    /** Writes the local state as plain data of getLocalStateSize() bytes.
+     *  \return False if there is no local state to restore now. */
+    virtual bool writeLocalState(uint8_t* snapshot) const    { return false; }
+    // -------------------------------------------------------------------------
+    /** Restores the local state written by writeLocalState. */
+    virtual void readLocalState(const uint8_t* snapshot)                    {}
+    // -------------------------------------------------------------------------
+    void saveLocalState(int ticks, unsigned slot, unsigned num_slots);
+    // -------------------------------------------------------------------------
+    bool restoreLocalState(int ticks, unsigned slot);
     // -------------------------------------------------------------------------
     const std::string& getUniqueIdentity() const
     {
@@ -112,6 +142,10 @@ public:
         return m_unique_identity;
     }
     // -------------------------------------------------------------------------
+    void setRewinderID(uint16_t id)                     { m_rewinder_id = id; }
+    // -------------------------------------------------------------------------
+    uint16_t getRewinderID() const                    { return m_rewinder_id; }
+    // -------------------------------------------------------------------------
     bool rewinderAdd();
     // -------------------------------------------------------------------------
     template<typename T> std::shared_ptr<T> getShared()
@@ -196,6 +196,17 @@ namespace ServerConfig
         "this value (read in seconds), it will be ignore, negative value to "
         "disable."));
 
+    SERVER_CFG_PREFIX FloatServerConfigParam m_command_rate_limit
+        SERVER_CFG_DEFAULT(FloatServerConfigParam(0.0f, "command-rate-limit",
+        "Number of server commands (like /spectate) per second each player "
+        "can send on average, faster commands are ignored. Use 0 to disable."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_command_burst_limit
+        SERVER_CFG_DEFAULT(IntServerConfigParam(0, "command-burst-limit",
+        "Number of server commands a player can send at once before "
+        "command-rate-limit applies (at least 1 if command-rate-limit is "
+        "enabled)."));
+
     SERVER_CFG_PREFIX BoolServerConfigParam m_track_voting
         SERVER_CFG_DEFAULT(BoolServerConfigParam(true, "track-voting",
         "Allow players to vote for which track to play. If this value is set "
@@ -435,6 +446,13 @@ namespace ServerConfig
         "more rewind, which clients with slow device may have problem playing "
         "this server, use the default value is recommended."));
 
+    SERVER_CFG_PREFIX BoolServerConfigParam m_delta_state
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(true,
+        "delta-state",
+        "Send states as difference to the last state acknowledged by each "
+        "client (if supported by the client), which saves upload bandwidth "
+        "at the cost of encoding states for each client."));
+
     SERVER_CFG_PREFIX BoolServerConfigParam m_sql_management
         SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
         "sql-management",
@@ -692,6 +710,20 @@ namespace ServerConfig
         "If true, the server owner can kick players, either via "
         "the UI button or using /kick command."));
 
+    SERVER_CFG_PREFIX BoolServerConfigParam m_record_matches
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(false, "record-matches",
+        "If true, the server saves a log of the setup and controller actions "
+        "of each game in the replay directory, which can be re-simulated "
+        "with --replay-match=file --no-graphics."));
+
+    SERVER_CFG_PREFIX StringServerConfigParam m_physics_broadphase
+        SERVER_CFG_DEFAULT(StringServerConfigParam("", "physics-broadphase",
+        "Broadphase of the physics when re-simulating a match log with "
+        "--replay-match: axis-sweep or dbvt (which is faster on huge tracks "
+        "and with many moveable objects), empty to use the one of "
+        "stk_config.xml. Games with clients always use the one of "
+        "stk_config.xml, so the server and clients simulate the same."));
+
     // ========================================================================
     /** Server version, will be advanced if there are protocol changes. */
     static const uint32_t m_server_version = 6;
@@ -0,0 +1,280 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/state_delta.hpp"
+
+#include "network/network_string.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace StateDelta
+{
+// ----------------------------------------------------------------------------
+/** Writes the data of a rewinder to out, as difference to baseline if that
+ *  is smaller than the full data.
+ *  \param baseline Data of the same rewinder in the acknowledged state, or
+ *         NULL if the receiver doesn't have it.
+ *  \param data Current data of the rewinder.
+ *  \param out Network string to write to.
+ */
+void encode(const std::vector<uint8_t>* baseline,
+            const std::vector<uint8_t>& data, BareNetworkString* out)
+{
+    if (baseline && *baseline == data)
+    {
+        out->addUInt8(DM_SAME);
+        return;
+    }
+
+    if (baseline && baseline->size() == data.size())
+    {
+        // Pairs of (count of unchanged bytes, count of changed bytes)
+        // followed by the xor-ed changed bytes
+        BareNetworkString rle(data.size());
+        const size_t size = data.size();
+        size_t i = 0;
+        while (i < size)
+        {
+            uint8_t same = 0;
+            while (i < size && same < 255 && (*baseline)[i] == data[i])
+            {
+                same++;
+                i++;
+            }
+            size_t start = i;
+            uint8_t changed = 0;
+            while (i < size && changed < 255)
+            {
+                // Keep a single unchanged byte inside the changed run, it's
+                // cheaper than starting a new pair
+                if ((*baseline)[i] == data[i] &&
+                    (i + 1 >= size || (*baseline)[i + 1] == data[i + 1]))
+                    break;
+                changed++;
+                i++;
+            }
+            rle.addUInt8(same).addUInt8(changed);
+            for (size_t j = start; j < start + changed; j++)
+                rle.addUInt8((*baseline)[j] ^ data[j]);
+        }
+        if (rle.getTotalSize() < data.size() + 2)
+        {
+            out->addUInt8(DM_XOR);
+            (*out) += rle;
+            return;
+        }
+    }
+
+    out->addUInt8(DM_FULL).addUInt16((uint16_t)data.size());
+    out->getBuffer().insert(out->getBuffer().end(), data.begin(), data.end());
+}   // encode
+
+// ----------------------------------------------------------------------------
+/** Reads the data of a rewinder written by encode.
+ *  \param baseline Data of the same rewinder in the baseline state, or NULL
+ *         if not available.
+ *  \param in Network string to read from.
+ *  \param data Restored data of the rewinder.
+ */
+void decode(const std::vector<uint8_t>* baseline, BareNetworkString& in,
+            std::vector<uint8_t>* data)
+{
+    uint8_t mode = in.getUInt8();
+    if (mode == DM_FULL)
+    {
+        uint16_t size = in.getUInt16();
+        if (size > in.size())
+            throw std::out_of_range("Delta state full data out of range.");
+        const uint8_t* start = (const uint8_t*)in.getCurrentData();
+        data->assign(start, start + size);
+        in.skip(size);
+        return;
+    }
+    if (!baseline)
+        throw std::runtime_error("Missing baseline for delta state.");
+
+    *data = *baseline;
+    if (mode == DM_SAME)
+        return;
+    if (mode != DM_XOR)
+        throw std::runtime_error("Unknown delta state mode.");
+
+    size_t i = 0;
+    while (i < data->size())
+    {
+        i += in.getUInt8();
+        uint8_t changed = in.getUInt8();
+        if (i + changed > data->size())
+            throw std::out_of_range("Delta state xor data out of range.");
+        for (unsigned j = 0; j < changed; j++)
+            (*data)[i++] ^= in.getUInt8();
+    }
+}   // decode
+
+// ----------------------------------------------------------------------------
+/** Reads the rewinders and their data of a delta state (everything after
+ *  the ticks and baseline ticks) into snapshot, and builds its index. The
+ *  unique identity is only read for ids with the highest bit set, which
+ *  are new or reused since the baseline and so sent without baseline.
+ *  \param baseline The acknowledged state the delta state is based on, or
+ *         NULL if it was sent without baseline.
+ *  \param in Network string to read from.
+ *  \param snapshot Set to the decoded state, except the ticks.
+ */
+void decodeSnapshot(const Snapshot* baseline, BareNetworkString& in,
+                    Snapshot* snapshot)
+{
+    unsigned rewinder_size = in.getUInt16();
+    snapshot->m_rewinder_ids.resize(rewinder_size);
+    snapshot->m_new_rewinders.clear();
+    // Index in baseline of each rewinder, -1 if it's new
+    std::vector<int> baseline_index(rewinder_size, -1);
+    for (unsigned i = 0; i < rewinder_size; i++)
+    {
+        uint16_t id = in.getUInt16();
+        if ((id & 0x8000) != 0)
+        {
+            id &= 0x7fff;
+            snapshot->m_new_rewinders.emplace_back(id, std::string());
+            in.decodeString(&snapshot->m_new_rewinders.back().second);
+        }
+        else
+        {
+            baseline_index[i] = baseline ? baseline->find(id) : -1;
+            if (baseline_index[i] == -1)
+                throw std::runtime_error("Unknown rewinder id.");
+        }
+        snapshot->m_rewinder_ids[i] = id;
+    }
+
+    snapshot->m_data.resize(rewinder_size);
+    for (unsigned i = 0; i < rewinder_size; i++)
+    {
+        decode(baseline_index[i] == -1 ? NULL :
+            &baseline->m_data[baseline_index[i]], in, &snapshot->m_data[i]);
+    }
+    snapshot->buildIndex();
+}   // decodeSnapshot
+
+// ----------------------------------------------------------------------------
+void unitTesting()
+{
+    std::vector<uint8_t> base, data, result;
+    for (unsigned i = 0; i < 600; i++)
+        base.push_back((uint8_t)(i * 7));
+
+    // Same data
+    BareNetworkString same;
+    encode(&base, base, &same);
+    assert(same.getTotalSize() == 1);
+    decode(&base, same, &result);
+    assert(result == base);
+
+    // Few bytes changed, including a run longer than 255 unchanged bytes
+    data = base;
+    data[0] ^= 1;
+    data[2] ^= 2;
+    data[400] ^= 3;
+    data[599] ^= 4;
+    BareNetworkString x;
+    encode(&base, data, &x);
+    uint8_t mode = x.getUInt8();
+    assert(mode == DM_XOR);
+    x.reset();
+    assert(x.getTotalSize() < 20);
+    decode(&base, x, &result);
+    assert(result == data);
+    assert(x.size() == 0);
+
+    // Everything changed or different size, full data is used
+    for (uint8_t& d : data)
+        d++;
+    BareNetworkString full;
+    encode(&base, data, &full);
+    mode = full.getUInt8();
+    assert(mode == DM_FULL);
+    (void)mode;
+    full.reset();
+    decode(&base, full, &result);
+    assert(result == data);
+
+    data.push_back(1);
+    BareNetworkString full_no_base;
+    encode(NULL, data, &full_no_base);
+    decode(NULL, full_no_base, &result);
+    assert(result == data);
+
+    // Missing baseline must be detected
+    bool thrown = false;
+    try
+    {
+        same.reset();
+        decode(NULL, same, &result);
+    }
+    catch (std::exception&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // Snapshots: the unique identity is only sent for new or reused ids
+    Snapshot first;
+    BareNetworkString s1;
+    s1.addUInt16(2).addUInt16(0x8000 | 3).encodeString(std::string("a"))
+        .addUInt16(0x8000 | 5).encodeString(std::string("b"));
+    encode(NULL, base, &s1);
+    encode(NULL, data, &s1);
+    decodeSnapshot(NULL, s1, &first);
+    assert(first.m_new_rewinders.size() == 2);
+    assert(first.m_new_rewinders[1].first == 5);
+    assert(first.m_new_rewinders[1].second == "b");
+    assert(first.find(5) == 1 && first.find(4) == -1);
+    assert(first.m_data[0] == base && first.m_data[1] == data);
+
+    // Id 3 is unchanged, id 5 is reused for a new rewinder
+    Snapshot second;
+    BareNetworkString s2;
+    s2.addUInt16(2).addUInt16(3)
+        .addUInt16(0x8000 | 5).encodeString(std::string("c"));
+    encode(&first.m_data[0], base, &s2);
+    encode(NULL, base, &s2);
+    decodeSnapshot(&first, s2, &second);
+    assert(second.m_new_rewinders.size() == 1);
+    assert(second.m_new_rewinders[0].first == 5);
+    assert(second.m_new_rewinders[0].second == "c");
+    assert(second.m_data[0] == base && second.m_data[1] == base);
+
+    // Ids without unique identity must be in the baseline
+    thrown = false;
+    try
+    {
+        Snapshot third;
+        BareNetworkString s3;
+        s3.addUInt16(1).addUInt16(4);
+        decodeSnapshot(&first, s3, &third);
+    }
+    catch (std::exception&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    (void)thrown;
+}   // unitTesting
+
+}   // namespace StateDelta
@@ -0,0 +1,96 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_STATE_DELTA_HPP
+#define HEADER_STATE_DELTA_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class BareNetworkString;
+
+/** Helper functions to encode the state of a rewinder as difference to the
+ *  same rewinder in an older (baseline) state, which the receiver has
+ *  already acknowledged. */
+namespace StateDelta
+{
+    /** How the data of one rewinder is stored in a delta state. */
+    enum DeltaMode : uint8_t
+    {
+        DM_FULL = 0, //!< Full data, 16bit size followed by the data.
+        DM_SAME = 1, //!< Identical to the baseline, no data follows.
+        DM_XOR  = 2, //!< Run length encoded xor against baseline.
+    };
+
+    /** One full state, split into the data written by each rewinder. */
+    struct Snapshot
+    {
+        int m_ticks;
+        std::vector<uint16_t> m_rewinder_ids;
+        /** Server: serial of each rewinder (see
+         *  RewindManager::getRewinderSerial), which tells if a baseline has
+         *  the same rewinder under an id. */
+        std::vector<uint32_t> m_rewinder_serials;
+        /** Client: rewinder ids sent with their unique identity in this
+         *  state, i.e. ids new or reused since the baseline. */
+        std::vector<std::pair<uint16_t, std::string> > m_new_rewinders;
+        std::vector<std::vector<uint8_t> > m_data;
+        /** Index in above vectors for each rewinder id, -1 if not used. */
+        std::vector<int> m_index;
+        // --------------------------------------------------------------------
+        void buildIndex()
+        {
+            m_index.clear();
+            for (unsigned i = 0; i < m_rewinder_ids.size(); i++)
+            {
+                if (m_rewinder_ids[i] >= m_index.size())
+                    m_index.resize(m_rewinder_ids[i] + 1, -1);
+                m_index[m_rewinder_ids[i]] = i;
+            }
+        }   // buildIndex
+        // --------------------------------------------------------------------
+        /** Returns the index of rewinder id in this snapshot (buildIndex must
+         *  be called first), or -1 if not found. */
+        int find(uint16_t id) const
+        {
+            return id < m_index.size() ? m_index[id] : -1;
+        }   // find
+        // --------------------------------------------------------------------
+        /** Server: returns the data of the rewinder with the same id and
+         *  serial, or NULL if not found. */
+        const std::vector<uint8_t>* find(uint16_t id, uint32_t serial) const
+        {
+            int i = find(id);
+            if (i == -1 || m_rewinder_serials[i] != serial)
+                return NULL;
+            return &m_data[i];
+        }   // find
+    };   // Snapshot
+
+    void encode(const std::vector<uint8_t>* baseline,
+                const std::vector<uint8_t>& data, BareNetworkString* out);
+    void decode(const std::vector<uint8_t>* baseline,
+                BareNetworkString& in, std::vector<uint8_t>* data);
+    void decodeSnapshot(const Snapshot* baseline, BareNetworkString& in,
+                        Snapshot* snapshot);
+    void unitTesting();
+};   // namespace StateDelta
+
+#endif
@@ -34,12 +34,14 @@
 #include "network/protocol_manager.hpp"
 #include "network/server_config.hpp"
 #include "network/child_loop.hpp"
+#include "network/crypto.hpp"
 #include "network/stk_ipv6.hpp"
 #include "network/stk_peer.hpp"
 #include "utils/log.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
+#include "utils/worker_pool.hpp"
 
 #include <string.h>
 #if defined(WIN32)
@@ -256,7 +258,7 @@ constexpr bool isPingPacket(unsigned char* data, size_t length)
 // ============================================================================
 /** The constructor for a server or client.
  */
-STKHost::STKHost(bool server)
+STKHost::STKHost(bool server) : m_enet_cmd(4096)
 {
     m_public_address.reset(new SocketAddress());
     init();
@@ -285,6 +287,8 @@ STKHost::STKHost(bool server)
         m_network = new Network(peer_count,
             /*channel_limit*/EVENT_CHANNEL_COUNT, /*max_in_bandwidth*/0,
             /*max_out_bandwidth*/ 0, &addr, true/*change_port_if_bound*/);
+        m_encrypt_pool.reset(new WorkerPool("EncryptPool",
+            WorkerPool::getDefaultThreads(3)));
     }
     else
     {
@@ -363,14 +367,15 @@ STKHost::~STKHost()
     stopListening();
 
     // Drop all unsent packets
-    for (auto& p : m_enet_cmd)
+    m_enet_cmd.consume([](std::tuple<ENetPeer*, ENetPacket*, uint32_t,
+        ENetCommandType, ENetAddress>& p)
     {
         if (std::get<3>(p) == ECT_SEND_PACKET)
         {
             ENetPacket* packet = std::get<1>(p);
             enet_packet_destroy(packet);
         }
-    }
+    });
     delete m_network;
     enet_deinitialize();
     if (m_client_loop)
@@ -746,6 +751,7 @@ void STKHost::disconnectAllPeers(bool timeout_waiting)
         m_exit_timeout.store(StkTime::getMonoTimeMs() + 2000);
     }
     m_peers.clear();
+    updatePeersSnapshot();
 }   // disconnectAllPeers
 
 //-----------------------------------------------------------------------------
@@ -909,8 +915,7 @@ void STKHost::mainLoop(ProcessType pt)
                                 player_name.c_str(), ap, max_ping);
                             p.second->setWarnedForHighPing(true);
                             p.second->setDisconnected(true);
-                            std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
-                            m_enet_cmd.emplace_back(p.second->getENetPeer(),
+                            addEnetCommand(p.second->getENetPeer(),
                                 (ENetPacket*)NULL, PDI_KICK_HIGH_PING,
                                 ECT_DISCONNECT, p.first->address);
                         }
@@ -951,6 +956,7 @@ void STKHost::mainLoop(ProcessType pt)
                     g_ping_packet.end());
             }
 
+            bool peers_removed = false;
             for (auto it = m_peers.begin(); it != m_peers.end();)
             {
                 if (!ping_packet.getBuffer().empty() &&
@@ -985,21 +991,20 @@ void STKHost::mainLoop(ProcessType pt)
                     enet_host_flush(host);
                     enet_peer_reset(it->first);
                     it = m_peers.erase(it);
+                    peers_removed = true;
                 }
                 else
                 {
                     it++;
                 }
             }
+            if (peers_removed)
+                updatePeersSnapshot();
             peer_lock.unlock();
         }
 
-        std::vector<std::tuple<ENetPeer*, ENetPacket*, uint32_t,
-            ENetCommandType, ENetAddress> > copied_list;
-        std::unique_lock<std::mutex> lock(m_enet_cmd_mutex);
-        std::swap(copied_list, m_enet_cmd);
-        lock.unlock();
-        for (auto& p : copied_list)
+        m_enet_cmd.consume([this, host](std::tuple<ENetPeer*, ENetPacket*,
+            uint32_t, ENetCommandType, ENetAddress>& p)
         {
             ENetPeer* peer = std::get<0>(p);
             ENetAddress& ea = std::get<4>(p);
@@ -1017,7 +1022,7 @@ void STKHost::mainLoop(ProcessType pt)
             {
                 if (packet != NULL)
                     enet_packet_destroy(packet);
-                continue;
+                return;
             }
 
             switch (std::get<3>(p))
@@ -1043,9 +1048,10 @@ void STKHost::mainLoop(ProcessType pt)
                 // Remove the stk peer of it
                 std::lock_guard<std::mutex> lock(m_peers_mutex);
                 m_peers.erase(peer);
+                updatePeersSnapshot();
                 break;
             }
-        }
+        });
 
         bool need_ping_update = false;
         while (enet_host_service(host, &event, 10) != 0)
@@ -1080,6 +1086,7 @@ void STKHost::mainLoop(ProcessType pt)
                     (event.peer, this, ++m_next_unique_host_id);
                 std::unique_lock<std::mutex> lock(m_peers_mutex);
                 m_peers[event.peer] = stk_peer;
+                updatePeersSnapshot();
                 size_t new_peer_count = m_peers.size();
                 lock.unlock();
                 stk_event = new Event(&event, stk_peer);
@@ -1112,17 +1119,17 @@ void STKHost::mainLoop(ProcessType pt)
                     addr = peer->getAddress().toString();
                     stk_event = new Event(&event, peer);
                     m_peers.erase(event.peer);
+                    updatePeersSnapshot();
                     new_peer_count = m_peers.size();
                 }
                 Log::info("STKHost", "%s has just disconnected. There are "
                     "now %u peers.", addr.c_str(), new_peer_count);
             }   // ENET_EVENT_TYPE_DISCONNECT
 
-            std::unique_lock<std::mutex> lock(m_peers_mutex);
-            if (!stk_event && m_peers.find(event.peer) != m_peers.end())
+            auto peers = getPeersSnapshot();
+            if (!stk_event && peers->find(event.peer) != peers->end())
             {
-                std::shared_ptr<STKPeer> peer = m_peers.at(event.peer);
-                lock.unlock();
+                std::shared_ptr<STKPeer> peer = peers->at(event.peer);
                 if (isPingPacket(event.packet->data, event.packet->dataLength))
                 {
                     if (!is_server)
@@ -1307,8 +1314,8 @@ void STKHost::handleDirectSocketRequest(Network* direct_socket,
  */
 bool STKHost::peerExists(const SocketAddress& peer)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    auto snapshot = getPeersSnapshot();
+    for (auto& p : *snapshot)
     {
         auto stk_peer = p.second;
         if (stk_peer->getAddress() == peer ||
@@ -1327,9 +1334,10 @@ bool STKHost::peerExists(const SocketAddress& peer)
 std::shared_ptr<STKPeer> STKHost::getServerPeerForClient() const
 {
     assert(NetworkConfig::get()->isClient());
-    if (m_peers.size() != 1)
+    auto peers = getPeersSnapshot();
+    if (peers->size() != 1)
         return nullptr;
-    return m_peers.begin()->second;
+    return peers->begin()->second;
 }   // getServerPeerForClient
 
 //-----------------------------------------------------------------------------
@@ -1339,12 +1347,14 @@ std::shared_ptr<STKPeer> STKHost::getServerPeerForClient() const
  */
 void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    std::vector<std::shared_ptr<STKPeer> > peers;
+    auto snapshot = getPeersSnapshot();
+    for (auto& p : *snapshot)
     {
         if (p.second->isValidated())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second);
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersInServer
 
 //-----------------------------------------------------------------------------
@@ -1354,12 +1364,14 @@ void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
  */
 void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    std::vector<std::shared_ptr<STKPeer> > peers;
+    auto snapshot = getPeersSnapshot();
+    for (auto& p : *snapshot)
     {
         if (p.second->isValidated() && !p.second->isWaitingForGame())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second);
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeers
 
 //-----------------------------------------------------------------------------
@@ -1371,16 +1383,18 @@ void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
                                bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    std::vector<std::shared_ptr<STKPeer> > peers;
+    auto snapshot = getPeersSnapshot();
+    for (auto& p : *snapshot)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isSamePeer(peer) && p.second->isValidated() &&
             !p.second->isWaitingForGame())
         {
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(p.second);
         }
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketExcept
 
 //-----------------------------------------------------------------------------
@@ -1392,26 +1406,68 @@ void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
 void STKHost::sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                        NetworkString* data, bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto p : m_peers)
+    std::vector<std::shared_ptr<STKPeer> > peers;
+    auto snapshot = getPeersSnapshot();
+    for (auto& p : *snapshot)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isValidated())
             continue;
         if (predicate(stk_peer))
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(p.second);
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersWith
 
+//-----------------------------------------------------------------------------
+/** Sends the same data to several peers. The encrypted packet of each peer is
+ *  created in parallel if it's worth it, and all packets are then queued for
+ *  the listening thread at once.
+ *  \param peers Peers to send to.
+ *  \param data Data to sent.
+ *  \param reliable If the data should be sent reliable or now.
+ */
+void STKHost::sendPacketToPeers(
+                         const std::vector<std::shared_ptr<STKPeer> >& peers,
+                         NetworkString *data, bool reliable)
+{
+    if (peers.empty())
+        return;
+    std::vector<ENetPacket*> packets(peers.size());
+    std::function<void(unsigned)> create =
+        [&peers, &packets, data, reliable](unsigned i)
+        {
+            packets[i] = peers[i]->createPacket(data, reliable);
+        };
+    // Waking up the pool costs more than encrypting a few small packets
+    if (m_encrypt_pool &&
+        peers.size() * data->getTotalSize() >= 16 * 1024)
+        m_encrypt_pool->parallelFor((unsigned)peers.size(), create);
+    else
+    {
+        for (unsigned i = 0; i < peers.size(); i++)
+            create(i);
+    }
+
+    for (unsigned i = 0; i < peers.size(); i++)
+    {
+        if (packets[i] == NULL)
+            continue;
+        addEnetCommand(peers[i]->getENetPeer(), packets[i],
+            EVENT_CHANNEL_NORMAL, ECT_SEND_PACKET,
+            peers[i]->getENetAddress());
+    }
+}   // sendPacketToPeers
+
 //-----------------------------------------------------------------------------
 /** Sends a message from a client to the server. */
 void STKHost::sendToServer(NetworkString *data, bool reliable)
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    if (m_peers.empty())
+    auto peers = getPeersSnapshot();
+    if (peers->empty())
         return;
     assert(NetworkConfig::get()->isClient());
-    m_peers.begin()->second->sendPacket(data, reliable);
+    peers->begin()->second->sendPacket(data, reliable);
 }   // sendToServer
 
 //-----------------------------------------------------------------------------
@@ -1419,8 +1475,8 @@ std::vector<std::shared_ptr<NetworkPlayerProfile> >
     STKHost::getAllPlayerProfiles() const
 {
     std::vector<std::shared_ptr<NetworkPlayerProfile> > p;
-    std::unique_lock<std::mutex> lock(m_peers_mutex);
-    for (auto& peer : m_peers)
+    auto snapshot = getPeersSnapshot();
+    for (auto& peer : *snapshot)
     {
         if (peer.second->isDisconnected() || !peer.second->isValidated())
             continue;
@@ -1429,7 +1485,6 @@ std::vector<std::shared_ptr<NetworkPlayerProfile> >
         auto peer_profile = peer.second->getPlayerProfiles();
         p.insert(p.end(), peer_profile.begin(), peer_profile.end());
     }
-    lock.unlock();
     return p;
 }   // getAllPlayerProfiles
 
@@ -1437,8 +1492,8 @@ std::vector<std::shared_ptr<NetworkPlayerProfile> >
 std::set<uint32_t> STKHost::getAllPlayerOnlineIds() const
 {
     std::set<uint32_t> online_ids;
-    std::unique_lock<std::mutex> lock(m_peers_mutex);
-    for (auto& peer : m_peers)
+    auto snapshot = getPeersSnapshot();
+    for (auto& peer : *snapshot)
     {
         if (peer.second->isDisconnected() || !peer.second->isValidated())
             continue;
@@ -1448,28 +1503,27 @@ std::set<uint32_t> STKHost::getAllPlayerOnlineIds() const
                 peer.second->getPlayerProfiles()[0]->getOnlineId());
         }
     }
-    lock.unlock();
     return online_ids;
 }   // getAllPlayerOnlineIds
 
 //-----------------------------------------------------------------------------
 std::shared_ptr<STKPeer> STKHost::findPeerByHostId(uint32_t id) const
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    auto ret = std::find_if(m_peers.begin(), m_peers.end(),
+    auto peers = getPeersSnapshot();
+    auto ret = std::find_if(peers->begin(), peers->end(),
         [id](const std::pair<ENetPeer*, std::shared_ptr<STKPeer> >& p)
         {
             return p.second->getHostId() == id;
         });
-    return ret != m_peers.end() ? ret->second : nullptr;
+    return ret != peers->end() ? ret->second : nullptr;
 }   // findPeerByHostId
 
 //-----------------------------------------------------------------------------
 std::shared_ptr<STKPeer>
     STKHost::findPeerByName(const core::stringw& name) const
 {
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    auto ret = std::find_if(m_peers.begin(), m_peers.end(),
+    auto peers = getPeersSnapshot();
+    auto ret = std::find_if(peers->begin(), peers->end(),
         [name](const std::pair<ENetPeer*, std::shared_ptr<STKPeer> >& p)
         {
             bool found = false;
@@ -1483,7 +1537,7 @@ std::shared_ptr<STKPeer>
             }
             return found;
         });
-    return ret != m_peers.end() ? ret->second : nullptr;
+    return ret != peers->end() ? ret->second : nullptr;
 }   // findPeerByName
 
 //-----------------------------------------------------------------------------
@@ -1500,7 +1554,10 @@ void STKHost::initClientNetwork(ENetEvent& event, Network* new_network)
     auto stk_peer = std::make_shared<STKPeer>(event.peer, this,
         m_next_unique_host_id++);
     stk_peer->setValidated(true);
+    std::unique_lock<std::mutex> lock(m_peers_mutex);
     m_peers[event.peer] = stk_peer;
+    updatePeersSnapshot();
+    lock.unlock();
     auto pm = ProtocolManager::lock();
     if (pm && !pm->isExiting())
         pm->propagateEvent(new Event(&event, stk_peer));
@@ -1530,8 +1587,8 @@ std::vector<std::shared_ptr<NetworkPlayerProfile> >
     STKHost::getPlayersForNewGame(bool* has_always_on_spectators) const
 {
     std::vector<std::shared_ptr<NetworkPlayerProfile> > players;
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto& p : m_peers)
+    auto snapshot = getPeersSnapshot();
+    for (auto& p : *snapshot)
     {
         auto& stk_peer = p.second;
         // Handle always spectate for peer
@@ -1564,8 +1621,8 @@ void STKHost::updatePlayers(unsigned* ingame, unsigned* waiting,
     uint32_t ingame_players = 0;
     uint32_t waiting_players = 0;
     uint32_t total_players = 0;
-    std::lock_guard<std::mutex> lock(m_peers_mutex);
-    for (auto& p : m_peers)
+    auto snapshot = getPeersSnapshot();
+    for (auto& p : *snapshot)
     {
         auto& stk_peer = p.second;
         if (!stk_peer->isValidated())
@@ -1632,3 +1689,196 @@ uint16_t STKHost::getPrivatePort() const
 {
     return m_network->getPort();
 }  // getPrivatePort
+
+//-----------------------------------------------------------------------------
+/** Measures the time to create the encrypted packets of a broadcast for
+ *  different numbers of peers, serially and with the encryption pool used in
+ *  sendPacketToPeers.
+ */
+void STKHost::benchmarkSendToPeers()
+{
+    const unsigned repeat = 200;
+    WorkerPool pool("EncryptBench", WorkerPool::getDefaultThreads(3));
+    Log::info("STKHost", "Encryption pool uses %d threads.",
+        pool.getNumThreads());
+    std::vector<uint8_t> key(16), iv(12);
+    std::mt19937 g(0);
+    for (uint8_t& k : key)
+        k = (uint8_t)g();
+    for (uint8_t& i : iv)
+        i = (uint8_t)g();
+
+    for (unsigned size : { 64u, 1024u })
+    {
+        NetworkString data(PROTOCOL_GAME_EVENTS, size);
+        for (unsigned i = 0; i < size; i++)
+            data.addUInt8((uint8_t)g());
+        for (unsigned count : { 8u, 32u, 128u })
+        {
+            std::vector<std::unique_ptr<Crypto> > crypto;
+            for (unsigned i = 0; i < count; i++)
+                crypto.emplace_back(new Crypto(key, iv));
+            std::vector<ENetPacket*> packets(count);
+            std::function<void(unsigned)> create =
+                [&crypto, &packets, &data](unsigned i)
+                {
+                    packets[i] = crypto[i]->encryptSend(data, false);
+                };
+
+            double serial = 0.0, parallel = 0.0;
+            for (unsigned r = 0; r < repeat; r++)
+            {
+                double start = StkTime::getRealTime();
+                for (unsigned i = 0; i < count; i++)
+                    create(i);
+                serial += StkTime::getRealTime() - start;
+                for (ENetPacket* p : packets)
+                    enet_packet_destroy(p);
+
+                start = StkTime::getRealTime();
+                pool.parallelFor(count, create);
+                parallel += StkTime::getRealTime() - start;
+                for (ENetPacket* p : packets)
+                    enet_packet_destroy(p);
+            }
+            Log::info("STKHost", "%d peers, %d bytes: serial %.3fms, "
+                "parallel %.3fms per broadcast.", count, size,
+                serial * 1000.0 / repeat, parallel * 1000.0 / repeat);
+        }
+    }
+}   // benchmarkSendToPeers
+
+//-----------------------------------------------------------------------------
+/** Compares the enet command queue and peer list lookup used before (vector
+ *  and map protected by a mutex) with the lock-free queue and the peer
+ *  snapshot, with several threads using them like the protocol threads.
+ */
+void STKHost::benchmarkContention()
+{
+    typedef std::tuple<ENetPeer*, ENetPacket*, uint32_t, ENetCommandType,
+        ENetAddress> Command;
+    const unsigned producers = 3;
+    const unsigned commands = 200000;
+    ENetAddress ea = {};
+
+    // Old queue: vector swapped by the consumer with a mutex
+    {
+        std::vector<Command> queue;
+        std::mutex queue_mutex;
+        std::atomic<unsigned> received(0);
+        double start = StkTime::getRealTime();
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < producers; t++)
+        {
+            threads.emplace_back([&queue, &queue_mutex, ea]()
+            {
+                for (unsigned i = 0; i < commands; i++)
+                {
+                    std::lock_guard<std::mutex> lock(queue_mutex);
+                    queue.emplace_back((ENetPeer*)NULL, (ENetPacket*)NULL, i,
+                        ECT_SEND_PACKET, ea);
+                }
+            });
+        }
+        while (received.load() < producers * commands)
+        {
+            std::vector<Command> copied;
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            std::swap(copied, queue);
+            lock.unlock();
+            received.fetch_add((unsigned)copied.size());
+        }
+        for (std::thread& t : threads)
+            t.join();
+        Log::info("STKHost", "Mutex command queue: %.3fms for %d commands.",
+            (StkTime::getRealTime() - start) * 1000.0, producers * commands);
+    }
+
+    // New queue
+    {
+        MPSCQueue<Command> queue(4096);
+        unsigned received = 0;
+        double start = StkTime::getRealTime();
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < producers; t++)
+        {
+            threads.emplace_back([&queue, ea]()
+            {
+                for (unsigned i = 0; i < commands; i++)
+                {
+                    queue.push(std::make_tuple((ENetPeer*)NULL,
+                        (ENetPacket*)NULL, i, ECT_SEND_PACKET, ea));
+                }
+            });
+        }
+        while (received < producers * commands)
+            queue.consume([&received](Command& c) { received++; });
+        for (std::thread& t : threads)
+            t.join();
+        Log::info("STKHost", "Lock-free command queue: %.3fms for %d "
+            "commands.", (StkTime::getRealTime() - start) * 1000.0,
+            producers * commands);
+    }
+
+    // Peer lookup with 16 peers, while a writer changes the peer list
+    typedef std::map<ENetPeer*, std::shared_ptr<STKPeer> > PeerMap;
+    const unsigned readers = 3;
+    const unsigned lookups = 100000;
+    PeerMap peers;
+    for (uintptr_t i = 1; i <= 16; i++)
+        peers[(ENetPeer*)i] = nullptr;
+    for (int use_snapshot = 0; use_snapshot < 2; use_snapshot++)
+    {
+        std::mutex peers_mutex;
+        std::shared_ptr<const PeerMap> peers_snapshot =
+            std::make_shared<const PeerMap>(peers);
+        std::atomic<bool> done(false);
+        std::thread writer([&]()
+        {
+            while (!done.load())
+            {
+                std::lock_guard<std::mutex> lock(peers_mutex);
+                peers[(ENetPeer*)100] = nullptr;
+                peers.erase((ENetPeer*)100);
+                if (use_snapshot == 1)
+                {
+                    std::atomic_store(&peers_snapshot,
+                        std::make_shared<const PeerMap>(peers));
+                }
+                StkTime::sleep(1);
+            }
+        });
+        double start = StkTime::getRealTime();
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < readers; t++)
+        {
+            threads.emplace_back([&]()
+            {
+                for (unsigned i = 0; i < lookups; i++)
+                {
+                    std::vector<std::shared_ptr<STKPeer> > copied;
+                    if (use_snapshot == 1)
+                    {
+                        auto snapshot = std::atomic_load(&peers_snapshot);
+                        for (auto& p : *snapshot)
+                            copied.push_back(p.second);
+                    }
+                    else
+                    {
+                        std::lock_guard<std::mutex> lock(peers_mutex);
+                        for (auto& p : peers)
+                            copied.push_back(p.second);
+                    }
+                }
+            });
+        }
+        for (std::thread& t : threads)
+            t.join();
+        double time = StkTime::getRealTime() - start;
+        done.store(true);
+        writer.join();
+        Log::info("STKHost", "%s peer lookup: %.3fms for %d lookups.",
+            use_snapshot == 1 ? "Snapshot" : "Mutex", time * 1000.0,
+            readers * lookups);
+    }
+}   // benchmarkContention
@@ -22,6 +22,7 @@
 #ifndef STK_HOST_HPP
 #define STK_HOST_HPP
 
+#include "utils/mpsc_queue.hpp"
 #include "utils/stk_process.hpp"
 #include "utils/synchronised.hpp"
 #include "utils/time.hpp"
@@ -59,6 +60,7 @@ class ServerLobby;
 class ChildLoop;
 class SocketAddress;
 class STKPeer;
+class WorkerPool;
 
 using namespace irr;
 
@@ -90,17 +92,27 @@ private:
     mutable std::mutex m_peers_mutex;
 
     /** Let (atm enet_peer_send and enet_peer_disconnect) run in the listening
-     *  thread. */
-    std::vector<std::tuple</*peer receive*/ENetPeer*,
+     *  thread, which is the only consumer. */
+    MPSCQueue<std::tuple</*peer receive*/ENetPeer*,
         /*packet to send*/ENetPacket*, /*integer data*/uint32_t,
         ENetCommandType, ENetAddress> > m_enet_cmd;
 
-    /** Protect \ref m_enet_cmd from multiple threads usage. */
-    std::mutex m_enet_cmd_mutex;
+    /** Threads to encrypt packets sent to many peers in parallel (server
+     *  only). */
+    std::unique_ptr<WorkerPool> m_encrypt_pool;
 
-    /** The list of peers connected to this instance. */
+    /** The list of peers connected to this instance, only changed with
+     *  \ref m_peers_mutex locked. */
     std::map<ENetPeer*, std::shared_ptr<STKPeer> > m_peers;
 
+    /** A read only copy of \ref m_peers, replaced (with std::atomic_store)
+     *  after each change of it. Threads only looking up peers use it without
+     *  locking \ref m_peers_mutex, and the old copy is freed when the last
+     *  of them is done with it. */
+    std::shared_ptr<const std::map<ENetPeer*, std::shared_ptr<STKPeer> > >
+        m_peers_snapshot = std::make_shared<
+        const std::map<ENetPeer*, std::shared_ptr<STKPeer> > >();
+
     /** Next unique host id. It is increased whenever a new peer is added (see
      *  getPeer()), but not decreased whena host (=peer) disconnects. This
      *  results in a unique host id for each host, even when a host should
@@ -170,6 +182,14 @@ private:
     // ------------------------------------------------------------------------
     void mainLoop(ProcessType pt);
     // ------------------------------------------------------------------------
+    /** Publishes the changed \ref m_peers, must be called with
+     *  \ref m_peers_mutex locked. */
+    void updatePeersSnapshot()
+    {
+        std::atomic_store(&m_peers_snapshot, std::make_shared<
+            const std::map<ENetPeer*, std::shared_ptr<STKPeer> > >(m_peers));
+    }
+    // ------------------------------------------------------------------------
     void getIPFromStun(int socket, const std::string& stun_address,
                        short family, SocketAddress* result);
 public:
@@ -272,6 +292,9 @@ public:
     void sendPacketExcept(STKPeer* peer, NetworkString *data,
                           bool reliable = true);
     // ------------------------------------------------------------------------
+    void sendPacketToPeers(const std::vector<std::shared_ptr<STKPeer> >& peers,
+                           NetworkString *data, bool reliable = true);
+    // ------------------------------------------------------------------------
     void setupClient(int peer_count, int channel_limit,
                      uint32_t max_incoming_bandwidth,
                      uint32_t max_outgoing_bandwidth);
@@ -289,8 +312,7 @@ public:
     void addEnetCommand(ENetPeer* peer, ENetPacket* packet, uint32_t i,
                         ENetCommandType ect, ENetAddress ea)
     {
-        std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
-        m_enet_cmd.emplace_back(peer, packet, i, ect, ea);
+        m_enet_cmd.push(std::make_tuple(peer, packet, i, ect, ea));
     }
     // ------------------------------------------------------------------------
     /** Returns the last error (or "" if no error has happened). */
@@ -312,15 +334,23 @@ public:
     /** Returns a copied list of peers. */
     std::vector<std::shared_ptr<STKPeer> > getPeers() const
     {
-        std::lock_guard<std::mutex> lock(m_peers_mutex);
         std::vector<std::shared_ptr<STKPeer> > peers;
-        for (auto p : m_peers)
+        auto snapshot = getPeersSnapshot();
+        for (auto& p : *snapshot)
         {
             peers.push_back(p.second);
         }
         return peers;
     }
     // ------------------------------------------------------------------------
+    /** Returns the current read only copy of the peers, which doesn't change
+     *  when peers are added or removed later. */
+    std::shared_ptr<const std::map<ENetPeer*, std::shared_ptr<STKPeer> > >
+        getPeersSnapshot() const
+    {
+        return std::atomic_load(&m_peers_snapshot);
+    }
+    // ------------------------------------------------------------------------
     /** Returns the next (unique) host id. */
     unsigned int getNextHostId() const
     {
@@ -333,8 +363,7 @@ public:
     /** Returns the number of currently connected peers. */
     unsigned int getPeerCount() const
     {
-        std::lock_guard<std::mutex> lock(m_peers_mutex);
-        return (unsigned)m_peers.size();
+        return (unsigned)getPeersSnapshot()->size();
     }
     // ------------------------------------------------------------------------
     /** Sets the global host id of this host (client use). */
@@ -395,6 +424,10 @@ public:
     // ------------------------------------------------------------------------
     static BareNetworkString getStunRequest(uint8_t* stun_tansaction_id);
     // ------------------------------------------------------------------------
+    static void benchmarkSendToPeers();
+    // ------------------------------------------------------------------------
+    static void benchmarkContention();
+    // ------------------------------------------------------------------------
     ChildLoop* getChildLoop() const { return m_client_loop; }
 };   // class STKHost
 
@@ -480,6 +480,51 @@ extern "C" int insideIPv6CIDR(const char* ipv6_cidr, const char* ipv6_in)
     return 1;
 }   // andIPv6
 
+// ----------------------------------------------------------------------------
+/** Converts an IPv6 address to 2 integers (upper 64 bits first), so it can be
+ *  compared as a number.
+ *  \return False if ipv6 is invalid.
+ */
+bool getIPv6Value(const char* ipv6, uint64_t* value)
+{
+    struct in6_addr v6_in;
+    if (stk_inet_pton6(ipv6, &v6_in) != 1)
+        return false;
+    value[0] = value[1] = 0;
+    for (unsigned i = 0; i < 16; i++)
+        value[i / 8] = (value[i / 8] << 8) | v6_in.s6_addr[i];
+    return true;
+}   // getIPv6Value
+
+// ----------------------------------------------------------------------------
+/** Finds the first and last address of a CIDR block (like 2001:db8::/32) in
+ *  the format of getIPv6Value, so insideIPv6CIDR can be done by comparing.
+ *  \return False if ipv6_cidr is invalid.
+ */
+bool getIPv6CIDRRange(const char* ipv6_cidr, uint64_t* first, uint64_t* last)
+{
+    const char* mask_location = strchr(ipv6_cidr, '/');
+    if (mask_location == NULL ||
+        mask_location - ipv6_cidr >= INET6_ADDRSTRLEN)
+        return false;
+
+    char ipv6[INET6_ADDRSTRLEN] = {};
+    memcpy(ipv6, ipv6_cidr, mask_location - ipv6_cidr);
+    int mask_length = atoi(mask_location + 1);
+    if (mask_length > 128 || mask_length <= 0 || !getIPv6Value(ipv6, first))
+        return false;
+
+    for (int i = 0; i < 2; i++)
+    {
+        int bits = mask_length - 64 * i;
+        bits = bits < 0 ? 0 : bits > 64 ? 64 : bits;
+        uint64_t host_mask = bits == 64 ? 0 : (~(uint64_t)0 >> bits);
+        first[i] &= ~host_mask;
+        last[i] = first[i] | host_mask;
+    }
+    return true;
+}   // getIPv6CIDRRange
+
 #ifndef ENABLE_IPV6
 // ----------------------------------------------------------------------------
 extern "C" int isIPv6Socket()
@@ -34,3 +34,5 @@ std::string getIPV6ReadableFromIn6(const struct sockaddr_in6* in);
 bool sameIPV6(const struct sockaddr_in6* in_1,
               const struct sockaddr_in6* in_2);
 bool isIPv4MappedAddress(const struct sockaddr_in6* in6);
+bool getIPv6Value(const char* ipv6, uint64_t* value);
+bool getIPv6CIDRRange(const char* ipv6_cidr, uint64_t* first, uint64_t* last);
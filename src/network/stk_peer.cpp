@@ -19,6 +19,7 @@
 #include "network/stk_peer.hpp"
 #include "config/stk_config.hpp"
 #include "config/user_config.hpp"
+#include "network/asset_ids.hpp"
 #include "network/crypto.hpp"
 #include "network/event.hpp"
 #include "network/network.hpp"
@@ -31,6 +32,7 @@
 #include "utils/string_utils.hpp"
 #include "utils/time.hpp"
 
+#include <algorithm>
 #include <string.h>
 
 /** Constructor for an empty peer.
@@ -55,6 +57,8 @@ STKPeer::STKPeer(ENetPeer *enet_peer, STKHost* host, uint32_t host_id)
     m_last_message.store(0);
     m_angry_host.store(false);
     m_consecutive_messages = 0;
+    m_command_tokens = 0.0f;
+    m_last_command_time = 0;
 }   // STKPeer
 
 //-----------------------------------------------------------------------------
@@ -62,6 +66,54 @@ STKPeer::~STKPeer()
 {
 }   // ~STKPeer
 
+//-----------------------------------------------------------------------------
+/** Rate limits server commands of this peer: it can send burst commands at
+ *  once, then rate commands per second on average.
+ *  \return False if the command should be ignored.
+ */
+bool STKPeer::consumeCommandToken(float rate, int burst)
+{
+    if (rate <= 0.0f)
+        return true;
+    uint64_t now = StkTime::getMonoTimeMs();
+    // The first command (m_last_command_time is 0) fills all tokens
+    // At least one command can always be sent once the tokens refilled
+    burst = std::max(burst, 1);
+    m_command_tokens = std::min((float)burst, m_command_tokens +
+        (float)(now - m_last_command_time) * rate / 1000.0f);
+    m_last_command_time = now;
+    if (m_command_tokens < 1.0f)
+        return false;
+    m_command_tokens -= 1.0f;
+    return true;
+}   // consumeCommandToken
+
+//-----------------------------------------------------------------------------
+/** Moves karts and tracks of this peer which the server didn't have before
+ *  to its bitsets, after the server added them to kart_ids or track_ids. */
+void STKPeer::addKnownAssets(const AssetIds& kart_ids,
+                             const AssetIds& track_ids)
+{
+    auto move_known = [](const AssetIds& ids, DynamicBitset& bits,
+                         std::set<std::string>& unknown)
+        {
+            auto it = unknown.begin();
+            while (it != unknown.end())
+            {
+                int id = ids.find(*it);
+                if (id == -1)
+                {
+                    it++;
+                    continue;
+                }
+                bits.set(id);
+                it = unknown.erase(it);
+            }
+        };
+    move_known(kart_ids, m_available_kts.first, m_unknown_kts.first);
+    move_known(track_ids, m_available_kts.second, m_unknown_kts.second);
+}   // addKnownAssets
+
 //-----------------------------------------------------------------------------
 void STKPeer::disconnect()
 {
@@ -96,15 +148,19 @@ void STKPeer::reset()
 }   // reset
 
 //-----------------------------------------------------------------------------
-/** Sends a packet to this host.
+/** Creates an enet packet (encrypted if needed) with the data to be sent to
+ *  this host. It can be called in parallel for different peers.
  *  \param data The data to send.
  *  \param reliable If the data is sent reliable or not.
  *  \param encrypted If the data is sent encrypted or not.
+ *  \return The packet, or NULL if this peer is disconnected or encryption
+ *          failed.
  */
-void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
+ENetPacket* STKPeer::createPacket(NetworkString *data, bool reliable,
+                                  bool encrypted)
 {
     if (m_disconnected.load())
-        return;
+        return NULL;
 
     ENetPacket* packet = NULL;
     if (m_crypto && encrypted)
@@ -120,14 +176,26 @@ void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
             ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
     }
 
+    if (packet && Network::m_connection_debug)
+    {
+        Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
+            packet->dataLength, getAddress().toString().c_str(),
+            StkTime::getRealTime());
+    }
+    return packet;
+}   // createPacket
+
+//-----------------------------------------------------------------------------
+/** Sends a packet to this host.
+ *  \param data The data to send.
+ *  \param reliable If the data is sent reliable or not.
+ *  \param encrypted If the data is sent encrypted or not.
+ */
+void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
+{
+    ENetPacket* packet = createPacket(data, reliable, encrypted);
     if (packet)
     {
-        if (Network::m_connection_debug)
-        {
-            Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
-                packet->dataLength, getAddress().toString().c_str(),
-                StkTime::getRealTime());
-        }
         m_host->addEnetCommand(m_enet_peer, packet,
                 encrypted ? EVENT_CHANNEL_NORMAL : EVENT_CHANNEL_UNENCRYPTED,
                 ECT_SEND_PACKET, m_address);
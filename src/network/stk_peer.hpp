@@ -23,6 +23,7 @@
 #ifndef STK_PEER_HPP
 #define STK_PEER_HPP
 
+#include "utils/dynamic_bitset.hpp"
 #include "utils/no_copy.hpp"
 #include "utils/time.hpp"
 #include "utils/types.hpp"
@@ -38,6 +39,7 @@
 #include <string>
 #include <vector>
 
+class AssetIds;
 class Crypto;
 class NetworkPlayerProfile;
 class NetworkString;
@@ -104,8 +106,18 @@ protected:
 
     int m_consecutive_messages;
 
-    /** Available karts and tracks from this peer */
-    std::pair<std::set<std::string>, std::set<std::string> > m_available_kts;
+    /** Server commands this peer can still send at once, refilled over time
+     *  (see consumeCommandToken). */
+    float m_command_tokens;
+
+    uint64_t m_last_command_time;
+
+    /** Available karts and tracks from this peer, as ids of the server (see
+     *  ServerLobby::m_kart_ids and m_track_ids). */
+    std::pair<DynamicBitset, DynamicBitset> m_available_kts;
+
+    /** Available karts and tracks from this peer the server doesn't have. */
+    std::pair<std::set<std::string>, std::set<std::string> > m_unknown_kts;
 
     std::unique_ptr<Crypto> m_crypto;
 
@@ -131,6 +143,9 @@ public:
     // ------------------------------------------------------------------------
     ~STKPeer();
     // ------------------------------------------------------------------------
+    ENetPacket* createPacket(NetworkString *data, bool reliable = true,
+                             bool encrypted = true);
+    // ------------------------------------------------------------------------
     void sendPacket(NetworkString *data, bool reliable = true,
                     bool encrypted = true);
     // ------------------------------------------------------------------------
@@ -166,42 +181,31 @@ public:
     float getConnectedTime() const
        { return float(StkTime::getMonoTimeMs() - m_connected_time) / 1000.0f; }
     // ------------------------------------------------------------------------
-    void setAvailableKartsTracks(std::set<std::string>& k,
-                                 std::set<std::string>& t)
-              { m_available_kts = std::make_pair(std::move(k), std::move(t)); }
-    // ------------------------------------------------------------------------
-    void eraseServerKarts(const std::set<std::string>& server_karts,
-                          std::set<std::string>& karts_erase) const
+    void setAvailableKartsTracks(
+        std::pair<DynamicBitset, DynamicBitset>& kts,
+        std::pair<std::set<std::string>, std::set<std::string> >& unknown)
     {
-        if (m_available_kts.first.empty())
-            return;
-        for (const std::string& server_kart : server_karts)
-        {
-            if (m_available_kts.first.find(server_kart) ==
-                m_available_kts.first.end())
-            {
-                karts_erase.insert(server_kart);
-            }
-        }
+        m_available_kts = std::move(kts);
+        m_unknown_kts = std::move(unknown);
     }
     // ------------------------------------------------------------------------
-    void eraseServerTracks(const std::set<std::string>& server_tracks,
-                           std::set<std::string>& tracks_erase) const
-    {
-        if (m_available_kts.second.empty())
-            return;
-        for (const std::string& server_track : server_tracks)
-        {
-            if (m_available_kts.second.find(server_track) ==
-                m_available_kts.second.end())
-            {
-                tracks_erase.insert(server_track);
-            }
-        }
-    }
+    const DynamicBitset& getAvailableKarts() const
+                                               { return m_available_kts.first; }
     // ------------------------------------------------------------------------
-    std::pair<std::set<std::string>, std::set<std::string> >
-                            getClientAssets() const { return m_available_kts; }
+    const DynamicBitset& getAvailableTracks() const
+                                              { return m_available_kts.second; }
+    // ------------------------------------------------------------------------
+    const std::pair<std::set<std::string>, std::set<std::string> >&
+                          getUnknownKartsTracks() const { return m_unknown_kts; }
+    // ------------------------------------------------------------------------
+    /** False if this peer hasn't sent its karts (like AI peers). */
+    bool hasAvailableKarts() const
+       { return !m_available_kts.first.none() || !m_unknown_kts.first.empty(); }
+    // ------------------------------------------------------------------------
+    bool hasAvailableTracks() const
+     { return !m_available_kts.second.none() || !m_unknown_kts.second.empty(); }
+    // ------------------------------------------------------------------------
+    void addKnownAssets(const AssetIds& kart_ids, const AssetIds& track_ids);
     // ------------------------------------------------------------------------
     void setPingInterval(uint32_t interval)
                             { enet_peer_ping_interval(m_enet_peer, interval); }
@@ -216,6 +220,8 @@ public:
     // ------------------------------------------------------------------------
     ENetPeer* getENetPeer() const                       { return m_enet_peer; }
     // ------------------------------------------------------------------------
+    const ENetAddress& getENetAddress() const             { return m_address; }
+    // ------------------------------------------------------------------------
     void setWaitingForGame(bool val)         { m_waiting_for_game.store(val); }
     // ------------------------------------------------------------------------
     bool isWaitingForGame() const         { return m_waiting_for_game.load(); }
@@ -302,6 +308,8 @@ public:
     // ------------------------------------------------------------------------
     int getConsecutiveMessages() const       { return m_consecutive_messages; }
     // ------------------------------------------------------------------------
+    bool consumeCommandToken(float rate, int burst);
+    // ------------------------------------------------------------------------
     const SocketAddress& getAddress() const { return *m_socket_address.get(); }
     // ------------------------------------------------------------------------
     void setAlwaysSpectate(bool val)          { m_always_spectate.store(val); }
@@ -32,6 +32,7 @@
 #include "network/compress_network_body.hpp"
 #include "network/network_config.hpp"
 #include "network/protocols/lobby_protocol.hpp"
+#include "scriptengine/script_engine.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_object.hpp"
 #include "utils/constants.hpp"
@@ -45,6 +46,7 @@ using namespace irr;
 
 #include <algorithm>
 #include <memory>
+#include <string.h>
 #include <string>
 #include <vector>
 
@@ -167,6 +169,8 @@ PhysicalObject::PhysicalObject(bool is_dynamic,
     m_reset_height       = settings.m_reset_height;
     m_on_kart_collision  = settings.m_on_kart_collision;
     m_on_item_collision  = settings.m_on_item_collision;
+    m_on_kart_collision_handle = Scripting::ScriptEngine::UNRESOLVED_FUNCTION;
+    m_on_item_collision_handle = Scripting::ScriptEngine::UNRESOLVED_FUNCTION;
     m_current_transform.setOrigin(Vec3());
     m_current_transform.setRotation(
         btQuaternion(0.0f, 0.0f, 0.0f, 1.0f));
@@ -513,6 +517,9 @@ void PhysicalObject::init(const PhysicalObject::Settings& settings)
                 }
             }   // for i<getMeshBufferCount
         }
+        Track* track = Track::getCurrentTrack();
+        if (track && !m_id.empty())
+            triangle_mesh->setBvhCacheName(track->getIdent() + "-" + m_id);
         triangle_mesh->createCollisionShape();
         m_shape = &triangle_mesh->getCollisionShape();
         m_triangle_mesh = triangle_mesh.release();
@@ -678,6 +685,53 @@ bool PhysicalObject::castRay(const btVector3 &from, const btVector3 &to,
     return result;
 }   // castRay
 
+// ----------------------------------------------------------------------------
+/** Returns the handle of the script function to call when a kart hits this
+ *  object (NO_FUNCTION if none). It is looked up only once, normally when
+ *  the track objects are initialised after compiling the scripts.
+ */
+int PhysicalObject::getOnKartCollisionHandle()
+{
+    if (m_on_kart_collision_handle ==
+        Scripting::ScriptEngine::UNRESOLVED_FUNCTION)
+    {
+        m_on_kart_collision_handle = m_on_kart_collision.empty()
+            ? (int)Scripting::ScriptEngine::NO_FUNCTION
+            : Scripting::ScriptEngine::getInstance()->getFunctionHandle(true,
+                  "void " + m_on_kart_collision +
+                  "(int, const string, const string)");
+    }
+    return m_on_kart_collision_handle;
+}   // getOnKartCollisionHandle
+
+// ----------------------------------------------------------------------------
+/** Returns the handle of the script function to call when an item (flyable)
+ *  hits this object, see getOnKartCollisionHandle.
+ */
+int PhysicalObject::getOnItemCollisionHandle()
+{
+    if (m_on_item_collision_handle ==
+        Scripting::ScriptEngine::UNRESOLVED_FUNCTION)
+    {
+        m_on_item_collision_handle = m_on_item_collision.empty()
+            ? (int)Scripting::ScriptEngine::NO_FUNCTION
+            : Scripting::ScriptEngine::getInstance()->getFunctionHandle(true,
+                  "void " + m_on_item_collision + "(int, int, const string)");
+    }
+    return m_on_item_collision_handle;
+}   // getOnItemCollisionHandle
+
+// ----------------------------------------------------------------------------
+/** Computes the world space bounds of the mesh castRay tests against.
+ *  \return False if castRay can not hit this object (it is not 'exact').
+ */
+bool PhysicalObject::getRaycastAabb(btVector3 *min, btVector3 *max) const
+{
+    if(m_body_type!=MP_EXACT || !m_triangle_mesh)
+        return false;
+    return m_triangle_mesh->getAabb(min, max);
+}   // getRaycastAabb
+
 // ----------------------------------------------------------------------------
 void PhysicalObject::reset()
 {
@@ -812,7 +866,7 @@ void PhysicalObject::computeError()
 }   // computeError
 
 // ----------------------------------------------------------------------------
-BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
+BareNetworkString* PhysicalObject::saveState(std::vector<uint16_t>* ru)
 {
     bool has_live_join = false;
 
@@ -837,7 +891,7 @@ BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
         return nullptr;
     }
 
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderID());
     m_last_transform = cur_transform;
     m_last_lv = current_lv;
     m_last_av = current_av;
@@ -856,35 +910,43 @@ void PhysicalObject::restoreState(BareNetworkString *buffer, int count)
 }   // restoreState
 
 // ----------------------------------------------------------------------------
-std::function<void()> PhysicalObject::getLocalStateRestoreFunction()
+bool PhysicalObject::writeLocalState(uint8_t* snapshot) const
 {
-    btTransform t = m_body->getWorldTransform();
-    Vec3 lv = m_body->getLinearVelocity();
-    Vec3 av = m_body->getAngularVelocity();
-    return [t, lv, av, this]()
+    LocalState ls;
+    m_body->getWorldTransform().getOpenGLMatrix(ls.m_transform);
+    const btVector3& lv = m_body->getLinearVelocity();
+    const btVector3& av = m_body->getAngularVelocity();
+    for (unsigned i = 0; i < 3; i++)
     {
-        if (m_no_server_state)
-        {
-            m_body->setWorldTransform(m_last_transform);
-            m_motion_state->setWorldTransform(m_last_transform);
-            m_body->setInterpolationWorldTransform(m_last_transform);
-            m_body->setLinearVelocity(m_last_lv);
-            m_body->setAngularVelocity(m_last_av);
-            m_body->setInterpolationLinearVelocity(m_last_lv);
-            m_body->setInterpolationAngularVelocity(m_last_av);
-        }
-        else
-        {
-            m_body->setWorldTransform(t);
-            m_motion_state->setWorldTransform(t);
-            m_body->setInterpolationWorldTransform(t);
-            m_body->setLinearVelocity(lv);
-            m_body->setAngularVelocity(av);
-            m_body->setInterpolationLinearVelocity(lv);
-            m_body->setInterpolationAngularVelocity(av);
-        }
-    };
-}   // getLocalStateRestoreFunction
+        ls.m_lv[i] = lv[i];
+        ls.m_av[i] = av[i];
+    }
+    memcpy(snapshot, &ls, sizeof(LocalState));
+    return true;
+}   // writeLocalState
+
+// ----------------------------------------------------------------------------
+void PhysicalObject::readLocalState(const uint8_t* snapshot)
+{
+    btTransform t = m_last_transform;
+    btVector3 lv = m_last_lv;
+    btVector3 av = m_last_av;
+    if (!m_no_server_state)
+    {
+        LocalState ls;
+        memcpy(&ls, snapshot, sizeof(LocalState));
+        t.setFromOpenGLMatrix(ls.m_transform);
+        lv = btVector3(ls.m_lv[0], ls.m_lv[1], ls.m_lv[2]);
+        av = btVector3(ls.m_av[0], ls.m_av[1], ls.m_av[2]);
+    }
+    m_body->setWorldTransform(t);
+    m_motion_state->setWorldTransform(t);
+    m_body->setInterpolationWorldTransform(t);
+    m_body->setLinearVelocity(lv);
+    m_body->setAngularVelocity(av);
+    m_body->setInterpolationLinearVelocity(lv);
+    m_body->setInterpolationAngularVelocity(av);
+}   // readLocalState
 
 // ----------------------------------------------------------------------------
 void PhysicalObject::joinToMainTrack()
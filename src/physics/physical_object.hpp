@@ -178,6 +178,10 @@ private:
     * when a (flyable) item collides with this object
     */
     std::string           m_on_item_collision;
+    /** Script function handles of m_on_kart_collision and
+     *  m_on_item_collision, see getOnKartCollisionHandle(). */
+    int                   m_on_kart_collision_handle;
+    int                   m_on_item_collision_handle;
     /** If this body is a bullet dynamic body, i.e. affected by physics
      *  or not (static (not moving) or kinematic (animated outside
      *  of physics). */
@@ -195,6 +199,14 @@ private:
      * when the object is not moving */
     bool                  m_no_server_state;
 
+    /** The transform and velocities saved for a local state restore. */
+    struct LocalState
+    {
+        btScalar m_transform[16];
+        btScalar m_lv[3];
+        btScalar m_av[3];
+    };   // LocalState
+
     void copyFromMainProcess(TrackObject* track_obj);
 public:
                     PhysicalObject(bool is_dynamic, const Settings& settings,
@@ -216,6 +228,7 @@ public:
                  const btVector3 &to, btVector3 *hit_point,
                  const Material **material, btVector3 *normal,
                  bool interpolate_normal) const;
+    bool getRaycastAabb(btVector3 *min, btVector3 *max) const;
 
     // ------------------------------------------------------------------------
     bool isDynamic() const { return m_is_dynamic; }
@@ -251,6 +264,10 @@ public:
     // ------------------------------------------------------------------------
     const std::string& getOnItemCollisionFunction() const { return m_on_item_collision; }
     // ------------------------------------------------------------------------
+    int getOnKartCollisionHandle();
+    // ------------------------------------------------------------------------
+    int getOnItemCollisionHandle();
+    // ------------------------------------------------------------------------
     TrackObject* getTrackObject() { return m_object; }
 
     // Methods usable by scripts
@@ -284,12 +301,14 @@ public:
     void addForRewind();
     virtual void saveTransform();
     virtual void computeError();
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru);
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru);
     virtual void undoEvent(BareNetworkString *buffer) {}
     virtual void rewindToEvent(BareNetworkString *buffer) {}
     virtual void restoreState(BareNetworkString *buffer, int count);
     virtual void undoState(BareNetworkString *buffer) {}
-    virtual std::function<void()> getLocalStateRestoreFunction();
+    virtual size_t getLocalStateSize() const { return sizeof(LocalState); }
+    virtual bool writeLocalState(uint8_t* snapshot) const;
+    virtual void readLocalState(const uint8_t* snapshot);
     bool hasTriangleMesh() const { return m_triangle_mesh != NULL; }
     void joinToMainTrack();
     std::shared_ptr<PhysicalObject> clone(TrackObject* track_obj)
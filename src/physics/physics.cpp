@@ -31,7 +31,9 @@
 #include "karts/controller/local_player_controller.hpp"
 #include "modes/soccer_world.hpp"
 #include "modes/world.hpp"
+#include "network/match_log.hpp"
 #include "network/network_config.hpp"
+#include "network/server_config.hpp"
 #include "karts/explosion_animation.hpp"
 #include "physics/btKart.hpp"
 #include "physics/irr_debug_drawer.hpp"
@@ -45,6 +47,8 @@
 #include "utils/profiler.hpp"
 #include "utils/stk_process.hpp"
 
+#include <chrono>
+
 //=============================================================================
 Physics* g_physics[PT_COUNT];
 // ----------------------------------------------------------------------------
@@ -79,6 +83,52 @@ Physics::Physics() : btSequentialImpulseConstraintSolver()
     m_dispatcher          = new btCollisionDispatcher(m_collision_conf);
 }   // Physics
 
+//-----------------------------------------------------------------------------
+/** Converts the name of a broadphase as used in the config files.
+ *  \param name "axis-sweep" or "dbvt".
+ *  \param type On return the broadphase, if the name is valid.
+ *  \return False if the name is unknown.
+ */
+bool Physics::parseBroadphase(const std::string& name, BroadphaseType* type)
+{
+    if (name == "axis-sweep")
+        *type = BP_AXIS_SWEEP;
+    else if (name == "dbvt")
+        *type = BP_DBVT;
+    else
+        return false;
+    return true;
+}   // parseBroadphase
+
+//-----------------------------------------------------------------------------
+const char* Physics::getBroadphaseName(BroadphaseType type)
+{
+    return type == BP_DBVT ? "dbvt" : "axis-sweep";
+}   // getBroadphaseName
+
+//-----------------------------------------------------------------------------
+/** Returns the broadphase to use: a re-simulated match log (see
+ *  --replay-match) uses physics-broadphase from the server config if it is
+ *  set, otherwise the one of stk_config.xml is used. Servers and clients of
+ *  a real game always use the same one from stk_config.xml, since the
+ *  broadphase changes the order in which contacts are solved.
+ */
+Physics::BroadphaseType Physics::getConfiguredBroadphase()
+{
+    BroadphaseType type = BP_AXIS_SWEEP;
+    const std::string& server_broadphase = ServerConfig::m_physics_broadphase;
+    if (MatchLog::isReplaying() && !server_broadphase.empty())
+    {
+        if (parseBroadphase(server_broadphase, &type))
+            return type;
+        Log::warn("Physics", "Unknown physics-broadphase '%s' in the server "
+                  "config, using '%s'.", server_broadphase.c_str(),
+                  stk_config->m_broadphase.c_str());
+    }
+    parseBroadphase(stk_config->m_broadphase, &type);
+    return type;
+}   // getConfiguredBroadphase
+
 //-----------------------------------------------------------------------------
 /** The actual initialisation of the physics, which is called after the track
  *  model is loaded. This allows the physics to use the actual track dimension
@@ -87,11 +137,19 @@ Physics::Physics() : btSequentialImpulseConstraintSolver()
 void Physics::init(const Vec3 &world_min, const Vec3 &world_max)
 {
     m_physics_loop_active = false;
-    m_axis_sweep          = new btAxisSweep3(world_min, world_max);
+    m_kart_kart_collision_handle =
+        Scripting::ScriptEngine::UNRESOLVED_FUNCTION;
+    m_broadphase_type     = getConfiguredBroadphase();
+    if (m_broadphase_type == BP_DBVT)
+        m_broadphase      = new btDbvtBroadphase();
+    else
+        m_broadphase      = new btAxisSweep3(world_min, world_max);
     m_dynamics_world      = new STKDynamicsWorld(m_dispatcher,
-                                                 m_axis_sweep,
+                                                 m_broadphase,
                                                  this,
                                                  m_collision_conf);
+    m_last_step.reset();
+    m_all_steps.reset();
     m_karts_to_delete.clear();
     m_dynamics_world->setGravity(
         btVector3(0.0f,
@@ -117,7 +175,7 @@ Physics::~Physics()
 {
     delete m_debug_drawer;
     delete m_dynamics_world;
-    delete m_axis_sweep;
+    delete m_broadphase;
     delete m_dispatcher;
     delete m_collision_conf;
 }   // ~Physics
@@ -190,16 +248,44 @@ void Physics::update(int ticks)
     // Since the world update (which calls physics update) is called at the
     // fixed frequency necessary for the physics update, we need to do exactly
     // one physic step only.
-    double start;
-    if(UserConfigParams::m_physics_debug) start = StkTime::getRealTime();
-
+    // The solver iterations are counted in solveGroup
+    m_last_step.reset();
+    m_last_step.m_steps = 1;
+    PROFILER_PUSH_CPU_MARKER("Step simulation", 0x40, 0x40, 0x40);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
     m_dynamics_world->stepSimulation(stk_config->ticks2Time(1), 1,
                                      stk_config->ticks2Time(1)      );
+    m_last_step.m_step_time = m_last_step.m_max_step_time =
+        std::chrono::duration_cast<std::chrono::microseconds>
+        (std::chrono::steady_clock::now() - start).count();
+    PROFILER_POP_CPU_MARKER();
+    m_last_step.m_broadphase_pairs =
+        m_broadphase->getOverlappingPairCache()->getNumOverlappingPairs();
+    m_last_step.m_manifolds = m_dispatcher->getNumManifolds();
+    m_all_steps.m_steps             += 1;
+    m_all_steps.m_broadphase_pairs  += m_last_step.m_broadphase_pairs;
+    m_all_steps.m_manifolds         += m_last_step.m_manifolds;
+    m_all_steps.m_solver_iterations += m_last_step.m_solver_iterations;
+    m_all_steps.m_step_time         += m_last_step.m_step_time;
+    m_all_steps.m_max_step_time = std::max(m_all_steps.m_max_step_time,
+                                           m_last_step.m_step_time);
+    PROFILER_SET_COUNTER("Broadphase pairs",
+                         (int64_t)m_last_step.m_broadphase_pairs);
+    PROFILER_SET_COUNTER("Manifolds", (int64_t)m_last_step.m_manifolds);
+    PROFILER_SET_COUNTER("Solver iterations",
+                         (int64_t)m_last_step.m_solver_iterations);
+    PROFILER_SET_COUNTER("Step simulation us",
+                         (int64_t)m_last_step.m_step_time);
     if (UserConfigParams::m_physics_debug)
     {
-        Log::verbose("Physics", "At %d physics duration %12.8f",
+        Log::verbose("Physics", "At %d physics duration %12.8f, %d pairs, "
+                     "%d manifolds, %d solver iterations",
                      World::getWorld()->getTicksSinceStart(),
-                     StkTime::getRealTime() - start);
+                     m_last_step.m_step_time / 1000000.0,
+                     (int)m_last_step.m_broadphase_pairs,
+                     (int)m_last_step.m_manifolds,
+                     (int)m_last_step.m_solver_iterations);
     }
 
     // Now handle the actual collision. Note: flyables can not be removed
@@ -225,7 +311,14 @@ void Physics::update(int ticks)
                                                 Scripting::ScriptEngine::getInstance();
                 int kartid1 = p->getUserPointer(0)->getPointerKart()->getWorldKartId();
                 int kartid2 = p->getUserPointer(1)->getPointerKart()->getWorldKartId();
-                script_engine->runFunction(false, "void onKartKartCollision(int, int)",
+                if (m_kart_kart_collision_handle ==
+                    Scripting::ScriptEngine::UNRESOLVED_FUNCTION)
+                {
+                    m_kart_kart_collision_handle =
+                        script_engine->getFunctionHandle(false,
+                        "void onKartKartCollision(int, int)");
+                }
+                script_engine->callFunction(m_kart_kart_collision_handle,
                     [=](asIScriptContext* ctx) {
                         ctx->SetArgDWord(0, kartid1);
                         ctx->SetArgDWord(1, kartid2);
@@ -241,21 +334,20 @@ void Physics::update(int ticks)
             AbstractKart *kart = p->getUserPointer(1)->getPointerKart();
             int kartId = kart->getWorldKartId();
             PhysicalObject* obj = p->getUserPointer(0)->getPointerPhysicalObject();
-            std::string obj_id = obj->getID();
-            std::string scripting_function = obj->getOnKartCollisionFunction();
-
-            TrackObject* to = obj->getTrackObject();
-            TrackObject* library = to->getParentLibrary();
-            std::string lib_id;
-            std::string* lib_id_ptr = NULL;
-            if (library != NULL)
-                lib_id = library->getID();
-            lib_id_ptr = &lib_id;
-
-            if (!is_child && scripting_function.size() > 0)
+
+            if (!is_child && obj->getOnKartCollisionHandle() >= 0)
             {
+                std::string obj_id = obj->getID();
+                TrackObject* to = obj->getTrackObject();
+                TrackObject* library = to->getParentLibrary();
+                std::string lib_id;
+                std::string* lib_id_ptr = NULL;
+                if (library != NULL)
+                    lib_id = library->getID();
+                lib_id_ptr = &lib_id;
+
                 Scripting::ScriptEngine* script_engine = Scripting::ScriptEngine::getInstance();
-                script_engine->runFunction(true, "void " + scripting_function + "(int, const string, const string)",
+                script_engine->callFunction(obj->getOnKartCollisionHandle(),
                     [&](asIScriptContext* ctx) {
                         ctx->SetArgDWord(0, kartId);
                         ctx->SetArgObject(1, lib_id_ptr);
@@ -343,12 +435,11 @@ void Physics::update(int ticks)
             // -------------------------------
             Flyable* flyable = p->getUserPointer(0)->getPointerFlyable();
             PhysicalObject* obj = p->getUserPointer(1)->getPointerPhysicalObject();
-            std::string obj_id = obj->getID();
-            std::string scripting_function = obj->getOnItemCollisionFunction();
-            if (!is_child && scripting_function.size() > 0)
+            if (!is_child && obj->getOnItemCollisionHandle() >= 0)
             {
+                std::string obj_id = obj->getID();
                 Scripting::ScriptEngine* script_engine = Scripting::ScriptEngine::getInstance();
-                script_engine->runFunction(true, "void " + scripting_function + "(int, int, const string)",
+                script_engine->callFunction(obj->getOnItemCollisionHandle(),
                         [&](asIScriptContext* ctx) {
                         ctx->SetArgDWord(0, (int)flyable->getType());
                         ctx->SetArgDWord(1, flyable->getOwnerId());
@@ -584,6 +675,10 @@ btScalar Physics::solveGroup(btCollisionObject** bodies, int numBodies,
                                                         debugDrawer,
                                                         stackAlloc,
                                                         dispatcher);
+    // Same test as solveGroupCacheFriendlySetup, which does not iterate
+    // without constraints
+    if (numManifolds + numConstraints > 0)
+        m_last_step.m_solver_iterations += info.m_numIterations;
     int currentNumManifolds = m_dispatcher->getNumManifolds();
     // We can't explode a rocket in a loop, since a rocket might collide with
     // more than one object, and/or more than once with each object (if there
@@ -25,6 +25,8 @@
   */
 
 #include <set>
+#include <stdint.h>
+#include <string>
 #include <vector>
 
 #include "btBulletDynamicsCommon.h"
@@ -42,6 +44,37 @@ class Vec3;
   */
 class Physics : public btSequentialImpulseConstraintSolver
 {
+public:
+    /** The broadphases the dynamics world can use. */
+    enum BroadphaseType
+    {
+        BP_AXIS_SWEEP,   //!< Sweep and prune, sized to the track.
+        BP_DBVT          //!< Dynamic AABB trees, for large or busy tracks.
+    };
+
+    /** Counters of physics steps, either of the last step or summed over
+     *  all steps of the world. */
+    struct StepStatistics
+    {
+        unsigned int m_steps;
+        /** Overlapping pairs in the broadphase after the step. */
+        uint64_t m_broadphase_pairs;
+        /** Contact manifolds of the narrowphase after the step. */
+        uint64_t m_manifolds;
+        /** Iterations done by the constraint solver for all islands. */
+        uint64_t m_solver_iterations;
+        /** Time spent in stepSimulation in microseconds, and the longest
+         *  step. */
+        uint64_t m_step_time, m_max_step_time;
+        StepStatistics() { reset(); }
+        void reset()
+        {
+            m_steps = 0;
+            m_broadphase_pairs = m_manifolds = m_solver_iterations = 0;
+            m_step_time = m_max_step_time = 0;
+        }   // reset
+    };   // StepStatistics
+
 private:
     /** Bullet can report the same collision more than once (up to 4
      *  contact points per collision. Additionally, more than one internal
@@ -130,6 +163,10 @@ private:
     *  taking place, as can happen in collision handling). */
     bool               m_physics_loop_active;
 
+    /** Handle of the script function onKartKartCollision, looked up at the
+     *  first kart-kart collision. */
+    int                m_kart_kart_collision_handle;
+
     /** If kart need to be removed from the physics world while physics
     *  processing is taking place, store the pointers to the karts to
     *  be removed here, and remove them once the physics processing
@@ -143,10 +180,14 @@ private:
     IrrDebugDrawer                  *m_debug_drawer;
 
     btCollisionDispatcher           *m_dispatcher;
-    btBroadphaseInterface           *m_axis_sweep;
+    btBroadphaseInterface           *m_broadphase;
     btDefaultCollisionConfiguration *m_collision_conf;
     CollisionList                    m_all_collisions;
 
+    BroadphaseType                   m_broadphase_type;
+
+    StepStatistics                   m_last_step, m_all_steps;
+
              Physics();
     virtual ~Physics();
 
@@ -176,6 +217,16 @@ public:
     /** Returns true if the debug drawer is enabled. */
     bool  isDebug() const     {return m_debug_drawer->debugEnabled(); }
     IrrDebugDrawer* getDebugDrawer() { return m_debug_drawer; }
+    /** Returns the broadphase used by the dynamics world. */
+    BroadphaseType getBroadphaseType() const { return m_broadphase_type; }
+    /** Returns the counters of the last physics step. */
+    const StepStatistics& getLastStep() const { return m_last_step; }
+    /** Returns the counters summed over all steps since init. */
+    const StepStatistics& getAllSteps() const { return m_all_steps; }
+    static BroadphaseType getConfiguredBroadphase();
+    static bool parseBroadphase(const std::string& name,
+                                BroadphaseType* type);
+    static const char* getBroadphaseName(BroadphaseType type);
     virtual btScalar solveGroup(btCollisionObject** bodies, int numBodies,
                                 btPersistentManifold** manifold,int numManifolds,
                                 btTypedConstraint** constraints,int numConstraints,
@@ -19,15 +19,46 @@
 #include "physics/triangle_mesh.hpp"
 
 #include "config/stk_config.hpp"
+#include "io/file_manager.hpp"
 #include "main_loop.hpp"
 #include "physics/physics.hpp"
 #include "utils/constants.hpp"
+#include "utils/file_utils.hpp"
 #include "utils/log.hpp"
+#include "utils/stk_process.hpp"
+#include "utils/string_utils.hpp"
 #include "utils/time.hpp"
 
 #include "btBulletDynamicsCommon.h"
 
+#include <cstring>
 #include <fstream>
+#include <set>
+
+#ifndef WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+/** Meshes with less triangles build their BVH faster than reading it. */
+static const int MIN_CACHED_BVH_TRIANGLES = 2000;
+
+/** Header of a cached BVH file, followed by the serialized btOptimizedBvh
+ *  (its size keeps that 16 bytes aligned). */
+struct BvhCacheHeader
+{
+    char     m_magic[8];
+    /** Changes with the format and the bullet version. */
+    uint32_t m_version;
+    uint32_t m_triangles;
+    uint64_t m_hash;
+    uint64_t m_bvh_size;
+};
+
+static const uint32_t BVH_CACHE_VERSION =
+    (1 << 24) | ((sizeof(btScalar) == 8 ? 1 : 0) << 16) | BT_BULLET_VERSION;
 
 // -----------------------------------------------------------------------------
 /** Constructor: Initialises all data structures with zero.
@@ -45,6 +76,9 @@ TriangleMesh::TriangleMesh(bool can_be_transformed) : m_mesh()
     // (and m_mesh->m_weldingThreshold at m_normals
     m_collision_shape  = NULL;
     m_collision_object = NULL;
+    m_bvh_buffer       = NULL;
+    m_bvh_buffer_size  = 0;
+    m_bvh_mapped       = false;
     m_user_pointer.set(this);
 }   // TriangleMesh
 
@@ -87,9 +121,208 @@ void TriangleMesh::addTriangle(const btVector3 &t1, const btVector3 &t2,
     m_p1p2p3.push_back(edge1.cross(edge2).length2());
 }   // addTriangle
 
+// -----------------------------------------------------------------------------
+/** Caches the BVH of this mesh in the cached BVH directory of the file
+ *  manager, so later loads of the same mesh don't need to build it again.
+ *  \param name Name of the mesh, e.g. the track ident and object id. Cached
+ *         files for an older version of the mesh with the same name are
+ *         removed when a new one is saved.
+ */
+void TriangleMesh::setBvhCacheName(const std::string& name)
+{
+    m_bvh_cache_name = name;
+    for (char& c : m_bvh_cache_name)
+    {
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_')
+            c = '_';
+    }
+}   // setBvhCacheName
+
+// -----------------------------------------------------------------------------
+/** Returns a hash of all vertices, which identifies the BVH of this mesh. */
+uint64_t TriangleMesh::getTriangleHash() const
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const void* data, size_t size)
+        {
+            const unsigned char* bytes = (const unsigned char*)data;
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+        };
+    int triangles = m_mesh.getNumTriangles();
+    add(&triangles, sizeof(triangles));
+    for (int i = 0; i < triangles; i++)
+    {
+        btVector3 p[3];
+        getTriangle(i, p, p + 1, p + 2);
+        for (unsigned j = 0; j < 3; j++)
+            add(p[j].m_floats, 3 * sizeof(btScalar));
+    }
+    return hash;
+}   // getTriangleHash
+
+// -----------------------------------------------------------------------------
+std::string TriangleMesh::getBvhCacheFile(uint64_t hash) const
+{
+    return file_manager->getCachedBvhDir() + m_bvh_cache_name + "-" +
+        StringUtils::toString(hash) + ".bvh";
+}   // getBvhCacheFile
+
+// -----------------------------------------------------------------------------
+/** Loads the cached BVH of this mesh. The file is memory mapped (where
+ *  possible) and used in place, so it's only copied into memory on writing.
+ *  \param hash Hash of the vertices, see getTriangleHash.
+ *  \return The BVH, or NULL if it is not cached.
+ */
+btOptimizedBvh* TriangleMesh::loadCachedBvh(uint64_t hash)
+{
+    std::string file = getBvhCacheFile(hash);
+#ifdef WIN32
+    FILE* f = FileUtils::fopenU8Path(file, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < (long)sizeof(BvhCacheHeader))
+    {
+        fclose(f);
+        return NULL;
+    }
+    m_bvh_buffer = btAlignedAlloc(size, 16);
+    m_bvh_buffer_size = size;
+    m_bvh_mapped = false;
+    bool ok = fread(m_bvh_buffer, size, 1, f) == 1;
+    fclose(f);
+    if (!ok)
+    {
+        freeBvhBuffer();
+        return NULL;
+    }
+#else
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(BvhCacheHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    // Private mapping, as deserializing writes to the header of the BVH
+    void* data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                      fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+    m_bvh_buffer = data;
+    m_bvh_buffer_size = st.st_size;
+    m_bvh_mapped = true;
+#endif
+
+    const BvhCacheHeader* header = (const BvhCacheHeader*)m_bvh_buffer;
+    if (memcmp(header->m_magic, "STKBVH", 7) != 0 ||
+        header->m_version != BVH_CACHE_VERSION ||
+        header->m_triangles != (uint32_t)m_mesh.getNumTriangles() ||
+        header->m_hash != hash ||
+        header->m_bvh_size != m_bvh_buffer_size - sizeof(BvhCacheHeader))
+    {
+        Log::warn("TriangleMesh", "Ignoring invalid cached BVH '%s'.",
+                  file.c_str());
+        freeBvhBuffer();
+        return NULL;
+    }
+    btOptimizedBvh* bvh = btOptimizedBvh::deSerializeInPlace(
+        (char*)m_bvh_buffer + sizeof(BvhCacheHeader),
+        (unsigned)header->m_bvh_size, !IS_LITTLE_ENDIAN);
+    if (!bvh)
+        freeBvhBuffer();
+    return bvh;
+}   // loadCachedBvh
+
+// -----------------------------------------------------------------------------
+/** Saves the BVH of this mesh into the cached BVH directory, and removes
+ *  files of older versions of this mesh (main process only, as listing the
+ *  directory uses the file manager).
+ *  \param bvh The BVH.
+ *  \param hash Hash of the vertices, see getTriangleHash.
+ */
+void TriangleMesh::saveCachedBvh(btOptimizedBvh* bvh, uint64_t hash) const
+{
+    BvhCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.m_magic, "STKBVH", 7);
+    header.m_version = BVH_CACHE_VERSION;
+    header.m_triangles = (uint32_t)m_mesh.getNumTriangles();
+    header.m_hash = hash;
+    header.m_bvh_size = bvh->calculateSerializeBufferSize();
+    void* buffer = btAlignedAlloc((int)header.m_bvh_size, 16);
+    bool ok = bvh->serialize(buffer, (unsigned)header.m_bvh_size,
+                             !IS_LITTLE_ENDIAN);
+
+    // Write to a temporary file of this process first, which then replaces
+    // the file in one step, so other processes never read a partial file
+    std::string file = getBvhCacheFile(hash);
+    std::string tmp_file = FileUtils::getTemporaryPath(file);
+    FILE* f = ok ? FileUtils::fopenU8Path(tmp_file, "wb") : NULL;
+    if (f)
+    {
+        ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(buffer, (size_t)header.m_bvh_size, 1, f) == 1;
+        ok = fclose(f) == 0 && ok;
+        if (ok)
+            ok = FileUtils::replaceU8Path(tmp_file, file) == 0;
+        if (!ok)
+            file_manager->removeFile(tmp_file);
+    }
+    btAlignedFree(buffer);
+    if (!f || !ok)
+    {
+        Log::warn("TriangleMesh", "Cannot write cached BVH '%s'.",
+                  file.c_str());
+        return;
+    }
+
+    std::set<std::string> files;
+    file_manager->listFiles(files, file_manager->getCachedBvhDir());
+    std::string prefix = m_bvh_cache_name + "-";
+    std::string name = StringUtils::getBasename(file);
+    for (const std::string& old : files)
+    {
+        if (old != name && StringUtils::startsWith(old, prefix) &&
+            StringUtils::hasSuffix(old, ".bvh") &&
+            old.find('-', prefix.size()) == std::string::npos)
+            file_manager->removeFile(file_manager->getCachedBvhDir() + old);
+    }
+}   // saveCachedBvh
+
+// -----------------------------------------------------------------------------
+/** Frees the memory of a deserialized BVH (after the shape using it was
+ *  deleted).
+ */
+void TriangleMesh::freeBvhBuffer()
+{
+    if (!m_bvh_buffer)
+        return;
+#ifndef WIN32
+    if (m_bvh_mapped)
+        munmap(m_bvh_buffer, m_bvh_buffer_size);
+    else
+#endif
+        btAlignedFree(m_bvh_buffer);
+    m_bvh_buffer = NULL;
+    m_bvh_buffer_size = 0;
+    m_bvh_mapped = false;
+}   // freeBvhBuffer
+
 // -----------------------------------------------------------------------------
 /** Creates a collision body only, which can be used for raycasting, but
- *  has no physical properties.
+ *  has no physical properties. If a cache name was set (see
+ *  setBvhCacheName), the BVH is loaded from or saved to the cache.
  *  @param serialized_bhv if non-null, load the serialized bhv from file instead
  *                        of builing it on the fly
  */
@@ -105,6 +338,8 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
     }
     // Now convert the triangle mesh into a static rigid body
     btBvhTriangleMeshShape* bhv_triangle_mesh;
+    btOptimizedBvh* bhv = NULL;
+    freeBvhBuffer();
 
     if (serialized_bhv != NULL)
     {
@@ -114,45 +349,42 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
         assert(pos != -1L);
         fseek(f, 0, SEEK_SET);
 
-        void* bytes = btAlignedAlloc(pos, 16);
-        fread(bytes, pos, 1, f);
+        // 'deSerializeInPlace' makes the btOptimizedBvh object directly at
+        // this memory location, so it's freed in removeAll
+        m_bvh_buffer = btAlignedAlloc(pos, 16);
+        m_bvh_buffer_size = pos;
+        fread(m_bvh_buffer, pos, 1, f);
         fclose(f);
 
-        btOptimizedBvh* bhv = btOptimizedBvh::deSerializeInPlace(bytes, pos, !IS_LITTLE_ENDIAN);
+        bhv = btOptimizedBvh::deSerializeInPlace(m_bvh_buffer, pos, !IS_LITTLE_ENDIAN);
         if (bhv == NULL)
         {
             Log::warn("TriangleMesh", "Failed to load serialized BHV");
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-        }
-        else
-        {
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
-                                                           false /* buildBvh */);
-            bhv_triangle_mesh->setOptimizedBvh( bhv );
+            freeBvhBuffer();
         }
-        // Do *NOT* free the bytes, 'deSerializeInPlace' makes the btOptimizedBvh object
-        // directly at this memory location
-        //free(bytes);
+    }
 
+    bool use_cache = !bhv && !m_bvh_cache_name.empty() &&
+        !file_manager->getCachedBvhDir().empty() &&
+        m_mesh.getNumTriangles() >= MIN_CACHED_BVH_TRIANGLES;
+    uint64_t hash = 0;
+    if (use_cache)
+    {
+        hash = getTriangleHash();
+        bhv = loadCachedBvh(hash);
+    }
+
+    if (bhv)
+    {
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
+                                                       false /* buildBvh */);
+        bhv_triangle_mesh->setOptimizedBvh( bhv );
     }
     else
     {
         bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-
-        /*
-         // code to serialize triangle mesh
-        btOptimizedBvh* bvh = bhv_triangle_mesh->getOptimizedBvh();
-        unsigned int ssize = bvh->calculateSerializeBufferSize();
-        char* buffer = (char*)btAlignedAlloc(ssize, 16);
-        bool success = bvh->serialize(buffer, ssize, !IS_LITTLE_ENDIAN);
-        printf("serialization success = %i\n", success);
-
-        std::ofstream fileout("/tmp/btOptimizedBvh");
-        fileout.write(buffer, ssize);
-        fileout.close();
-
-        btAlignedFree(buffer);
-         */
+        if (use_cache && STKProcess::getType() == PT_MAIN)
+            saveCachedBvh(bhv_triangle_mesh->getOptimizedBvh(), hash);
     }
 
     m_collision_shape = bhv_triangle_mesh;
@@ -233,6 +465,7 @@ void TriangleMesh::removeAll()
     }
     delete m_collision_shape;
     m_collision_shape = NULL;
+    freeBvhBuffer();
 }   // removeAll
 
 // -----------------------------------------------------------------------------
@@ -408,3 +641,22 @@ bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
     return ray_callback.hasHit();
 
 }   // castRay
+
+// ----------------------------------------------------------------------------
+/** Computes the world space bounds of the mesh as tested by castRay, i.e.
+ *  using the current transform of the body if there is one.
+ *  \return False if there is no collision shape (castRay never hits).
+ */
+bool TriangleMesh::getAabb(btVector3 *min, btVector3 *max) const
+{
+    if(!m_collision_shape)
+        return false;
+
+    btTransform world_trans;
+    if(m_body)
+        world_trans = m_body->getWorldTransform();
+    else
+        world_trans.setIdentity();
+    m_collision_shape->getAabb(world_trans, *min, *max);
+    return true;
+}   // getAabb
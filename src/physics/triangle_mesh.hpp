@@ -19,6 +19,8 @@
 #ifndef HEADER_TRIANGLE_MESH_HPP
 #define HEADER_TRIANGLE_MESH_HPP
 
+#include <cstdint>
+#include <string>
 #include <vector>
 #include "btBulletDynamicsCommon.h"
 
@@ -57,6 +59,28 @@ private:
      *  to the current transform of the body. */
     bool m_can_be_transformed;
 
+    /** Name of the file caching the BVH of this mesh (see
+     *  createCollisionShape), or empty if it is not cached. */
+    std::string m_bvh_cache_name;
+
+    /** Memory of a deserialized BVH, which is used in place. */
+    void*  m_bvh_buffer;
+    size_t m_bvh_buffer_size;
+
+    /** True if m_bvh_buffer is a memory mapped file. */
+    bool   m_bvh_mapped;
+
+    // ------------------------------------------------------------------------
+    uint64_t getTriangleHash() const;
+    // ------------------------------------------------------------------------
+    std::string getBvhCacheFile(uint64_t hash) const;
+    // ------------------------------------------------------------------------
+    btOptimizedBvh* loadCachedBvh(uint64_t hash);
+    // ------------------------------------------------------------------------
+    void saveCachedBvh(btOptimizedBvh* bvh, uint64_t hash) const;
+    // ------------------------------------------------------------------------
+    void freeBvhBuffer();
+
 public:
     class RigidBodyTriangleMesh : public btRigidBody
     {
@@ -83,6 +107,7 @@ public:
                             const char* serializedBhv = NULL);
     void removeAll();
     void removeCollisionObject();
+    void setBvhCacheName(const std::string& name);
     btVector3 getInterpolatedNormal(unsigned int index,
                                     const btVector3 &position) const;
     // ------------------------------------------------------------------------
@@ -113,6 +138,8 @@ public:
                  btVector3 *xyz, const Material **material,
                  btVector3 *normal=NULL, bool interpolate_normal=false) const;
     // ------------------------------------------------------------------------
+    bool getAabb(btVector3 *min, btVector3 *max) const;
+    // ------------------------------------------------------------------------
     /** Returns the points of the 'indx' triangle.
      *  \param indx Index of the triangle to get.
      *  \param p1,p2,p3 On return the three points of the triangle. */
@@ -147,8 +174,11 @@ public:
         return m_p1p2p3[indx];
     }
     // ------------------------------------------------------------------------
+    /** Copies the triangles (and the BVH cache name, so the BVH cached by
+     *  tm is used). */
     void copyFrom(const TriangleMesh& tm)
     {
+        m_bvh_cache_name = tm.m_bvh_cache_name;
         for (int i = 0; i < tm.m_mesh.getNumTriangles(); i++)
         {
             btVector3 v[6];
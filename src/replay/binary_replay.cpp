@@ -0,0 +1,658 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "replay/binary_replay.hpp"
+
+#include "network/network_string.hpp"
+#include "utils/log.hpp"
+#include "utils/mini_glm.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+const unsigned int BinaryReplay::FORMAT_VERSION;
+const unsigned int BinaryReplay::CHUNK_FRAMES;
+
+namespace
+{
+    /** Text replays start with "version:", so they can't match this. */
+    const char MAGIC[8] = { 'S', 'T', 'K', 'R', 'E', 'P', 'L', 'Y' };
+
+    /** Magic, format version and index size. */
+    const long PREAMBLE_SIZE = 16;
+
+    /** Times are stored in 1/10000 s, positions and distances in 1/1024 m. */
+    const double TIME_SCALE     = 10000.0;
+    const double POSITION_SCALE = 1024.0;
+
+    // ------------------------------------------------------------------------
+    int64_t quantize(float f, double scale)
+    {
+        double d = std::floor((double)f * scale + 0.5);
+        // Also handles NaN
+        if (!(std::fabs(d) < 1e15))
+            return 0;
+        return (int64_t)d;
+    }   // quantize
+
+    // ------------------------------------------------------------------------
+    /** Adds a zigzag encoded variable length integer, so small values of
+     *  either sign use one byte. */
+    void addVarInt(std::vector<uint8_t>* out, int64_t value)
+    {
+        uint64_t u = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+        while (u >= 0x80)
+        {
+            out->push_back((uint8_t)(u | 0x80));
+            u >>= 7;
+        }
+        out->push_back((uint8_t)u);
+    }   // addVarInt
+
+    // ------------------------------------------------------------------------
+    void addUInt32(std::vector<uint8_t>* out, uint32_t value)
+    {
+        out->push_back((uint8_t)(value >> 24));
+        out->push_back((uint8_t)(value >> 16));
+        out->push_back((uint8_t)(value >>  8));
+        out->push_back((uint8_t)(value      ));
+    }   // addUInt32
+
+    // ------------------------------------------------------------------------
+    void addFloat16(std::vector<uint8_t>* out, float f)
+    {
+        uint16_t value = (uint16_t)MiniGLM::toFloat16(f);
+        out->push_back((uint8_t)(value >> 8));
+        out->push_back((uint8_t)(value     ));
+    }   // addFloat16
+
+    // ------------------------------------------------------------------------
+    /** Reads the values added above, setting m_error instead of reading
+     *  past the end of the data. */
+    class ChunkReader
+    {
+    private:
+        const std::vector<uint8_t>& m_data;
+        size_t m_pos;
+    public:
+        bool m_error;
+        // --------------------------------------------------------------------
+        ChunkReader(const std::vector<uint8_t>& data)
+            : m_data(data), m_pos(0), m_error(false) {}
+        // --------------------------------------------------------------------
+        uint8_t getUInt8()
+        {
+            if (m_pos >= m_data.size())
+            {
+                m_error = true;
+                return 0;
+            }
+            return m_data[m_pos++];
+        }   // getUInt8
+        // --------------------------------------------------------------------
+        int64_t getVarInt()
+        {
+            uint64_t u = 0;
+            for (unsigned int shift = 0; shift < 64; shift += 7)
+            {
+                uint8_t byte = getUInt8();
+                u |= (uint64_t)(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                    return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+            }
+            m_error = true;
+            return 0;
+        }   // getVarInt
+        // --------------------------------------------------------------------
+        uint32_t getUInt32()
+        {
+            uint32_t value = (uint32_t)getUInt8() << 24;
+            value |= (uint32_t)getUInt8() << 16;
+            value |= (uint32_t)getUInt8() << 8;
+            return value | getUInt8();
+        }   // getUInt32
+        // --------------------------------------------------------------------
+        float getFloat16()
+        {
+            uint16_t value = (uint16_t)(getUInt8() << 8);
+            value |= getUInt8();
+            return MiniGLM::toFloat32((short)value);
+        }   // getFloat16
+        // --------------------------------------------------------------------
+        bool isEnd() const                  { return m_pos == m_data.size(); }
+    };   // ChunkReader
+}   // namespace
+
+// ----------------------------------------------------------------------------
+BinaryReplay::BinaryReplay()
+{
+    m_file = NULL;
+    m_data_start = 0;
+}   // BinaryReplay
+
+// ----------------------------------------------------------------------------
+BinaryReplay::~BinaryReplay()
+{
+    if (m_file)
+        fclose(m_file);
+}   // ~BinaryReplay
+
+// ----------------------------------------------------------------------------
+/** Returns true if the file is a binary replay, and sets the position to the
+ *  start of the file. */
+bool BinaryReplay::isBinaryReplay(FILE* fd)
+{
+    char magic[sizeof(MAGIC)];
+    fseek(fd, 0, SEEK_SET);
+    bool binary = fread(magic, 1, sizeof(MAGIC), fd) == sizeof(MAGIC) &&
+        memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+    fseek(fd, 0, SEEK_SET);
+    return binary;
+}   // isBinaryReplay
+
+// ----------------------------------------------------------------------------
+/** Reads the index at the start of a file.
+ *  \param chunks Set to the chunks of each kart.
+ *  \param data_start Set to the offset of the first chunk.
+ */
+bool BinaryReplay::readIndex(FILE* fd, ReplayBase::ReplayHeader* header,
+                             std::vector<std::vector<ChunkInfo> >* chunks,
+                             long* data_start)
+{
+    char preamble[PREAMBLE_SIZE];
+    if (fseek(fd, 0, SEEK_SET) != 0 ||
+        fread(preamble, 1, PREAMBLE_SIZE, fd) != (size_t)PREAMBLE_SIZE ||
+        memcmp(preamble, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        Log::warn("BinaryReplay", "Not a binary replay file.");
+        return false;
+    }
+
+    BareNetworkString sizes(preamble + sizeof(MAGIC), 8);
+    uint32_t version = sizes.getUInt32();
+    uint32_t index_size = sizes.getUInt32();
+    if (version != FORMAT_VERSION)
+    {
+        Log::warn("BinaryReplay", "Unsupported binary replay version %d.",
+                  version);
+        return false;
+    }
+    // Much more than the index of the largest race
+    if (index_size > 1024 * 1024)
+    {
+        Log::warn("BinaryReplay", "Invalid index size %d.", index_size);
+        return false;
+    }
+
+    std::vector<char> data(index_size);
+    if (index_size > 0 && fread(data.data(), 1, index_size, fd) != index_size)
+    {
+        Log::warn("BinaryReplay", "Replay index is truncated.");
+        return false;
+    }
+
+    try
+    {
+        BareNetworkString index(data.data(), (int)index_size);
+        index.decodeStringW(&header->m_stk_version);
+        index.decodeString(&header->m_track_name);
+        index.decodeString(&header->m_minor_mode);
+        header->m_reverse    = index.getUInt8() != 0;
+        header->m_difficulty = index.getUInt8();
+        header->m_laps       = index.getUInt16();
+        header->m_min_time   = index.getFloat();
+        header->m_replay_uid = index.getUInt64();
+
+        unsigned int num_karts = index.getUInt8();
+        header->m_kart_list.resize(num_karts);
+        header->m_name_list.resize(num_karts);
+        header->m_kart_color.resize(num_karts);
+        chunks->clear();
+        chunks->resize(num_karts);
+        for (unsigned int k = 0; k < num_karts; k++)
+        {
+            index.decodeString(&header->m_kart_list[k]);
+            index.decodeStringW(&header->m_name_list[k]);
+            header->m_kart_color[k] = index.getFloat();
+            unsigned int num_chunks = index.getUInt32();
+            // Each chunk uses 16 bytes in the index
+            if (num_chunks > index.size() / 16)
+                throw std::out_of_range("Too many chunks");
+            (*chunks)[k].resize(num_chunks);
+            for (ChunkInfo& chunk : (*chunks)[k])
+            {
+                chunk.m_offset          = index.getUInt32();
+                chunk.m_compressed_size = index.getUInt32();
+                chunk.m_raw_size        = index.getUInt32();
+                chunk.m_num_frames      = index.getUInt32();
+            }
+        }
+    }
+    catch (std::exception& e)
+    {
+        Log::warn("BinaryReplay", "Invalid replay index: %s", e.what());
+        return false;
+    }
+
+    *data_start = PREAMBLE_SIZE + (long)index_size;
+    return true;
+}   // readIndex
+
+// ----------------------------------------------------------------------------
+/** Reads only the header of a binary replay file, for listing replays. */
+bool BinaryReplay::readHeader(FILE* fd, ReplayBase::ReplayHeader* header)
+{
+    std::vector<std::vector<ChunkInfo> > chunks;
+    long data_start;
+    return readIndex(fd, header, &chunks, &data_start);
+}   // readHeader
+
+// ----------------------------------------------------------------------------
+/** Opens a binary replay file to read the frames with readNextChunk.
+ *  \param fd The file, which is closed by this object (even if it fails).
+ */
+bool BinaryReplay::open(FILE* fd, ReplayBase::ReplayHeader* header)
+{
+    if (m_file)
+        fclose(m_file);
+    m_file = fd;
+    if (!readIndex(m_file, header, &m_chunks, &m_data_start))
+        return false;
+    m_next_chunk.clear();
+    m_next_chunk.resize(m_chunks.size(), 0);
+    return true;
+}   // open
+
+// ----------------------------------------------------------------------------
+/** Reads the next chunk of frames of a kart.
+ *  \param frames Cleared, then set to the frames read.
+ *  \return False if all chunks were read or the chunk is invalid.
+ */
+bool BinaryReplay::readNextChunk(unsigned int kart,
+                                 std::vector<ReplayBase::ReplayFrame>* frames)
+{
+    frames->clear();
+    if (!m_file || isEnd(kart))
+        return false;
+    const ChunkInfo& chunk = m_chunks[kart][m_next_chunk[kart]++];
+
+    // Chunks are much smaller, this only avoids huge allocations
+    const uint32_t max_size = 64 * 1024 * 1024;
+    if (chunk.m_compressed_size > max_size || chunk.m_raw_size > max_size)
+    {
+        Log::warn("BinaryReplay", "Invalid chunk size.");
+        return false;
+    }
+    std::vector<uint8_t> compressed(chunk.m_compressed_size);
+    if (fseek(m_file, m_data_start + (long)chunk.m_offset, SEEK_SET) != 0 ||
+        fread(compressed.data(), 1, compressed.size(), m_file) !=
+        compressed.size())
+    {
+        Log::warn("BinaryReplay", "Replay chunk is truncated.");
+        return false;
+    }
+
+    std::vector<uint8_t> raw(chunk.m_raw_size);
+    uLongf raw_size = (uLongf)raw.size();
+    if (uncompress(raw.data(), &raw_size, compressed.data(),
+                   (uLong)compressed.size()) != Z_OK ||
+        raw_size != raw.size())
+    {
+        Log::warn("BinaryReplay", "Can't uncompress replay chunk.");
+        return false;
+    }
+
+    if (!decodeChunk(raw, chunk.m_num_frames, frames))
+    {
+        Log::warn("BinaryReplay", "Invalid replay chunk.");
+        frames->clear();
+        return false;
+    }
+    return true;
+}   // readNextChunk
+
+// ----------------------------------------------------------------------------
+/** Encodes frames, the deltas start from 0 so the chunk can be decoded
+ *  alone. */
+void BinaryReplay::encodeChunk(const ReplayBase::ReplayFrame* frames,
+                               unsigned int num_frames,
+                               std::vector<uint8_t>* out)
+{
+    out->clear();
+    int64_t prev_time = 0, prev_distance = 0;
+    int64_t prev_xyz[3] = { 0, 0, 0 };
+    for (unsigned int i = 0; i < num_frames; i++)
+    {
+        const ReplayBase::TransformEvent& te = frames[i].m_transform_event;
+        const ReplayBase::PhysicInfo& pi = frames[i].m_physic_info;
+        const ReplayBase::BonusInfo& bi = frames[i].m_bonus_info;
+        const ReplayBase::KartReplayEvent& kre =
+            frames[i].m_kart_replay_event;
+
+        int64_t time = quantize(te.m_time, TIME_SCALE);
+        addVarInt(out, time - prev_time);
+        prev_time = time;
+        for (int j = 0; j < 3; j++)
+        {
+            int64_t p = quantize(te.m_transform.getOrigin()[j],
+                                 POSITION_SCALE);
+            addVarInt(out, p - prev_xyz[j]);
+            prev_xyz[j] = p;
+        }
+        btQuaternion q = te.m_transform.getRotation();
+        if (q.length2() == 0.0f)
+            q = btQuaternion(0, 0, 0, 1);
+        addUInt32(out, MiniGLM::compressQuaternion(q));
+
+        addFloat16(out, pi.m_speed);
+        addFloat16(out, pi.m_steer);
+        for (int j = 0; j < 4; j++)
+            addFloat16(out, pi.m_suspension_length[j]);
+        addVarInt(out, pi.m_skidding_state);
+
+        addVarInt(out, bi.m_attachment);
+        addFloat16(out, bi.m_nitro_amount);
+        addVarInt(out, bi.m_item_amount);
+        addVarInt(out, bi.m_item_type);
+        addVarInt(out, bi.m_special_value);
+
+        int64_t distance = quantize(kre.m_distance, POSITION_SCALE);
+        addVarInt(out, distance - prev_distance);
+        prev_distance = distance;
+        addVarInt(out, kre.m_nitro_usage);
+        addVarInt(out, kre.m_skidding_effect);
+        out->push_back((uint8_t)((kre.m_zipper_usage ? 1 : 0) |
+                                 (kre.m_red_skidding ? 2 : 0) |
+                                 (kre.m_jumping      ? 4 : 0)));
+    }
+}   // encodeChunk
+
+// ----------------------------------------------------------------------------
+bool BinaryReplay::decodeChunk(const std::vector<uint8_t>& data,
+                               unsigned int num_frames,
+                               std::vector<ReplayBase::ReplayFrame>* frames)
+{
+    // Each frame uses more than 16 bytes
+    if (num_frames > data.size() / 16)
+        return false;
+    ChunkReader reader(data);
+    int64_t time = 0, distance = 0;
+    int64_t xyz[3] = { 0, 0, 0 };
+    frames->resize(num_frames);
+    for (ReplayBase::ReplayFrame& frame : *frames)
+    {
+        ReplayBase::TransformEvent& te = frame.m_transform_event;
+        ReplayBase::PhysicInfo& pi = frame.m_physic_info;
+        ReplayBase::BonusInfo& bi = frame.m_bonus_info;
+        ReplayBase::KartReplayEvent& kre = frame.m_kart_replay_event;
+
+        time += reader.getVarInt();
+        te.m_time = (float)(time / TIME_SCALE);
+        for (int j = 0; j < 3; j++)
+            xyz[j] += reader.getVarInt();
+        te.m_transform.setOrigin(btVector3((float)(xyz[0] / POSITION_SCALE),
+                                           (float)(xyz[1] / POSITION_SCALE),
+                                           (float)(xyz[2] / POSITION_SCALE)));
+        te.m_transform.setRotation(
+            MiniGLM::decompressbtQuaternion(reader.getUInt32()));
+
+        pi.m_speed = reader.getFloat16();
+        pi.m_steer = reader.getFloat16();
+        for (int j = 0; j < 4; j++)
+            pi.m_suspension_length[j] = reader.getFloat16();
+        pi.m_skidding_state = (int)reader.getVarInt();
+
+        bi.m_attachment    = (int)reader.getVarInt();
+        bi.m_nitro_amount  = reader.getFloat16();
+        bi.m_item_amount   = (int)reader.getVarInt();
+        bi.m_item_type     = (int)reader.getVarInt();
+        bi.m_special_value = (int)reader.getVarInt();
+
+        distance += reader.getVarInt();
+        kre.m_distance        = (float)(distance / POSITION_SCALE);
+        kre.m_nitro_usage     = (int)reader.getVarInt();
+        kre.m_skidding_effect = (int)reader.getVarInt();
+        uint8_t flags         = reader.getUInt8();
+        kre.m_zipper_usage    = (flags & 1) != 0;
+        kre.m_red_skidding    = (flags & 2) != 0;
+        kre.m_jumping         = (flags & 4) != 0;
+    }
+    return !reader.m_error && reader.isEnd();
+}   // decodeChunk
+
+// ----------------------------------------------------------------------------
+/** Writes a binary replay file.
+ *  \param frames The frames of each kart of the header.
+ */
+bool BinaryReplay::write(FILE* fd, const ReplayBase::ReplayHeader& header,
+                         const std::vector<std::vector<ReplayBase::ReplayFrame> >&
+                         frames)
+{
+    assert(frames.size() == header.m_kart_list.size());
+    assert(frames.size() == header.m_name_list.size());
+    assert(frames.size() == header.m_kart_color.size());
+
+    // Compress all chunks first, since the index is before them
+    std::vector<std::vector<uint8_t> > compressed;
+    std::vector<std::vector<ChunkInfo> > chunks(frames.size());
+    std::vector<uint8_t> raw;
+    uint32_t offset = 0;
+    for (unsigned int k = 0; k < frames.size(); k++)
+    {
+        for (unsigned int i = 0; i < frames[k].size(); i += CHUNK_FRAMES)
+        {
+            unsigned int n = std::min(CHUNK_FRAMES,
+                                      (unsigned int)frames[k].size() - i);
+            encodeChunk(frames[k].data() + i, n, &raw);
+            uLongf size = compressBound((uLong)raw.size());
+            compressed.emplace_back(size);
+            if (compress2(compressed.back().data(), &size, raw.data(),
+                          (uLong)raw.size(), Z_BEST_COMPRESSION) != Z_OK)
+            {
+                Log::error("BinaryReplay", "Can't compress replay chunk.");
+                return false;
+            }
+            compressed.back().resize(size);
+
+            ChunkInfo chunk;
+            chunk.m_offset          = offset;
+            chunk.m_compressed_size = (uint32_t)size;
+            chunk.m_raw_size        = (uint32_t)raw.size();
+            chunk.m_num_frames      = n;
+            chunks[k].push_back(chunk);
+            offset += (uint32_t)size;
+        }
+    }
+
+    BareNetworkString index(1024);
+    index.encodeString(header.m_stk_version)
+         .encodeString(header.m_track_name)
+         .encodeString(header.m_minor_mode)
+         .addUInt8(header.m_reverse ? 1 : 0)
+         .addUInt8((uint8_t)header.m_difficulty)
+         .addUInt16((uint16_t)header.m_laps)
+         .addFloat(header.m_min_time)
+         .addUInt64(header.m_replay_uid)
+         .addUInt8((uint8_t)frames.size());
+    for (unsigned int k = 0; k < frames.size(); k++)
+    {
+        index.encodeString(header.m_kart_list[k])
+             .encodeString(header.m_name_list[k])
+             .addFloat(header.m_kart_color[k])
+             .addUInt32((uint32_t)chunks[k].size());
+        for (const ChunkInfo& chunk : chunks[k])
+        {
+            index.addUInt32(chunk.m_offset).addUInt32(chunk.m_compressed_size)
+                 .addUInt32(chunk.m_raw_size).addUInt32(chunk.m_num_frames);
+        }
+    }
+    BareNetworkString sizes(8);
+    sizes.addUInt32(FORMAT_VERSION).addUInt32(index.getTotalSize());
+
+    bool ok = fwrite(MAGIC, 1, sizeof(MAGIC), fd) == sizeof(MAGIC) &&
+        fwrite(sizes.getData(), 1, sizes.getTotalSize(), fd) ==
+        sizes.getTotalSize() &&
+        fwrite(index.getData(), 1, index.getTotalSize(), fd) ==
+        index.getTotalSize();
+    for (unsigned int i = 0; ok && i < compressed.size(); i++)
+    {
+        ok = fwrite(compressed[i].data(), 1, compressed[i].size(), fd) ==
+            compressed[i].size();
+    }
+    if (!ok)
+        Log::error("BinaryReplay", "Can't write replay file.");
+    return ok;
+}   // write
+
+// ----------------------------------------------------------------------------
+void BinaryReplay::unitTesting()
+{
+    ReplayBase::ReplayHeader header;
+    header.m_track_name  = "sandtrack";
+    header.m_minor_mode  = "time-trial";
+    header.m_stk_version = L"1.4";
+    header.m_kart_list   = { "tux", "nolok" };
+    header.m_name_list   = { L"\u00e9l\u00e8ve", L"" };
+    header.m_kart_color  = { 0.5f, 0.0f };
+    header.m_reverse     = true;
+    header.m_difficulty  = 2;
+    header.m_laps        = 3;
+    header.m_replay_uid  = 0x123456789abcdefULL;
+    header.m_min_time    = 81.25f;
+
+    // A kart with several chunks, and one with less than a chunk
+    std::vector<std::vector<ReplayBase::ReplayFrame> > frames(2);
+    frames[0].resize(CHUNK_FRAMES * 2 + 17);
+    frames[1].resize(3);
+    for (unsigned int k = 0; k < frames.size(); k++)
+    {
+        for (unsigned int i = 0; i < frames[k].size(); i++)
+        {
+            ReplayBase::ReplayFrame& f = frames[k][i];
+            f.m_transform_event.m_time = i / 120.0f;
+            f.m_transform_event.m_transform = btTransform(
+                btQuaternion(btVector3(0.3f, 1, 0.1f).normalize(), i * 0.01f),
+                btVector3(-300.0f + i * 0.37f, 2.5f + k, 500.0f - i * 1.1f));
+            f.m_physic_info.m_speed = i * 0.1f;
+            f.m_physic_info.m_steer = -0.5f;
+            for (int j = 0; j < 4; j++)
+                f.m_physic_info.m_suspension_length[j] = 0.2f + j * 0.01f;
+            f.m_physic_info.m_skidding_state = i % 5;
+            f.m_bonus_info.m_attachment = i % 6;
+            f.m_bonus_info.m_nitro_amount = i * 0.01f;
+            f.m_bonus_info.m_item_amount = i % 3;
+            f.m_bonus_info.m_item_type = 11;
+            f.m_bonus_info.m_special_value = i / 100;
+            f.m_kart_replay_event.m_distance = i * 0.9f;
+            f.m_kart_replay_event.m_nitro_usage = i % 2;
+            f.m_kart_replay_event.m_zipper_usage = i % 3 == 0;
+            f.m_kart_replay_event.m_skidding_effect = i % 4;
+            f.m_kart_replay_event.m_red_skidding = i % 7 == 0;
+            f.m_kart_replay_event.m_jumping = i % 11 == 0;
+        }
+    }
+
+    FILE* fd = tmpfile();
+    if (!fd)
+    {
+        Log::warn("BinaryReplay", "Can't create a temporary file, "
+                  "skipping test.");
+        return;
+    }
+    bool ok = write(fd, header, frames);
+    assert(ok);
+    fflush(fd);
+    ok = isBinaryReplay(fd);
+    assert(ok);
+
+    ReplayBase::ReplayHeader read_header;
+    ok = readHeader(fd, &read_header);
+    assert(ok);
+    assert(read_header.m_track_name == header.m_track_name);
+    assert(read_header.m_minor_mode == header.m_minor_mode);
+    assert(read_header.m_stk_version == header.m_stk_version);
+    assert(read_header.m_kart_list == header.m_kart_list);
+    assert(read_header.m_name_list == header.m_name_list);
+    assert(read_header.m_kart_color == header.m_kart_color);
+    assert(read_header.m_reverse && read_header.m_difficulty == 2);
+    assert(read_header.m_laps == 3 && read_header.m_min_time == 81.25f);
+    assert(read_header.m_replay_uid == header.m_replay_uid);
+
+    BinaryReplay replay;
+    ok = replay.open(fd, &read_header);
+    assert(ok);
+    (void)ok;
+    std::vector<ReplayBase::ReplayFrame> chunk;
+    for (unsigned int k = 0; k < frames.size(); k++)
+    {
+        unsigned int n = 0;
+        while (replay.readNextChunk(k, &chunk))
+        {
+            assert(chunk.size() <= CHUNK_FRAMES);
+            for (const ReplayBase::ReplayFrame& f : chunk)
+            {
+                const ReplayBase::ReplayFrame& e = frames[k][n++];
+                assert(std::fabs(f.m_transform_event.m_time -
+                                 e.m_transform_event.m_time) < 0.0001f);
+                assert(f.m_transform_event.m_transform.getOrigin()
+                       .distance(e.m_transform_event.m_transform.getOrigin())
+                       < 0.001f);
+                assert(std::fabs(f.m_transform_event.m_transform.getRotation()
+                       .dot(e.m_transform_event.m_transform.getRotation()))
+                       > 0.999f);
+                assert(std::fabs(f.m_physic_info.m_speed -
+                                 e.m_physic_info.m_speed) < 0.05f);
+                assert(f.m_physic_info.m_steer == -0.5f);
+                assert(std::fabs(f.m_physic_info.m_suspension_length[3] -
+                                 0.23f) < 0.001f);
+                assert(f.m_physic_info.m_skidding_state ==
+                       e.m_physic_info.m_skidding_state);
+                assert(f.m_bonus_info.m_attachment ==
+                       e.m_bonus_info.m_attachment);
+                assert(std::fabs(f.m_bonus_info.m_nitro_amount -
+                                 e.m_bonus_info.m_nitro_amount) < 0.01f);
+                assert(f.m_bonus_info.m_item_amount ==
+                       e.m_bonus_info.m_item_amount);
+                assert(f.m_bonus_info.m_item_type == 11);
+                assert(f.m_bonus_info.m_special_value ==
+                       e.m_bonus_info.m_special_value);
+                assert(std::fabs(f.m_kart_replay_event.m_distance -
+                                 e.m_kart_replay_event.m_distance) < 0.001f);
+                assert(f.m_kart_replay_event.m_nitro_usage ==
+                       e.m_kart_replay_event.m_nitro_usage);
+                assert(f.m_kart_replay_event.m_zipper_usage ==
+                       e.m_kart_replay_event.m_zipper_usage);
+                assert(f.m_kart_replay_event.m_skidding_effect ==
+                       e.m_kart_replay_event.m_skidding_effect);
+                assert(f.m_kart_replay_event.m_red_skidding ==
+                       e.m_kart_replay_event.m_red_skidding);
+                assert(f.m_kart_replay_event.m_jumping ==
+                       e.m_kart_replay_event.m_jumping);
+                (void)f;
+                (void)e;
+            }
+        }
+        assert(n == frames[k].size() && replay.isEnd(k));
+    }
+    // The file is closed by replay
+}   // unitTesting
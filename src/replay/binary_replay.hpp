@@ -0,0 +1,112 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_BINARY_REPLAY_HPP
+#define HEADER_BINARY_REPLAY_HPP
+
+#include "replay/replay_base.hpp"
+#include "utils/no_copy.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+/** Reads and writes binary replay files. A file starts with a magic string,
+ *  the format version and the size of the index, followed by the index
+ *  (the ReplayHeader and the table of chunks of each kart), so listing
+ *  replays only reads the start of each file. The frames of each kart are
+ *  stored in zlib compressed chunks of up to CHUNK_FRAMES frames, in which
+ *  positions, distances and times are quantized and delta encoded, and
+ *  rotations and other floats are stored with 32 and 16 bits. Each chunk
+ *  can be decoded alone, so playing a replay reads the chunks as needed.
+ * \ingroup replay
+ */
+class BinaryReplay : public NoCopy
+{
+public:
+    /** The version of the binary format written. */
+    static const unsigned int FORMAT_VERSION = 5;
+
+    /** The maximum number of frames of a kart in a chunk. */
+    static const unsigned int CHUNK_FRAMES = 256;
+
+private:
+    struct ChunkInfo
+    {
+        /** Offset of the chunk from the end of the index. */
+        uint32_t m_offset;
+
+        uint32_t m_compressed_size;
+
+        uint32_t m_raw_size;
+
+        uint32_t m_num_frames;
+    };   // ChunkInfo
+
+    /** The file read, owned by this object. */
+    FILE* m_file;
+
+    /** Offset of the first chunk in the file. */
+    long m_data_start;
+
+    /** For each kart its chunks, in time order. */
+    std::vector<std::vector<ChunkInfo> > m_chunks;
+
+    /** For each kart the index of the next chunk to read. */
+    std::vector<unsigned int> m_next_chunk;
+
+    // ------------------------------------------------------------------------
+    static bool readIndex(FILE* fd, ReplayBase::ReplayHeader* header,
+                          std::vector<std::vector<ChunkInfo> >* chunks,
+                          long* data_start);
+    // ------------------------------------------------------------------------
+    static void encodeChunk(const ReplayBase::ReplayFrame* frames,
+                            unsigned int num_frames,
+                            std::vector<uint8_t>* out);
+    // ------------------------------------------------------------------------
+    static bool decodeChunk(const std::vector<uint8_t>& data,
+                            unsigned int num_frames,
+                            std::vector<ReplayBase::ReplayFrame>* frames);
+
+public:
+    BinaryReplay();
+    // ------------------------------------------------------------------------
+    ~BinaryReplay();
+    // ------------------------------------------------------------------------
+    static bool isBinaryReplay(FILE* fd);
+    // ------------------------------------------------------------------------
+    static bool readHeader(FILE* fd, ReplayBase::ReplayHeader* header);
+    // ------------------------------------------------------------------------
+    static bool write(FILE* fd, const ReplayBase::ReplayHeader& header,
+                      const std::vector<std::vector<ReplayBase::ReplayFrame> >&
+                      frames);
+    // ------------------------------------------------------------------------
+    bool open(FILE* fd, ReplayBase::ReplayHeader* header);
+    // ------------------------------------------------------------------------
+    bool readNextChunk(unsigned int kart,
+                       std::vector<ReplayBase::ReplayFrame>* frames);
+    // ------------------------------------------------------------------------
+    /** Returns true if all chunks of a kart were read. */
+    bool isEnd(unsigned int kart) const
+                  { return m_next_chunk.at(kart) >= m_chunks.at(kart).size(); }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // BinaryReplay
+
+#endif
@@ -34,7 +34,7 @@ FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file
 {
     FILE* fd = FileUtils::fopenU8Path(full_path ? getReplayFilename(replay_file_number) :
         file_manager->getReplayDir() + getReplayFilename(replay_file_number),
-        writeable ? "w" : "r");
+        writeable ? "wb" : "rb");
     if (!fd)
     {
         return NULL;
@@ -22,6 +22,8 @@
 #include "LinearMath/btTransform.h"
 #include "utils/no_copy.hpp"
 
+#include "irrString.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <string>
 #include <vector>
@@ -33,6 +35,26 @@ class ReplayBase : public NoCopy
 {
     // Needs access to KartReplayEvent
     friend class GhostKart;
+    // Needs access to ReplayFrame
+    friend class BinaryReplay;
+
+public:
+    /** The information about a replay stored before the kart data, used
+     *  to list replays. */
+    struct ReplayHeader
+    {
+        std::string                       m_track_name;
+        std::string                       m_minor_mode;
+        irr::core::stringw                m_stk_version;
+        std::vector<std::string>          m_kart_list;
+        std::vector<irr::core::stringw>   m_name_list;
+        std::vector<float>                m_kart_color; //no sorting for this
+        bool                              m_reverse;
+        unsigned int                      m_difficulty;
+        unsigned int                      m_laps;
+        uint64_t                          m_replay_uid; //no sorting for this
+        float                             m_min_time;
+    };   // ReplayHeader
 
 protected:
     /** Stores a transform event, i.e. a position and rotation of a kart
@@ -97,6 +119,16 @@ protected:
         bool        m_jumping;
     };   // KartReplayEvent
 
+    // ------------------------------------------------------------------------
+    /** All data recorded for a kart at a certain time. */
+    struct ReplayFrame
+    {
+        TransformEvent  m_transform_event;
+        PhysicInfo      m_physic_info;
+        BonusInfo       m_bonus_info;
+        KartReplayEvent m_kart_replay_event;
+    };   // ReplayFrame
+
     // ------------------------------------------------------------------------
     FILE *openReplayFile(bool writeable, bool full_path = false, int replay_file_number=1);
     // ------------------------------------------------------------------------
@@ -104,8 +136,13 @@ protected:
     virtual const std::string& getReplayFilename(int replay_file_number = 1) const = 0;
     // ------------------------------------------------------------------------
     /** Returns the version number of the replay file recorderd by this executable.
-     *  This is also used as a maximum supported version by this exexcutable. */
-    unsigned int getCurrentReplayVersion() const { return 4; }
+     *  This is also used as a maximum supported version by this exexcutable.
+     *  Version 5 and later are binary (see BinaryReplay). */
+    unsigned int getCurrentReplayVersion() const { return 5; }
+
+    // ------------------------------------------------------------------------
+    /** Returns the last version of the text replay files. */
+    unsigned int getLastTextReplayVersion() const { return 4; }
 
     // ------------------------------------------------------------------------
     /** This is used to check that a loaded replay file can still
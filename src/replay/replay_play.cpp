@@ -24,6 +24,7 @@
 #include "karts/controller/ghost_controller.hpp"
 #include "modes/world.hpp"
 #include "race/race_manager.hpp"
+#include "replay/binary_replay.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
 #include "utils/file_utils.hpp"
@@ -106,11 +107,9 @@ void ReplayPlay::loadAllReplayFile()
 //-----------------------------------------------------------------------------
 bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int call_index)
 {
-
-    char s[1024], s1[1024];
     if (StringUtils::getExtension(fn) != "replay") return false;
     FILE* fd = FileUtils::fopenU8Path(custom_replay ? fn :
-        file_manager->getReplayDir() + fn, "r");
+        file_manager->getReplayDir() + fn, "rb");
     if (fd == NULL) return false;
     ReplayData rd;
 
@@ -118,26 +117,81 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
     rd.m_custom_replay_file = custom_replay;
     rd.m_filename = fn;
 
+    bool valid;
+    if (BinaryReplay::isBinaryReplay(fd))
+    {
+        // Only the index at the start of the file is read
+        valid = BinaryReplay::readHeader(fd, &rd);
+        rd.m_replay_version = BinaryReplay::FORMAT_VERSION;
+        if (!valid)
+            Log::warn("Replay", "Skipped '%s'", fn.c_str());
+    }
+    else
+        valid = readTextHeader(fd, fn, &rd, call_index);
+    fclose(fd);
+    if (!valid)
+        return false;
+
+    // The first user is the game master and the "owner" of this replay file
+    if (!rd.m_name_list.empty())
+        rd.m_user_name = rd.m_name_list[0];
+
+    // If former official tracks are present as addons, show the matching replays.
+    if (rd.m_track_name.compare("greenvalley") == 0)
+        rd.m_track_name = std::string("addon_green-valley");
+    if (rd.m_track_name.compare("mansion") == 0)
+        rd.m_track_name = std::string("addon_blackhill-mansion");
+
+    Track* t = track_manager->getTrack(rd.m_track_name);
+    if (t == NULL)
+    {
+        Log::warn("Replay", "Track '%s' used in replay '%s' not found in STK!",
+        rd.m_track_name.c_str(), fn.c_str());
+        return false;
+    }
+
+    rd.m_track = t;
+
+    m_replay_file_list.push_back(rd);
+
+    assert(m_replay_file_list.size() > 0);
+    // Force to use custom replay file immediately
+    if (custom_replay)
+        m_current_replay_file = (unsigned int)m_replay_file_list.size() - 1;
+
+    return true;
+
+}   // addReplayFile
+
+//-----------------------------------------------------------------------------
+/** Reads the header of a text replay file (version 4 and older), leaving
+ *  the file at the start of the kart data.
+ *  \param fn The file name, for error messages.
+ *  \param call_index Used as UID of replays without one.
+ */
+bool ReplayPlay::readTextHeader(FILE *fd, const std::string& fn,
+                                ReplayData* rd, int call_index)
+{
+    char s[1024], s1[1024];
+
     fgets(s, 1023, fd);
     unsigned int version;
     if (sscanf(s,"version: %u", &version) != 1)
     {
         Log::warn("Replay", "No Version information "
                   "found in replay file (bogus replay file).");
-        fclose(fd);
         return false;
     }
-    if (version > getCurrentReplayVersion() ||
+    if (version > getLastTextReplayVersion() ||
         version < getMinSupportedReplayVersion() )
     {
         Log::warn("Replay", "Replay is version '%d'", version);
-        Log::warn("Replay", "STK replay version is '%d'", getCurrentReplayVersion());
+        Log::warn("Replay", "STK replay version is '%d'", getLastTextReplayVersion());
         Log::warn("Replay", "Minimum supported replay version is '%d'", getMinSupportedReplayVersion());
         Log::warn("Replay", "Skipped '%s'", fn.c_str());
-        fclose(fd);
         return false;
     }
-        rd.m_replay_version = version;
+    rd->m_replay_version = version;
 
     if (version >= 4)
     {
@@ -145,13 +199,12 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
         if(sscanf(s, "stk_version: %1023s", s1) != 1)
         {
             Log::warn("Replay", "No STK release version found in replay file, '%s'.", fn.c_str());
-            fclose(fd);
             return false;
         }
-        rd.m_stk_version = s1;
+        rd->m_stk_version = s1;
     }
     else
-        rd.m_stk_version = "";
+        rd->m_stk_version = "";
 
     while(true)
     {
@@ -162,28 +215,23 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
         char s1[1024];
         char display_name_encoded[1024];
 
-        int scanned = sscanf(s,"kart: %1023s %1023[^\n]", s1, display_name_encoded);
+        int scanned = sscanf(s,"kart: %1023s %1023[^\r\n]", s1, display_name_encoded);
         if (scanned < 1)
         {
             Log::warn("Replay", "Could not read ghost karts info!");
             break;
         }
 
-        rd.m_kart_list.push_back(std::string(s1));
+        rd->m_kart_list.push_back(std::string(s1));
         if (scanned == 2)
         {
             // If username of kart is present, use it
-            rd.m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
-            if (rd.m_name_list.size() == 1)
-            {
-                // First user is the game master and the "owner" of this replay file
-                rd.m_user_name = rd.m_name_list[0];
-            }
+            rd->m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
         } else
         { // scanned == 1
             // If username is not present, kart display name will default to kart name
             // (see GhostController::getName)
-            rd.m_name_list.push_back("");
+            rd->m_name_list.push_back("");
         }
 
         // Read kart color data
@@ -194,13 +242,12 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
             if(sscanf(s, "kart_color: %f", &f) != 1)
             {
                 Log::warn("Replay", "Kart color missing in replay file, '%s'.", fn.c_str());
-                fclose(fd);
                 return false;
             }
-            rd.m_kart_color.push_back(f);
+            rd->m_kart_color.push_back(f);
         }
         else
-            rd.m_kart_color.push_back(0.0f); // Use default kart color
+            rd->m_kart_color.push_back(0.0f); // Use default kart color
     }
 
     int reverse = 0;
@@ -208,16 +255,14 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
     if(sscanf(s, "reverse: %d", &reverse) != 1)
     {
         Log::warn("Replay", "No reverse info found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
-    rd.m_reverse = reverse != 0;
+    rd->m_reverse = reverse != 0;
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "difficulty: %u", &rd.m_difficulty) != 1)
+    if (sscanf(s, "difficulty: %u", &rd->m_difficulty) != 1)
     {
         Log::warn("Replay", " No difficulty found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
 
@@ -227,83 +272,52 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
         if (sscanf(s, "mode: %1023s", s1) != 1)
         {
             Log::warn("Replay", "Replay mode not found in replay file, '%s'.", fn.c_str());
-            fclose(fd);
             return false;
         }
-        rd.m_minor_mode = s1;
+        rd->m_minor_mode = s1;
     }
     // Assume time-trial mode for old replays
     else
-        rd.m_minor_mode = "time-trial";
+        rd->m_minor_mode = "time-trial";
 
 
     fgets(s, 1023, fd);
     if (sscanf(s, "track: %1023s", s1) != 1)
     {
         Log::warn("Replay", "Track info not found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
-        return false;
-    }
-    rd.m_track_name = std::string(s1);
-
-    // If former official tracks are present as addons, show the matching replays.
-    if (rd.m_track_name.compare("greenvalley") == 0)
-        rd.m_track_name = std::string("addon_green-valley");
-    if (rd.m_track_name.compare("mansion") == 0)
-        rd.m_track_name = std::string("addon_blackhill-mansion");
-
-    Track* t = track_manager->getTrack(rd.m_track_name);
-    if (t == NULL)
-    {
-        Log::warn("Replay", "Track '%s' used in replay '%s' not found in STK!",
-        rd.m_track_name.c_str(), fn.c_str());
-        fclose(fd);
         return false;
     }
-
-    rd.m_track = t;
+    rd->m_track_name = std::string(s1);
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "laps: %u", &rd.m_laps) != 1)
+    if (sscanf(s, "laps: %u", &rd->m_laps) != 1)
     {
         Log::warn("Replay", "No number of laps found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
 
     fgets(s, 1023, fd);
-    if (sscanf(s, "min_time: %f", &rd.m_min_time) != 1)
+    if (sscanf(s, "min_time: %f", &rd->m_min_time) != 1)
     {
         Log::warn("Replay", "Finish time not found in replay file, '%s'.", fn.c_str());
-        fclose(fd);
         return false;
     }
 
     if (version >= 4)
     {
         fgets(s, 1023, fd);
-        if (sscanf(s, "replay_uid: %" PRIu64, &rd.m_replay_uid) != 1)
+        if (sscanf(s, "replay_uid: %" PRIu64, &rd->m_replay_uid) != 1)
         {
             Log::warn("Replay", "Replay UID not found in replay file, '%s'.", fn.c_str());
-            fclose(fd);
             return false;
         }
     }
     // No UID in old replay format
     else
-        rd.m_replay_uid = call_index;
-
-    fclose(fd);
-    m_replay_file_list.push_back(rd);
-
-    assert(m_replay_file_list.size() > 0);
-    // Force to use custom replay file immediately
-    if (custom_replay)
-        m_current_replay_file = (unsigned int)m_replay_file_list.size() - 1;
+        rd->m_replay_uid = call_index;
 
     return true;
-
-}   // addReplayFile
+}   // readTextHeader
 
 //-----------------------------------------------------------------------------
 void ReplayPlay::load()
@@ -343,6 +357,26 @@ void ReplayPlay::loadFile(bool second_replay)
     ReplayData &rd = m_replay_file_list[replay_index];
     unsigned int num_kart = (unsigned int)m_replay_file_list.at(replay_index)
                                                             .m_kart_list.size();
+
+    if (rd.m_replay_version >= BinaryReplay::FORMAT_VERSION)
+    {
+        // The ghost karts read the frames while playing, and close the
+        // file when the last of them is deleted
+        std::shared_ptr<BinaryReplay> replay = std::make_shared<BinaryReplay>();
+        ReplayHeader header;
+        if (!replay->open(fd, &header) ||
+            header.m_kart_list.size() != num_kart)
+        {
+            Log::error("Replay", "Can't read '%s', ghost replay disabled.",
+                        getReplayFilename(replay_file_number).c_str());
+            destroy();
+            return;
+        }
+        for (unsigned int k = 0; k < num_kart; k++)
+            createGhostKart(second_replay)->setReplayStream(replay, k);
+        return;
+    }
+
     unsigned int lines_to_skip = (rd.m_replay_version == 3) ? 7 : 10;
     lines_to_skip += (rd.m_replay_version == 3) ? num_kart : 2*num_kart;
 
@@ -362,13 +396,10 @@ void ReplayPlay::loadFile(bool second_replay)
 }   // loadFile
 
 //-----------------------------------------------------------------------------
-/** Reads all data from a replay file for a specific kart.
- *  \param fd The file descriptor from which to read.
+/** Creates the next ghost kart of a replay file, without any replay data.
  */
-void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
+std::shared_ptr<GhostKart> ReplayPlay::createGhostKart(bool second_replay)
 {
-    char s[1024];
-
     int replay_index = second_replay ? m_second_replay_file
                                      : m_current_replay_file;
 
@@ -380,129 +411,223 @@ void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
                                                              .m_kart_list.size();
 
     ReplayData &rd = m_replay_file_list[replay_index];
-    m_ghost_karts.push_back(std::make_shared<GhostKart>
+    std::shared_ptr<GhostKart> ghost = std::make_shared<GhostKart>
         (rd.m_kart_list.at(kart_num-first_loaded_f_num), kart_num, kart_num + 1,
-        rd.m_kart_color.at(kart_num-first_loaded_f_num)));
-    m_ghost_karts[kart_num]->init(RaceManager::KT_GHOST);
-    Controller* controller = new GhostController(getGhostKart(kart_num).get(),
+        rd.m_kart_color.at(kart_num-first_loaded_f_num));
+    m_ghost_karts.push_back(ghost);
+    ghost->init(RaceManager::KT_GHOST);
+    Controller* controller = new GhostController(ghost.get(),
                                                  rd.m_name_list[kart_num-first_loaded_f_num]);
-    getGhostKart(kart_num)->setController(controller);
+    ghost->setController(controller);
+    return ghost;
+}   // createGhostKart
+
+//-----------------------------------------------------------------------------
+/** Reads all data from a text replay file for a specific kart.
+ *  \param fd The file descriptor from which to read.
+ */
+void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
+{
+    char s[1024];
+
+    int replay_index = second_replay ? m_second_replay_file
+                                     : m_current_replay_file;
+
+    const unsigned int kart_num = (unsigned int)m_ghost_karts.size();
+    ReplayData &rd = m_replay_file_list[replay_index];
+    std::shared_ptr<GhostKart> ghost = createGhostKart(second_replay);
 
     unsigned int size;
     if(sscanf(next_line,"size: %u",&size)!=1)
         Log::fatal("Replay", "Number of records not found in replay file "
             "for kart %d.", kart_num);
 
+    ReplayFrame frame;
     for(unsigned int i=0; i<size; i++)
     {
         fgets(s, 1023, fd);
-        float x, y, z, rx, ry, rz, rw, time, speed, steer, w1, w2, w3, w4, nitro_amount, distance;
-        int skidding_state, attachment, item_amount, item_type, special_value,
-            nitro, zipper, skidding, red_skidding, jumping;
-
-        // Check for EV_TRANSFORM event:
-        // -----------------------------
-
-        // Up to STK 0.9.3 replays
-        if (rd.m_replay_version == 3)
+        if (readTextFrame(s, rd.m_replay_version, &frame))
         {
-            if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f  %d %d %d %d %d\n",
-                &time,
-                &x, &y, &z,
-                &rx, &ry, &rz, &rw,
-                &speed, &steer, &w1, &w2, &w3, &w4,
-                &nitro, &zipper, &skidding, &red_skidding, &jumping
-                )==19)
-            {
-                btQuaternion q(rx, ry, rz, rw);
-                btVector3 xyz(x, y, z);
-                PhysicInfo pi             = {0};
-                BonusInfo bi              = {0};
-                KartReplayEvent kre       = {0};
-
-                pi.m_speed                = speed;
-                pi.m_steer                = steer;
-                pi.m_suspension_length[0] = w1;
-                pi.m_suspension_length[1] = w2;
-                pi.m_suspension_length[2] = w3;
-                pi.m_suspension_length[3] = w4;
-                pi.m_skidding_state       = 0;    //not saved in version 3 replays
-                bi.m_attachment           = 0;    //not saved in version 3 replays
-                bi.m_nitro_amount         = 0;    //not saved in version 3 replays
-                bi.m_item_amount          = 0;    //not saved in version 3 replays
-                bi.m_item_type            = 0;    //not saved in version 3 replays
-                bi.m_special_value        = 0;    //not saved in version 3 replays
-                kre.m_distance            = 0.0f; //not saved in version 3 replays
-                kre.m_nitro_usage         = nitro;
-                kre.m_zipper_usage        = zipper!=0;
-                kre.m_skidding_effect     = skidding;
-                kre.m_red_skidding        = red_skidding!=0;
-                kre.m_jumping             = jumping != 0;
-                m_ghost_karts[kart_num]->addReplayEvent(time,
-                    btTransform(q, xyz), pi, bi, kre);
-            }
-            else
-            {
-                // Invalid record found
-                // ---------------------
-                Log::warn("Replay", "Can't read replay data line %d:", i);
-                Log::warn("Replay", "%s", s);
-                Log::warn("Replay", "Ignored.");
-            }
+            ghost->addReplayEvent(frame.m_transform_event.m_time,
+                frame.m_transform_event.m_transform, frame.m_physic_info,
+                frame.m_bonus_info, frame.m_kart_replay_event);
         }
-
-        //version 4 replays (STK 0.9.4 and higher)
         else
         {
-            if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
-                &time,
-                &x, &y, &z,
-                &rx, &ry, &rz, &rw,
-                &speed, &steer, &w1, &w2, &w3, &w4, &skidding_state,
-                &attachment, &nitro_amount, &item_amount, &item_type, &special_value,
-                &distance, &nitro, &zipper, &skidding, &red_skidding, &jumping
-                )==26)
-            {
-                btQuaternion q(rx, ry, rz, rw);
-                btVector3 xyz(x, y, z);
-                PhysicInfo pi             = {0};
-                BonusInfo bi              = {0};
-                KartReplayEvent kre       = {0};
-
-                pi.m_speed                = speed;
-                pi.m_steer                = steer;
-                pi.m_suspension_length[0] = w1;
-                pi.m_suspension_length[1] = w2;
-                pi.m_suspension_length[2] = w3;
-                pi.m_suspension_length[3] = w4;
-                pi.m_skidding_state       = skidding_state;
-                bi.m_attachment           = attachment;
-                bi.m_nitro_amount         = nitro_amount;
-                bi.m_item_amount          = item_amount;
-                bi.m_item_type            = item_type;
-                bi.m_special_value        = special_value;
-                kre.m_distance            = distance;
-                kre.m_nitro_usage         = nitro;
-                kre.m_zipper_usage        = zipper!=0;
-                kre.m_skidding_effect     = skidding;
-                kre.m_red_skidding        = red_skidding!=0;
-                kre.m_jumping             = jumping != 0;
-                m_ghost_karts[kart_num]->addReplayEvent(time,
-                    btTransform(q, xyz), pi, bi, kre);
-            }
-            else
-            {
-                // Invalid record found
-                // ---------------------
-                Log::warn("Replay", "Can't read replay data line %d:", i);
-                Log::warn("Replay", "%s", s);
-                Log::warn("Replay", "Ignored.");
-            }
+            // Invalid record found
+            // ---------------------
+            Log::warn("Replay", "Can't read replay data line %d:", i);
+            Log::warn("Replay", "%s", s);
+            Log::warn("Replay", "Ignored.");
         }
     }   // for i
 
 }   // readKartData
 
+//-----------------------------------------------------------------------------
+/** Parses a line of kart data of a text replay file.
+ *  \param version The version of the replay file.
+ *  \return False if the line is invalid.
+ */
+bool ReplayPlay::readTextFrame(const char *line, unsigned int version,
+                               ReplayFrame* frame)
+{
+    float x, y, z, rx, ry, rz, rw, time, speed, steer, w1, w2, w3, w4, nitro_amount, distance;
+    int skidding_state, attachment, item_amount, item_type, special_value,
+        nitro, zipper, skidding, red_skidding, jumping;
+
+    // Up to STK 0.9.3 replays
+    if (version == 3)
+    {
+        if (sscanf(line, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f  %d %d %d %d %d\n",
+            &time,
+            &x, &y, &z,
+            &rx, &ry, &rz, &rw,
+            &speed, &steer, &w1, &w2, &w3, &w4,
+            &nitro, &zipper, &skidding, &red_skidding, &jumping
+            ) != 19)
+            return false;
+        skidding_state = 0;    //not saved in version 3 replays
+        attachment     = 0;    //not saved in version 3 replays
+        nitro_amount   = 0;    //not saved in version 3 replays
+        item_amount    = 0;    //not saved in version 3 replays
+        item_type      = 0;    //not saved in version 3 replays
+        special_value  = 0;    //not saved in version 3 replays
+        distance       = 0.0f; //not saved in version 3 replays
+    }
+    //version 4 replays (STK 0.9.4 and higher)
+    else
+    {
+        if (sscanf(line, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
+            &time,
+            &x, &y, &z,
+            &rx, &ry, &rz, &rw,
+            &speed, &steer, &w1, &w2, &w3, &w4, &skidding_state,
+            &attachment, &nitro_amount, &item_amount, &item_type, &special_value,
+            &distance, &nitro, &zipper, &skidding, &red_skidding, &jumping
+            ) != 26)
+            return false;
+    }
+
+    frame->m_transform_event.m_time = time;
+    frame->m_transform_event.m_transform =
+        btTransform(btQuaternion(rx, ry, rz, rw), btVector3(x, y, z));
+
+    PhysicInfo& pi            = frame->m_physic_info;
+    BonusInfo& bi             = frame->m_bonus_info;
+    KartReplayEvent& kre      = frame->m_kart_replay_event;
+    pi.m_speed                = speed;
+    pi.m_steer                = steer;
+    pi.m_suspension_length[0] = w1;
+    pi.m_suspension_length[1] = w2;
+    pi.m_suspension_length[2] = w3;
+    pi.m_suspension_length[3] = w4;
+    pi.m_skidding_state       = skidding_state;
+    bi.m_attachment           = attachment;
+    bi.m_nitro_amount         = nitro_amount;
+    bi.m_item_amount          = item_amount;
+    bi.m_item_type            = item_type;
+    bi.m_special_value        = special_value;
+    kre.m_distance            = distance;
+    kre.m_nitro_usage         = nitro;
+    kre.m_zipper_usage        = zipper!=0;
+    kre.m_skidding_effect     = skidding;
+    kre.m_red_skidding        = red_skidding!=0;
+    kre.m_jumping             = jumping != 0;
+    return true;
+}   // readTextFrame
+
+//-----------------------------------------------------------------------------
+/** Converts a text replay file to the binary format. The text file is kept
+ *  with an additional ".txt" extension, so it is not listed anymore.
+ *  \param full_path Full path of the replay file.
+ *  \return True if the file was converted.
+ */
+bool ReplayPlay::convertTextReplay(const std::string& full_path)
+{
+    FILE *fd = FileUtils::fopenU8Path(full_path, "rb");
+    if (!fd)
+        return false;
+    ReplayData rd;
+    if (BinaryReplay::isBinaryReplay(fd) ||
+        !readTextHeader(fd, full_path, &rd, 0))
+    {
+        fclose(fd);
+        return false;
+    }
+
+    // Don't trust the number of records: older versions saved the number
+    // of recorded transforms even when it was more than the maximum saved
+    std::vector<std::vector<ReplayFrame> > frames;
+    char s[1024];
+    unsigned int size;
+    ReplayFrame frame;
+    while (fgets(s, 1023, fd))
+    {
+        if (sscanf(s, "size: %u", &size) == 1)
+            frames.emplace_back();
+        else if (!frames.empty() &&
+                 readTextFrame(s, rd.m_replay_version, &frame))
+            frames.back().push_back(frame);
+    }
+    fclose(fd);
+    if (frames.size() != rd.m_kart_list.size())
+    {
+        Log::warn("Replay", "Kart data missing in replay file '%s'.",
+                  full_path.c_str());
+        return false;
+    }
+
+    // Write a temporary file first, so a failure can't lose the replay
+    const std::string tmp = full_path + ".tmp";
+    fd = FileUtils::fopenU8Path(tmp, "wb");
+    if (!fd)
+    {
+        Log::error("Replay", "Can't open '%s' for writing.", tmp.c_str());
+        return false;
+    }
+    bool written = BinaryReplay::write(fd, rd, frames);
+    written = fclose(fd) == 0 && written;
+    if (!written ||
+        FileUtils::renameU8Path(full_path, full_path + ".txt") != 0)
+    {
+        Log::error("Replay", "Can't convert replay file '%s'.",
+                   full_path.c_str());
+        file_manager->removeFile(tmp);
+        return false;
+    }
+    if (FileUtils::renameU8Path(tmp, full_path) != 0)
+    {
+        Log::error("Replay", "Can't rename '%s' to '%s', the text replay is "
+                   "in '%s.txt'.", tmp.c_str(), full_path.c_str(),
+                   full_path.c_str());
+        return false;
+    }
+    return true;
+}   // convertTextReplay
+
+//-----------------------------------------------------------------------------
+/** Converts all text replay files recorded by users to the binary format.
+ */
+void ReplayPlay::convertTextReplays()
+{
+    std::set<std::string> files;
+    file_manager->listFiles(files, file_manager->getReplayDir(),
+        /*is_full_path*/ true);
+
+    unsigned int converted = 0, total = 0;
+    for (const std::string& file : files)
+    {
+        if (StringUtils::getExtension(file) != "replay")
+            continue;
+        total++;
+        if (convertTextReplay(file))
+            converted++;
+    }
+    Log::info("Replay", "Converted %d of %d replay files in '%s'.",
+              converted, total, file_manager->getReplayDir().c_str());
+}   // convertTextReplays
+
 //-----------------------------------------------------------------------------
 /** call getReplayIdByUID and set the current replay file to the first one
  *  with a matching UID.
@@ -53,25 +53,14 @@ public:
         SO_VERSION
     };
 
-    class ReplayData
+    class ReplayData : public ReplayHeader
     {
     public:
         std::string                m_filename;
-        std::string                m_track_name;
         Track*                     m_track;
-        std::string                m_minor_mode;
-        core::stringw              m_stk_version;
         core::stringw              m_user_name;
-        std::vector<std::string>   m_kart_list;
-        std::vector<core::stringw> m_name_list;
-        std::vector<float>         m_kart_color; //no sorting for this
-        bool                       m_reverse;
         bool                       m_custom_replay_file;
-        unsigned int               m_difficulty;
-        unsigned int               m_laps;
         unsigned int               m_replay_version; //no sorting for this
-        uint64_t                   m_replay_uid; //no sorting for this
-        float                      m_min_time;
 
         bool operator < (const ReplayData& r) const
         {
@@ -125,11 +114,18 @@ private:
           ReplayPlay();
          ~ReplayPlay();
     void  readKartData(FILE *fd, char *next_line, bool second_replay);
+    bool  readTextHeader(FILE *fd, const std::string& fn, ReplayData* rd,
+                         int call_index);
+    static bool readTextFrame(const char *line, unsigned int version,
+                              ReplayFrame* frame);
+    std::shared_ptr<GhostKart> createGhostKart(bool second_replay);
 public:
     void  reset();
     void  load();
     void  loadFile(bool second_replay);
     void  loadAllReplayFile();
+    bool  convertTextReplay(const std::string& full_path);
+    void  convertTextReplays();
     // ------------------------------------------------------------------------
     static void        setSortOrder(SortOrder so)       { m_sort_order = so; }
     // ------------------------------------------------------------------------
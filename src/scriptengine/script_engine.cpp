@@ -44,6 +44,7 @@ extern "C"
 #include "utils/file_utils.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/profiler.hpp"
+#include "utils/time.hpp"
 
 
 using namespace Scripting;
@@ -52,6 +53,13 @@ namespace Scripting
 {
     const char* MODULE_ID_MAIN_SCRIPT_FILE = "main";
 
+    /** A script function taking longer than this (in seconds) is reported,
+     *  since most are called from the physics update. */
+    const double FUNCTION_TIME_BUDGET = 0.001;
+
+    /** Maximum number of unused contexts kept for later calls. */
+    const unsigned MAX_POOLED_CONTEXTS = 8;
+
     void AngelScript_ErrorCallback (const asSMessageInfo *msg, void *param)
     {
         const char *type = "ERR ";
@@ -86,6 +94,9 @@ namespace Scripting
     {
         // Release the engine
         m_pending_timeouts.clearAndDeleteAll();
+        for (asIScriptContext* ctx : m_context_pool)
+            ctx->Release();
+        m_context_pool.clear();
         m_engine->DiscardModule(MODULE_ID_MAIN_SCRIPT_FILE);
         m_engine->Release();
     }
@@ -188,11 +199,12 @@ namespace Scripting
             return;
         }
 
-        asIScriptContext *ctx = m_engine->CreateContext();
+        asIScriptContext *ctx = requestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "evalScript: Failed to create the context.");
             //m_engine->Release();
+            func->Release();
             return;
         }
 
@@ -200,7 +212,8 @@ namespace Scripting
         if (r < 0)
         {
             Log::error("Scripting", "evalScript: Failed to prepare the context.");
-            ctx->Release();
+            returnContext(ctx);
+            func->Release();
             return;
         }
 
@@ -223,7 +236,7 @@ namespace Scripting
             }
         }
 
-        ctx->Release();
+        returnContext(ctx);
         func->Release();
     }
 
@@ -231,7 +244,7 @@ namespace Scripting
 
     void ScriptEngine::runDelegate(asIScriptFunction* delegate)
     {
-        asIScriptContext *ctx = m_engine->CreateContext();
+        asIScriptContext *ctx = requestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "runMethod: Failed to create the context.");
@@ -243,7 +256,7 @@ namespace Scripting
         if (r < 0)
         {
             Log::error("Scripting", "runMethod: Failed to prepare the context.");
-            ctx->Release();
+            returnContext(ctx);
             return;
         }
 
@@ -268,7 +281,7 @@ namespace Scripting
             }
         }
 
-        ctx->Release();
+        returnContext(ctx);
     }
 
     //-----------------------------------------------------------------------------
@@ -350,69 +363,122 @@ namespace Scripting
         std::function<void(asIScriptContext*)> callback,
         std::function<void(asIScriptContext*)> get_return_value)
     {
-        int r; //int for error checking
-
-        asIScriptFunction *func;
+        int handle = getFunctionHandle(warn_if_not_found, function_name);
+        callFunction(handle,
+            [&callback](asIScriptContext* ctx)
+            {
+                if (callback)
+                    callback(ctx);
+            },
+            [&get_return_value](asIScriptContext* ctx)
+            {
+                if (get_return_value)
+                    get_return_value(ctx);
+            });
+    }
 
-        // TODO: allow splitting in multiple files
-        std::string script_filename = "scripting.as";
-        auto cached_function = m_functions_cache.find(function_name);
-        if (cached_function == m_functions_cache.end())
-        {
-            // Find the function for the function we want to execute.
-            //      This is how you call a normal function with arguments
-            //      asIScriptFunction *func = engine->GetModule(0)->GetFunctionByDecl("void func(arg1Type, arg2Type)");
-            asIScriptModule* module = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE);
+    //-----------------------------------------------------------------------------
+    /** Finds a function of the main module, so that it can be called without
+     *  looking it up each time. Handles stay valid until cleanupCache().
+     *  \param function_name The declaration of the function, e.g.
+     *         "void onKartKartCollision(int, int)".
+     *  \return The handle of the function, or NO_FUNCTION if not found.
+     */
+    int ScriptEngine::getFunctionHandle(bool warn_if_not_found,
+                                        const std::string& function_name)
+    {
+        auto cached_function = m_function_handles.find(function_name);
+        if (cached_function != m_function_handles.end())
+            return cached_function->second;
 
-            if (module == NULL)
-            {
-#ifndef SERVER_ONLY
-                if (warn_if_not_found)
-                    Log::warn("Scripting", "Scripting function was not found : %s (module not found)", function_name.c_str());
-                else
-                    Log::debug("Scripting", "Scripting function was not found : %s (module not found)", function_name.c_str());
-#endif
-                m_functions_cache[function_name] = NULL; // remember that this function is unavailable
-                return;
-            }
+        // Find the function for the function we want to execute.
+        //      This is how you call a normal function with arguments
+        //      asIScriptFunction *func = engine->GetModule(0)->GetFunctionByDecl("void func(arg1Type, arg2Type)");
+        asIScriptModule* module = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE);
 
-            func = module->GetFunctionByDecl(function_name.c_str());
-            
-            if (func == NULL)
-            {
+        if (module == NULL)
+        {
 #ifndef SERVER_ONLY
-                if (warn_if_not_found)
-                    Log::warn("Scripting", "Scripting function was not found : %s", function_name.c_str());
-                else
-                    Log::debug("Scripting", "Scripting function was not found : %s", function_name.c_str());
+            if (warn_if_not_found)
+                Log::warn("Scripting", "Scripting function was not found : %s (module not found)", function_name.c_str());
+            else
+                Log::debug("Scripting", "Scripting function was not found : %s (module not found)", function_name.c_str());
 #endif
-                m_functions_cache[function_name] = NULL; // remember that this function is unavailable
-                return;
-            }
-
-            m_functions_cache[function_name] = func;
-            func->AddRef();
-        }
-        else
-        {
-            // Script present in cache
-            func = cached_function->second;
+            m_function_handles[function_name] = NO_FUNCTION; // remember that this function is unavailable
+            return NO_FUNCTION;
         }
 
+        asIScriptFunction *func = module->GetFunctionByDecl(function_name.c_str());
+
         if (func == NULL)
         {
+#ifndef SERVER_ONLY
             if (warn_if_not_found)
                 Log::warn("Scripting", "Scripting function was not found : %s", function_name.c_str());
-            return; // function unavailable
+            else
+                Log::debug("Scripting", "Scripting function was not found : %s", function_name.c_str());
+#endif
+            m_function_handles[function_name] = NO_FUNCTION; // remember that this function is unavailable
+            return NO_FUNCTION;
+        }
+
+        func->AddRef();
+        ScriptFunction sf;
+        sf.m_declaration = function_name;
+        sf.m_function    = func;
+        sf.m_profiler_marker = profiler.registerMarker(function_name.c_str(),
+            video::SColor(0xFF, 0xFF, 0x80, 0x00));
+        sf.m_calls       = 0;
+        sf.m_total_time  = 0.0;
+        sf.m_max_time    = 0.0;
+        int handle = (int)m_functions.size();
+        m_functions.push_back(sf);
+        m_function_handles[function_name] = handle;
+        return handle;
+    }
+
+    //-----------------------------------------------------------------------------
+    /** Returns an unused context, from the pool if possible. */
+    asIScriptContext* ScriptEngine::requestContext()
+    {
+        if (m_context_pool.empty())
+            return m_engine->CreateContext();
+        asIScriptContext* ctx = m_context_pool.back();
+        m_context_pool.pop_back();
+        return ctx;
+    }
+
+    //-----------------------------------------------------------------------------
+    /** Puts a context back in the pool after use (script functions can call
+     *  other script functions, so more than one can be in use).
+     */
+    void ScriptEngine::returnContext(asIScriptContext* ctx)
+    {
+        if (m_context_pool.size() >= MAX_POOLED_CONTEXTS)
+        {
+            ctx->Release();
+            return;
         }
+        ctx->Unprepare();
+        m_context_pool.push_back(ctx);
+    }
+
+    //-----------------------------------------------------------------------------
+    /** Returns a context prepared to run the function, or NULL if it can't
+     *  be run.
+     */
+    asIScriptContext* ScriptEngine::prepareFunction(int handle)
+    {
+        if (handle < 0 || handle >= (int)m_functions.size())
+            return NULL; // function unavailable
 
         // Create a context that will execute the script.
-        asIScriptContext *ctx = m_engine->CreateContext();
+        asIScriptContext *ctx = requestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "Failed to create the context.");
             //m_engine->Release();
-            return;
+            return NULL;
         }
 
         // Prepare the script context with the function we wish to execute. Prepare()
@@ -420,24 +486,50 @@ namespace Scripting
         // executed. Note, that if because we intend to execute the same function 
         // several times, we will store the function returned by 
         // GetFunctionByDecl(), so that this relatively slow call can be skipped.
-        r = ctx->Prepare(func);
+        int r = ctx->Prepare(m_functions[handle].m_function);
         if (r < 0)
         {
             Log::error("Scripting", "Failed to prepare the context.");
-            ctx->Release();
+            returnContext(ctx);
             //m_engine->Release();
-            return;
+            return NULL;
         }
 
         // Here, we can pass parameters to the script functions. 
         //ctx->setArgType(index, value);
         //for example : ctx->SetArgFloat(0, 3.14159265359f);
+        return ctx;
+    }
 
-        if (callback)
-            callback(ctx);
+    //-----------------------------------------------------------------------------
+    /** Executes a context returned by prepareFunction, and records the time
+     *  it took for the function (shown in the profiler too).
+     *  \return True if the function finished, so its return value can be
+     *          read from the context.
+     */
+    bool ScriptEngine::executeFunction(int handle, asIScriptContext* ctx)
+    {
+        profiler.pushCPUMarker(m_functions[handle].m_profiler_marker);
+        double start = StkTime::getRealTime();
 
         // Execute the function
-        r = ctx->Execute();
+        int r = ctx->Execute();
+
+        double duration = StkTime::getRealTime() - start;
+        PROFILER_POP_CPU_MARKER();
+        // m_functions can have grown if the script looked up new functions
+        ScriptFunction& f = m_functions[handle];
+        f.m_calls++;
+        f.m_total_time += duration;
+        if (duration > FUNCTION_TIME_BUDGET && f.m_max_time <= FUNCTION_TIME_BUDGET)
+        {
+            Log::warn("Scripting", "%s took %.2f ms, more than the %.2f ms "
+                "a script function should take.", f.m_declaration.c_str(),
+                duration * 1000.0, FUNCTION_TIME_BUDGET * 1000.0);
+        }
+        if (duration > f.m_max_time)
+            f.m_max_time = duration;
+
         if (r != asEXECUTION_FINISHED)
         {
             // The execution didn't finish as we had planned. Determine why.
@@ -461,31 +553,33 @@ namespace Scripting
             {
                 Log::error("Scripting", "The script ended for some unforeseen reason (%i)", r);
             }
+            return false;
         }
-        else
-        {
-            // Retrieve the return value from the context here (for scripts that return values)
-            // <type> returnValue = ctx->getReturnType(); for example
-            //float returnValue = ctx->GetReturnFloat();
-
-            if (get_return_value)
-                get_return_value(ctx);
-        }
-
-        // We must release the contexts when no longer using them
-        ctx->Release();
+        // Retrieve the return value from the context here (for scripts that return values)
+        // <type> returnValue = ctx->getReturnType(); for example
+        //float returnValue = ctx->GetReturnFloat();
+        return true;
     }
 
     //-----------------------------------------------------------------------------
 
     void ScriptEngine::cleanupCache()
     {
-        for (auto curr : m_functions_cache)
+        for (const ScriptFunction& f : m_functions)
         {
-            if (curr.second != NULL)
-                curr.second->Release();
+            if (f.m_max_time > FUNCTION_TIME_BUDGET)
+            {
+                Log::info("Scripting", "%s: %d calls, %.2f ms in total, "
+                    "at most %.2f ms.", f.m_declaration.c_str(), (int)f.m_calls,
+                    f.m_total_time * 1000.0, f.m_max_time * 1000.0);
+            }
+            f.m_function->Release();
         }
-        m_functions_cache.clear();
+        m_functions.clear();
+        m_function_handles.clear();
+        // The handles of pending timeouts are invalid now
+        for (PendingTimeout* timeout : m_pending_timeouts)
+            timeout->m_callback_handle = UNRESOLVED_FUNCTION;
         m_engine->DiscardModule(MODULE_ID_MAIN_SCRIPT_FILE);
     }
 
@@ -608,7 +702,9 @@ namespace Scripting
 
     void ScriptEngine::addPendingTimeout(double time, const std::string& callback_name)
     {
-        m_pending_timeouts.push_back(new PendingTimeout(time, callback_name));
+        int handle = getFunctionHandle(true, "void " + callback_name + "()");
+        m_pending_timeouts.push_back(new PendingTimeout(time, callback_name,
+                                                        handle));
     }
 
     //-----------------------------------------------------------------------------
@@ -634,7 +730,13 @@ namespace Scripting
                 }
                 else
                 {
-                    runFunction(true, "void " + curr.m_callback_name + "()");
+                    if (curr.m_callback_handle == UNRESOLVED_FUNCTION)
+                    {
+                        curr.m_callback_handle = getFunctionHandle(true,
+                            "void " + curr.m_callback_name + "()");
+                    }
+                    callFunction(curr.m_callback_handle,
+                                 [](asIScriptContext*) {});
                 }
 
                 m_pending_timeouts.erase(i);
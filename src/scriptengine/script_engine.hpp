@@ -25,9 +25,11 @@
 #include "utils/singleton.hpp"
 
 #include <angelscript.h>
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <string>
+#include <vector>
 
 class TrackObjectPresentation;
 
@@ -44,11 +46,17 @@ namespace Scripting
         std::string m_callback_name;
         asIScriptFunction* m_callback_delegate;
 
-        PendingTimeout(double time, const std::string& callback_name)
+        /** Handle of the function named m_callback_name, see
+         *  ScriptEngine::getFunctionHandle. */
+        int m_callback_handle;
+
+        PendingTimeout(double time, const std::string& callback_name,
+                       int callback_handle)
         {
             m_callback_delegate = NULL;
             m_time = time;
             m_callback_name = callback_name;
+            m_callback_handle = callback_handle;
         }
 
         PendingTimeout(double time, asIScriptFunction* callback_delegate);
@@ -65,7 +73,41 @@ namespace Scripting
         friend class AbstractSingleton<ScriptEngine>;
 
     public:
-
+        /** Handle of a function which was not found. */
+        static const int NO_FUNCTION = -1;
+
+        /** Can be used by callers for a handle not looked up yet. */
+        static const int UNRESOLVED_FUNCTION = -2;
+
+        // --------------------------------------------------------------------
+        /** Runs a function found with getFunctionHandle, which avoids looking
+         *  up its declaration, and the std::function of the other versions.
+         *  \param set_args Called with the prepared context to set the
+         *         arguments.
+         *  \param get_return_value Called with the context if the function
+         *         finished, to get the returned value.
+         */
+        template<typename SetArgs, typename GetReturnValue>
+        void callFunction(int handle, SetArgs set_args,
+                          GetReturnValue get_return_value)
+        {
+            asIScriptContext *ctx = prepareFunction(handle);
+            if (ctx == NULL)
+                return;
+            set_args(ctx);
+            if (executeFunction(handle, ctx))
+                get_return_value(ctx);
+            returnContext(ctx);
+        }   // callFunction
+        // --------------------------------------------------------------------
+        template<typename SetArgs>
+        void callFunction(int handle, SetArgs set_args)
+        {
+            callFunction(handle, set_args, [](asIScriptContext*) {});
+        }   // callFunction
+        // --------------------------------------------------------------------
+        int getFunctionHandle(bool warn_if_not_found,
+                              const std::string& function_name);
 
         void runFunction(bool warn_if_not_found, std::string function_name);
         void runFunction(bool warn_if_not_found, std::string function_name,
@@ -87,11 +129,37 @@ namespace Scripting
         asIScriptEngine* getEngine() { return m_engine; }
 
     private:
+        /** A function found by getFunctionHandle, with the time spent in it
+         *  (in seconds). */
+        struct ScriptFunction
+        {
+            std::string m_declaration;
+            asIScriptFunction *m_function;
+            /** Profiler marker id of the declaration. */
+            int m_profiler_marker;
+            uint64_t m_calls;
+            double m_total_time;
+            double m_max_time;
+        };
+
         asIScriptEngine *m_engine;
-        std::map<std::string, asIScriptFunction*> m_functions_cache;
+
+        /** Handle (index in m_functions) of each declaration looked up, or
+         *  NO_FUNCTION if it was not found. */
+        std::map<std::string, int> m_function_handles;
+
+        std::vector<ScriptFunction> m_functions;
+
+        /** Contexts not in use, to avoid creating one for each call. */
+        std::vector<asIScriptContext*> m_context_pool;
+
         PtrVector<PendingTimeout> m_pending_timeouts;
 
         void configureEngine(asIScriptEngine *engine);
+        asIScriptContext* requestContext();
+        void returnContext(asIScriptContext *ctx);
+        asIScriptContext* prepareFunction(int handle);
+        bool executeFunction(int handle, asIScriptContext *ctx);
     };   // class ScriptEngine
 
 }
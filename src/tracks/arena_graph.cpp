@@ -25,20 +25,66 @@
 #include "tracks/arena_node.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
+#include "utils/file_utils.hpp"
 #include "utils/log.hpp"
+#include "utils/stk_process.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/worker_pool.hpp"
 
 #include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
 #include <queue>
 
+/** Smaller navmeshes compute their paths faster than reading them. */
+static const unsigned MIN_CACHED_PATHS_NODES = 200;
+
+/** Maximum number of threads computing the paths. */
+static const unsigned MAX_PATH_THREADS = 8;
+
+/** Header of a cached paths file, followed by the distances and the parent
+ *  nodes of all paths (see ArenaGraph::m_distances and m_parent_node). */
+struct PathsCacheHeader
+{
+    char     m_magic[8];
+    uint32_t m_version;
+    uint32_t m_nodes;
+    uint64_t m_hash;
+    float    m_distance_unit;
+    uint32_t m_padding;
+};
+
+static const uint32_t PATHS_CACHE_VERSION = 1;
+
+const uint16_t ArenaGraph::NO_PATH;
+
 // -----------------------------------------------------------------------------
 ArenaGraph::ArenaGraph(const std::string &navmesh, const XMLNode *node)
           : Graph()
 {
+    m_distance_unit = 1.0f;
+    m_name = StringUtils::getBasename(StringUtils::getPath(navmesh));
+    for (char& c : m_name)
+    {
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_')
+            c = '_';
+    }
     loadNavmesh(navmesh);
-    buildGraph();
-    // Compute shortest distance from all nodes
-    for (unsigned int i = 0; i < getNumNodes(); i++)
-        computeDijkstra(i);
+    buildSpatialIndex();
+
+    // Computing the shortest paths takes seconds on large navmeshes, so they
+    // are cached (and only written by the main process, which can use the
+    // file manager)
+    const bool cached = getNumNodes() >= MIN_CACHED_PATHS_NODES &&
+        !file_manager->getCachedNavmeshDir().empty();
+    const uint64_t hash = cached ? getNavmeshHash() : 0;
+    if (!cached || !loadCachedPaths(hash))
+    {
+        computeAllPaths();
+        if (cached && STKProcess::getType() == PT_MAIN)
+            saveCachedPaths(hash);
+    }
 
     setNearbyNodesOfAllNodes();
     if (node && RaceManager::get()->getMinorMode() == RaceManager::MINOR_MODE_SOCCER)
@@ -175,49 +221,69 @@ void ArenaGraph::loadNavmesh(const std::string &navmesh)
 }   // loadNavmesh
 
 // ----------------------------------------------------------------------------
-void ArenaGraph::buildGraph()
+/** Computes the shortest paths between all nodes, running Dijkstra from each
+ *  node in parallel. The distances are stored with 16 bits, in units which
+ *  allow the longest possible path.
+ */
+void ArenaGraph::computeAllPaths()
 {
-    const unsigned int n_nodes = getNumNodes();
+    const unsigned int n = getNumNodes();
+    m_distances.assign(n * n, NO_PATH);
+    m_parent_node.assign(n * n, Graph::UNKNOWN_SECTOR);
+    if (n == 0)
+        return;
 
-    m_distance_matrix = std::vector<std::vector<float>>
-        (n_nodes, std::vector<float>(n_nodes, 9999.9f));
-    for (unsigned int i = 0; i < n_nodes; i++)
+    // The path between two nodes of a connected part of the graph is at most
+    // twice as long as the longest path from any of its nodes
+    float max_distance = 0.0f;
+    std::vector<bool> reached(n, false);
+    std::vector<float> distance;
+    std::vector<int16_t> parent(n);
+    for (unsigned int i = 0; i < n; i++)
     {
-        ArenaNode* cur_node = getNode(i);
-        for (const int& adjacent : cur_node->getAdjacentNodes())
+        if (reached[i])
+            continue;
+        computeDijkstra(i, &distance, parent.data());
+        for (unsigned int j = 0; j < n; j++)
         {
-            Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
-            float distance = diff.length();
-            m_distance_matrix[i][adjacent] = distance;
+            if (distance[j] >= 9899.9f)
+                continue;
+            reached[j] = true;
+            max_distance = std::max(max_distance, 2.0f * distance[j]);
         }
-        m_distance_matrix[i][i] = 0.0f;
     }
+    m_distance_unit = std::max(max_distance / (NO_PATH - 1), 0.0001f);
 
-    // Allocate and initialise the previous node data structure:
-    m_parent_node = std::vector<std::vector<int16_t>>
-        (n_nodes, std::vector<int16_t>(n_nodes, Graph::UNKNOWN_SECTOR));
-    for (unsigned int i = 0; i < n_nodes; i++)
-    {
-        for (unsigned int j = 0; j < n_nodes; j++)
+    unsigned threads = WorkerPool::getDefaultThreads(MAX_PATH_THREADS);
+    WorkerPool pool("ArenaPaths", std::min(threads, n - 1));
+    pool.parallelFor(n, [this, n](unsigned int i)
         {
-            if (i == j || m_distance_matrix[i][j] >= 9899.9f)
-                m_parent_node[i][j] = -1;
-            else
-                m_parent_node[i][j] = i;
-        }   // for j
-    }   // for i
-
-}   // buildGraph
+            std::vector<float> distance;
+            computeDijkstra(i, &distance, &m_parent_node[i * n]);
+            uint16_t* row = &m_distances[i * n];
+            for (unsigned int j = 0; j < n; j++)
+            {
+                if (distance[j] < 9899.9f)
+                {
+                    row[j] = (uint16_t)std::min(
+                        distance[j] / m_distance_unit + 0.5f,
+                        float(NO_PATH - 1));
+                }
+            }
+        });
+}   // computeAllPaths
 
 // ----------------------------------------------------------------------------
 /** Dijkstra shortest path computation. It computes the shortest distance from
  *  the specified node 'source' to all other nodes. At the end of the
- *  computation, m_distance_matrix[i][j] stores the shortest path distance from
- *  source to j and m_parent_node[source][j] stores the last vertex visited on
- *  the shortest path from i to j before visiting j. Suppose the shortest path
- *  from i to j is i->......->k->j  then m_parent_node[i][j] = k
+ *  computation, (*distance)[j] stores the shortest path distance from
+ *  source to j (or 9999.9 if there is none) and parent[j] stores the last
+ *  vertex visited on the shortest path from source to j before visiting j.
+ *  Suppose the shortest path from source to j is source->......->k->j then
+ *  parent[j] = k. It can be used by several threads at once.
  */
-void ArenaGraph::computeDijkstra(int source)
+void ArenaGraph::computeDijkstra(int source, std::vector<float>* distance,
+                                 int16_t* parent) const
 {
     // Stores the distance (float) to 'source' from a specified node (int)
     typedef std::pair<int, float> IndDistPair;
@@ -231,10 +297,15 @@ void ArenaGraph::computeDijkstra(int source)
         }
     };
 
+    const unsigned int n = getNumNodes();
+    distance->assign(n, 9999.9f);
+    for (unsigned int i = 0; i < n; i++)
+        parent[i] = Graph::UNKNOWN_SECTOR;
+    (*distance)[source] = 0.0f;
+
     std::priority_queue<IndDistPair, std::vector<IndDistPair>, Shortest> queue;
     IndDistPair begin(source, 0.0f);
     queue.push(begin);
-    const unsigned int n = getNumNodes();
     std::vector<bool> visited;
     visited.resize(n, false);
     while (!queue.empty())
@@ -246,20 +317,21 @@ void ArenaGraph::computeDijkstra(int source)
         if (visited[cur_index]) continue;
         visited[cur_index] = true;
 
-        for (const int& adjacent : getNode(cur_index)->getAdjacentNodes())
+        ArenaNode* cur_node = getNode(cur_index);
+        for (const int& adjacent : cur_node->getAdjacentNodes())
         {
             // Distance already computed, can be ignored
             if (visited[adjacent]) continue;
 
-            float new_dist =
-                current.second + m_distance_matrix[cur_index][adjacent];
-            if (new_dist < m_distance_matrix[source][adjacent])
+            Vec3 diff = getNode(adjacent)->getCenter() -
+                cur_node->getCenter();
+            float new_dist = current.second + diff.length();
+            if (new_dist < (*distance)[adjacent])
             {
-                m_distance_matrix[source][adjacent] = new_dist;
-                m_parent_node[source][adjacent] = cur_index;
+                (*distance)[adjacent] = new_dist;
+                parent[adjacent] = cur_index;
+                queue.push(IndDistPair(adjacent, new_dist));
             }
-            IndDistPair pair(adjacent, new_dist);
-            queue.push(pair);
         }
     }
 }   // computeDijkstra
@@ -268,15 +340,32 @@ void ArenaGraph::computeDijkstra(int source)
 /** THIS FUNCTION IS ONLY USED FOR UNIT-TESTING, to verify that the new
  *  Dijkstra algorithm gives the same results.
  *  computeFloydWarshall() computes the shortest distance between any two
- *  nodes. At the end of the computation, m_distance_matrix[i][j] stores the
- *  shortest path distance from i to j and m_parent_node[i][j] stores the last
- *  vertex visited on the shortest path from i to j before visiting j. Suppose
- *  the shortest path from i to j is i->......->k->j  then
- *  m_parent_node[i][j] = k
+ *  nodes. At the end of the computation, (*distance)[i * n + j] stores the
+ *  shortest path distance from i to j and (*parent)[i * n + j] stores the
+ *  last vertex visited on the shortest path from i to j before visiting j.
+ *  Suppose the shortest path from i to j is i->......->k->j  then
+ *  (*parent)[i * n + j] = k
  */
-void ArenaGraph::computeFloydWarshall()
+void ArenaGraph::computeFloydWarshall(std::vector<float>* distance,
+                                      std::vector<int16_t>* parent) const
 {
     unsigned int n = getNumNodes();
+    std::vector<float>& d = *distance;
+    std::vector<int16_t>& p = *parent;
+    d.assign(n * n, 9999.9f);
+    p.assign(n * n, Graph::UNKNOWN_SECTOR);
+    for (unsigned int i = 0; i < n; i++)
+    {
+        ArenaNode* cur_node = getNode(i);
+        for (const int& adjacent : cur_node->getAdjacentNodes())
+        {
+            Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
+            d[i * n + adjacent] = diff.length();
+            p[i * n + adjacent] = i;
+        }
+        d[i * n + i] = 0.0f;
+        p[i * n + i] = Graph::UNKNOWN_SECTOR;
+    }
 
     for (unsigned int k = 0; k < n; k++)
     {
@@ -284,12 +373,10 @@ void ArenaGraph::computeFloydWarshall()
         {
             for (unsigned int j = 0; j < n; j++)
             {
-                if ((m_distance_matrix[i][k] + m_distance_matrix[k][j]) <
-                    m_distance_matrix[i][j])
+                if ((d[i * n + k] + d[k * n + j]) < d[i * n + j])
                 {
-                    m_distance_matrix[i][j] =
-                        m_distance_matrix[i][k] + m_distance_matrix[k][j];
-                    m_parent_node[i][j] = m_parent_node[k][j];
+                    d[i * n + j] = d[i * n + k] + d[k * n + j];
+                    p[i * n + j] = p[k * n + j];
                 }
             }
         }
@@ -297,6 +384,120 @@ void ArenaGraph::computeFloydWarshall()
 
 }   // computeFloydWarshall
 
+// ----------------------------------------------------------------------------
+/** Returns a hash of all nodes and their connections, which identifies the
+ *  cached paths of this navmesh. */
+uint64_t ArenaGraph::getNavmeshHash() const
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const void* data, size_t size)
+        {
+            const unsigned char* bytes = (const unsigned char*)data;
+            for (size_t i = 0; i < size; i++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+        };
+    unsigned int n = getNumNodes();
+    add(&n, sizeof(n));
+    for (unsigned int i = 0; i < n; i++)
+    {
+        ArenaNode* node = getNode(i);
+        for (int j = 0; j < 4; j++)
+            add((*node)[j].m_floats, 3 * sizeof(btScalar));
+        for (int adjacent : node->getAdjacentNodes())
+            add(&adjacent, sizeof(adjacent));
+        int end = -1;
+        add(&end, sizeof(end));
+    }
+    return hash;
+}   // getNavmeshHash
+
+// ----------------------------------------------------------------------------
+std::string ArenaGraph::getCachedPathsFile() const
+{
+    return file_manager->getCachedNavmeshDir() + m_name + ".paths";
+}   // getCachedPathsFile
+
+// ----------------------------------------------------------------------------
+/** Loads the cached shortest paths of this navmesh.
+ *  \param hash Hash of the navmesh, see getNavmeshHash.
+ *  \return False if they are not cached (or for a different navmesh).
+ */
+bool ArenaGraph::loadCachedPaths(uint64_t hash)
+{
+    std::string file = getCachedPathsFile();
+    FILE* f = FileUtils::fopenU8Path(file, "rb");
+    if (!f)
+        return false;
+    const unsigned int n = getNumNodes();
+    PathsCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+        memcmp(header.m_magic, "STKPATHS", 8) == 0 &&
+        header.m_version == PATHS_CACHE_VERSION &&
+        header.m_nodes == n && header.m_hash == hash;
+    if (ok)
+    {
+        m_distances.resize(n * n);
+        m_parent_node.resize(n * n);
+        ok = fread(m_distances.data(), sizeof(uint16_t), n * n, f) == n * n &&
+            fread(m_parent_node.data(), sizeof(int16_t), n * n, f) == n * n;
+        m_distance_unit = header.m_distance_unit;
+    }
+    fclose(f);
+    if (!ok)
+    {
+        Log::info("ArenaGraph", "Cached paths '%s' are outdated.",
+                  file.c_str());
+        m_distances.clear();
+        m_parent_node.clear();
+    }
+    return ok;
+}   // loadCachedPaths
+
+// ----------------------------------------------------------------------------
+/** Saves the shortest paths of this navmesh into the cached navmesh
+ *  directory (main process only, as it uses the file manager).
+ *  \param hash Hash of the navmesh, see getNavmeshHash.
+ */
+void ArenaGraph::saveCachedPaths(uint64_t hash) const
+{
+    PathsCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.m_magic, "STKPATHS", 8);
+    header.m_version = PATHS_CACHE_VERSION;
+    header.m_nodes = getNumNodes();
+    header.m_hash = hash;
+    header.m_distance_unit = m_distance_unit;
+
+    // Write to a temporary file of this process first, which then replaces
+    // the file in one step, so other processes never read a partial file
+    std::string file = getCachedPathsFile();
+    std::string tmp_file = FileUtils::getTemporaryPath(file);
+    FILE* f = FileUtils::fopenU8Path(tmp_file, "wb");
+    bool ok = f != NULL;
+    if (f)
+    {
+        ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(m_distances.data(), sizeof(uint16_t), m_distances.size(),
+                   f) == m_distances.size() &&
+            fwrite(m_parent_node.data(), sizeof(int16_t),
+                   m_parent_node.size(), f) == m_parent_node.size();
+        ok = fclose(f) == 0 && ok;
+        if (ok)
+            ok = FileUtils::replaceU8Path(tmp_file, file) == 0;
+        if (!ok)
+            file_manager->removeFile(tmp_file);
+    }
+    if (!ok)
+    {
+        Log::warn("ArenaGraph", "Cannot write cached paths '%s'.",
+                  file.c_str());
+    }
+}   // saveCachedPaths
+
 // -----------------------------------------------------------------------------
 void ArenaGraph::loadGoalNodes(const XMLNode *node)
 {
@@ -346,17 +547,18 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
         // Get the distance to all nodes at i
         ArenaNode* cur_node = getNode(i);
         std::vector<int> nearby_nodes;
-        std::vector<float> dist = m_distance_matrix[i];
+        std::vector<uint32_t> dist(m_distances.begin() + i * getNumNodes(),
+            m_distances.begin() + (i + 1) * getNumNodes());
 
         // Skip the same node
-        dist[i] = 999999.0f;
+        dist[i] = 0xffffffff;
         for (unsigned int j = 0; j < try_count; j++)
         {
-            std::vector<float>::iterator it =
+            std::vector<uint32_t>::iterator it =
                 std::min_element(dist.begin(), dist.end());
             const int pos = int(it - dist.begin());
             nearby_nodes.push_back(pos);
-            dist[pos] = 999999.0f;
+            dist[pos] = 0xffffffff;
         }
         cur_node->setNearbyNodes(nearby_nodes);
     }
@@ -367,14 +569,14 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
 /** Determines the full path from 'from' to 'to' and returns it in a
  *  std::vector (in reverse order). Used only for unit testing.
  */
-std::vector<int16_t> ArenaGraph::getPathFromTo(int from, int to,
-                      const std::vector< std::vector< int16_t > >& parent_node)
+std::vector<int16_t> ArenaGraph::getPathFromTo(int from, int to, unsigned n,
+                                      const std::vector<int16_t>& parent_node)
 {
     std::vector<int16_t> path;
     path.push_back(to);
     while(from!=to)
     {
-        to = parent_node[from][to];
+        to = parent_node[from * n + to];
         path.push_back(to);
     }
     return path;
@@ -395,29 +597,39 @@ void ArenaGraph::unitTesting()
     double s = StkTime::getRealTime();
     ArenaGraph* ag = new ArenaGraph(navmesh_file_name);
     double e = StkTime::getRealTime();
-    Log::error("Time", "Dijkstra       %lf", e-s);
+    Log::error("Time", "Loading        %lf", e-s);
 
-    // Save the Dijkstra results
-    std::vector< std::vector< float > > distance_matrix = ag->m_distance_matrix;
-    std::vector< std::vector< int16_t > > parent_node = ag->m_parent_node;
-    ag->buildGraph();
+    // The paths loaded from the cache (if any) must be the computed ones
+    std::vector<uint16_t> distances = ag->m_distances;
+    std::vector<int16_t> parent_node = ag->m_parent_node;
+    s = StkTime::getRealTime();
+    ag->computeAllPaths();
+    e = StkTime::getRealTime();
+    Log::error("Time", "Dijkstra       %lf", e-s);
+    assert(distances == ag->m_distances);
+    assert(parent_node == ag->m_parent_node);
 
     // Now compute results with Floyd-Warshall
+    const unsigned int n = ag->getNumNodes();
+    std::vector<float> fw_distance;
+    std::vector<int16_t> fw_parent_node;
     s = StkTime::getRealTime();
-    ag->computeFloydWarshall();
+    ag->computeFloydWarshall(&fw_distance, &fw_parent_node);
     e = StkTime::getRealTime();
     Log::error("Time", "Floyd-Warshall %lf", e-s);
 
     int error_count = 0;
-    for(unsigned int i=0; i<ag->m_distance_matrix.size(); i++)
+    for(unsigned int i=0; i<n; i++)
     {
-        for(unsigned int j=0; j<ag->m_distance_matrix[i].size(); j++)
+        for(unsigned int j=0; j<n; j++)
         {
-            if(ag->m_distance_matrix[i][j] - distance_matrix[i][j] > 0.001f)
+            // Distances are rounded to m_distance_unit
+            float distance = ag->getDistance(i, j);
+            if(fabsf(fw_distance[i * n + j] - distance) > ag->m_distance_unit)
             {
                 Log::error("ArenaGraph",
                            "Incorrect distance %d, %d: Dijkstra: %f F.W.: %f",
-                           i, j, distance_matrix[i][j], ag->m_distance_matrix[i][j]);
+                           i, j, distance, fw_distance[i * n + j]);
                 error_count++;
             }    // if distance is too different
 
@@ -429,16 +641,19 @@ void ArenaGraph::unitTesting()
             // debugging in the feature
 #undef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
 #ifdef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
-            if(ag->m_parent_node[i][j] != parent_node[i][j])
+            if(fw_parent_node[i * n + j] != parent_node[i * n + j])
             {
                 error_count++;
-                std::vector<int16_t> dijkstra_path = getPathFromTo(i, j, parent_node);
-                std::vector<int16_t> floyd_path = getPathFromTo(i, j, ag->m_parent_node);
+                std::vector<int16_t> dijkstra_path =
+                    getPathFromTo(i, j, n, parent_node);
+                std::vector<int16_t> floyd_path =
+                    getPathFromTo(i, j, n, fw_parent_node);
                 if(dijkstra_path.size()!=floyd_path.size())
                 {
                     Log::error("ArenaGraph",
                                "Incorrect path length %d, %d: Dijkstra: %d F.W.: %d",
-                               i, j, parent_node[i][j], ag->m_parent_node[i][j]);
+                               i, j, parent_node[i * n + j],
+                               fw_parent_node[i * n + j]);
                     continue;
                 }
                 Log::error("ArenaGraph", "Path problems from %d to %d:",
@@ -456,6 +671,23 @@ void ArenaGraph::unitTesting()
         }   // for j
     }   // for i
 
+    // Check that the cached paths are read back unchanged
+    if (!file_manager->getCachedNavmeshDir().empty())
+    {
+        const uint64_t hash = ag->getNavmeshHash();
+        ag->saveCachedPaths(hash);
+        ag->m_distances.clear();
+        ag->m_parent_node.clear();
+        bool loaded = ag->loadCachedPaths(hash);
+        assert(loaded);
+        assert(distances == ag->m_distances);
+        assert(parent_node == ag->m_parent_node);
+        // A different navmesh must not use the cached paths
+        loaded = ag->loadCachedPaths(hash + 1);
+        assert(!loaded);
+        (void)loaded;
+    }
+
     delete ag;
 
 }   // unitTesting
@@ -22,7 +22,9 @@
 #include "tracks/graph.hpp"
 #include "utils/cpp2011.hpp"
 
+#include <cstdint>
 #include <set>
+#include <string>
 
 class ArenaNode;
 class XMLNode;
@@ -34,38 +36,59 @@ class XMLNode;
 class ArenaGraph : public Graph
 {
 private:
-    /** The actual graph data structure, it is an adjacency matrix. */
-    std::vector<std::vector<float>> m_distance_matrix;
+    /** The shortest distances between all nodes: m_distances[i * n + j] is
+     *  the distance from i to j in units of m_distance_unit, or NO_PATH. */
+    std::vector<uint16_t> m_distances;
 
-    /** The matrix that is used to store computed shortest paths. */
-    std::vector<std::vector<int16_t>> m_parent_node;
+    float m_distance_unit;
+
+    /** The shortest paths: m_parent_node[i * n + j] is the node before j on
+     *  the shortest path from i to j (or -1 if there is none). */
+    std::vector<int16_t> m_parent_node;
 
     /** Used in soccer mode to colorize the goal lines in minimap. */
     std::set<int> m_red_node;
 
     std::set<int> m_blue_node;
 
+    /** Name of the track, used for the file of the cached paths. */
+    std::string m_name;
+
     // ------------------------------------------------------------------------
     void loadGoalNodes(const XMLNode *node);
     // ------------------------------------------------------------------------
     void loadNavmesh(const std::string &navmesh);
     // ------------------------------------------------------------------------
-    void buildGraph();
+    void computeAllPaths();
     // ------------------------------------------------------------------------
-    void setNearbyNodesOfAllNodes();
+    void computeDijkstra(int source, std::vector<float>* distance,
+                         int16_t* parent) const;
+    // ------------------------------------------------------------------------
+    void computeFloydWarshall(std::vector<float>* distance,
+                              std::vector<int16_t>* parent) const;
+    // ------------------------------------------------------------------------
+    uint64_t getNavmeshHash() const;
     // ------------------------------------------------------------------------
-    void computeDijkstra(int n);
+    std::string getCachedPathsFile() const;
     // ------------------------------------------------------------------------
-    void computeFloydWarshall();
+    bool loadCachedPaths(uint64_t hash);
+    // ------------------------------------------------------------------------
+    void saveCachedPaths(uint64_t hash) const;
+    // ------------------------------------------------------------------------
+    void setNearbyNodesOfAllNodes();
     // ------------------------------------------------------------------------
     static std::vector<int16_t> getPathFromTo(int from, int to,
-                     const std::vector< std::vector< int16_t > >& parent_node);
+                                              unsigned n,
+                                     const std::vector<int16_t>& parent_node);
     // ------------------------------------------------------------------------
     virtual bool hasLapLine() const OVERRIDE                  { return false; }
     // ------------------------------------------------------------------------
     virtual void differentNodeColor(int n, video::SColor* c) const OVERRIDE;
 
 public:
+    /** Distance of nodes which are not connected. */
+    static const uint16_t NO_PATH = 0xffff;
+    // ------------------------------------------------------------------------
     static ArenaGraph* get()     { return dynamic_cast<ArenaGraph*>(m_graph); }
     // ------------------------------------------------------------------------
     static void unitTesting();
@@ -77,14 +100,15 @@ public:
     ArenaNode* getNode(unsigned int i) const;
     // ------------------------------------------------------------------------
     /** Returns the next node on the shortest path from i to j.
-     *  Note: m_parent_node[j][i] contains the parent of i on path from j to i,
-     *  which is the next node on the path from i to j (undirected graph)
+     *  Note: m_parent_node[j * n + i] contains the parent of i on path from j
+     *  to i, which is the next node on the path from i to j (undirected
+     *  graph)
      */
     int getNextNode(int i, int j) const
     {
         if (i == Graph::UNKNOWN_SECTOR || j == Graph::UNKNOWN_SECTOR)
             return Graph::UNKNOWN_SECTOR;
-        return (int)(m_parent_node[j][i]);
+        return (int)(m_parent_node[j * m_all_nodes.size() + i]);
     }
     // ------------------------------------------------------------------------
     /** Returns the distance between any two nodes */
@@ -92,7 +116,8 @@ public:
     {
         if (from == Graph::UNKNOWN_SECTOR || to == Graph::UNKNOWN_SECTOR)
             return 99999.0f;
-        return m_distance_matrix[from][to];
+        uint16_t d = m_distances[from * m_all_nodes.size() + to];
+        return d == NO_PATH ? 9999.9f : d * m_distance_unit;
     }
 
 };   // ArenaGraph
@@ -31,7 +31,13 @@
 #include "tracks/drive_node_2d.hpp"
 #include "tracks/drive_node_3d.hpp"
 #include "tracks/track.hpp"
+#include "utils/constants.hpp"
+#include "utils/cpp2011.hpp"
 #include "utils/log.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
+#include <random>
 
 const int Graph::UNKNOWN_SECTOR = -1;
 const float Graph::MIN_HEIGHT_TESTING = -1.0f;
@@ -48,6 +54,11 @@ Graph::Graph()
     m_bb_min      = Vec3( 99999,  99999,  99999);
     m_bb_max      = Vec3(-99999, -99999, -99999);
     memset(m_bb_nodes, 0, 4 * sizeof(int));
+    m_grid_min_x     = 0;
+    m_grid_min_z     = 0;
+    m_grid_cell_size = 1.0f;
+    m_grid_width     = 0;
+    m_grid_height    = 0;
 }  // Graph
 
 // -----------------------------------------------------------------------------
@@ -593,9 +604,116 @@ void Graph::createQuad(const Vec3 &p0, const Vec3 &p1, const Vec3 &p2,
 
 }   // createQuad
 
+//-----------------------------------------------------------------------------
+/** Builds the grid used by findRoadSector and findOutOfRoadSector, it must
+ *  be called after all quads are created. The cell size is about the size
+ *  of a quad, so a cell lists only a few quads.
+ */
+void Graph::buildSpatialIndex()
+{
+    m_grid_cell_start.clear();
+    m_grid_quads.clear();
+    const unsigned n = getNumNodes();
+    if (n == 0)
+        return;
+
+    // Extend the boxes a bit, so rounding errors can't make a point inside
+    // a quad end up in a cell not listing it
+    const float padding = 1.0f;
+    std::vector<float> boxes(n * 4);
+    float min_x = 99999, min_z = 99999, max_x = -99999, max_z = -99999;
+    float total_size = 0;
+    for (unsigned i = 0; i < n; i++)
+    {
+        const Quad* q = m_all_nodes[i];
+        Vec3 box_min = (*q)[0], box_max = (*q)[0];
+        for (int j = 1; j < 4; j++)
+        {
+            box_min.min((*q)[j]);
+            box_max.max((*q)[j]);
+        }
+        total_size += std::max(box_max.x() - box_min.x(),
+                               box_max.z() - box_min.z());
+        if (q->is3DQuad())
+        {
+            // The box used by pointInside of 3d quads extends 5 units along
+            // the normal
+            box_min -= Vec3(5, 0, 5);
+            box_max += Vec3(5, 0, 5);
+        }
+        boxes[i * 4    ] = box_min.x() - padding;
+        boxes[i * 4 + 1] = box_min.z() - padding;
+        boxes[i * 4 + 2] = box_max.x() + padding;
+        boxes[i * 4 + 3] = box_max.z() + padding;
+        min_x = std::min(min_x, boxes[i * 4    ]);
+        min_z = std::min(min_z, boxes[i * 4 + 1]);
+        max_x = std::max(max_x, boxes[i * 4 + 2]);
+        max_z = std::max(max_z, boxes[i * 4 + 3]);
+    }
+
+    // Limit the number of cells for tracks with a few big quads spread out
+    m_grid_cell_size = std::max(total_size / n, 1.0f);
+    while (true)
+    {
+        m_grid_width  = (int)((max_x - min_x) / m_grid_cell_size) + 1;
+        m_grid_height = (int)((max_z - min_z) / m_grid_cell_size) + 1;
+        if ((unsigned)(m_grid_width * m_grid_height) <= 4 * n + 64)
+            break;
+        m_grid_cell_size *= 1.5f;
+    }
+    m_grid_min_x = min_x;
+    m_grid_min_z = min_z;
+
+    // Count the quads of each cell first, then fill the lists
+    m_grid_cell_start.resize(m_grid_width * m_grid_height + 1, 0);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        std::vector<unsigned> next;
+        if (pass == 1)
+        {
+            for (unsigned i = 1; i < m_grid_cell_start.size(); i++)
+                m_grid_cell_start[i] += m_grid_cell_start[i - 1];
+            m_grid_quads.resize(m_grid_cell_start.back());
+            next.assign(m_grid_cell_start.begin(),
+                        m_grid_cell_start.end() - 1);
+        }
+        for (unsigned i = 0; i < n; i++)
+        {
+            int x0, z0, x1, z1;
+            getGridCell(Vec3(boxes[i * 4], 0, boxes[i * 4 + 1]), &x0, &z0);
+            getGridCell(Vec3(boxes[i * 4 + 2], 0, boxes[i * 4 + 3]), &x1,
+                        &z1);
+            for (int z = z0; z <= z1; z++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    unsigned cell = z * m_grid_width + x;
+                    if (pass == 0)
+                        m_grid_cell_start[cell + 1]++;
+                    else
+                        m_grid_quads[next[cell]++] = i;
+                }
+            }
+        }
+    }
+}   // buildSpatialIndex
+
+//-----------------------------------------------------------------------------
+/** Returns the grid cell containing xyz, or the closest one if xyz is outside
+ *  of the grid. */
+void Graph::getGridCell(const Vec3& xyz, int* x, int* z) const
+{
+    float fx = (xyz.x() - m_grid_min_x) / m_grid_cell_size;
+    float fz = (xyz.z() - m_grid_min_z) / m_grid_cell_size;
+    *x = fx <= 0 ? 0 : std::min((int)fx, m_grid_width  - 1);
+    *z = fz <= 0 ? 0 : std::min((int)fz, m_grid_height - 1);
+}   // getGridCell
+
 //-----------------------------------------------------------------------------
 /** findRoadSector returns in which sector on the road the position
  *  xyz is. If xyz is not on top of the road, it sets UNKNOWN_SECTOR as sector.
+ *  When several quads contain xyz, the first one after the previous sector
+ *  is used (in the order of the quads).
  *
  *  \param xyz Position for which the segment should be determined.
  *  \param sector Contains the previous sector (as a shortcut, since usually
@@ -608,6 +726,59 @@ void Graph::createQuad(const Vec3 &p0, const Vec3 &p1, const Vec3 &p2,
 void Graph::findRoadSector(const Vec3& xyz, int *sector,
                            std::vector<int> *all_sectors,
                            bool ignore_vertical) const
+{
+    if (all_sectors || m_grid_cell_start.empty())
+    {
+        findRoadSectorLinear(xyz, sector, all_sectors, ignore_vertical);
+        return;
+    }
+
+    // Most likely the kart will still be on the sector it was before,
+    // or on the next one, so these simple cases are tested first.
+    if (*sector != UNKNOWN_SECTOR &&
+        getQuad(*sector)->pointInside(xyz, ignore_vertical))
+    {
+        return;
+    }
+    const int n = getNumNodes();
+    const int first = *sector == UNKNOWN_SECTOR ? 0 : (*sector + 1) % n;
+    if (getQuad(first)->pointInside(xyz, ignore_vertical))
+    {
+        *sector = first;
+        return;
+    }
+
+    // Otherwise test the quads of the cell containing xyz, and take the
+    // one found first by findRoadSectorLinear
+    *sector = UNKNOWN_SECTOR;
+    if (xyz.x() < m_grid_min_x || xyz.z() < m_grid_min_z ||
+        xyz.x() >= m_grid_min_x + m_grid_width  * m_grid_cell_size ||
+        xyz.z() >= m_grid_min_z + m_grid_height * m_grid_cell_size)
+        return;
+    int x, z;
+    getGridCell(xyz, &x, &z);
+    const unsigned cell = z * m_grid_width + x;
+    int best_rank = n;
+    for (unsigned i = m_grid_cell_start[cell];
+         i < m_grid_cell_start[cell + 1]; i++)
+    {
+        const int indx = m_grid_quads[i];
+        const int rank = (indx - first + n) % n;
+        if (rank > 0 && rank < best_rank &&
+            getQuad(indx)->pointInside(xyz, ignore_vertical))
+        {
+            best_rank = rank;
+            *sector = indx;
+        }
+    }
+}   // findRoadSector
+
+//-----------------------------------------------------------------------------
+/** Finds the sector by testing the quads one after the other, see
+ *  findRoadSector. */
+void Graph::findRoadSectorLinear(const Vec3& xyz, int *sector,
+                                 std::vector<int> *all_sectors,
+                                 bool ignore_vertical) const
 {
     // Most likely the kart will still be on the sector it was before,
     // so this simple case is tested first.
@@ -649,7 +820,7 @@ void Graph::findRoadSector(const Vec3& xyz, int *sector,
     }   // for i<m_all_nodes.size()
 
     return;
-}   // findRoadSector
+}   // findRoadSectorLinear
 
 //-----------------------------------------------------------------------------
 /** findOutOfRoadSector finds the sector where XYZ is, but as it name
@@ -678,10 +849,134 @@ void Graph::findRoadSector(const Vec3& xyz, int *sector,
     Probably the best solution would be to construct a quad that reaches
     until the next higher overlapping line segment, and find the closest
     one to XYZ.
+
+    When several quads have the same distance, the first one tested by
+    findOutOfRoadSectorLinear (starting 9 quads before curr_sector) is used.
  */
 int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
                                std::vector<int> *all_sectors,
                                bool ignore_vertical) const
+{
+    if (all_sectors || m_grid_cell_start.empty())
+    {
+        return findOutOfRoadSectorLinear(xyz, curr_sector, all_sectors,
+                                         ignore_vertical);
+    }
+    const int n = getNumNodes();
+    int first = 1 % n;
+    if (curr_sector != UNKNOWN_SECTOR)
+        first = ((curr_sector - 9) % n + n) % n;
+    return findOutOfRoadSectorInGrid(xyz, first, ignore_vertical);
+}   // findOutOfRoadSector
+
+//-----------------------------------------------------------------------------
+/** Implements findOutOfRoadSector with the grid: the cells are searched in
+ *  rings around the cell of xyz, until no quad in the cells left can be
+ *  closer than the closest one found (the distance of quads in the xz plane
+ *  is never more than the distance used).
+ *  \param first_sector The quad which findOutOfRoadSectorLinear would test
+ *         first, used to select the same quad if distances are equal.
+ */
+int Graph::findOutOfRoadSectorInGrid(const Vec3& xyz, int first_sector,
+                                     bool ignore_vertical) const
+{
+    const int n = getNumNodes();
+    int cx, cz;
+    getGridCell(xyz, &cx, &cz);
+
+    // Like findOutOfRoadSectorLinear, test first with the height condition,
+    // then without it
+    for (int phase = 0; phase < 2; phase++)
+    {
+        int   min_sector = UNKNOWN_SECTOR;
+        int   min_rank   = n;
+        float min_dist_2 = 999999.0f*999999.0f;
+        for (int r = 0; ; r++)
+        {
+            for (int z = cz - r; z <= cz + r; z++)
+            {
+                if (z < 0 || z >= m_grid_height)
+                    continue;
+                // Only the border of the square is new in this ring
+                const int step = (z == cz - r || z == cz + r) ? 1 : 2 * r;
+                for (int x = cx - r; x <= cx + r; x += step)
+                {
+                    if (x < 0 || x >= m_grid_width)
+                        continue;
+                    const unsigned cell = z * m_grid_width + x;
+                    for (unsigned i = m_grid_cell_start[cell];
+                         i < m_grid_cell_start[cell + 1]; i++)
+                    {
+                        const int indx = m_grid_quads[i];
+                        const Quad* q = m_all_nodes[indx];
+                        if (q->isIgnored())
+                            continue;
+                        const float dist_2 = q->getDistance2FromPoint(xyz);
+                        const int rank = (indx - first_sector + n) % n;
+                        if (dist_2 > min_dist_2 ||
+                            (dist_2 == min_dist_2 &&
+                             (min_sector == UNKNOWN_SECTOR ||
+                              rank >= min_rank)))
+                            continue;
+                        float dist = xyz.getY() - q->getMinHeight();
+                        if (phase == 1 || (dist < 5.0f && dist > -1.0f) ||
+                            q->is3DQuad() || ignore_vertical)
+                        {
+                            min_dist_2 = dist_2;
+                            min_rank   = rank;
+                            min_sector = indx;
+                        }
+                    }   // for i in cell
+                }   // for x
+            }   // for z
+
+            // Find the smallest distance in the xz plane of xyz to the
+            // cells not searched yet
+            bool cells_left = false;
+            float bound = 999999.0f;
+            if (cx - r > 0)
+            {
+                cells_left = true;
+                bound = std::min(bound, xyz.x() -
+                    (m_grid_min_x + (cx - r) * m_grid_cell_size));
+            }
+            if (cx + r + 1 < m_grid_width)
+            {
+                cells_left = true;
+                bound = std::min(bound,
+                    m_grid_min_x + (cx + r + 1) * m_grid_cell_size - xyz.x());
+            }
+            if (cz - r > 0)
+            {
+                cells_left = true;
+                bound = std::min(bound, xyz.z() -
+                    (m_grid_min_z + (cz - r) * m_grid_cell_size));
+            }
+            if (cz + r + 1 < m_grid_height)
+            {
+                cells_left = true;
+                bound = std::min(bound,
+                    m_grid_min_z + (cz + r + 1) * m_grid_cell_size - xyz.z());
+            }
+            if (!cells_left)
+                break;
+            if (min_sector != UNKNOWN_SECTOR && bound > 0 &&
+                min_dist_2 < bound * bound)
+                break;
+        }   // for r
+        if (min_sector != UNKNOWN_SECTOR)
+            return min_sector;
+    }   // phase
+
+    Log::warn("Graph", "unknown sector found.");
+    return 0;
+}   // findOutOfRoadSectorInGrid
+
+//-----------------------------------------------------------------------------
+/** Finds the closest sector by testing all quads, see findOutOfRoadSector. */
+int Graph::findOutOfRoadSectorLinear(const Vec3& xyz, const int curr_sector,
+                                     std::vector<int> *all_sectors,
+                                     bool ignore_vertical) const
 {
     int count = (all_sectors!=NULL) ? (int)all_sectors->size() : getNumNodes();
     int current_sector = 0;
@@ -760,7 +1055,7 @@ int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
     // We can only reach this point if min_sector==UNKNOWN_SECTOR
     Log::warn("Graph", "unknown sector found.");
     return 0;
-}   // findOutOfRoadSector
+}   // findOutOfRoadSectorLinear
 
 //-----------------------------------------------------------------------------
 void Graph::loadBoundingBoxNodes()
@@ -774,3 +1069,204 @@ void Graph::loadBoundingBoxNodes()
     m_bb_nodes[3] = findOutOfRoadSector(Vec3(m_bb_max.x(), 0, m_bb_max.z()),
         -1/*curr_sector*/, NULL/*all_sectors*/, true/*ignore_vertical*/);
 }   // loadBoundingBoxNodes
+
+//-----------------------------------------------------------------------------
+/** A graph of arena nodes (drive nodes need a DriveGraph) used to test and
+ *  benchmark the sector lookups.
+ */
+class TestGraph : public Graph
+{
+private:
+    virtual bool hasLapLine() const OVERRIDE                  { return false; }
+    // ------------------------------------------------------------------------
+    virtual void differentNodeColor(int n, video::SColor* c) const OVERRIDE {}
+
+public:
+    // ------------------------------------------------------------------------
+    void addQuad(const Vec3 &p0, const Vec3 &p1, const Vec3 &p2,
+                 const Vec3 &p3)
+    {
+        createQuad(p0, p1, p2, p3, getNumNodes(), false/*invisible*/,
+                   false/*ai_ignore*/, true/*is_arena*/, false/*ignored*/);
+    }   // addQuad
+    // ------------------------------------------------------------------------
+    void finishLoading()
+    {
+        buildSpatialIndex();
+        loadBoundingBoxNodes();
+    }   // finishLoading
+};   // TestGraph
+
+//-----------------------------------------------------------------------------
+/** Returns a point of the test track: a figure eight with a bridge where it
+ *  crosses itself, and a banked part (which uses 3d quads).
+ *  \param t Position along the track, 0 to 1 is one lap.
+ *  \param side Sidewards position, -1 and 1 are the borders of the road.
+ *  \param height Height above the road.
+ */
+static Vec3 getTestTrackPoint(unsigned num_quads, float t, float side,
+                              float height)
+{
+    const float radius = num_quads * 3.0f / 6.0f;
+    const float a = 2.0f * M_PI * t;
+    Vec3 center(radius * sinf(a), 8.0f * cosf(a) + 2.0f * sinf(13.0f * a),
+                0.5f * radius * sinf(2.0f * a));
+    Vec3 forward(cosf(a), 0, cosf(2.0f * a));
+    forward.normalize();
+    const float bank = (t > 0.6f && t < 0.7f) ? 0.7f : 0.0f;
+    Vec3 across = Vec3(forward.z(), 0, -forward.x()) * cosf(bank) +
+                  Vec3(0, sinf(bank), 0);
+    Vec3 up = across.cross(forward);
+    up.normalize();
+    if (up.y() < 0)
+        up = -up;
+    return center + across * (6.0f * side) + up * height;
+}   // getTestTrackPoint
+
+//-----------------------------------------------------------------------------
+Graph* Graph::createTestGraph(unsigned num_quads)
+{
+    TestGraph* graph = new TestGraph();
+    for (unsigned i = 0; i < num_quads; i++)
+    {
+        float t0 = float(i) / num_quads, t1 = float(i + 1) / num_quads;
+        graph->addQuad(getTestTrackPoint(num_quads, t0, -1, 0),
+                       getTestTrackPoint(num_quads, t0,  1, 0),
+                       getTestTrackPoint(num_quads, t1,  1, 0),
+                       getTestTrackPoint(num_quads, t1, -1, 0));
+    }
+    graph->finishLoading();
+    return graph;
+}   // createTestGraph
+
+//-----------------------------------------------------------------------------
+/** Returns the positions of karts driving on the test track, weaving from
+ *  side to side (sometimes off the road) and jumping, num_karts positions
+ *  for each tick.
+ */
+std::vector<Vec3> Graph::createTestPositions(unsigned num_quads,
+                                             unsigned num_karts,
+                                             unsigned num_ticks)
+{
+    std::vector<Vec3> positions;
+    positions.reserve(num_karts * num_ticks);
+    for (unsigned tick = 0; tick < num_ticks; tick++)
+    {
+        for (unsigned k = 0; k < num_karts; k++)
+        {
+            // About 0.3 units per tick, 3 units per quad
+            float t = float(k) / num_karts +
+                tick * (0.08f + 0.005f * k) / num_quads;
+            float side = 1.4f * sinf(tick / (50.0f + 7.0f * k));
+            float jump = 7.0f * sinf(tick / (80.0f + 11.0f * k));
+            positions.push_back(getTestTrackPoint(num_quads,
+                t - floorf(t), side, 0.5f + std::max(jump, 0.0f)));
+        }
+    }
+    return positions;
+}   // createTestPositions
+
+//-----------------------------------------------------------------------------
+/** Updates the sectors of karts like TrackSector::update, and appends them
+ *  to sectors.
+ *  \param use_index If the grid is used, or the quads tested one by one.
+ */
+void Graph::replayKarts(Graph* graph, const std::vector<Vec3>& positions,
+                        unsigned num_karts, bool use_index,
+                        std::vector<int>* sectors)
+{
+    std::vector<int> current(num_karts, UNKNOWN_SECTOR);
+    for (unsigned i = 0; i < positions.size(); i++)
+    {
+        int& sector = current[i % num_karts];
+        const int prev_sector = sector;
+        if (use_index)
+            graph->findRoadSector(positions[i], &sector);
+        else
+            graph->findRoadSectorLinear(positions[i], &sector, NULL, false);
+        if (sector == UNKNOWN_SECTOR)
+        {
+            sector = use_index
+                ? graph->findOutOfRoadSector(positions[i], prev_sector)
+                : graph->findOutOfRoadSectorLinear(positions[i], prev_sector,
+                                                   NULL, false);
+        }
+        sectors->push_back(sector);
+    }
+}   // replayKarts
+
+//-----------------------------------------------------------------------------
+/** Checks that the grid finds the same sectors as testing all quads. */
+void Graph::unitTesting()
+{
+    const unsigned num_quads = 400, num_karts = 8;
+    Graph* graph = createTestGraph(num_quads);
+    std::vector<Vec3> positions = createTestPositions(num_quads, num_karts,
+                                                      2000);
+    std::vector<int> linear, grid;
+    replayKarts(graph, positions, num_karts, false, &linear);
+    replayKarts(graph, positions, num_karts, true,  &grid);
+    assert(linear == grid);
+
+    // Random points around the track, also far away from it
+    std::mt19937 g(0);
+    std::uniform_real_distribution<float> coord(-1.2f * num_quads,
+                                                 1.2f * num_quads);
+    std::uniform_real_distribution<float> height(-20.0f, 20.0f);
+    for (unsigned i = 0; i < 5000; i++)
+    {
+        Vec3 xyz(coord(g), height(g), coord(g) * 0.5f);
+        if (i % 2 == 0)
+        {
+            // Close to the road, to test overlapping quads
+            xyz = getTestTrackPoint(num_quads, coord(g) / num_quads,
+                                    coord(g) / num_quads, height(g) * 0.1f);
+        }
+        int curr = i % 3 == 0 ? UNKNOWN_SECTOR : (int)(g() % num_quads);
+        const bool ignore_vertical = i % 5 == 0;
+        int linear_sector = curr, grid_sector = curr;
+        graph->findRoadSectorLinear(xyz, &linear_sector, NULL,
+                                    ignore_vertical);
+        graph->findRoadSector(xyz, &grid_sector, NULL, ignore_vertical);
+        assert(linear_sector == grid_sector);
+        assert(graph->findOutOfRoadSectorLinear(xyz, curr, NULL,
+                                                ignore_vertical) ==
+               graph->findOutOfRoadSector(xyz, curr, NULL, ignore_vertical));
+    }
+    delete graph;
+}   // unitTesting
+
+//-----------------------------------------------------------------------------
+/** Replays the positions of karts on a large test track, finding their
+ *  sectors with the grid and by testing all quads.
+ */
+void Graph::benchmarkSectorLookups()
+{
+    const unsigned num_karts = 16, num_ticks = 3000;
+    for (unsigned num_quads : { 500u, 2000u, 8000u })
+    {
+        Graph* graph = createTestGraph(num_quads);
+        std::vector<Vec3> positions = createTestPositions(num_quads,
+                                                          num_karts,
+                                                          num_ticks);
+        std::vector<int> linear, grid;
+        double start = StkTime::getRealTime();
+        replayKarts(graph, positions, num_karts, false, &linear);
+        double linear_time = StkTime::getRealTime() - start;
+        start = StkTime::getRealTime();
+        replayKarts(graph, positions, num_karts, true, &grid);
+        double grid_time = StkTime::getRealTime() - start;
+
+        unsigned on_road = 0;
+        for (unsigned i = 0; i < positions.size(); i++)
+        {
+            if (graph->getQuad(grid[i])->pointInside(positions[i]))
+                on_road++;
+        }
+        Log::info("Graph", "%d quads, %d lookups (%d on road): linear "
+            "%.3fms, grid %.3fms, %s results.", num_quads,
+            (int)positions.size(), on_road, linear_time * 1000.0,
+            grid_time * 1000.0, linear == grid ? "same" : "DIFFERENT");
+        delete graph;
+    }
+}   // benchmarkSectorLookups
@@ -66,6 +66,8 @@ protected:
     // ------------------------------------------------------------------------
     /** Map 4 bounding box points to 4 closest graph nodes. */
     void loadBoundingBoxNodes();
+    // ------------------------------------------------------------------------
+    void buildSpatialIndex();
 
 private:
     /** The 2d bounding box, used for hashing. */
@@ -75,6 +77,21 @@ private:
     /** The 4 closest graph nodes to the bounding box. */
     int m_bb_nodes[4];
 
+    /** A uniform grid in the XZ plane used to find the quads near a point
+     *  without testing all of them. Each cell lists all quads whose (padded)
+     *  2d bounding box overlaps it: the quads of cell i are
+     *  m_grid_quads[m_grid_cell_start[i]] until
+     *  m_grid_quads[m_grid_cell_start[i + 1]]. Empty if not built. */
+    std::vector<unsigned> m_grid_cell_start;
+
+    std::vector<int> m_grid_quads;
+
+    float m_grid_min_x, m_grid_min_z;
+
+    float m_grid_cell_size;
+
+    int m_grid_width, m_grid_height;
+
     /** The node of the graph mesh. */
     scene::ISceneNode *m_node;
 
@@ -106,6 +123,29 @@ private:
     virtual bool hasLapLine() const = 0;
     // ------------------------------------------------------------------------
     virtual void differentNodeColor(int n, video::SColor* c) const = 0;
+    // ------------------------------------------------------------------------
+    void findRoadSectorLinear(const Vec3& xyz, int *sector,
+                              std::vector<int> *all_sectors,
+                              bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    int findOutOfRoadSectorLinear(const Vec3& xyz, const int curr_sector,
+                                  std::vector<int> *all_sectors,
+                                  bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    int findOutOfRoadSectorInGrid(const Vec3& xyz, int first_sector,
+                                  bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    void getGridCell(const Vec3& xyz, int* x, int* z) const;
+    // ------------------------------------------------------------------------
+    static void replayKarts(Graph* graph, const std::vector<Vec3>& positions,
+                            unsigned num_karts, bool use_index,
+                            std::vector<int>* sectors);
+    // ------------------------------------------------------------------------
+    static Graph* createTestGraph(unsigned num_quads);
+    // ------------------------------------------------------------------------
+    static std::vector<Vec3> createTestPositions(unsigned num_quads,
+                                                 unsigned num_karts,
+                                                 unsigned num_ticks);
 
 public:
     static const int UNKNOWN_SECTOR;
@@ -172,6 +212,10 @@ public:
     const Vec3& getBBMax() const                           { return m_bb_max; }
     // ------------------------------------------------------------------------
     const int* getBBNodes() const                        { return m_bb_nodes; }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+    // ------------------------------------------------------------------------
+    static void benchmarkSectorLookups();
 
 };   // Graph
 
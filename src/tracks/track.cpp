@@ -59,6 +59,7 @@
 #include "main_loop.hpp"
 #include "modes/linear_world.hpp"
 #include "modes/easter_egg_hunt.hpp"
+#include "network/match_log.hpp"
 #include "network/network_config.hpp"
 #include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
@@ -103,7 +104,14 @@ bool        Track::m_dont_load_navmesh = false;
 std::atomic<Track*> Track::m_current_track[PT_COUNT];
 
 // ----------------------------------------------------------------------------
-Track::Track(const std::string &filename)
+/** Creates a track from its track.xml file.
+ *  \param filename Name of the track.xml file.
+ *  \param info Optional, either the already parsed track.xml file, or the
+ *         entry of the track index (see TrackManager), in which case only
+ *         the information needed for menus is loaded, and the remaining
+ *         is loaded at the first loadTrackModel.
+ */
+Track::Track(const std::string &filename, const XMLNode* info)
 {
 #ifdef DEBUG
     m_magic_number          = 0x17AC3802;
@@ -177,7 +185,11 @@ Track::Track(const std::string &filename)
     m_all_nodes.clear();
     m_static_physics_only_nodes.clear();
     m_all_cached_meshes.clear();
-    loadTrackInfo();
+    m_full_info_loaded      = false;
+    if (info && info->getName() == "entry")
+        loadIndexInfo(*info);
+    else
+        loadTrackInfo(info);
 }   // Track
 
 //-----------------------------------------------------------------------------
@@ -510,7 +522,97 @@ void Track::cleanup()
 }   // cleanup
 
 //-----------------------------------------------------------------------------
-void Track::loadTrackInfo()
+/** Loads all information from track.xml.
+ *  \param xml The parsed track.xml file, or NULL to read it here.
+ */
+void Track::loadTrackInfo(const XMLNode* xml)
+{
+    irr_driver->setSSAORadius(1.);
+    irr_driver->setSSAOK(1.5);
+    irr_driver->setSSAOSigma(1.);
+    XMLNode *root = xml ? NULL : file_manager->createXMLTree(m_filename);
+    if (!xml)
+        xml = root;
+
+    if(!xml || xml->getName()!="track")
+    {
+        delete root;
+        std::ostringstream o;
+        o<<"Can't load track '"<<m_filename<<"', no track element.";
+        throw std::runtime_error(o.str());
+    }
+    loadTrackAttributes(*xml);
+    loadTrackContents(*xml);
+    delete root;
+
+    std::string dir = StringUtils::getPath(m_filename);
+    std::string easter_name = dir + "/easter_eggs.xml";
+
+    XMLNode *easter = file_manager->createXMLTree(easter_name);
+
+    if(easter)
+    {
+        for(unsigned int i=0; i<easter->getNumNodes(); i++)
+        {
+            const XMLNode *eggs = easter->getNode(i);
+            if(eggs->getNumNodes() > 0)
+            {
+                m_has_easter_eggs = true;
+                break;
+            }
+        }
+        delete easter;
+    }
+
+    if(file_manager->fileExists(m_root+"navmesh.xml") && !m_dont_load_navmesh)
+        m_has_navmesh = true;
+    else if ( (m_is_arena || m_is_soccer) && !m_dont_load_navmesh)
+    {
+        Log::warn("Track", "NavMesh is not found for arena %s, "
+                  "disable AI for it.\n", m_name.c_str());
+    }
+    m_full_info_loaded = true;
+}   // loadTrackInfo
+
+//-----------------------------------------------------------------------------
+/** Loads the music, the modes and the curves of track.xml, which are not in
+ *  the track index because they are only needed to play the track.
+ */
+void Track::loadTrackContents(const XMLNode &root)
+{
+    std::vector<std::string> filenames;
+    root.get("music",                  &filenames);
+    getMusicInformation(filenames, m_music);
+
+    for(unsigned int i=0; i<root.getNumNodes(); i++)
+    {
+        const XMLNode *mode=root.getNode(i);
+        if(mode->getName()!="mode") continue;
+        TrackMode tm;
+        mode->get("name",  &tm.m_name      );
+        mode->get("quads", &tm.m_quad_name );
+        mode->get("graph", &tm.m_graph_name);
+        mode->get("scene", &tm.m_scene     );
+        m_all_modes.push_back(tm);
+    }
+    // If no mode is specified, add a default mode.
+    if(m_all_modes.size()==0)
+    {
+        TrackMode tm;
+        m_all_modes.push_back(tm);
+    }
+
+    const XMLNode *xml_node = root.getNode("curves");
+
+    if(xml_node) loadCurves(*xml_node);
+}   // loadTrackContents
+
+//-----------------------------------------------------------------------------
+/** Loads the attributes of the track element of track.xml, which is all
+ *  needed for menus and the server lobby except for the music, the modes and
+ *  the curves.
+ */
+void Track::loadTrackAttributes(const XMLNode &root)
 {
     // Default values
     m_use_fog               = false;
@@ -531,50 +633,36 @@ void Track::loadTrackInfo()
     m_sun_specular_color    = video::SColor(255, 255, 255, 255);
     m_sun_diffuse_color     = video::SColor(255, 255, 255, 255);
     m_sun_position          = core::vector3df(0, 10, 10);
-    irr_driver->setSSAORadius(1.);
-    irr_driver->setSSAOK(1.5);
-    irr_driver->setSSAOSigma(1.);
-    XMLNode *root           = file_manager->createXMLTree(m_filename);
-
-    if(!root || root->getName()!="track")
-    {
-        delete root;
-        std::ostringstream o;
-        o<<"Can't load track '"<<m_filename<<"', no track element.";
-        throw std::runtime_error(o.str());
-    }
-    root->get("name",                  &m_name);
+    root.get("name",                  &m_name);
 
     std::string designer;
-    root->get("designer",              &designer);
+    root.get("designer",              &designer);
     m_designer = StringUtils::xmlDecode(designer);
 
-    root->get("version",               &m_version);
-    std::vector<std::string> filenames;
-    root->get("music",                 &filenames);
-    root->get("screenshot",            &m_screenshot);
-    root->get("gravity",               &m_gravity);
-    root->get("friction",              &m_friction);
-    root->get("soccer",                &m_is_soccer);
-    root->get("arena",                 &m_is_arena);
-    root->get("ctf",                   &m_is_ctf);
-    root->get("max-arena-players",     &m_max_arena_players);
-    root->get("cutscene",              &m_is_cutscene);
-    root->get("groups",                &m_groups);
-    root->get("internal",              &m_internal);
-    root->get("reverse",               &m_reverse_available);
-    root->get("default-number-of-laps",&m_default_number_of_laps);
-    root->get("push-back",             &m_enable_push_back);
-    root->get("clouds",                &m_clouds);
-    root->get("bloom",                 &m_bloom);
-    root->get("bloom-threshold",       &m_bloom_threshold);
-    root->get("shadows",               &m_shadows);
-    root->get("is-during-day",         &m_is_day);
-    root->get("displacement-speed",    &m_displacement_speed);
-    root->get("color-level-in",        &m_color_inlevel);
-    root->get("color-level-out",       &m_color_outlevel);
+    root.get("version",               &m_version);
+    m_screenshot = "";
+    root.get("screenshot",            &m_screenshot);
+    root.get("gravity",               &m_gravity);
+    root.get("friction",              &m_friction);
+    root.get("soccer",                &m_is_soccer);
+    root.get("arena",                 &m_is_arena);
+    root.get("ctf",                   &m_is_ctf);
+    root.get("max-arena-players",     &m_max_arena_players);
+    root.get("cutscene",              &m_is_cutscene);
+    root.get("groups",                &m_groups);
+    root.get("internal",              &m_internal);
+    root.get("reverse",               &m_reverse_available);
+    root.get("default-number-of-laps",&m_default_number_of_laps);
+    root.get("push-back",             &m_enable_push_back);
+    root.get("clouds",                &m_clouds);
+    root.get("bloom",                 &m_bloom);
+    root.get("bloom-threshold",       &m_bloom_threshold);
+    root.get("shadows",               &m_shadows);
+    root.get("is-during-day",         &m_is_day);
+    root.get("displacement-speed",    &m_displacement_speed);
+    root.get("color-level-in",        &m_color_inlevel);
+    root.get("color-level-out",       &m_color_outlevel);
 
-    getMusicInformation(filenames, m_music);
     if (m_default_number_of_laps <= 0)
         m_default_number_of_laps = 3;
     m_actual_number_of_laps = m_default_number_of_laps;
@@ -582,69 +670,20 @@ void Track::loadTrackInfo()
     // Make the default for auto-rescue in battle mode and soccer mode to be false
     if(m_is_arena || m_is_soccer)
         m_enable_auto_rescue = false;
-    root->get("auto-rescue",           &m_enable_auto_rescue);
-    root->get("smooth-normals",        &m_smooth_normals);
+    root.get("auto-rescue",           &m_enable_auto_rescue);
+    root.get("smooth-normals",        &m_smooth_normals);
     // Reverse is meaningless in arena
     if(m_is_arena || m_is_soccer)
         m_reverse_available = false;
 
-
-    for(unsigned int i=0; i<root->getNumNodes(); i++)
-    {
-        const XMLNode *mode=root->getNode(i);
-        if(mode->getName()!="mode") continue;
-        TrackMode tm;
-        mode->get("name",  &tm.m_name      );
-        mode->get("quads", &tm.m_quad_name );
-        mode->get("graph", &tm.m_graph_name);
-        mode->get("scene", &tm.m_scene     );
-        m_all_modes.push_back(tm);
-    }
-    // If no mode is specified, add a default mode.
-    if(m_all_modes.size()==0)
-    {
-        TrackMode tm;
-        m_all_modes.push_back(tm);
-    }
-
     if(m_groups.size()==0) m_groups.push_back(DEFAULT_GROUP_NAME);
-    const XMLNode *xml_node = root->getNode("curves");
-
-    if(xml_node) loadCurves(*xml_node);
 
     // Set the correct paths
     if (m_screenshot.length() > 0)
     {
         m_screenshot = m_root+m_screenshot;
     }
-    delete root;
-
-    std::string dir = StringUtils::getPath(m_filename);
-    std::string easter_name = dir + "/easter_eggs.xml";
-
-    XMLNode *easter = file_manager->createXMLTree(easter_name);
-
-    if(easter)
-    {
-        for(unsigned int i=0; i<easter->getNumNodes(); i++)
-        {
-            const XMLNode *eggs = easter->getNode(i);
-            if(eggs->getNumNodes() > 0)
-            {
-                m_has_easter_eggs = true;
-                break;
-            }
-        }
-        delete easter;
-    }
 
-    if(file_manager->fileExists(m_root+"navmesh.xml") && !m_dont_load_navmesh)
-        m_has_navmesh = true;
-    else if ( (m_is_arena || m_is_soccer) && !m_dont_load_navmesh)
-    {
-        Log::warn("Track", "NavMesh is not found for arena %s, "
-                  "disable AI for it.\n", m_name.c_str());
-    }
     if (m_is_soccer)
     {
         // Currently only max eight players in soccer mode
@@ -653,8 +692,47 @@ void Track::loadTrackInfo()
     // Max 10 players supported in arena
     if (m_max_arena_players > 10)
         m_max_arena_players = 10;
+}   // loadTrackAttributes
 
-}   // loadTrackInfo
+//-----------------------------------------------------------------------------
+/** Loads the information of a track from its entry in the track index,
+ *  which contains the attributes of track.xml and if the directory contains
+ *  easter eggs and a navmesh.
+ */
+void Track::loadIndexInfo(const XMLNode &entry)
+{
+    const XMLNode* root = entry.getNode("track");
+    if (!root)
+    {
+        throw std::runtime_error("Invalid track index entry for '" +
+                                 m_filename + "'.");
+    }
+    loadTrackAttributes(*root);
+    entry.get("easter-eggs", &m_has_easter_eggs);
+    bool navmesh = false;
+    entry.get("navmesh", &navmesh);
+    m_has_navmesh = navmesh && !m_dont_load_navmesh;
+}   // loadIndexInfo
+
+//-----------------------------------------------------------------------------
+/** Loads what a track created from the track index doesn't know yet from
+ *  track.xml. The attributes are not read again, so settings changed since
+ *  (like the number of laps) are kept.
+ */
+void Track::loadRemainingTrackInfo()
+{
+    XMLNode *root = file_manager->createXMLTree(m_filename);
+    if(!root || root->getName()!="track")
+    {
+        delete root;
+        std::ostringstream o;
+        o<<"Can't load track '"<<m_filename<<"', no track element.";
+        throw std::runtime_error(o.str());
+    }
+    loadTrackContents(*root);
+    delete root;
+    m_full_info_loaded = true;
+}   // loadRemainingTrackInfo
 
 //-----------------------------------------------------------------------------
 /** Loads all curves from the XML node.
@@ -910,6 +988,8 @@ void Track::createPhysicsModel(unsigned int main_track_count)
         uploadNodeVertexBuffer(m_all_nodes[i]);
     }
     main_loop->renderGUI(5580);
+    m_track_mesh->setBvhCacheName(m_ident + "-track");
+    m_gfx_effect_mesh->setBvhCacheName(m_ident + "-gfx");
     m_track_mesh->createPhysicalBody(m_friction);
     main_loop->renderGUI(5585);
     m_gfx_effect_mesh->createCollisionShape();
@@ -1793,6 +1873,10 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
 {
     assert(m_current_track[PT_MAIN].load() == NULL);
 
+    // Tracks created from the track index only know about their attributes
+    if (!m_full_info_loaded)
+        loadRemainingTrackInfo();
+
     // Use m_filename to also get the path, not only the identifier
     STKTexManager::getInstance()
         ->setTextureErrorMessage("While loading track '%s'", m_filename);
@@ -1924,6 +2008,11 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         nim->rewinderAdd();
         m_item_manager = nim;
     }
+    else if (MatchLog::isReplaying())
+    {
+        // The seeds of the recorded match are already set
+        m_item_manager = std::make_shared<ItemManager>();
+    }
     else
     {
         // Seed random engine locally
@@ -2320,7 +2409,8 @@ void Track::loadObjects(const XMLNode* root, const std::string& path,
             int geo_level = 0;
             node->get("geometry-level", &geo_level);
             if (UserConfigParams::m_geometry_level + geo_level - 2 > 0 &&
-                !NetworkConfig::get()->isNetworking())
+                !NetworkConfig::get()->isNetworking() &&
+                !MatchLog::isReplaying())
                 continue;
             m_track_object_manager->add(*node, parent, model_def_loader, parent_library);
         }
@@ -214,6 +214,9 @@ private:
     bool                     m_has_easter_eggs;
     /** True if this track has navmesh. */
     bool                     m_has_navmesh;
+    /** False if only the attributes of track.xml were loaded (from the
+     *  track index), the rest is then loaded in loadTrackModel. */
+    bool                     m_full_info_loaded;
     /** True if this track is a soccer arena. */
     bool                     m_is_soccer;
 
@@ -394,7 +397,11 @@ private:
     /** The number of laps that is predefined in a track info dialog. */
     int m_actual_number_of_laps;
 
-    void loadTrackInfo();
+    void loadTrackInfo(const XMLNode* xml = NULL);
+    void loadTrackAttributes(const XMLNode &root);
+    void loadTrackContents(const XMLNode &root);
+    void loadIndexInfo(const XMLNode &entry);
+    void loadRemainingTrackInfo();
     void loadDriveGraph(unsigned int mode_id, const bool reverse);
     void loadArenaGraph(const XMLNode &node);
     btQuaternion getArenaStartRotation(const Vec3& xyz, float heading);
@@ -440,7 +447,8 @@ public:
 
     static const float NOHIT;
 
-                       Track             (const std::string &filename);
+                       Track             (const std::string &filename,
+                                          const XMLNode* info = NULL);
                       ~Track             ();
     void               cleanup           ();
     void               removeCachedData  ();
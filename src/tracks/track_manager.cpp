@@ -20,18 +20,112 @@
 
 #include "config/stk_config.hpp"
 #include "graphics/irr_driver.hpp"
+#include "guiengine/engine.hpp"
 #include "io/file_manager.hpp"
+#include "io/xml_node.hpp"
 #include "tracks/track.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/log.hpp"
+#include "utils/worker_pool.hpp"
 
 #include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 #include <stdio.h>
+#include <sys/stat.h>
 
 TrackManager* track_manager = 0;
 std::vector<std::string>  TrackManager::m_track_search_path;
 
+/** File in the config directory caching the attributes of all track.xml
+ *  files, and the version of its format. */
+static const char* TRACK_INDEX_FILE = "track_index.xml";
+static const int   TRACK_INDEX_VERSION = 1;
+
+/** Maximum number of threads parsing track.xml files. */
+static const unsigned MAX_LOADING_THREADS = 8;
+
+// ----------------------------------------------------------------------------
+/** Returns the key of a track directory in the track index, which changes
+ *  when track.xml or easter_eggs.xml is modified, or files are added to or
+ *  removed from the directory (e.g. navmesh.xml).
+ */
+static std::string getTrackIndexKey(const std::string& dirname)
+{
+    std::ostringstream key;
+    const std::string files[] = { dirname + "track.xml", dirname,
+                                  dirname + "easter_eggs.xml" };
+    for (const std::string& file : files)
+    {
+        struct stat st;
+        if (FileUtils::statU8Path(file, &st) != 0)
+            key << "-:";
+        else
+            key << (int64_t)st.st_mtime << "," << (int64_t)st.st_size << ":";
+    }
+    return key.str();
+}   // getTrackIndexKey
+
+// ----------------------------------------------------------------------------
+/** Writes value as an XML attribute value. Attributes are read byte by byte
+ *  from track.xml (which has no BOM), so they are written back the same way.
+ *  \return False if value has characters not fitting in a byte.
+ */
+static bool encodeIndexAttribute(const core::stringw& value, std::string* out)
+{
+    for (unsigned i = 0; i < value.size(); i++)
+    {
+        uint32_t c = (uint32_t)value[i];
+        if (c > 255)
+            return false;
+        switch (c)
+        {
+        case '&': *out += "&amp;";  break;
+        case '<': *out += "&lt;";   break;
+        case '>': *out += "&gt;";   break;
+        case '"': *out += "&quot;"; break;
+        default:  *out += (char)c;  break;
+        }
+    }
+    return true;
+}   // encodeIndexAttribute
+
+// ----------------------------------------------------------------------------
+/** Returns the entry of a track in the track index, see loadTrackList.
+ *  \param track The loaded track.
+ *  \param dirname Directory of the track.
+ *  \param key Key of the directory, see getTrackIndexKey.
+ *  \param attributes The track element of its track.xml or of its entry in
+ *         the old track index.
+ *  \return The entry, or an empty string if the track can't be cached.
+ */
+static std::string createTrackIndexEntry(const Track* track,
+                                         const std::string& dirname,
+                                         const std::string& key,
+                                         const XMLNode& attributes)
+{
+    core::stringw dir;
+    for (char c : dirname)
+        dir.append((wchar_t)(unsigned char)c);
+    std::string entry = "  <entry dir=\"";
+    encodeIndexAttribute(dir, &entry);
+    entry += "\" key=\"" + key + "\" easter-eggs=\"" +
+        (track->hasEasterEggs() ? "Y" : "N") + "\" navmesh=\"" +
+        (file_manager->fileExists(dirname + "navmesh.xml") ? "Y" : "N") +
+        "\">\n    <track";
+    for (auto& a : attributes.getAttributes())
+    {
+        entry += " " + a.first + "=\"";
+        if (!encodeIndexAttribute(a.second, &entry))
+            return "";
+        entry += "\"";
+    }
+    entry += "/>\n  </entry>\n";
+    return entry;
+}   // createTrackIndexEntry
+
 /** Constructor (currently empty). The real work happens in loadTrackList.
  */
 TrackManager::TrackManager()
@@ -138,7 +232,11 @@ std::vector<std::string> TrackManager::getAllTrackIdentifiers()
 }   // getAllTrackNames
 
 //-----------------------------------------------------------------------------
-/** Loads all tracks from the track directory (data/track).
+/** Loads all tracks from the track directory (data/track). The attributes of
+ *  all track.xml files are cached in the track index in the config
+ *  directory, so tracks which have not changed since the last start are
+ *  created from it without reading their files (see Track::loadIndexInfo).
+ *  The track.xml files of the remaining tracks are parsed in parallel.
  */
 void TrackManager::loadTrackList()
 {
@@ -156,13 +254,18 @@ void TrackManager::loadTrackList()
         delete track;
     m_tracks.clear();
 
+    std::vector<std::string> track_dirs;
     for(unsigned int i=0; i<m_track_search_path.size(); i++)
     {
         const std::string &dir = m_track_search_path[i];
 
         // First test if the directory itself contains a track:
         // ----------------------------------------------------
-        if(loadTrack(dir)) continue;  // track found, no more tests
+        if(file_manager->fileExists(dir+"track.xml"))
+        {
+            track_dirs.push_back(dir);
+            continue;  // track found, no more tests
+        }
 
         // Then see if a subdir of this dir contains tracks
         // ------------------------------------------------
@@ -172,33 +275,145 @@ void TrackManager::loadTrackList()
             subdir != dirs.end(); subdir++)
         {
             if(*subdir=="." || *subdir=="..") continue;
-            loadTrack(dir+*subdir+"/");
+            if(file_manager->fileExists(dir+*subdir+"/track.xml"))
+                track_dirs.push_back(dir+*subdir+"/");
         }   // for dir in dirs
     }   // for i <m_track_search_path.size()
+
+    // Find the tracks which are unchanged in the track index
+    std::string index_file = file_manager->getUserConfigFile(TRACK_INDEX_FILE);
+    XMLNode* index = NULL;
+    if (file_manager->fileExists(index_file))
+        index = file_manager->createXMLTree(index_file);
+    int version = 0;
+    if (index && (index->getName() != "track-index" ||
+        !index->get("version", &version) || version != TRACK_INDEX_VERSION))
+    {
+        delete index;
+        index = NULL;
+    }
+    std::map<std::string, const XMLNode*> cached_entries;
+    for (unsigned i = 0; index && i < index->getNumNodes(); i++)
+    {
+        std::string dir;
+        if (index->getNode(i)->get("dir", &dir))
+            cached_entries[dir] = index->getNode(i);
+    }
+
+    std::vector<std::string> keys(track_dirs.size());
+    std::vector<const XMLNode*> entries(track_dirs.size(), NULL);
+    std::vector<XMLNode*> roots(track_dirs.size(), NULL);
+    std::vector<unsigned> changed;
+    for (unsigned i = 0; i < track_dirs.size(); i++)
+    {
+        keys[i] = getTrackIndexKey(track_dirs[i]);
+        auto it = cached_entries.find(track_dirs[i]);
+        std::string key;
+        if (it != cached_entries.end() && it->second->get("key", &key) &&
+            key == keys[i])
+            entries[i] = it->second;
+        else
+            changed.push_back(i);
+    }
+
+    // Parse the changed track.xml files in parallel. The files are read
+    // without the irrlicht file system, whose archives are not thread safe.
+    if (!changed.empty())
+    {
+        unsigned threads = std::min(
+            WorkerPool::getDefaultThreads(MAX_LOADING_THREADS),
+            (unsigned)changed.size() - 1);
+        WorkerPool pool("TrackLoader", threads);
+        pool.parallelFor((unsigned)changed.size(), [&](unsigned n)
+            {
+                unsigned i = changed[n];
+                FILE* f = FileUtils::fopenU8Path(track_dirs[i] + "track.xml",
+                                                 "rb");
+                if (!f)
+                    return;
+                std::string content;
+                char buffer[4096];
+                size_t read;
+                while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+                    content.append(buffer, read);
+                fclose(f);
+                if (!content.empty())
+                    roots[i] = file_manager->createXMLTreeFromString(content);
+            });
+        Log::info("TrackManager", "Parsed %d of %d track.xml files.",
+                  (int)changed.size(), (int)track_dirs.size());
+    }
+
+    std::string new_index;
+    for (unsigned i = 0; i < track_dirs.size(); i++)
+    {
+        Track* track = loadTrack(track_dirs[i],
+                                 entries[i] ? entries[i] : roots[i]);
+        if (track)
+        {
+            const XMLNode* attributes = entries[i] ?
+                entries[i]->getNode("track") : roots[i];
+            if (attributes && attributes->getName() == "track")
+            {
+                new_index += createTrackIndexEntry(track, track_dirs[i],
+                                                   keys[i], *attributes);
+            }
+        }
+        delete roots[i];
+    }
+    bool index_changed = !index || !changed.empty() ||
+        cached_entries.size() != track_dirs.size();
+    delete index;
+
+    if (!index_changed)
+        return;
+    // Write to a temporary file of this process first, which then replaces
+    // the index in one step, so other processes starting at the same time
+    // never read a partial index
+    std::string tmp_file = FileUtils::getTemporaryPath(index_file);
+    std::ofstream out(FileUtils::getPortableWritingPath(tmp_file),
+                      std::ofstream::out | std::ofstream::binary);
+    out << "<?xml version=\"1.0\"?>\n<track-index version=\""
+        << TRACK_INDEX_VERSION << "\">\n" << new_index << "</track-index>\n";
+    out.close();
+    if (out.fail())
+    {
+        Log::warn("TrackManager", "Cannot write %s.", tmp_file.c_str());
+        file_manager->removeFile(tmp_file);
+        return;
+    }
+    if (FileUtils::replaceU8Path(tmp_file, index_file) != 0)
+    {
+        Log::warn("TrackManager", "Cannot write %s.", index_file.c_str());
+        file_manager->removeFile(tmp_file);
+    }
 }  // loadTrackList
 
 // ----------------------------------------------------------------------------
-/** Tries to load a track from a single directory. Returns true if a track was
- *  successfully loaded.
+/** Tries to load a track from a single directory.
  *  \param dirname Name of the directory to load the track from.
+ *  \param info Optional, either the parsed track.xml file, or the entry of
+ *         the track in the track index (see loadTrackList).
+ *  \return The loaded track, or NULL if none was loaded.
  */
-bool TrackManager::loadTrack(const std::string& dirname)
+Track* TrackManager::loadTrack(const std::string& dirname,
+                               const XMLNode* info)
 {
     std::string config_file = dirname+"track.xml";
-    if(!file_manager->fileExists(config_file))
-        return false;
+    if(!info && !file_manager->fileExists(config_file))
+        return NULL;
 
     Track *track;
 
     try
     {
-        track = new Track(config_file);
+        track = new Track(config_file, info);
     }
     catch (std::exception& e)
     {
         Log::error("TrackManager", "Cannot load track <%s> : %s\n",
                 dirname.c_str(), e.what());
-        return false;
+        return NULL;
     }
 
     if (track->getVersion()<stk_config->m_min_track_version ||
@@ -211,7 +426,7 @@ bool TrackManager::loadTrack(const std::string& dirname)
                   stk_config->m_min_track_version,
                   stk_config->m_max_track_version);
         delete track;
-        return false;
+        return NULL;
     }
     m_all_track_dirs.push_back(dirname);
     m_tracks.push_back(track);
@@ -219,11 +434,12 @@ bool TrackManager::loadTrack(const std::string& dirname)
     updateGroups(track);
 
     // Populate the texture cache with track screenshots
-    // (internal tracks like end cutscene don't have screenshots)
-    if (!track->isInternal())
+    // (internal tracks like end cutscene don't have screenshots, and servers
+    // never show them)
+    if (!track->isInternal() && !GUIEngine::isNoGraphics())
         irr_driver->getTexture(track->getScreenshotFile());
 
-    return true;
+    return track;
 }   // loadTrack
 
 // ----------------------------------------------------------------------------
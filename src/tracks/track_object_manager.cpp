@@ -24,16 +24,57 @@
 #include "graphics/lod_node.hpp"
 #include "graphics/material_manager.hpp"
 #include "io/xml_node.hpp"
+#include "network/match_log.hpp"
 #include "network/network_config.hpp"
 #include "physics/physical_object.hpp"
 #include "tracks/track_object.hpp"
 #include "utils/log.hpp"
+#include "utils/stk_process.hpp"
 
 #include <IMeshSceneNode.h>
 #include <ISceneManager.h>
 
+#include <algorithm>
+
+/** The leaves of the driveable tree are this much larger than the objects,
+ *  so that objects moving a little do not change the tree every time. */
+static const float DRIVEABLE_TREE_MARGIN = 0.5f;
+
+// ----------------------------------------------------------------------------
+/** Collects the indices stored in the leaves of the driveable tree. */
+struct DriveableLeafCollector : public btDbvt::ICollide
+{
+    std::vector<unsigned> *m_indices;
+    // ------------------------------------------------------------------------
+    DriveableLeafCollector(std::vector<unsigned> *indices)
+    {
+        m_indices = indices;
+    }   // DriveableLeafCollector
+    // ------------------------------------------------------------------------
+    void Process(const btDbvtNode *leaf)
+    {
+        m_indices->push_back((unsigned)leaf->dataAsInt);
+    }   // Process
+};   // DriveableLeafCollector
+
+// ----------------------------------------------------------------------------
+/** Computes the bounds of a driveable object for the driveable tree.
+ *  \return False if it has none, and must be tested by every ray.
+ */
+static bool getDriveableVolume(const TrackObject *obj, btDbvtVolume *volume)
+{
+    const PhysicalObject *po = obj->getPhysicalObject();
+    btVector3 min, max;
+    if (!po || !po->getRaycastAabb(&min, &max))
+        return false;
+    *volume = btDbvtVolume::FromMM(min, max);
+    return true;
+}   // getDriveableVolume
+
+// ----------------------------------------------------------------------------
 TrackObjectManager::TrackObjectManager()
 {
+    m_driveable_tree_built = false;
 }   // TrackObjectManager
 
 // ----------------------------------------------------------------------------
@@ -54,7 +95,12 @@ void TrackObjectManager::add(const XMLNode &xml_node, scene::ISceneNode* parent,
         TrackObject *obj = new TrackObject(xml_node, parent, model_def_loader, parent_library);
         m_all_objects.push_back(obj);
         if(obj->isDriveable())
+        {
             m_driveable_objects.push_back(obj);
+            // Objects are normally added before init() builds the tree
+            if (m_driveable_tree_built)
+                buildDriveableTree();
+        }
     }
     catch (std::exception& e)
     {
@@ -74,6 +120,13 @@ void TrackObjectManager::init()
     {
         TrackObject* curr = m_all_objects.m_contents_vector[i];
         curr->onWorldReady();
+        // Look up the collision callbacks now that the scripts are compiled
+        // instead of at the first collision
+        if (curr->getPhysicalObject() && STKProcess::getType() != PT_CHILD)
+        {
+            curr->getPhysicalObject()->getOnKartCollisionHandle();
+            curr->getPhysicalObject()->getOnItemCollisionHandle();
+        }
 
         if (moveable_objects > stk_config->m_max_moveable_objects)
         {
@@ -90,7 +143,8 @@ void TrackObjectManager::init()
         }
 
         // onWorldReady will hide some track objects using scripting
-        if (NetworkConfig::get()->isNetworking() &&
+        if ((NetworkConfig::get()->isNetworking() ||
+             MatchLog::isReplaying()) &&
             curr->isEnabled() && curr->getPhysicalObject() &&
             curr->getPhysicalObject()->isDynamic())
         {
@@ -100,8 +154,56 @@ void TrackObjectManager::init()
             moveable_objects++;
         }
     }
+    buildDriveableTree();
 }   // init
 
+// ----------------------------------------------------------------------------
+/** (Re)builds the tree of driveable objects used by castRay.
+ */
+void TrackObjectManager::buildDriveableTree()
+{
+    m_driveable_tree.clear();
+    m_driveable_leaves.clear();
+    m_unbounded_objects.clear();
+    for (unsigned i = 0; i < m_driveable_objects.size(); i++)
+    {
+        btDbvtVolume volume;
+        if (!getDriveableVolume(m_driveable_objects.get(i), &volume))
+        {
+            m_driveable_leaves.push_back(NULL);
+            m_unbounded_objects.push_back(i);
+            continue;
+        }
+        volume.Expand(btVector3(DRIVEABLE_TREE_MARGIN, DRIVEABLE_TREE_MARGIN,
+                                DRIVEABLE_TREE_MARGIN));
+        btDbvtNode *leaf = m_driveable_tree.insert(volume, NULL);
+        leaf->dataAsInt = (int)i;
+        m_driveable_leaves.push_back(leaf);
+    }
+    m_driveable_tree_built = true;
+}   // buildDriveableTree
+
+// ----------------------------------------------------------------------------
+/** Updates the leaves of objects which moved (e.g. animated or physical
+ *  driveable objects), so that castRay does not miss them.
+ */
+void TrackObjectManager::refitDriveableTree()
+{
+    if (!m_driveable_tree_built)
+        return;
+    for (unsigned i = 0; i < m_driveable_leaves.size(); i++)
+    {
+        btDbvtVolume volume;
+        if (m_driveable_leaves[i] &&
+            getDriveableVolume(m_driveable_objects.get(i), &volume))
+        {
+            // Only changes the tree if the object left its (larger) leaf
+            m_driveable_tree.update(m_driveable_leaves[i], volume,
+                                    DRIVEABLE_TREE_MARGIN);
+        }
+    }
+}   // refitDriveableTree
+
 // ----------------------------------------------------------------------------
 /** Initialises all track objects.
  */
@@ -112,6 +214,7 @@ void TrackObjectManager::reset()
         curr->reset();
         curr->resetEnabled();
     }
+    refitDriveableTree();
 }   // reset
 
 // ----------------------------------------------------------------------------
@@ -193,6 +296,9 @@ void TrackObjectManager::update(float dt)
     {
         curr->update(dt);
     }
+    // The physics update of the last frame and the animations above are
+    // done, so the driveable objects stay here until the next update.
+    refitDriveableTree();
 }   // update
 
 // ----------------------------------------------------------------------------
@@ -203,6 +309,7 @@ void TrackObjectManager::resetAfterRewind()
     {
         curr->resetAfterRewind();
     }
+    refitDriveableTree();
 }   // resetAfterRewind
 
 // ----------------------------------------------------------------------------
@@ -230,6 +337,38 @@ bool TrackObjectManager::castRay(const btVector3 &from,
                                  const Material **material,
                                  btVector3 *normal,
                                  bool interpolate_normal) const
+{
+    m_ray_candidates.clear();
+    if (!m_driveable_tree_built)
+    {
+        for (unsigned i = 0; i < m_driveable_objects.size(); i++)
+            m_ray_candidates.push_back(i);
+    }
+    else
+    {
+        // Only objects whose bounds the ray crosses can be hit
+        m_ray_candidates = m_unbounded_objects;
+        DriveableLeafCollector collector(&m_ray_candidates);
+        btDbvt::rayTest(m_driveable_tree.m_root, from, to, collector);
+        std::sort(m_ray_candidates.begin(), m_ray_candidates.end());
+    }
+    return castRayOnObjects(m_ray_candidates, from, to, hit_point, material,
+                            normal, interpolate_normal);
+}   // castRay
+
+// ----------------------------------------------------------------------------
+/** Does the raycast of castRay against the given driveable objects, which
+ *  must be sorted, so that of objects hit at the same distance the same one
+ *  is used as when testing all objects.
+ *  \param objects Indices of the objects in m_driveable_objects.
+ */
+bool TrackObjectManager::castRayOnObjects(const std::vector<unsigned>& objects,
+                                          const btVector3 &from,
+                                          const btVector3 &to,
+                                          btVector3 *hit_point,
+                                          const Material **material,
+                                          btVector3 *normal,
+                                          bool interpolate_normal) const
 {
     bool result = false;
     float distance = 9999.9f;
@@ -238,8 +377,9 @@ bool TrackObjectManager::castRay(const btVector3 &from,
     {
         distance = hit_point->distance(from);
     }
-    for (const TrackObject* curr : m_driveable_objects)
+    for (unsigned i : objects)
     {
+        const TrackObject* curr = m_driveable_objects.get(i);
         if (!curr->isEnabled())
         {
             // For example jumping pad in cocoa temple
@@ -265,7 +405,8 @@ bool TrackObjectManager::castRay(const btVector3 &from,
         }   // if hit
     }   // for all track objects.
     return result;
-}   // castRay
+}   // castRayOnObjects
+
 
 // ----------------------------------------------------------------------------
 void TrackObjectManager::insertObject(TrackObject* object)
@@ -273,6 +414,40 @@ void TrackObjectManager::insertObject(TrackObject* object)
     m_all_objects.push_back(object);
 }
 
+// ----------------------------------------------------------------------------
+/** Removes an object from the list of driveable objects (e.g. because it
+ *  was joined to the main track mesh), so castRay does not test it anymore.
+ */
+void TrackObjectManager::removeDriveableObject(TrackObject* obj)
+{
+    unsigned index = 0;
+    while (index < m_driveable_objects.size() &&
+           m_driveable_objects.get(index) != obj)
+        index++;
+    if (index == m_driveable_objects.size())
+        return;
+    m_driveable_objects.remove(obj);
+    if (!m_driveable_tree_built)
+        return;
+
+    // Many objects can be removed after init(), so instead of building the
+    // tree again only the indices of the objects after obj are moved
+    if (m_driveable_leaves[index])
+        m_driveable_tree.remove(m_driveable_leaves[index]);
+    m_driveable_leaves.erase(m_driveable_leaves.begin() + index);
+    for (unsigned i = index; i < m_driveable_leaves.size(); i++)
+    {
+        if (m_driveable_leaves[i])
+            m_driveable_leaves[i]->dataAsInt = (int)i;
+    }
+    m_unbounded_objects.clear();
+    for (unsigned i = 0; i < m_driveable_leaves.size(); i++)
+    {
+        if (!m_driveable_leaves[i])
+            m_unbounded_objects.push_back(i);
+    }
+}   // removeDriveableObject
+
 // ----------------------------------------------------------------------------
 /** Removes the object from the scene graph, bullet, and the list of
  *  track objects, and then frees the object.
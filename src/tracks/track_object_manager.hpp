@@ -23,6 +23,8 @@
 #include "tracks/track_object.hpp"
 #include "utils/ptr_vector.hpp"
 
+#include "BulletCollision/BroadphaseCollision/btDbvt.h"
+
 class Track;
 class Vec3;
 class XMLNode;
@@ -51,6 +53,30 @@ protected:
     /** A second list which holds all objects that karts can drive on. */
     PtrVector<TrackObject, REF> m_driveable_objects;
 
+    /** Dynamic AABB tree over the driveable objects, used to cull rays before
+     *  the raycast against each object mesh. The data of each leaf is the
+     *  index of its object in m_driveable_objects. Built in init(). */
+    btDbvt m_driveable_tree;
+
+    /** The leaf of each driveable object (same index), or NULL for objects
+     *  without bounds (e.g. not 'exact'), which are tested by every ray. */
+    std::vector<btDbvtNode*> m_driveable_leaves;
+
+    /** Indices of the driveable objects without a leaf. */
+    std::vector<unsigned> m_unbounded_objects;
+
+    bool m_driveable_tree_built;
+
+    /** Objects to raycast against, reused by castRay to avoid allocations. */
+    mutable std::vector<unsigned> m_ray_candidates;
+
+    void buildDriveableTree();
+    void refitDriveableTree();
+    bool castRayOnObjects(const std::vector<unsigned>& objects,
+                          const btVector3 &from, const btVector3 &to,
+                          btVector3 *hit_point, const Material **material,
+                          btVector3 *normal, bool interpolate_normal) const;
+
 public:
          TrackObjectManager();
         ~TrackObjectManager();
@@ -72,7 +98,7 @@ public:
     void insertObject(TrackObject* object);
 
     void removeObject(TrackObject* who);
-    void removeDriveableObject(TrackObject* obj) { m_driveable_objects.remove(obj); }
+    void removeDriveableObject(TrackObject* obj);
     TrackObject* getTrackObject(const std::string& libraryInstance, const std::string& name);
 
           PtrVector<TrackObject>& getObjects()       { return m_all_objects; }
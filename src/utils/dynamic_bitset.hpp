@@ -0,0 +1,175 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_DYNAMIC_BITSET_HPP
+#define HEADER_DYNAMIC_BITSET_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/** A set of small integers (like the ids of AssetIds) stored as bits, which
+ *  grows as needed. Bits past the end are treated as unset, so sets of
+ *  different sizes can be compared.
+ */
+class DynamicBitset
+{
+private:
+    std::vector<uint64_t> m_words;
+
+    // ------------------------------------------------------------------------
+    static unsigned popcount(uint64_t word)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return (unsigned)__builtin_popcountll(word);
+#else
+        word = word - ((word >> 1) & 0x5555555555555555ULL);
+        word = (word & 0x3333333333333333ULL) +
+            ((word >> 2) & 0x3333333333333333ULL);
+        word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        return (unsigned)((word * 0x0101010101010101ULL) >> 56);
+#endif
+    }   // popcount
+
+public:
+    // ------------------------------------------------------------------------
+    void set(unsigned i)
+    {
+        if (i / 64 >= m_words.size())
+            m_words.resize(i / 64 + 1, 0);
+        m_words[i / 64] |= (uint64_t)1 << (i % 64);
+    }   // set
+    // ------------------------------------------------------------------------
+    void reset(unsigned i)
+    {
+        if (i / 64 < m_words.size())
+            m_words[i / 64] &= ~((uint64_t)1 << (i % 64));
+    }   // reset
+    // ------------------------------------------------------------------------
+    bool test(unsigned i) const
+    {
+        return i / 64 < m_words.size() &&
+            (m_words[i / 64] & ((uint64_t)1 << (i % 64))) != 0;
+    }   // test
+    // ------------------------------------------------------------------------
+    void clear()                                          { m_words.clear(); }
+    // ------------------------------------------------------------------------
+    /** Returns the number of bits set. */
+    unsigned count() const
+    {
+        unsigned n = 0;
+        for (uint64_t word : m_words)
+            n += popcount(word);
+        return n;
+    }   // count
+    // ------------------------------------------------------------------------
+    bool none() const
+    {
+        for (uint64_t word : m_words)
+        {
+            if (word != 0)
+                return false;
+        }
+        return true;
+    }   // none
+    // ------------------------------------------------------------------------
+    /** Returns the number of bits set in both this and other. */
+    unsigned countAnd(const DynamicBitset& other) const
+    {
+        size_t size = std::min(m_words.size(), other.m_words.size());
+        unsigned n = 0;
+        for (size_t i = 0; i < size; i++)
+            n += popcount(m_words[i] & other.m_words[i]);
+        return n;
+    }   // countAnd
+    // ------------------------------------------------------------------------
+    /** True if all bits set in other are set in this. */
+    bool containsAll(const DynamicBitset& other) const
+    {
+        for (size_t i = 0; i < other.m_words.size(); i++)
+        {
+            uint64_t word = i < m_words.size() ? m_words[i] : 0;
+            if ((other.m_words[i] & ~word) != 0)
+                return false;
+        }
+        return true;
+    }   // containsAll
+    // ------------------------------------------------------------------------
+    DynamicBitset& operator&=(const DynamicBitset& other)
+    {
+        if (m_words.size() > other.m_words.size())
+            m_words.resize(other.m_words.size());
+        for (size_t i = 0; i < m_words.size(); i++)
+            m_words[i] &= other.m_words[i];
+        return *this;
+    }   // operator&=
+    // ------------------------------------------------------------------------
+    DynamicBitset& operator|=(const DynamicBitset& other)
+    {
+        if (m_words.size() < other.m_words.size())
+            m_words.resize(other.m_words.size(), 0);
+        for (size_t i = 0; i < other.m_words.size(); i++)
+            m_words[i] |= other.m_words[i];
+        return *this;
+    }   // operator|=
+    // ------------------------------------------------------------------------
+    /** Returns the n-th (from 0) bit set, or -1 if less are set. */
+    int findNth(unsigned n) const
+    {
+        for (size_t i = 0; i < m_words.size(); i++)
+        {
+            uint64_t word = m_words[i];
+            unsigned bits = popcount(word);
+            if (n >= bits)
+            {
+                n -= bits;
+                continue;
+            }
+            for (; n > 0; n--)
+                word &= word - 1;
+            unsigned bit = 0;
+            while ((word & 1) == 0)
+            {
+                word >>= 1;
+                bit++;
+            }
+            return (int)(i * 64 + bit);
+        }
+        return -1;
+    }   // findNth
+    // ------------------------------------------------------------------------
+    /** Calls f(i) for each bit i set, in increasing order. */
+    template<typename F> void forEach(F f) const
+    {
+        for (size_t i = 0; i < m_words.size(); i++)
+        {
+            uint64_t word = m_words[i];
+            unsigned bit = 0;
+            while (word != 0)
+            {
+                if (word & 1)
+                    f((unsigned)(i * 64 + bit));
+                word >>= 1;
+                bit++;
+            }
+        }
+    }   // forEach
+
+};   // DynamicBitset
+
+#endif
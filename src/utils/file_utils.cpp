@@ -19,6 +19,7 @@
 #include "utils/log.hpp"
 #include "utils/string_utils.hpp"
 
+#include <atomic>
 #include <stdio.h>
 #include <string>
 #include <sys/stat.h>
@@ -110,6 +111,8 @@ std::string FileUtils::Private::getShortPathWriting(const std::string& u8_path)
     }
     return FileUtils::Private::getShortPathW(w_path);
 }   // getShortPathWriting
+#else
+#include <unistd.h>
 #endif
 
 // ----------------------------------------------------------------------------
@@ -166,3 +169,37 @@ int FileUtils::renameU8Path(const std::string& u8_path_old,
     return rename(u8_path_old.c_str(), u8_path_new.c_str());
 #endif
 }   // renameU8Path
+
+// ----------------------------------------------------------------------------
+/** Renames a file, replacing the new path if it exists in one step, so other
+ *  processes either find the old or the new file there.
+ */
+int FileUtils::replaceU8Path(const std::string& u8_path_old,
+                             const std::string& u8_path_new)
+{
+#if defined(WIN32)
+    // _wrename fails if the new path exists
+    return MoveFileExW(StringUtils::utf8ToWide(u8_path_old).c_str(),
+        StringUtils::utf8ToWide(u8_path_new).c_str(),
+        MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+#else
+    return rename(u8_path_old.c_str(), u8_path_new.c_str());
+#endif
+}   // replaceU8Path
+
+// ----------------------------------------------------------------------------
+/** Returns a path next to u8_path to write a file before it's moved to
+ *  u8_path with replaceU8Path. It's unique for each process and call, so
+ *  processes sharing a directory never write to the same temporary file.
+ */
+std::string FileUtils::getTemporaryPath(const std::string& u8_path)
+{
+    static std::atomic<unsigned> count(0);
+#if defined(WIN32)
+    unsigned pid = (unsigned)GetCurrentProcessId();
+#else
+    unsigned pid = (unsigned)getpid();
+#endif
+    return u8_path + "." + StringUtils::toString(pid) + "-" +
+        StringUtils::toString(count++) + ".tmp";
+}   // getTemporaryPath
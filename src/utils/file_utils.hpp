@@ -39,6 +39,11 @@ namespace FileUtils
     int renameU8Path(const std::string& u8_path_old,
                      const std::string& u8_path_new);
     // ------------------------------------------------------------------------
+    int replaceU8Path(const std::string& u8_path_old,
+                      const std::string& u8_path_new);
+    // ------------------------------------------------------------------------
+    std::string getTemporaryPath(const std::string& u8_path);
+    // ------------------------------------------------------------------------
     /* Return a path which can be opened for writing in all systems, as long as
      * u8_path is unicode encoded. */
     inline std::string getPortableWritingPath(const std::string& u8_path)
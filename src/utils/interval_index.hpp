@@ -0,0 +1,174 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_INTERVAL_INDEX_HPP
+#define HEADER_INTERVAL_INDEX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <utility>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+/** Sets next to key + 1 for the keys of IntervalIndex.
+ *  \return False if key is the largest value. */
+template<typename Key>
+bool nextIntervalKey(const Key& key, Key* next)
+{
+    if (key == std::numeric_limits<Key>::max())
+        return false;
+    *next = key + 1;
+    return true;
+}   // nextIntervalKey
+
+// ----------------------------------------------------------------------------
+/** 128 bit keys (like IPv6 addresses), the upper 64 bits first. */
+inline bool nextIntervalKey(const std::pair<uint64_t, uint64_t>& key,
+                            std::pair<uint64_t, uint64_t>* next)
+{
+    const uint64_t max = std::numeric_limits<uint64_t>::max();
+    if (key.second != max)
+        *next = std::make_pair(key.first, key.second + 1);
+    else if (key.first != max)
+        *next = std::make_pair(key.first + 1, (uint64_t)0);
+    else
+        return false;
+    return true;
+}   // nextIntervalKey
+
+// ============================================================================
+/** Finds the values of closed intervals [start, end] containing a key in
+ *  O(log n). Intervals can overlap: build() splits the key range into
+ *  segments where the same intervals apply, and stores for each segment the
+ *  intervals covering it, the one with the largest start (then the one added
+ *  last) first. After adding intervals build() must be called before find().
+ */
+template<typename Key, typename Value>
+class IntervalIndex
+{
+private:
+    struct Interval
+    {
+        Key m_start;
+        Key m_end;
+        Value m_value;
+    };
+
+    std::vector<Interval> m_intervals;
+
+    /** Sorted first keys of each segment, which lasts until the next one. */
+    std::vector<Key> m_bounds;
+
+    /** Intervals covering segment i are m_covering[m_first[i]] until
+     *  m_covering[m_first[i + 1]]. */
+    std::vector<unsigned> m_first;
+
+    std::vector<unsigned> m_covering;
+
+public:
+    // ------------------------------------------------------------------------
+    void add(const Key& start, const Key& end, const Value& value)
+    {
+        if (end < start)
+            return;
+        m_intervals.push_back({ start, end, value });
+    }   // add
+    // ------------------------------------------------------------------------
+    void clear()
+    {
+        m_intervals.clear();
+        m_bounds.clear();
+        m_first.clear();
+        m_covering.clear();
+    }   // clear
+    // ------------------------------------------------------------------------
+    void build()
+    {
+        m_bounds.clear();
+        m_first.clear();
+        m_covering.clear();
+
+        // Keys where the intervals covering them change
+        std::vector<std::pair<Key, unsigned> > starts, ends;
+        for (unsigned i = 0; i < m_intervals.size(); i++)
+        {
+            starts.emplace_back(m_intervals[i].m_start, i);
+            Key next;
+            if (nextIntervalKey(m_intervals[i].m_end, &next))
+                ends.emplace_back(next, i);
+        }
+        std::sort(starts.begin(), starts.end());
+        std::sort(ends.begin(), ends.end());
+
+        auto priority = [this](unsigned a, unsigned b)
+            {
+                if (m_intervals[a].m_start < m_intervals[b].m_start ||
+                    m_intervals[b].m_start < m_intervals[a].m_start)
+                    return m_intervals[b].m_start < m_intervals[a].m_start;
+                return a > b;
+            };
+        std::set<unsigned, decltype(priority)> active(priority);
+        size_t s = 0, e = 0;
+        while (s < starts.size() || e < ends.size())
+        {
+            Key key;
+            if (e == ends.size() ||
+                (s < starts.size() && starts[s].first < ends[e].first))
+                key = starts[s].first;
+            else
+                key = ends[e].first;
+            for (; e < ends.size() && !(key < ends[e].first); e++)
+                active.erase(ends[e].second);
+            for (; s < starts.size() && !(key < starts[s].first); s++)
+                active.insert(starts[s].second);
+            m_bounds.push_back(key);
+            m_first.push_back((unsigned)m_covering.size());
+            m_covering.insert(m_covering.end(), active.begin(), active.end());
+        }
+        m_first.push_back((unsigned)m_covering.size());
+    }   // build
+    // ------------------------------------------------------------------------
+    /** Returns the first value (see above for the order) of intervals
+     *  containing key for which accept(value) is true, or NULL. */
+    template<typename F>
+    const Value* find(const Key& key, F accept) const
+    {
+        auto it = std::upper_bound(m_bounds.begin(), m_bounds.end(), key);
+        if (it == m_bounds.begin())
+            return NULL;
+        size_t segment = it - m_bounds.begin() - 1;
+        for (unsigned i = m_first[segment]; i < m_first[segment + 1]; i++)
+        {
+            const Value& value = m_intervals[m_covering[i]].m_value;
+            if (accept(value))
+                return &value;
+        }
+        return NULL;
+    }   // find
+    // ------------------------------------------------------------------------
+    const Value* find(const Key& key) const
+                     { return find(key, [](const Value&) { return true; }); }
+    // ------------------------------------------------------------------------
+    /** Returns the number of intervals added. */
+    size_t size() const                          { return m_intervals.size(); }
+
+};   // IntervalIndex
+
+#endif
@@ -0,0 +1,158 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_MPSC_QUEUE_HPP
+#define HEADER_MPSC_QUEUE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/** A queue for many producer threads and a single consumer thread. Items are
+ *  stored in a fixed size ring, where each slot has a sequence number telling
+ *  if it can be written or read, so pushing only needs an atomic increment
+ *  in the common case. If the ring is full (e.g. the consumer is blocked),
+ *  items go to an overflow vector protected by a mutex, which is used for
+ *  all items until the consumer has emptied it, so the order of items pushed
+ *  by the same thread is kept.
+ */
+template<typename T>
+class MPSCQueue : public NoCopy
+{
+private:
+    struct Slot
+    {
+        std::atomic<size_t> m_sequence;
+        T m_item;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+
+    const size_t m_mask;
+
+    /** Next position to write, shared by all producers. */
+    std::atomic<size_t> m_write_pos;
+
+    /** Keep the read position in a different cache line than the write
+     *  position, it's only used by the consumer. */
+    char m_padding[64];
+
+    size_t m_read_pos;
+
+    std::atomic<bool> m_has_overflow;
+
+    std::mutex m_overflow_mutex;
+
+    std::vector<T> m_overflow;
+
+    // ------------------------------------------------------------------------
+    bool tryPush(T& item)
+    {
+        size_t pos = m_write_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true)
+        {
+            slot = &m_slots[pos & m_mask];
+            size_t seq = slot->m_sequence.load(std::memory_order_acquire);
+            if (seq == pos)
+            {
+                if (m_write_pos.compare_exchange_weak(pos, pos + 1,
+                    std::memory_order_relaxed))
+                    break;
+            }
+            else if (seq < pos)
+            {
+                // Slot not read yet since last round, the ring is full
+                return false;
+            }
+            else
+                pos = m_write_pos.load(std::memory_order_relaxed);
+        }
+        slot->m_item = std::move(item);
+        slot->m_sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }   // tryPush
+
+    // ------------------------------------------------------------------------
+    bool tryPop(T* item)
+    {
+        Slot* slot = &m_slots[m_read_pos & m_mask];
+        if (slot->m_sequence.load(std::memory_order_acquire) !=
+            m_read_pos + 1)
+            return false;
+        *item = std::move(slot->m_item);
+        slot->m_sequence.store(m_read_pos + m_mask + 1,
+            std::memory_order_release);
+        m_read_pos++;
+        return true;
+    }   // tryPop
+
+public:
+    /** \param capacity Size of the ring, must be a power of 2. */
+    MPSCQueue(size_t capacity)
+        : m_slots(new Slot[capacity]), m_mask(capacity - 1)
+    {
+        assert(capacity > 1 && (capacity & m_mask) == 0);
+        for (size_t i = 0; i < capacity; i++)
+            m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+        m_write_pos.store(0);
+        m_read_pos = 0;
+        m_has_overflow.store(false);
+    }   // MPSCQueue
+    // ------------------------------------------------------------------------
+    /** Adds an item, can be called from any thread. */
+    void push(T item)
+    {
+        if (!m_has_overflow.load(std::memory_order_acquire) && tryPush(item))
+            return;
+        std::lock_guard<std::mutex> lock(m_overflow_mutex);
+        m_overflow.push_back(std::move(item));
+        m_has_overflow.store(true, std::memory_order_release);
+    }   // push
+    // ------------------------------------------------------------------------
+    /** Calls f for each item in the queue in pushing order, and removes them.
+     *  Only one thread at a time can call this. Items pushed while this is
+     *  running may be left for the next call. */
+    template<typename F> void consume(F f)
+    {
+        T item;
+        while (tryPop(&item))
+            f(item);
+        // If a producer is still writing its slot, the overflow items must
+        // wait, they may have been pushed later by the same thread
+        if (!m_has_overflow.load(std::memory_order_acquire) ||
+            m_write_pos.load(std::memory_order_acquire) != m_read_pos)
+            return;
+        std::vector<T> overflow;
+        std::unique_lock<std::mutex> lock(m_overflow_mutex);
+        std::swap(overflow, m_overflow);
+        m_has_overflow.store(false, std::memory_order_release);
+        lock.unlock();
+        for (T& o : overflow)
+            f(o);
+    }   // consume
+
+};   // MPSCQueue
+
+#endif
@@ -27,11 +27,14 @@
 #include "guiengine/scalable_font.hpp"
 #include "io/file_manager.hpp"
 #include "utils/file_utils.hpp"
+#include "utils/log.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/time.hpp"
 #include "utils/tls.hpp"
 #include "utils/vs.hpp"
 
 #include <algorithm>
+#include <cstdio>
 #include <fstream>
 #include <ostream>
 #include <stack>
@@ -39,6 +42,12 @@
 
 Profiler profiler;
 
+// Definitions of the in-class constants, which are passed by reference
+// (e.g. to std::min)
+const int      Profiler::MAX_MARKERS;
+const unsigned Profiler::TRACE_BUFFER_SIZE;
+const int      Profiler::MAX_TRACE_THREADS;
+
 // Unit is in pencentage of the screen dimensions
 #define MARGIN_X    0.02f    // left and right margin
 #define MARGIN_Y    0.02f    // top margin
@@ -91,15 +100,37 @@ Profiler::Profiler()
     m_current_frame       = 0;
     m_has_wrapped_around  = false;
     m_threads_used = 1;
+
+    m_marker_count        = 0;
+    for (int i = 0; i < MAX_TRACE_THREADS; i++)
+        m_trace_buffers[i] = NULL;
+    m_trace_buffer_count  = 0;
+    m_continuous_trace    = false;
+    m_trace_captures      = 0;
+    m_tracing             = false;
+    m_trace_epoch         = std::chrono::steady_clock::now();
+    m_stop_capture        = false;
 }   // Profile
 
 //-----------------------------------------------------------------------------
 Profiler::~Profiler()
 {
+    {
+        std::lock_guard<std::mutex> lock(m_capture_mutex);
+        m_stop_capture = true;
+    }
+    m_capture_cv.notify_all();
+    if (m_capture_thread.joinable())
+        m_capture_thread.join();
+    // The trace buffers are not freed, threads still running at exit can
+    // still use them
 }   // ~Profiler
 
 thread_local int g_thread_id = -1;
 const int MAX_THREADS = 10;
+/** Index of the trace buffer of a thread, -1 if it has none yet, -2 if there
+ *  were too many threads. */
+thread_local int g_trace_buffer_index = -1;
 //-----------------------------------------------------------------------------
 /** It is split from the constructor so that it can be avoided allocating
  *  unnecessary memory when the profiler is never used (for example in no
@@ -130,13 +161,83 @@ int Profiler::getThreadID()
     return g_thread_id;
 }   // getThreadID
 
+//-----------------------------------------------------------------------------
+/** Returns the id of a marker name, registering it the first time. Names are
+ *  never removed, so after MAX_MARKERS names all new ones share one id.
+ */
+int Profiler::registerMarker(const char* name, const video::SColor& colour)
+{
+    std::lock_guard<std::mutex> lock(m_markers_mutex);
+    auto it = m_marker_ids.find(name);
+    if (it != m_marker_ids.end())
+        return it->second;
+
+    int id = m_marker_count.load(std::memory_order_relaxed);
+    if (id == MAX_MARKERS - 1)
+    {
+        if (m_markers[id].m_name.empty())
+        {
+            m_markers[id].m_name = "Other markers";
+            m_markers[id].m_colour = video::SColor(0xFF, 0x80, 0x80, 0x80);
+            m_marker_count.store(id + 1, std::memory_order_release);
+        }
+        return id;
+    }
+    m_markers[id].m_name = name;
+    m_markers[id].m_colour = colour;
+    m_marker_ids[name] = id;
+    m_marker_count.store(id + 1, std::memory_order_release);
+    return id;
+}   // registerMarker
+
 //-----------------------------------------------------------------------------
 /// Push a new marker that starts now
+void Profiler::pushCPUMarker(int id)
+{
+    if (m_tracing.load(std::memory_order_relaxed))
+        addTraceEvent((uint32_t)id);
+    if (UserConfigParams::m_profiler_enabled)
+        pushScreenMarker(id);
+}   // pushCPUMarker
+
+//-----------------------------------------------------------------------------
+/** Push a new marker that starts now, with a name which is looked up (see
+ *  PROFILER_PUSH_DYNAMIC_CPU_MARKER). */
 void Profiler::pushCPUMarker(const char* name, const video::SColor& colour)
 {
-    // Don't do anything when disabled or frozen
-    if (!UserConfigParams::m_profiler_enabled ||
-         m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
+    if (!m_tracing.load(std::memory_order_relaxed) &&
+        !UserConfigParams::m_profiler_enabled)
+        return;
+    pushCPUMarker(registerMarker(name, colour));
+}   // pushCPUMarker
+
+//-----------------------------------------------------------------------------
+/// Stop the last pushed marker
+void Profiler::popCPUMarker()
+{
+    if (m_tracing.load(std::memory_order_relaxed))
+        addTraceEvent(TRACE_END);
+    if (UserConfigParams::m_profiler_enabled)
+        popScreenMarker();
+}   // popCPUMarker
+
+//-----------------------------------------------------------------------------
+/** Records the value of a counter in the trace buffers (see
+ *  PROFILER_SET_COUNTER). Counters are not shown on screen.
+ *  \param id The id of the counter, registered as a marker.
+ */
+void Profiler::setCounter(int id, int64_t value)
+{
+    if (m_tracing.load(std::memory_order_relaxed))
+        addTraceEvent((uint32_t)id | TRACE_COUNTER, value);
+}   // setCounter
+
+//-----------------------------------------------------------------------------
+/** Records the start of a marker for the on-screen display. */
+void Profiler::pushScreenMarker(int id)
+{
+    // Don't do anything when frozen
+    if (m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE)
         return;
 
     // We need to look before getting the thread id (since this might
@@ -145,7 +246,7 @@ void Profiler::pushCPUMarker(const char* name, const video::SColor& colour)
     int thread_id = getThreadID();
 
     ThreadData &td = m_all_threads_data[thread_id];
-    AllEventData::iterator i = td.m_all_event_data.find(name);
+    AllEventData::iterator i = td.m_all_event_data.find(id);
     double  start = getTimeMilliseconds() - m_time_last_sync;
     if (i != td.m_all_event_data.end())
     {
@@ -153,26 +254,25 @@ void Profiler::pushCPUMarker(const char* name, const video::SColor& colour)
     }
     else
     {
-        EventData ed(colour, m_max_frames);
+        EventData ed(m_markers[id].m_colour, m_max_frames);
         ed.setStart(m_current_frame, start, (int)td.m_event_stack.size());
-        td.m_all_event_data[name] = ed;
+        td.m_all_event_data[id] = ed;
         // Ordered headings is used to determine the order in which the
         // bar graph is drawn. Outer profiling events will be added first,
         // so they will be drawn first, which gives the proper nested
         // displayed of events.
-        td.m_ordered_headings.push_back(name);
+        td.m_ordered_headings.push_back(id);
     }
-    td.m_event_stack.push_back(name);
+    td.m_event_stack.push_back(id);
     m_lock.unlock();
-}   // pushCPUMarker
+}   // pushScreenMarker
 
 //-----------------------------------------------------------------------------
-/// Stop the last pushed marker
-void Profiler::popCPUMarker()
+/** Records the end of the last pushed marker for the on-screen display. */
+void Profiler::popScreenMarker()
 {
-    // Don't do anything when disabled or frozen
-    if( !UserConfigParams::m_profiler_enabled ||
-        m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
+    // Don't do anything when frozen
+    if (m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE)
         return;
     double now = getTimeMilliseconds();
 
@@ -191,12 +291,283 @@ void Profiler::popCPUMarker()
 
     assert(td.m_event_stack.size() > 0);
 
-    const std::string &name = td.m_event_stack.back();
-    td.m_all_event_data[name].setEnd(m_current_frame, now - m_time_last_sync);
+    int id = td.m_event_stack.back();
+    td.m_all_event_data[id].setEnd(m_current_frame, now - m_time_last_sync);
 
     td.m_event_stack.pop_back();
     m_lock.unlock();
-}   // popCPUMarker
+}   // popScreenMarker
+
+//-----------------------------------------------------------------------------
+uint64_t Profiler::getTraceTime() const
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - m_trace_epoch).count();
+}   // getTraceTime
+
+//-----------------------------------------------------------------------------
+/** Returns the trace buffer of the calling thread, creating it the first
+ *  time. Returns NULL if there are too many threads.
+ */
+Profiler::TraceBuffer* Profiler::getTraceBuffer()
+{
+    if (g_trace_buffer_index >= 0)
+        return m_trace_buffers[g_trace_buffer_index].load(
+            std::memory_order_relaxed);
+    if (g_trace_buffer_index == -2)
+        return NULL;
+
+    int index = m_trace_buffer_count.fetch_add(1);
+    if (index >= MAX_TRACE_THREADS)
+    {
+        if (index == MAX_TRACE_THREADS)
+        {
+            Log::warn("Profiler", "More than %d threads, not tracing "
+                      "the new ones.", MAX_TRACE_THREADS);
+        }
+        g_trace_buffer_index = -2;
+        return NULL;
+    }
+    TraceBuffer* tb = new TraceBuffer();
+#if defined(__linux__) && defined(__GLIBC__) && defined(__GLIBC_MINOR__)
+#if __GLIBC__ > 2 || __GLIBC_MINOR__ > 11
+    pthread_getname_np(pthread_self(), tb->m_thread_name,
+                       sizeof(tb->m_thread_name));
+#endif
+#endif
+    m_trace_buffers[index].store(tb, std::memory_order_release);
+    g_trace_buffer_index = index;
+    return tb;
+}   // getTraceBuffer
+
+//-----------------------------------------------------------------------------
+/** Adds an event to the trace buffer of this thread. The entry is written
+ *  like a seqlock (its index is invalid while it's written), so writeTrace
+ *  can skip entries overwritten while it reads them.
+ */
+void Profiler::addTraceEvent(uint32_t marker, int64_t value)
+{
+    TraceBuffer* tb = getTraceBuffer();
+    if (tb == NULL)
+        return;
+    uint64_t n = tb->m_count.load(std::memory_order_relaxed);
+    TraceEvent& e = tb->m_events[n % TRACE_BUFFER_SIZE];
+    e.m_index.store(TraceEvent::NO_INDEX, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e.m_time.store(getTraceTime(), std::memory_order_relaxed);
+    e.m_marker.store(marker, std::memory_order_relaxed);
+    e.m_value.store(value, std::memory_order_relaxed);
+    e.m_index.store(n, std::memory_order_release);
+    tb->m_count.store(n + 1, std::memory_order_release);
+}   // addTraceEvent
+
+//-----------------------------------------------------------------------------
+void Profiler::updateTracing()
+{
+    m_tracing = m_continuous_trace || m_trace_captures > 0;
+}   // updateTracing
+
+//-----------------------------------------------------------------------------
+/** Records markers in the trace buffers all the time, so the last events
+ *  can be written at any time with writeTraceToFile. */
+void Profiler::setContinuousTrace(bool enabled)
+{
+    m_continuous_trace = enabled;
+    updateTracing();
+}   // setContinuousTrace
+
+//-----------------------------------------------------------------------------
+/** Records the markers of all threads for some time, then writes them to a
+ *  file (see getTraceFileName) from a separate thread.
+ *  \return False if a capture is already running.
+ */
+bool Profiler::captureTrace(double seconds)
+{
+    std::lock_guard<std::mutex> lock(m_capture_mutex);
+    if (m_trace_captures > 0)
+        return false;
+    // The previous capture thread has written its file
+    if (m_capture_thread.joinable())
+        m_capture_thread.join();
+
+    m_trace_captures++;
+    updateTracing();
+    uint64_t from = getTraceTime();
+    std::string file_name = getTraceFileName();
+    m_capture_thread = std::thread([this, seconds, from, file_name]()
+    {
+        VS::setThreadName("ProfilerCapture");
+        std::unique_lock<std::mutex> ul(m_capture_mutex);
+        m_capture_cv.wait_for(ul, std::chrono::duration<double>(seconds),
+                              [this]() { return m_stop_capture; });
+        bool stopped = m_stop_capture;
+        ul.unlock();
+        if (!stopped)
+        {
+            std::ofstream f(FileUtils::getPortableWritingPath(file_name));
+            writeTrace(f, from, getTraceTime());
+            if (f.good())
+                Log::info("Profiler", "Trace written to %s.", file_name.c_str());
+            else
+                Log::error("Profiler", "Can't write %s.", file_name.c_str());
+        }
+        m_trace_captures--;
+        updateTracing();
+    });
+    return true;
+}   // captureTrace
+
+//-----------------------------------------------------------------------------
+/** Writes all events in the trace buffers. */
+bool Profiler::writeTraceToFile()
+{
+    std::string file_name = getTraceFileName();
+    std::ofstream f(FileUtils::getPortableWritingPath(file_name));
+    writeTrace(f, 0, getTraceTime());
+    if (!f.good())
+    {
+        Log::error("Profiler", "Can't write %s.", file_name.c_str());
+        return false;
+    }
+    Log::info("Profiler", "Trace written to %s.", file_name.c_str());
+    return true;
+}   // writeTraceToFile
+
+//-----------------------------------------------------------------------------
+/** Returns a new file name for a trace, based on the stdout name. */
+std::string Profiler::getTraceFileName() const
+{
+    return file_manager->getUserConfigFile(file_manager->getStdoutName()) +
+        ".trace-" + StringUtils::toString(StkTime::getTimeSinceEpoch()) +
+        ".json";
+}   // getTraceFileName
+
+//-----------------------------------------------------------------------------
+static void writeJSONString(std::ostream& out, const std::string& str)
+{
+    out << '"';
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if ((unsigned char)c < 0x20)
+            out << ' ';
+        else
+            out << c;
+    }
+    out << '"';
+}   // writeJSONString
+
+//-----------------------------------------------------------------------------
+/** Writes the markers of all trace buffers which overlap a time interval in
+ *  the Chrome trace event format (as complete events, and counters as counter
+ *  events). Markers still running at the end are cut there, ends of markers
+ *  whose start was overwritten in the buffer are skipped.
+ *  \param from, to Times as returned by getTraceTime.
+ */
+void Profiler::writeTrace(std::ostream& out, uint64_t from, uint64_t to)
+{
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    char buffer[128];
+    /** Time, marker and counter value of the events of a thread. */
+    struct Event
+    {
+        uint64_t m_time;
+        uint32_t m_marker;
+        int64_t  m_value;
+    };
+    std::vector<Event> events;
+    int count = std::min(m_trace_buffer_count.load(std::memory_order_acquire),
+                         MAX_TRACE_THREADS);
+    for (int thread = 0; thread < count; thread++)
+    {
+        TraceBuffer* tb =
+            m_trace_buffers[thread].load(std::memory_order_acquire);
+        if (tb == NULL)
+            continue;
+
+        std::string thread_name = tb->m_thread_name[0] ?
+            std::string(tb->m_thread_name) :
+            "Thread " + StringUtils::toString(thread);
+        if (!first)
+            out << ",\n";
+        first = false;
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << thread << ",\"args\":{\"name\":";
+        writeJSONString(out, thread_name);
+        out << "}}";
+
+        // Start times and marker ids of the markers not ended yet
+        std::vector<std::pair<uint64_t, int> > stack;
+        auto write_event = [&](int marker, uint64_t start, uint64_t end)
+        {
+            if (end < from)
+                return;
+            out << ",\n{\"name\":";
+            writeJSONString(out, getMarkerName(marker));
+            snprintf(buffer, sizeof(buffer), ",\"ph\":\"X\",\"pid\":1,"
+                     "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", thread,
+                     (double)start / 1000.0, (double)(end - start) / 1000.0);
+            out << buffer;
+        };
+
+        // Copy the events first, so less are overwritten while reading them
+        events.clear();
+        uint64_t end = tb->m_count.load(std::memory_order_acquire);
+        uint64_t begin = end > TRACE_BUFFER_SIZE ? end - TRACE_BUFFER_SIZE : 0;
+        for (uint64_t n = begin; n < end; n++)
+        {
+            const TraceEvent& e = tb->m_events[n % TRACE_BUFFER_SIZE];
+            uint64_t index = e.m_index.load(std::memory_order_acquire);
+            uint64_t time = e.m_time.load(std::memory_order_relaxed);
+            uint32_t marker = e.m_marker.load(std::memory_order_relaxed);
+            int64_t value = e.m_value.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (index != n || e.m_index.load(std::memory_order_relaxed) != n)
+            {
+                // Overwritten by the thread meanwhile, the older events
+                // can't be paired anymore
+                events.clear();
+                continue;
+            }
+            if (time > to)
+                break;
+            Event event = { time, marker, value };
+            events.push_back(event);
+        }
+
+        for (auto& e : events)
+        {
+            if (e.m_marker & TRACE_COUNTER)
+            {
+                if (e.m_time < from)
+                    continue;
+                out << ",\n{\"name\":";
+                writeJSONString(out,
+                    getMarkerName((int)(e.m_marker & ~TRACE_COUNTER)));
+                snprintf(buffer, sizeof(buffer), ",\"ph\":\"C\",\"pid\":1,"
+                         "\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                         thread, (double)e.m_time / 1000.0,
+                         (long long)e.m_value);
+                out << buffer;
+            }
+            else if (e.m_marker != TRACE_END)
+            {
+                stack.emplace_back(e.m_time, (int)e.m_marker);
+            }
+            else if (!stack.empty())
+            {
+                write_event(stack.back().second, stack.back().first,
+                            e.m_time);
+                stack.pop_back();
+            }
+        }
+        for (auto& open : stack)
+            write_event(open.second, open.first, to);
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}   // writeTrace
 
 //-----------------------------------------------------------------------------
 /** Switches the profiler either on or off.
@@ -449,7 +820,7 @@ void Profiler::draw()
             const Marker &marker = j->second.getMarker(indx);
             std::ostringstream oss;
             oss.precision(4);
-            oss << j->first << " [" << (marker.getDuration()) << " ms / ";
+            oss << getMarkerName(j->first) << " [" << (marker.getDuration()) << " ms / ";
             oss.precision(3);
             oss << marker.getDuration()*100.0 / duration << "%]" << std::endl;
             text += oss.str().c_str();
@@ -542,7 +913,7 @@ void Profiler::writeToFile()
         ThreadData &td = m_all_threads_data[thread_id];
         f << "#  ";
         for (unsigned int i = 0; i < td.m_ordered_headings.size(); i++)
-            f << "\"" << td.m_ordered_headings[i] << "(" << i+1 <<")\"   ";
+            f << "\"" << getMarkerName(td.m_ordered_headings[i]) << "(" << i+1 <<")\"   ";
         f << std::endl;
         int start = m_has_wrapped_around ? m_current_frame + 1 : 0;
         if (start > m_max_frames) start -= m_max_frames;
@@ -583,3 +954,52 @@ void Profiler::writeToFile()
     m_lock.unlock();
 
 }   // writeFile
+
+//-----------------------------------------------------------------------------
+void Profiler::unitTesting()
+{
+    bool continuous = profiler.isContinuousTrace();
+    profiler.setContinuousTrace(true);
+    uint64_t from = profiler.getTraceTime();
+
+    auto add_markers = []()
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            PROFILER_PUSH_CPU_MARKER("Unit test outer", 0xFF, 0x00, 0x00);
+            PROFILER_PUSH_CPU_MARKER("Unit test inner", 0x00, 0xFF, 0x00);
+            PROFILER_POP_CPU_MARKER();
+            PROFILER_POP_CPU_MARKER();
+        }
+    };
+    std::thread other(add_markers);
+    add_markers();
+    other.join();
+    // A pop without push is skipped, a marker not ended yet is written
+    PROFILER_POP_CPU_MARKER();
+    PROFILER_PUSH_DYNAMIC_CPU_MARKER("Unit test \"open\"", 0, 0, 0xFF);
+    for (int i = 0; i < 3; i++)
+        PROFILER_SET_COUNTER("Unit test counter", 1000000000000LL + i);
+
+    std::ostringstream oss;
+    profiler.writeTrace(oss, from, profiler.getTraceTime());
+    PROFILER_POP_CPU_MARKER();
+    profiler.setContinuousTrace(continuous);
+
+    std::string trace = oss.str();
+    auto count = [&trace](const std::string& str)
+    {
+        int n = 0;
+        for (size_t pos = trace.find(str); pos != std::string::npos;
+             pos = trace.find(str, pos + 1))
+            n++;
+        return n;
+    };
+    (void)count;
+    assert(trace.compare(0, 15, "{\"traceEvents\":") == 0);
+    assert(count("{\"name\":\"Unit test outer\",\"ph\":\"X\"") == 200);
+    assert(count("{\"name\":\"Unit test inner\",\"ph\":\"X\"") == 200);
+    assert(count("{\"name\":\"Unit test \\\"open\\\"\",\"ph\":\"X\"") == 1);
+    assert(count("{\"name\":\"Unit test counter\",\"ph\":\"C\"") == 3);
+    assert(count("\"args\":{\"value\":1000000000002}}") == 1);
+}   // unitTesting
@@ -24,13 +24,18 @@
 
 #include <assert.h>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <iostream>
 #include <list>
 #include <map>
+#include <mutex>
 #include <ostream>
 #include <stack>
 #include <streambuf>
 #include <string>
+#include <thread>
 #include <vector>
 
 enum QueryPerf
@@ -69,12 +74,32 @@ double getTimeMilliseconds();
 #define ENABLE_PROFILER
 
 #ifdef ENABLE_PROFILER
-    #define PROFILER_PUSH_CPU_MARKER(name, r, g, b) \
+    /** The name must be a constant, it is registered only once. */
+    #define PROFILER_PUSH_CPU_MARKER(name, r, g, b)                          \
+        do                                                                   \
+        {                                                                    \
+            static const int profiler_marker_id =                           \
+                profiler.registerMarker(name, video::SColor(0xFF, r, g, b)); \
+            profiler.pushCPUMarker(profiler_marker_id);                      \
+        } while (0)
+
+    /** For names built at run time, which are looked up at each push. */
+    #define PROFILER_PUSH_DYNAMIC_CPU_MARKER(name, r, g, b) \
         profiler.pushCPUMarker(name, video::SColor(0xFF, r, g, b))
 
     #define PROFILER_POP_CPU_MARKER()  \
         profiler.popCPUMarker()
 
+    /** Records the value of a counter in the traces, the name must be a
+     *  constant. */
+    #define PROFILER_SET_COUNTER(name, value)                                \
+        do                                                                   \
+        {                                                                    \
+            static const int profiler_counter_id =                          \
+                profiler.registerMarker(name, video::SColor(0xFF, 0, 0, 0)); \
+            profiler.setCounter(profiler_counter_id, value);                 \
+        } while (0)
+
     #define PROFILER_SYNC_FRAME()   \
         profiler.synchronizeFrame()
 
@@ -82,7 +107,9 @@ double getTimeMilliseconds();
         profiler.draw()
 #else
     #define PROFILER_PUSH_CPU_MARKER(name, r, g, b)
+    #define PROFILER_PUSH_DYNAMIC_CPU_MARKER(name, r, g, b)
     #define PROFILER_POP_CPU_MARKER()
+    #define PROFILER_SET_COUNTER(name, value)
     #define PROFILER_SYNC_FRAME()
     #define PROFILER_DRAW()
 #endif
@@ -91,7 +118,9 @@ using namespace irr;
 
 // ============================================================================
 /** \brief class that allows run-time graphical profiling through the use 
- *  of markers.
+ *  of markers. The markers can also be recorded in a ring buffer per thread
+ *  and written as a Chrome trace (chrome://tracing or Perfetto), which works
+ *  without graphics, e.g. on servers (see captureTrace).
  * \ingroup utils
  */
 class Profiler
@@ -201,19 +230,19 @@ private:
     };   // EventData
 
     // ========================================================================
-    /** The mapping of event names to the corresponding EventData. */
-    typedef std::map<std::string, EventData> AllEventData;
+    /** The mapping of marker ids to the corresponding EventData. */
+    typedef std::map<int, EventData> AllEventData;
     // ========================================================================
     struct ThreadData
     {
         /** Stack of events to detect nesting. */
-        std::vector< std::string > m_event_stack;
+        std::vector<int> m_event_stack;
 
-        /** This stores the event names in the order in which they occur.
+        /** This stores the marker ids in the order in which they occur.
         *  This means that 'outer' events occur here before any child
         *  events. This list is then used to determine the order in which the
         *  bar graphs are drawn, which results in the proper nesting of events.*/
-        std::vector<std::string> m_ordered_headings;
+        std::vector<int> m_ordered_headings;
 
         AllEventData m_all_event_data;
     };   // class ThreadData
@@ -253,10 +282,105 @@ private:
     /** Time between now and last sync, used to scale the GUI bar. */
     double m_time_between_sync;
 
-    /** List of all event names. This list is sorted to make sure
-     *  if the circular buffer is dumped more than once the order
-     *  of events remains the same. */
-    std::vector<std::string> m_all_event_names;
+    // ========================================================================
+    /** A registered marker. Entries below m_marker_count are never changed,
+     *  so they can be read without a lock. */
+    struct MarkerInfo
+    {
+        std::string   m_name;
+        video::SColor m_colour;
+    };
+
+    static const int MAX_MARKERS = 1024;
+
+    MarkerInfo m_markers[MAX_MARKERS];
+
+    std::atomic<int> m_marker_count;
+
+    /** Protects registering markers. */
+    std::mutex m_markers_mutex;
+
+    std::map<std::string, int> m_marker_ids;
+
+    // ========================================================================
+    /** A begin or end of a marker in a trace buffer. Atomics are used so that
+     *  a trace can be written while the thread keeps adding events. */
+    struct TraceEvent
+    {
+        static const uint64_t NO_INDEX = 0xffffffffffffffffULL;
+
+        /** The number of the event in the thread, NO_INDEX while the event
+         *  is being written. */
+        std::atomic<uint64_t> m_index;
+
+        /** Nanoseconds since m_trace_epoch. */
+        std::atomic<uint64_t> m_time;
+
+        /** The marker id, or TRACE_END for the end of the last marker. */
+        std::atomic<uint32_t> m_marker;
+
+        /** The value of a counter (m_marker has TRACE_COUNTER set). */
+        std::atomic<int64_t> m_value;
+
+        TraceEvent() : m_index(NO_INDEX), m_time(0), m_marker(0), m_value(0)
+        {}
+    };
+
+    static const uint32_t TRACE_END = 0x80000000u;
+
+    /** Set in the marker of an event which is the value of a counter. */
+    static const uint32_t TRACE_COUNTER = 0x40000000u;
+
+    /** Number of events kept per thread, a power of 2. */
+    static const unsigned TRACE_BUFFER_SIZE = 1 << 16;
+
+    /** The ring buffer of trace events of a thread. Only this thread writes
+     *  to it, so adding events needs no lock. It is kept until the end, since
+     *  there's no portable way to know when a thread ends. */
+    struct TraceBuffer
+    {
+        /** Number of events ever added, so the next one is added at
+         *  m_count % TRACE_BUFFER_SIZE. */
+        std::atomic<uint64_t> m_count;
+
+        std::vector<TraceEvent> m_events;
+
+        /** Name of the thread when it added its first event. */
+        char m_thread_name[16];
+
+        TraceBuffer() : m_count(0), m_events(TRACE_BUFFER_SIZE)
+        {
+            m_thread_name[0] = 0;
+        }
+    };
+
+
+    static const int MAX_TRACE_THREADS = 64;
+
+    /** The index is used as the thread id in the written traces. */
+    std::atomic<TraceBuffer*> m_trace_buffers[MAX_TRACE_THREADS];
+
+    std::atomic<int> m_trace_buffer_count;
+
+    /** If events are added to the trace buffers all the time. */
+    std::atomic<bool> m_continuous_trace;
+
+    /** Number of captures waiting for their end. */
+    std::atomic<int> m_trace_captures;
+
+    /** Fast test if events must be added to the trace buffers. */
+    std::atomic<bool> m_tracing;
+
+    std::chrono::steady_clock::time_point m_trace_epoch;
+
+    /** Thread waiting for the end of a capture to write it. */
+    std::thread m_capture_thread;
+
+    std::mutex m_capture_mutex;
+
+    std::condition_variable m_capture_cv;
+
+    bool m_stop_capture;
 
     // Handling freeze/unfreeze by clicking on the display
     enum FreezeState
@@ -272,14 +396,29 @@ private:
 private:
     int  getThreadID();
     void drawBackground();
+    void pushScreenMarker(int id);
+    void popScreenMarker();
+    void addTraceEvent(uint32_t marker, int64_t value = 0);
+    TraceBuffer* getTraceBuffer();
+    uint64_t getTraceTime() const;
+    void updateTracing();
+    void writeTrace(std::ostream& out, uint64_t from, uint64_t to);
 
 public:
              Profiler();
     virtual ~Profiler();
     void     init();
+    int      registerMarker(const char* name, const video::SColor& colour);
+    void     pushCPUMarker(int id);
     void     pushCPUMarker(const char* name="N/A",
                            const video::SColor& color=video::SColor());
     void     popCPUMarker();
+    void     setCounter(int id, int64_t value);
+    void     setContinuousTrace(bool enabled);
+    bool     captureTrace(double seconds);
+    bool     writeTraceToFile();
+    std::string getTraceFileName() const;
+    static void unitTesting();
     void     toggleStatus(); 
     void     synchronizeFrame();
     void     draw();
@@ -288,6 +427,14 @@ public:
 
     // ------------------------------------------------------------------------
     bool isFrozen() const { return m_freeze_state == FROZEN; }
+    // ------------------------------------------------------------------------
+    const std::string& getMarkerName(int id) const
+    {
+        assert(id >= 0 && id < m_marker_count);
+        return m_markers[id].m_name;
+    }   // getMarkerName
+    // ------------------------------------------------------------------------
+    bool isContinuousTrace() const { return m_continuous_trace; }
 
 };
 
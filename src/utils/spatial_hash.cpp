@@ -0,0 +1,206 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/spatial_hash.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+
+/** Cell coordinates are clamped to +-2^20, so they fit in 21 bits each. */
+static const int MAX_CELL_COORDINATE = 1 << 20;
+
+const uint64_t SpatialHash::NO_CELL;
+
+// ----------------------------------------------------------------------------
+SpatialHash::SpatialHash(float cell_size)
+{
+    assert(cell_size > 0.0f);
+    m_cell_size = cell_size;
+}   // SpatialHash
+
+// ----------------------------------------------------------------------------
+int SpatialHash::getCellCoordinate(float f) const
+{
+    float c = std::floor(f / m_cell_size);
+    // Also handles NaN (e.g. a kart with an invalid position)
+    if (!(c > -MAX_CELL_COORDINATE))
+        return -MAX_CELL_COORDINATE;
+    if (c > MAX_CELL_COORDINATE)
+        return MAX_CELL_COORDINATE;
+    return (int)c;
+}   // getCellCoordinate
+
+// ----------------------------------------------------------------------------
+uint64_t SpatialHash::getCellKey(int x, int y, int z)
+{
+    const uint64_t mask = (1 << 21) - 1;
+    return  (uint64_t)((x + MAX_CELL_COORDINATE) & mask)        |
+           ((uint64_t)((y + MAX_CELL_COORDINATE) & mask) << 21) |
+           ((uint64_t)((z + MAX_CELL_COORDINATE) & mask) << 42);
+}   // getCellKey
+
+// ----------------------------------------------------------------------------
+/** Adds an id at a position. If the id was already added, it is moved. */
+void SpatialHash::insert(unsigned id, const Vec3& xyz)
+{
+    remove(id);
+    uint64_t key = getCellKey(getCellCoordinate(xyz.getX()),
+                              getCellCoordinate(xyz.getY()),
+                              getCellCoordinate(xyz.getZ()));
+    m_cells[key].push_back(id);
+    if (id >= m_cell_of.size())
+        m_cell_of.resize(id + 1, NO_CELL);
+    m_cell_of[id] = key;
+}   // insert
+
+// ----------------------------------------------------------------------------
+void SpatialHash::remove(unsigned id)
+{
+    if (!contains(id))
+        return;
+    auto it = m_cells.find(m_cell_of[id]);
+    assert(it != m_cells.end());
+    std::vector<unsigned>& ids = it->second;
+    ids.erase(std::find(ids.begin(), ids.end(), id));
+    if (ids.empty())
+        m_cells.erase(it);
+    m_cell_of[id] = NO_CELL;
+}   // remove
+
+// ----------------------------------------------------------------------------
+void SpatialHash::clear()
+{
+    m_cells.clear();
+    m_cell_of.clear();
+}   // clear
+
+// ----------------------------------------------------------------------------
+/** Finds the ids which can be within a distance of a point: all ids in the
+ *  cells overlapping the cube around the sphere, so the caller still needs
+ *  to test the exact distance.
+ *  \param ids Cleared, then set to the ids found, sorted.
+ */
+void SpatialHash::findNear(const Vec3& xyz, float radius,
+                           std::vector<unsigned>* ids) const
+{
+    ids->clear();
+    if (m_cells.empty())
+        return;
+    const int min_x = getCellCoordinate(xyz.getX() - radius);
+    const int max_x = getCellCoordinate(xyz.getX() + radius);
+    const int min_y = getCellCoordinate(xyz.getY() - radius);
+    const int max_y = getCellCoordinate(xyz.getY() + radius);
+    const int min_z = getCellCoordinate(xyz.getZ() - radius);
+    const int max_z = getCellCoordinate(xyz.getZ() + radius);
+    if ((double)(max_x - min_x + 1) * (max_y - min_y + 1) *
+        (max_z - min_z + 1) > (double)m_cells.size())
+    {
+        // A large radius, testing the used cells is faster
+        for (auto& cell : m_cells)
+            ids->insert(ids->end(), cell.second.begin(), cell.second.end());
+    }
+    else
+    {
+        for (int x = min_x; x <= max_x; x++)
+        {
+            for (int y = min_y; y <= max_y; y++)
+            {
+                for (int z = min_z; z <= max_z; z++)
+                {
+                    auto it = m_cells.find(getCellKey(x, y, z));
+                    if (it != m_cells.end())
+                    {
+                        ids->insert(ids->end(), it->second.begin(),
+                                    it->second.end());
+                    }
+                }
+            }
+        }
+    }
+    std::sort(ids->begin(), ids->end());
+}   // findNear
+
+// ----------------------------------------------------------------------------
+void SpatialHash::unitTesting()
+{
+    SpatialHash hash(4.0f);
+    std::vector<unsigned> ids;
+    hash.findNear(Vec3(0, 0, 0), 100.0f, &ids);
+    assert(ids.empty());
+
+    // Ids in far cells can be found too, so only test what must be found
+    auto found = [&ids](unsigned id)
+        {
+            return std::binary_search(ids.begin(), ids.end(), id);
+        };
+    (void)found;
+    hash.insert(3, Vec3(1, 0, 1));
+    hash.insert(0, Vec3(-1, 0, -1));
+    hash.insert(7, Vec3(50, 0, 0));
+    for (unsigned i = 0; i < 20; i++)
+        hash.insert(10 + i, Vec3(-200.0f, 0, i * 10.0f));
+    assert(hash.contains(3) && hash.contains(7) && !hash.contains(1));
+    hash.findNear(Vec3(0, 0, 0), 2.0f, &ids);
+    assert(ids.size() == 2 && ids[0] == 0 && ids[1] == 3);
+    hash.findNear(Vec3(0, 0, 0), 1000.0f, &ids);
+    assert(ids.size() == 23 && found(7));
+
+    // Moving and removing
+    hash.insert(3, Vec3(49, 0, 0));
+    hash.findNear(Vec3(50, 0, 0), 2.0f, &ids);
+    assert(ids.size() == 2 && ids[0] == 3 && ids[1] == 7);
+    hash.remove(7);
+    hash.remove(7);
+    hash.findNear(Vec3(50, 0, 0), 2.0f, &ids);
+    assert(ids.size() == 1 && ids[0] == 3 && !hash.contains(7));
+    hash.clear();
+    hash.findNear(Vec3(50, 0, 0), 2.0f, &ids);
+    assert(ids.empty() && !hash.contains(3));
+
+    // Compare with testing all points, including negative coordinates and
+    // points on cell borders
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> coordinate(-40, 40);
+    std::vector<Vec3> points(300);
+    for (unsigned i = 0; i < points.size(); i++)
+    {
+        points[i] = Vec3((float)coordinate(random),
+                         (float)coordinate(random) * 0.25f,
+                         (float)coordinate(random) * 0.5f);
+        hash.insert(i, points[i]);
+    }
+    for (unsigned i = 0; i < points.size(); i += 3)
+        hash.remove(i);
+    for (unsigned n = 0; n < 200; n++)
+    {
+        Vec3 center((float)coordinate(random), (float)coordinate(random),
+                    (float)coordinate(random) * 0.25f);
+        float radius = (float)(n % 10);
+        hash.findNear(center, radius, &ids);
+        assert(std::is_sorted(ids.begin(), ids.end()));
+        for (unsigned i = 0; i < points.size(); i++)
+        {
+            if (i % 3 == 0)
+                assert(!found(i));
+            else if ((points[i] - center).length() <= radius)
+                assert(found(i));
+        }
+    }
+}   // unitTesting
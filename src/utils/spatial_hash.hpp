@@ -0,0 +1,74 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SPATIAL_HASH_HPP
+#define HEADER_SPATIAL_HASH_HPP
+
+#include "utils/vec3.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/** A uniform 3d grid of cubic cells, of which only the used ones are stored
+ *  (in a hash map). It stores small integer ids (e.g. indices in a list of
+ *  objects) at a point each, and finds the ids near a point. The results
+ *  only depend on the ids and positions, and are sorted by id, so using them
+ *  gives the same results as testing all objects in index order.
+ */
+class SpatialHash
+{
+private:
+    float m_cell_size;
+
+    /** The ids in each used cell. */
+    std::unordered_map<uint64_t, std::vector<unsigned> > m_cells;
+
+    /** The cell of each id, NO_CELL if it's not in the hash. */
+    std::vector<uint64_t> m_cell_of;
+
+    static const uint64_t NO_CELL = 0xffffffffffffffffULL;
+
+    // ------------------------------------------------------------------------
+    int getCellCoordinate(float f) const;
+    // ------------------------------------------------------------------------
+    static uint64_t getCellKey(int x, int y, int z);
+
+public:
+    SpatialHash(float cell_size);
+    // ------------------------------------------------------------------------
+    void insert(unsigned id, const Vec3& xyz);
+    // ------------------------------------------------------------------------
+    void remove(unsigned id);
+    // ------------------------------------------------------------------------
+    void clear();
+    // ------------------------------------------------------------------------
+    void findNear(const Vec3& xyz, float radius,
+                  std::vector<unsigned>* ids) const;
+    // ------------------------------------------------------------------------
+    /** Returns true if id was inserted (and not removed). */
+    bool contains(unsigned id) const
+    {
+        return id < m_cell_of.size() && m_cell_of[id] != NO_CELL;
+    }   // contains
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+
+};   // SpatialHash
+
+#endif
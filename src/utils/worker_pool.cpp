@@ -0,0 +1,121 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/worker_pool.hpp"
+
+#include "utils/vs.hpp"
+
+// ----------------------------------------------------------------------------
+/** Starts the threads of the pool.
+ *  \param name Name of the threads for debugging.
+ *  \param threads Number of threads to create in addition to the calling
+ *         thread of parallelFor.
+ */
+WorkerPool::WorkerPool(const std::string& name, unsigned threads)
+          : m_name(name)
+{
+    m_job = NULL;
+    m_next_index.store(0);
+    m_count = 0;
+    m_busy_threads = 0;
+    m_generation = 0;
+    m_exit = false;
+    m_process_type = PT_MAIN;
+    for (unsigned i = 0; i < threads; i++)
+        m_threads.emplace_back(&WorkerPool::mainLoop, this);
+}   // WorkerPool
+
+// ----------------------------------------------------------------------------
+WorkerPool::~WorkerPool()
+{
+    std::unique_lock<std::mutex> ul(m_mutex);
+    m_exit = true;
+    ul.unlock();
+    m_work_cv.notify_all();
+    for (std::thread& t : m_threads)
+        t.join();
+}   // ~WorkerPool
+
+// ----------------------------------------------------------------------------
+void WorkerPool::mainLoop()
+{
+    VS::setThreadName(m_name.c_str());
+    unsigned generation = 0;
+    std::unique_lock<std::mutex> ul(m_mutex);
+    while (true)
+    {
+        m_work_cv.wait(ul, [this, generation]()
+            { return m_exit || m_generation != generation; });
+        if (m_exit)
+            return;
+        generation = m_generation;
+        const std::function<void(unsigned)>* job = m_job;
+        unsigned count = m_count;
+        STKProcess::init(m_process_type);
+        ul.unlock();
+        runJobs(*job, count);
+        ul.lock();
+        if (--m_busy_threads == 0)
+            m_done_cv.notify_one();
+    }
+}   // mainLoop
+
+// ----------------------------------------------------------------------------
+void WorkerPool::runJobs(const std::function<void(unsigned)>& job,
+                         unsigned count)
+{
+    while (true)
+    {
+        unsigned i = m_next_index.fetch_add(1);
+        if (i >= count)
+            return;
+        job(i);
+    }
+}   // runJobs
+
+// ----------------------------------------------------------------------------
+/** Calls job(i) for each i in [0, count), and returns when all are done. The
+ *  order of calls is undefined, so job must not depend on it.
+ */
+void WorkerPool::parallelFor(unsigned count,
+                             const std::function<void(unsigned)>& job)
+{
+    std::unique_lock<std::mutex> run_lock(m_run_mutex, std::try_to_lock);
+    if (m_threads.empty() || count < 2 || !run_lock.owns_lock())
+    {
+        for (unsigned i = 0; i < count; i++)
+            job(i);
+        return;
+    }
+
+    std::unique_lock<std::mutex> ul(m_mutex);
+    m_job = &job;
+    m_count = count;
+    m_next_index.store(0);
+    m_busy_threads = (unsigned)m_threads.size();
+    m_process_type = STKProcess::getType();
+    m_generation++;
+    ul.unlock();
+    m_work_cv.notify_all();
+
+    runJobs(job, count);
+
+    ul.lock();
+    m_done_cv.wait(ul, [this]() { return m_busy_threads == 0; });
+    m_job = NULL;
+}   // parallelFor
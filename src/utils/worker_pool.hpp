@@ -0,0 +1,98 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2024 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_WORKER_POOL_HPP
+#define HEADER_WORKER_POOL_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/stk_process.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** A small pool of threads to run the iterations of a loop in parallel. The
+ *  calling thread always takes part in the work, so a pool without threads
+ *  (e.g. on a single core machine) simply runs the loop serially. Only one
+ *  loop runs in the pool at a time, other callers run their loop serially
+ *  instead of waiting for the pool. Threads of the pool take the process
+ *  type of the caller, so singletons for STKProcess work in jobs.
+ */
+class WorkerPool : public NoCopy
+{
+private:
+    std::vector<std::thread> m_threads;
+
+    /** Protects all members below. */
+    std::mutex m_mutex;
+
+    std::condition_variable m_work_cv, m_done_cv;
+
+    /** Held by the thread currently using the pool. */
+    std::mutex m_run_mutex;
+
+    const std::function<void(unsigned)>* m_job;
+
+    std::atomic<unsigned> m_next_index;
+
+    unsigned m_count;
+
+    /** Number of threads still working on the current loop. */
+    unsigned m_busy_threads;
+
+    /** Increased for each loop so threads know when new work arrives. */
+    unsigned m_generation;
+
+    bool m_exit;
+
+    /** Process type of the thread calling parallelFor, which is used in
+     *  threads of the pool too (for the singletons of STKProcess). */
+    ProcessType m_process_type;
+
+    std::string m_name;
+
+    // ------------------------------------------------------------------------
+    void mainLoop();
+    // ------------------------------------------------------------------------
+    void runJobs(const std::function<void(unsigned)>& job, unsigned count);
+
+public:
+    WorkerPool(const std::string& name, unsigned threads);
+    // ------------------------------------------------------------------------
+    ~WorkerPool();
+    // ------------------------------------------------------------------------
+    void parallelFor(unsigned count, const std::function<void(unsigned)>& job);
+    // ------------------------------------------------------------------------
+    unsigned getNumThreads() const       { return (unsigned)m_threads.size(); }
+    // ------------------------------------------------------------------------
+    /** Returns a suitable number of threads to use all other cores, capped
+     *  by max_threads. */
+    static unsigned getDefaultThreads(unsigned max_threads)
+    {
+        unsigned cores = std::thread::hardware_concurrency();
+        if (cores <= 1)
+            return 0;
+        return cores - 1 < max_threads ? cores - 1 : max_threads;
+    }   // getDefaultThreads
+};   // WorkerPool
+
+#endif